@@ -0,0 +1,36 @@
+/*
+ *	Clearing of pages with non-temporal stores, which go straight to
+ *	memory rather than through the cache.  For pages cleared ahead of
+ *	time, which won't be touched again soon after.
+ */
+
+#include <linux/config.h>
+#include <linux/mm.h>
+#include <asm/cpufeature.h>
+#include <asm/page.h>
+
+void clear_page_nocache(void *page)
+{
+	int i;
+
+	if (!cpu_has_sse2) {
+		clear_page(page);
+		return;
+	}
+
+	for (i = 0; i < PAGE_SIZE / 32; i++) {
+		__asm__ __volatile__ (
+		"  movnti %1, (%0)\n"
+		"  movnti %1, 4(%0)\n"
+		"  movnti %1, 8(%0)\n"
+		"  movnti %1, 12(%0)\n"
+		"  movnti %1, 16(%0)\n"
+		"  movnti %1, 20(%0)\n"
+		"  movnti %1, 24(%0)\n"
+		"  movnti %1, 28(%0)\n"
+		: : "r" (page), "r" (0) : "memory");
+		page += 32;
+	}
+	/* movnti is weakly ordered */
+	__asm__ __volatile__ ("  sfence\n" : : : "memory");
+}
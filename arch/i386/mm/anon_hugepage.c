@@ -0,0 +1,319 @@
+/*
+ * IA-32 huge pages for anonymous memory.
+ *
+ * A write fault in a private anonymous vma which covers a whole, aligned
+ * huge page worth of address space, and whose page table for that range
+ * has not been allocated yet, gets a freshly zeroed huge page mapped by
+ * the pmd, exactly as hugetlbfs maps its pages.  If the huge page can't
+ * be allocated the fault is handled with small pages as before.
+ *
+ * Huge pmds are never shared or copied: everything which would need to
+ * look at part of one - splitting the vma, fork, mremap, partial zapping
+ * and page reclaim - first replaces it with a page table mapping the same
+ * memory with small ptes.  Unless somebody holds a reference to the
+ * page, the compound page is broken up at the same time, and its pieces
+ * go onto the LRU to be aged and swapped like any other anonymous page.
+ */
+
+#include <linux/config.h>
+#include <linux/init.h>
+#include <linux/mm.h>
+#include <linux/hugetlb.h>
+#include <linux/highmem.h>
+#include <linux/swap.h>
+#include <linux/rmap-locking.h>
+#include <asm/pgalloc.h>
+#include <asm/rmap.h>
+#include <asm/tlb.h>
+#include <asm/tlbflush.h>
+
+#define HPAGE_NR_PAGES	(HPAGE_SIZE / PAGE_SIZE)
+
+int sysctl_anon_hugepages = 1;
+
+/* Huge pmds mapping anonymous memory, for the shrinker */
+static atomic_t nr_anon_hugepages = ATOMIC_INIT(0);
+
+static void free_anon_hugepage(struct page *page)
+{
+	page->lru.prev = NULL;
+	set_page_count(page, 1);
+	__free_pages(page, HUGETLB_PAGE_ORDER);
+}
+
+/*
+ * Called by handle_mm_fault() with the page_table_lock held and an empty
+ * pmd.  Returns zero, with the lock still held, if the fault should be
+ * handled with small pages.  Otherwise returns VM_FAULT_MINOR with the
+ * lock dropped.
+ */
+int anon_hugepage_fault(struct mm_struct *mm, struct vm_area_struct *vma,
+			unsigned long address, pmd_t *pmd, int write_access)
+{
+	unsigned long start = address & HPAGE_MASK;
+	struct page *page;
+	pte_t entry;
+	int i;
+
+	if (!sysctl_anon_hugepages || !write_access)
+		return 0;
+	if (vma->vm_ops || vma->vm_file ||
+	    (vma->vm_flags & (VM_SHARED | VM_IO | VM_RESERVED |
+				VM_GROWSDOWN | VM_GROWSUP)))
+		return 0;
+	if (start < vma->vm_start || start + HPAGE_SIZE > vma->vm_end)
+		return 0;
+
+	spin_unlock(&mm->page_table_lock);
+	page = alloc_pages(GFP_HIGHUSER | __GFP_NOWARN, HUGETLB_PAGE_ORDER);
+	if (!page) {
+		spin_lock(&mm->page_table_lock);
+		return 0;
+	}
+	page->lru.prev = (void *)free_anon_hugepage;
+	for (i = 0; i < HPAGE_NR_PAGES; i++) {
+		clear_user_highpage(page + i, start + i * PAGE_SIZE);
+		if (!(i & 63))
+			cond_resched();
+	}
+
+	spin_lock(&mm->page_table_lock);
+	if (!pmd_none(*pmd)) {
+		/* Raced with another fault, which will have fixed it up */
+		spin_unlock(&mm->page_table_lock);
+		put_page(page);
+		return VM_FAULT_MINOR;
+	}
+	entry = pte_mkwrite(pte_mkdirty(mk_pte(page, vma->vm_page_prot)));
+	entry = pte_mkyoung(entry);
+	mk_pte_huge(entry);
+	set_pte((pte_t *)pmd, entry);
+	mm->rss += HPAGE_NR_PAGES;
+	mm->anon_hugepages++;
+	atomic_inc(&nr_anon_hugepages);
+	spin_unlock(&mm->page_table_lock);
+	return VM_FAULT_MINOR;
+}
+
+/*
+ * Unmap a huge pmd.  The page is handed to the mmu_gather so that it is
+ * not freed before the TLBs have been flushed.  page_table_lock is held.
+ */
+void zap_anon_hugepage(struct mmu_gather *tlb, pmd_t *pmd)
+{
+	struct page *page = pte_page(*(pte_t *)pmd);
+
+	pmd_clear(pmd);
+	tlb->mm->anon_hugepages--;
+	atomic_dec(&nr_anon_hugepages);
+	tlb->freed += HPAGE_NR_PAGES;
+	tlb_remove_page(tlb, page);
+}
+
+/*
+ * mprotect() of a whole huge pmd.  page_table_lock is held.
+ */
+void change_anon_hugepage(pmd_t *pmd, pgprot_t newprot)
+{
+	pte_t entry;
+
+	entry = ptep_get_and_clear((pte_t *)pmd);
+	entry = pte_modify(entry, newprot);
+	mk_pte_huge(entry);
+	set_pte((pte_t *)pmd, entry);
+}
+
+/*
+ * Write fault on a huge pmd which mprotect() has made writable again: the
+ * pmd still carries the read-only protection.  The page is never shared,
+ * so there is nothing to copy, just the write bit to set.
+ * page_table_lock is held.
+ */
+void anon_hugepage_write_fault(struct vm_area_struct *vma,
+			unsigned long address, pmd_t *pmd)
+{
+	pte_t entry = *(pte_t *)pmd;
+
+	if (!(vma->vm_flags & VM_WRITE) || pte_write(entry))
+		return;
+	entry = pte_mkyoung(pte_mkdirty(pte_mkwrite(entry)));
+	set_pte((pte_t *)pmd, entry);
+	flush_tlb_page(vma, address & HPAGE_MASK);
+}
+
+/*
+ * Replace the huge pmd by the page table `new', mapping the same memory
+ * with small ptes.  page_table_lock is held.
+ */
+static void __split_anon_hugepage(struct mm_struct *mm,
+		struct vm_area_struct *vma, unsigned long start,
+		pmd_t *pmd, struct page *new)
+{
+	pte_t huge = *(pte_t *)pmd;
+	struct page *page = pte_page(huge);
+	int pinned = page_count(page) > 1;
+	pte_t *pte;
+	int i;
+
+	pte = (pte_t *)kmap_atomic(new, KM_PTE0);
+	for (i = 0; i < HPAGE_NR_PAGES; i++) {
+		struct page *p = page + i;
+		pte_t entry;
+
+		if (pinned) {
+			/*
+			 * The references taken through get_page() are on the
+			 * head page, and will be dropped through whichever
+			 * small page they were taken for.  So keep the page
+			 * in one piece, and have each pte hold a reference on
+			 * it as well.  It is freed when the last one goes.
+			 */
+			get_page(p);
+		} else {
+			ClearPageCompound(p);
+			p->lru.next = p->lru.prev = NULL;
+			set_page_count(p, 1);
+		}
+
+		entry = mk_pte(p, vma->vm_page_prot);
+		entry = pte_write(huge) ? pte_mkwrite(entry) :
+					  pte_wrprotect(entry);
+		if (pte_dirty(huge))
+			entry = pte_mkdirty(entry);
+		if (pte_young(huge))
+			entry = pte_mkyoung(entry);
+		set_pte(pte + i, entry);
+
+		/* p is not mapped anywhere else, so no pte_chain is needed */
+		page_add_rmap(p, pte + i, NULL);
+		if (!pinned)
+			lru_cache_add_active(p);
+	}
+	kunmap_atomic(pte, KM_PTE0);
+
+	if (pinned)
+		put_page(page);		/* The pmd's reference */
+
+	pgtable_add_rmap(new, mm, start);
+	pmd_populate(mm, pmd, new);
+	flush_tlb_range(vma, start, start + HPAGE_SIZE);
+	mm->anon_hugepages--;
+	atomic_dec(&nr_anon_hugepages);
+}
+
+/**
+ * split_anon_hugepage - map an anonymous huge page with small ptes
+ * @vma: the vma containing @address
+ * @address: any address within the huge page
+ *
+ * Does nothing if @address is not mapped by a huge pmd.  The caller holds
+ * mmap_sem, and may sleep.  Returns -ENOMEM if no page table could be
+ * allocated.
+ */
+int split_anon_hugepage(struct vm_area_struct *vma, unsigned long address)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	pgd_t *pgd;
+	pmd_t *pmd;
+	struct page *new;
+
+	if (!mm->anon_hugepages)
+		return 0;
+	address &= HPAGE_MASK;
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd))
+		return 0;
+	pmd = pmd_offset(pgd, address);
+	if (!pmd_huge(*pmd))
+		return 0;
+
+	new = pte_alloc_one(mm, address);
+	if (!new)
+		return -ENOMEM;
+
+	spin_lock(&mm->page_table_lock);
+	if (pmd_huge(*pmd)) {
+		__split_anon_hugepage(mm, vma, address, pmd, new);
+		new = NULL;
+	}
+	spin_unlock(&mm->page_table_lock);
+	if (new)
+		pte_free(new);
+	return 0;
+}
+
+/*
+ * Split every huge page which overlaps [start, end) in the vma.
+ */
+int split_anon_hugepages(struct vm_area_struct *vma,
+			unsigned long start, unsigned long end)
+{
+	unsigned long address;
+	int err = 0;
+
+	if (!vma->vm_mm->anon_hugepages)
+		return 0;
+	for (address = start & HPAGE_MASK; address < end && !err;
+					address += HPAGE_SIZE)
+		err = split_anon_hugepage(vma, address);
+	return err;
+}
+
+/*
+ * Huge pages can't be swapped, so when memory is short some of them are
+ * split and their pieces put onto the LRU.  The count is given in small
+ * pages so that the pressure put on them matches that on the LRU.
+ */
+static int shrink_anon_hugepages(int nr_to_scan, unsigned int gfp_mask)
+{
+	struct mm_struct *mm = NULL;
+	struct list_head *p;
+
+	if (nr_to_scan && (gfp_mask & __GFP_IO)) {
+		int nr = (nr_to_scan + HPAGE_NR_PAGES - 1) / HPAGE_NR_PAGES;
+
+		spin_lock(&mmlist_lock);
+		list_for_each(p, &init_mm.mmlist) {
+			struct mm_struct *m;
+
+			m = list_entry(p, struct mm_struct, mmlist);
+			if (m->anon_hugepages) {
+				mm = m;
+				atomic_inc(&mm->mm_users);
+				break;
+			}
+		}
+		spin_unlock(&mmlist_lock);
+
+		if (mm && down_read_trylock(&mm->mmap_sem)) {
+			struct vm_area_struct *vma;
+
+			for (vma = mm->mmap; vma && nr; vma = vma->vm_next) {
+				unsigned long address;
+
+				address = (vma->vm_start + HPAGE_SIZE - 1) &
+								HPAGE_MASK;
+				for (; address < vma->vm_end && nr;
+				     address += HPAGE_SIZE) {
+					unsigned long before = mm->anon_hugepages;
+
+					if (split_anon_hugepage(vma, address))
+						break;
+					if (mm->anon_hugepages != before)
+						nr--;
+				}
+			}
+			up_read(&mm->mmap_sem);
+		}
+		if (mm)
+			mmput(mm);
+	}
+	return atomic_read(&nr_anon_hugepages) * HPAGE_NR_PAGES;
+}
+
+static int __init anon_hugepage_init(void)
+{
+	set_shrinker(DEFAULT_SEEKS, shrink_anon_hugepages);
+	return 0;
+}
+__initcall(anon_hugepage_init);
@@ -9,6 +9,7 @@
 #include <linux/highmem.h>
 #include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <asm/uaccess.h>
 #include <asm/processor.h>
 #include <asm/tlbflush.h>
@@ -152,7 +153,8 @@ static inline void flush_map(void)
  * in kernel linear mapping too.
  * 
  * The caller needs to ensure that there are no conflicting mappings elsewhere.
- * This function only deals with the kernel linear map.
+ * This function only deals with the kernel linear map; global_flush_tlb()
+ * also drops what stale TLB entries of vfree()d areas may map the page.
  * 
  * Caller must call global_flush_tlb() after this.
  */
@@ -179,6 +181,7 @@ void global_flush_tlb(void)
 
 	BUG_ON(irqs_disabled());
 
+	purge_vm_lazy();
 	spin_lock_irq(&cpa_lock);
 	list_splice_init(&df_list, &l);
 	spin_unlock_irq(&cpa_lock);
@@ -2306,6 +2306,7 @@ pfm_smpl_buffer_alloc(struct task_struct *task, pfm_context_t *ctx, unsigned lon
 	vma->vm_pgoff	     = 0;
 	vma->vm_file	     = NULL;
 	vma->vm_private_data = ctx;	/* information needed by the pfm_vm_close() function */
+	vma_set_policy(vma, NULL);
 
 	/*
 	 * Now we have everything we need and we can initialize
@@ -129,6 +129,7 @@ ia64_init_addr_space (void)
 		vma->vm_pgoff = 0;
 		vma->vm_file = NULL;
 		vma->vm_private_data = NULL;
+		vma_set_policy(vma, NULL);
 		insert_vm_struct(current->mm, vma);
 	}
 
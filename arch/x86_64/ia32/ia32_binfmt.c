@@ -359,6 +359,7 @@ int setup_arg_pages(struct linux_binprm *bprm)
 		mpnt->vm_file = NULL;
 		INIT_LIST_HEAD(&mpnt->shared);
 		mpnt->vm_private_data = (void *) 0;
+		vma_set_policy(mpnt, NULL);
 		insert_vm_struct(mm, mpnt);
 		mm->total_vm = (mpnt->vm_end - mpnt->vm_start) >> PAGE_SHIFT;
 	} 
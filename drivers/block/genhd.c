@@ -376,6 +376,17 @@ static ssize_t disk_stats_read(struct gendisk * disk, char *page)
 		jiffies_to_msec(disk_stat_read(disk, io_ticks)),
 		jiffies_to_msec(disk_stat_read(disk, time_in_queue)));
 }
+static ssize_t disk_readahead_read(struct gendisk * disk, char *page)
+{
+	struct backing_dev_info *bdi;
+
+	if (!disk->queue)
+		return 0;
+	bdi = &disk->queue->backing_dev_info;
+	return sprintf(page, "%8u %8u\n",
+		(unsigned)atomic_read(&bdi->ra_hits),
+		(unsigned)atomic_read(&bdi->ra_misses));
+}
 static struct disk_attribute disk_attr_dev = {
 	.attr = {.name = "dev", .mode = S_IRUGO },
 	.show	= disk_dev_read
@@ -393,11 +404,17 @@ static struct disk_attribute disk_attr_stat = {
 	.show	= disk_stats_read
 };
 
+static struct disk_attribute disk_attr_readahead = {
+	.attr = {.name = "readahead", .mode = S_IRUGO },
+	.show	= disk_readahead_read
+};
+
 static struct attribute * default_attrs[] = {
 	&disk_attr_dev.attr,
 	&disk_attr_range.attr,
 	&disk_attr_size.attr,
 	&disk_attr_stat.attr,
+	&disk_attr_readahead.attr,
 	NULL,
 };
 
@@ -61,6 +61,8 @@
 #include <linux/smp_lock.h>
 #include <linux/swap.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mempool.h>
 #include <linux/loop.h>
 #include <linux/suspend.h>
 #include <linux/writeback.h>
@@ -72,6 +74,38 @@ static int max_loop = 8;
 static struct loop_device *loop_dev;
 static struct gendisk **disks;
 
+/*
+ * A file backed loop device is normally serviced by loop_thread, one
+ * bio at a time, through the page cache of the backing file.  When the
+ * file has no holes and its filesystem can bmap, we instead record
+ * where its blocks live on the underlying device and send io there
+ * directly from loop_make_request.  That keeps many requests in flight,
+ * and the data is only cached once, above the loop device.  As with a
+ * swapfile, the backing file must not be truncated while it is bound.
+ */
+struct loop_extent {
+	sector_t sector;	/* first sector within the backing file */
+	sector_t nr_sects;
+	sector_t start;		/* first sector on lo_extent_bdev */
+};
+
+#define LOOP_MAX_EXTENTS	65536
+
+/*
+ * Tracks the pieces a bio has been split into along the extents.
+ */
+struct loop_extent_io {
+	struct loop_device *lo;
+	struct bio *bio;
+	atomic_t remaining;
+	int error;
+};
+
+#define MIN_EXTENT_IOS		64
+
+static kmem_cache_t *extent_io_cachep;
+static mempool_t *extent_io_pool;
+
 /*
  * Transfer functions
  */
@@ -517,6 +551,280 @@ static int loop_transfer_bio(struct loop_device *lo,
 	return ret;
 }
 		
+static void loop_unpin_file(struct inode *inode)
+{
+	down(&inode->i_sem);
+	inode->i_flags &= ~S_PINNED;
+	up(&inode->i_sem);
+}
+
+/*
+ * Find where the backing file lives on its device.  Fails if the
+ * filesystem cannot tell us, or the file has holes that would need
+ * allocating on write.
+ *
+ * Like a swapfile, the file is pinned while we write to its blocks
+ * behind the filesystem's back: truncate, write(2) and shared writable
+ * mmap fail with -ETXTBSY, so its blocks can't move or be freed and
+ * the page cache doesn't get out of step with the disk.  Only
+ * filesystems which do O_DIRECT are trusted with this, as that is the
+ * same promise; it leaves out data journalling, for one.
+ */
+static int loop_map_extents(struct loop_device *lo, struct file *file)
+{
+	struct inode *inode = file->f_dentry->d_inode->i_mapping->host;
+	struct address_space *mapping = inode->i_mapping;
+	unsigned int shift = inode->i_blkbits - 9;
+	struct loop_extent *ext = NULL, *new;
+	sector_t block, nr_blocks, start;
+	int nr = 0, max = 0;
+
+	if (!mapping->a_ops->bmap || !mapping->a_ops->direct_IO ||
+	    !inode->i_sb->s_bdev)
+		return -EINVAL;
+
+	down(&inode->i_sem);
+	if (IS_PINNED(inode) || !list_empty(&mapping->i_mmap_shared)) {
+		up(&inode->i_sem);
+		return -EBUSY;
+	}
+	inode->i_flags |= S_PINNED;
+	up(&inode->i_sem);
+
+	if (inode->i_size & ((1 << inode->i_blkbits) - 1))
+		goto fail;
+	nr_blocks = inode->i_size >> inode->i_blkbits;
+
+	/*
+	 * Get any dirty data allocated and on disk; the clean pages are
+	 * dropped below once we know we won't be going through them.
+	 */
+	filemap_fdatawrite(mapping);
+	filemap_fdatawait(mapping);
+
+	for (block = 0; block < nr_blocks; block++) {
+		cond_resched();
+
+		start = bmap(inode, block);
+		if (!start)
+			goto fail;
+		start <<= shift;
+
+		if (nr && ext[nr - 1].start + ext[nr - 1].nr_sects == start) {
+			ext[nr - 1].nr_sects += 1 << shift;
+			continue;
+		}
+
+		if (nr == max) {
+			if (max == LOOP_MAX_EXTENTS)
+				goto fail;
+			max = max ? max * 2 : 16;
+			new = vmalloc(max * sizeof(*ext));
+			if (!new)
+				goto fail;
+			if (ext) {
+				memcpy(new, ext, nr * sizeof(*ext));
+				vfree(ext);
+			}
+			ext = new;
+		}
+
+		ext[nr].sector = block << shift;
+		ext[nr].nr_sects = 1 << shift;
+		ext[nr].start = start;
+		nr++;
+	}
+
+	if (!nr)
+		goto fail;
+
+	invalidate_inode_pages(mapping);
+
+	lo->lo_extent_bdev = inode->i_sb->s_bdev;
+	lo->lo_extents = ext;
+	lo->lo_extent_sects = nr_blocks << shift;
+	lo->lo_extent_written = 0;
+	lo->lo_nr_extents = nr;
+	return 0;
+
+ fail:
+	if (ext)
+		vfree(ext);
+	loop_unpin_file(inode);
+	return -EINVAL;
+}
+
+/*
+ * Direct writes don't touch the file's times; catch up on them once
+ * the writing is done.
+ */
+static void loop_extents_written(struct loop_device *lo, struct file *file)
+{
+	if (lo->lo_extent_written) {
+		lo->lo_extent_written = 0;
+		inode_update_time(file->f_dentry->d_inode->i_mapping->host, 1);
+	}
+}
+
+/*
+ * Going straight to the device is only right while it sees the same
+ * data the page cache path would: no encryption, and nothing beyond
+ * the part of the file that was mapped.  Once turned off it stays off
+ * until the file is rebound, as the backing page cache may then hold
+ * newer data than the disk.  The extent map itself is only freed in
+ * loop_clr_fd, when no io can be using it.
+ */
+static void loop_check_extents(struct loop_device *lo,
+			       struct loop_func_table *xfer)
+{
+	struct file *file = lo->lo_backing_file;
+	sector_t end;
+
+	if (!lo->lo_nr_extents)
+		return;
+
+	end = (lo->lo_offset >> 9) + get_capacity(disks[lo->lo_number]);
+	if (xfer || (lo->lo_offset & 511) || end > lo->lo_extent_sects) {
+		lo->lo_nr_extents = 0;
+		/*
+		 * Anyone reading the file meanwhile may have cached what
+		 * is now out of date on disk.
+		 */
+		invalidate_inode_pages2(file->f_dentry->d_inode->i_mapping);
+		loop_extents_written(lo, file);
+	}
+}
+
+static struct loop_extent *
+loop_find_extent(struct loop_device *lo, int nr_extents, sector_t sector)
+{
+	struct loop_extent *ext = lo->lo_extents;
+	int first = 0, last = nr_extents;
+
+	while (first < last) {
+		int mid = (first + last) / 2;
+
+		if (sector < ext[mid].sector)
+			last = mid;
+		else if (sector >= ext[mid].sector + ext[mid].nr_sects)
+			first = mid + 1;
+		else
+			return &ext[mid];
+	}
+	return NULL;
+}
+
+static void loop_put_extent_io(struct loop_extent_io *io)
+{
+	if (atomic_dec_and_test(&io->remaining)) {
+		struct loop_device *lo = io->lo;
+		struct bio *bio = io->bio;
+		int error = io->error;
+
+		mempool_free(io, extent_io_pool);
+		bio_endio(bio, bio->bi_size, error);
+		if (atomic_dec_and_test(&lo->lo_pending))
+			up(&lo->lo_bh_mutex);
+	}
+}
+
+static int loop_end_io_extent(struct bio *bio, unsigned int bytes_done, int err)
+{
+	struct loop_extent_io *io = bio->bi_private;
+
+	if (bio->bi_size)
+		return 1;
+
+	if (!test_bit(BIO_UPTODATE, &bio->bi_flags))
+		io->error = err ? err : -EIO;
+
+	bio_put(bio);
+	loop_put_extent_io(io);
+	return 0;
+}
+
+/*
+ * Split a bio along the extents of the backing file and send the
+ * pieces to the underlying device, merging pieces that turn out to be
+ * contiguous there.  The original bio completes when all pieces have.
+ */
+static void loop_map_direct(struct loop_device *lo, int nr_extents,
+			    struct bio *rbh)
+{
+	struct loop_extent_io *io;
+	struct loop_extent *ext = NULL;
+	struct bio *bio = NULL;
+	struct bio_vec *bvec;
+	sector_t sector, start, next = 0;
+	int i;
+
+	io = mempool_alloc(extent_io_pool, GFP_NOIO);
+	io->lo = lo;
+	io->bio = rbh;
+	io->error = 0;
+	atomic_set(&io->remaining, 1);
+
+	sector = rbh->bi_sector + (lo->lo_offset >> 9);
+
+	bio_for_each_segment(bvec, rbh, i) {
+		unsigned int offset = bvec->bv_offset;
+		unsigned int len = bvec->bv_len;
+
+		if (len & 511) {
+			io->error = -EIO;
+			goto out;
+		}
+
+		while (len) {
+			unsigned int count;
+
+			if (!ext || sector >= ext->sector + ext->nr_sects) {
+				ext = loop_find_extent(lo, nr_extents, sector);
+				if (!ext) {
+					io->error = -EIO;
+					goto out;
+				}
+			}
+
+			count = min_t(sector_t, len >> 9,
+				      ext->sector + ext->nr_sects - sector) << 9;
+			start = ext->start + (sector - ext->sector);
+
+			if (!bio || start != next ||
+			    bio_add_page(bio, bvec->bv_page, count, offset) != count) {
+				if (bio)
+					generic_make_request(bio);
+
+				bio = bio_alloc(GFP_NOIO,
+						bio_get_nr_vecs(lo->lo_extent_bdev));
+				bio->bi_sector = start;
+				bio->bi_bdev = lo->lo_extent_bdev;
+				bio->bi_rw = rbh->bi_rw;
+				bio->bi_end_io = loop_end_io_extent;
+				bio->bi_private = io;
+				atomic_inc(&io->remaining);
+
+				if (bio_add_page(bio, bvec->bv_page, count,
+						 offset) != count) {
+					bio_endio(bio, 0, -EIO);
+					bio = NULL;
+					goto out;
+				}
+			}
+
+			next = start + (count >> 9);
+			sector += count >> 9;
+			offset += count;
+			len -= count;
+		}
+	}
+
+ out:
+	if (bio)
+		generic_make_request(bio);
+	loop_put_extent_io(io);
+}
+
 static int loop_make_request(request_queue_t *q, struct bio *old_bio)
 {
 	struct bio *new_bio = NULL;
@@ -543,10 +851,19 @@ static int loop_make_request(request_queue_t *q, struct bio *old_bio)
 	}
 
 	/*
-	 * file backed, queue for loop_thread to handle
+	 * file backed, go straight to the file's blocks if we know where
+	 * they are, otherwise queue for loop_thread to handle
 	 */
 	if (lo->lo_flags & LO_FLAGS_DO_BMAP) {
-		loop_add_bio(lo, old_bio);
+		int nr_extents = lo->lo_nr_extents;
+
+		if (nr_extents) {
+			if (rw == WRITE)
+				lo->lo_extent_written = 1;
+			loop_map_direct(lo, nr_extents, old_bio);
+		}
+		else
+			loop_add_bio(lo, old_bio);
 		return 0;
 	}
 
@@ -729,6 +1046,9 @@ static int loop_set_fd(struct loop_device *lo, struct file *lo_file,
 	lo->old_gfp_mask = inode->i_mapping->gfp_mask;
 	inode->i_mapping->gfp_mask &= ~(__GFP_IO|__GFP_FS);
 
+	if ((lo_flags & LO_FLAGS_DO_BMAP) && !loop_map_extents(lo, file))
+		loop_check_extents(lo, NULL);
+
 	set_blocksize(bdev, lo_blocksize);
 
 	lo->lo_bio = lo->lo_biotail = NULL;
@@ -829,6 +1149,16 @@ static int loop_clr_fd(struct loop_device *lo, struct block_device *bdev)
 
 	lo->lo_backing_file = NULL;
 
+	if (lo->lo_extents) {
+		loop_extents_written(lo, filp);
+		loop_unpin_file(filp->f_dentry->d_inode->i_mapping->host);
+		vfree(lo->lo_extents);
+	}
+	lo->lo_extents = NULL;
+	lo->lo_nr_extents = 0;
+	lo->lo_extent_sects = 0;
+	lo->lo_extent_bdev = NULL;
+
 	loop_release_xfer(lo);
 	lo->transfer = NULL;
 	lo->ioctl = NULL;
@@ -880,6 +1210,10 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 	} else
 		xfer = NULL;
 
+	/* must stop direct io before the data starts being encrypted */
+	if (xfer)
+		loop_check_extents(lo, xfer);
+
 	err = loop_init_xfer(lo, xfer, info);
 	if (err)
 		return err;
@@ -890,6 +1224,7 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 		lo->lo_sizelimit = info->lo_sizelimit;
 		if (figure_loop_size(lo))
 			return -EFBIG;
+		loop_check_extents(lo, xfer);
 	}
 
 	strlcpy(lo->lo_name, info->lo_name, LO_NAME_SIZE);
@@ -1161,6 +1496,17 @@ int __init loop_init(void)
 	if (register_blkdev(LOOP_MAJOR, "loop"))
 		return -EIO;
 
+	extent_io_cachep = kmem_cache_create("loop_extent_io",
+					     sizeof(struct loop_extent_io),
+					     0, 0, NULL, NULL);
+	if (!extent_io_cachep)
+		goto out_mem0;
+
+	extent_io_pool = mempool_create(MIN_EXTENT_IOS, mempool_alloc_slab,
+					mempool_free_slab, extent_io_cachep);
+	if (!extent_io_pool)
+		goto out_cache;
+
 	loop_dev = kmalloc(max_loop * sizeof(struct loop_device), GFP_KERNEL);
 	if (!loop_dev)
 		goto out_mem1;
@@ -1205,6 +1551,10 @@ out_mem3:
 out_mem2:
 	kfree(loop_dev);
 out_mem1:
+	mempool_destroy(extent_io_pool);
+out_cache:
+	kmem_cache_destroy(extent_io_cachep);
+out_mem0:
 	unregister_blkdev(LOOP_MAJOR, "loop");
 	printk(KERN_ERR "loop: ran out of memory\n");
 	return -ENOMEM;
@@ -1224,6 +1574,8 @@ void loop_exit(void)
 
 	kfree(disks);
 	kfree(loop_dev);
+	mempool_destroy(extent_io_pool);
+	kmem_cache_destroy(extent_io_cachep);
 }
 
 module_init(loop_init);
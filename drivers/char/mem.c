@@ -24,6 +24,7 @@
 #include <linux/smp_lock.h>
 #include <linux/devfs_fs_kernel.h>
 #include <linux/ptrace.h>
+#include <linux/hugetlb.h>
 
 #include <asm/uaccess.h>
 #include <asm/io.h>
@@ -378,6 +379,8 @@ static inline size_t read_zero_pagealigned(char * buf, size_t size)
 		if (count > size)
 			count = size;
 
+		if (split_anon_hugepage_edges(vma, addr, addr + count))
+			break;
 		zap_page_range(vma, addr, count);
         	zeromap_page_range(vma, addr, count, PAGE_COPY);
 
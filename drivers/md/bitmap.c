@@ -0,0 +1,551 @@
+/*
+   bitmap.c : write-intent bitmap for Multiple Devices driver for Linux
+
+   Keeps track of which chunks of a redundant array may be out of sync,
+   so that the resync after an unclean shutdown only has to visit the
+   chunks that were being written to.  See <linux/raid/bitmap.h> for
+   the on-disk layout.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   You should have received a copy of the GNU General Public License
+   (for example /usr/src/linux/COPYING); if not, write to the Free
+   Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/raid/md.h>
+
+#define chunk_block(chunk)	((chunk) / BITMAP_BLOCK_BITS)
+#define chunk_bit(chunk)	((chunk) % BITMAP_BLOCK_BITS)
+
+static inline void *chunk_page(struct bitmap *bitmap, unsigned long chunk)
+{
+	return page_address(bitmap->pages[chunk_block(chunk)]);
+}
+
+/*
+ * Number of sectors from 'offset' to the end of its chunk, capped
+ * at 'sectors'.
+ */
+static inline unsigned long chunk_left(struct bitmap *bitmap, sector_t offset,
+				       unsigned long sectors)
+{
+	unsigned long left;
+
+	left = bitmap->chunksize - ((unsigned long)offset & (bitmap->chunksize - 1));
+	return left < sectors ? left : sectors;
+}
+
+/*
+ * Write one bitmap block (0 being the bitmap superblock) to every
+ * working device.  A device on which we cannot record write intent
+ * cannot be trusted after a crash, so it is failed.
+ *
+ * Called with flush_sem held, which keeps the disk list stable.
+ */
+static void write_block(struct bitmap *bitmap, int block, struct page *page)
+{
+	mddev_t *mddev = bitmap->mddev;
+	mdk_rdev_t *rdev;
+	struct list_head *tmp;
+
+	ITERATE_RDEV(mddev,rdev,tmp) {
+		char b[BDEVNAME_SIZE];
+
+		if (rdev->faulty)
+			continue;
+		if (sync_page_io(rdev->bdev, (rdev->sb_offset<<1) + MD_SB_SECTORS
+				 + block * BITMAP_BLOCK_SECTORS,
+				 BITMAP_BLOCK_SIZE, page, WRITE))
+			continue;
+		printk(KERN_ERR "md%d: bitmap write failed on %s\n",
+			mdidx(mddev), bdevname(rdev->bdev,b));
+		md_error(mddev, rdev);
+	}
+}
+
+/*
+ * Write out every block that has changed in memory.  Anyone who finds
+ * the block holding their bit dirty or being written must come through
+ * here before issuing their data write; as flushes are serialised by
+ * flush_sem, they will not get past it until the block is safely on disk.
+ *
+ * This is called from the write path, so it must not take the mddev
+ * lock: do_md_stop() holds that while it syncs the array.
+ */
+static void bitmap_flush(struct bitmap *bitmap)
+{
+	unsigned long mask;
+	int i;
+
+	down(&bitmap->flush_sem);
+	spin_lock_irq(&bitmap->lock);
+	mask = bitmap->dirty;
+	bitmap->dirty = 0;
+	bitmap->writing = mask;
+	spin_unlock_irq(&bitmap->lock);
+
+	for (i = 0; i < bitmap->blocks; i++)
+		if (mask & (1UL << i))
+			write_block(bitmap, i + 1, bitmap->pages[i]);
+
+	spin_lock_irq(&bitmap->lock);
+	bitmap->writing = 0;
+	spin_unlock_irq(&bitmap->lock);
+	up(&bitmap->flush_sem);
+}
+
+static void bitmap_timeout(unsigned long data)
+{
+	struct bitmap *bitmap = (struct bitmap *) data;
+
+	md_wakeup_thread(bitmap->mddev->thread);
+}
+
+/*
+ * Called from md_update_sb() with the mddev locked, after the md
+ * superblocks have been written, so that the event counts match.
+ */
+void bitmap_update_sb(struct bitmap *bitmap)
+{
+	mddev_t *mddev;
+	bitmap_super_t *sb;
+
+	if (!bitmap)
+		return;
+	mddev = bitmap->mddev;
+	sb = page_address(bitmap->sb_page);
+
+	sb->magic = BITMAP_MAGIC;
+	sb->version = BITMAP_MAJOR;
+	memcpy(sb->uuid, mddev->uuid, 16);
+	sb->events = mddev->events;
+	sb->sync_size = bitmap->sync_size;
+	sb->chunksize = bitmap->chunksize;
+	sb->nr_dirty = bitmap->nr_dirty;
+
+	down(&bitmap->flush_sem);
+	write_block(bitmap, 0, bitmap->sb_page);
+	up(&bitmap->flush_sem);
+}
+
+/*
+ * Called before any write to [offset, offset+sectors) of the component
+ * devices is issued.  Sets the bits for the chunks involved and waits
+ * for them to reach the disk.  May sleep.
+ */
+void bitmap_startwrite(struct bitmap *bitmap, sector_t offset,
+		       unsigned long sectors)
+{
+	int flush = 0;
+
+	if (!bitmap)
+		return;
+
+	while (sectors && offset < bitmap->sync_size) {
+		unsigned long chunk = offset >> bitmap->chunkshift;
+		unsigned long len = chunk_left(bitmap, offset, sectors);
+		bitmap_counter_t *bmc = &bitmap->counts[chunk];
+
+		spin_lock_irq(&bitmap->lock);
+		wait_event_lock_irq(bitmap->overflow_wait,
+			(*bmc & BITMAP_COUNTER_MAX) != BITMAP_COUNTER_MAX,
+			bitmap->lock);
+
+		if (*bmc & BITMAP_PENDING)
+			bitmap->pending--;
+		*bmc = (*bmc & ~(BITMAP_PENDING|BITMAP_AGED)) + 1;
+
+		if (!ext2_set_bit(chunk_bit(chunk), chunk_page(bitmap, chunk))) {
+			bitmap->nr_dirty++;
+			bitmap->dirty |= 1UL << chunk_block(chunk);
+		}
+		if ((bitmap->dirty | bitmap->writing) & (1UL << chunk_block(chunk)))
+			flush = 1;
+		spin_unlock_irq(&bitmap->lock);
+
+		offset += len;
+		sectors -= len;
+	}
+
+	if (flush)
+		bitmap_flush(bitmap);
+}
+
+/*
+ * Called, possibly from interrupt context, when a write started with
+ * bitmap_startwrite() has completed on all devices.  Chunks which have
+ * gone idle are handed to the daemon for (lazy) clearing, unless the
+ * write failed or the array is degraded.
+ */
+void bitmap_endwrite(struct bitmap *bitmap, sector_t offset,
+		     unsigned long sectors, int success)
+{
+	unsigned long flags;
+
+	if (!bitmap)
+		return;
+
+	spin_lock_irqsave(&bitmap->lock, flags);
+	while (sectors && offset < bitmap->sync_size) {
+		unsigned long chunk = offset >> bitmap->chunkshift;
+		unsigned long len = chunk_left(bitmap, offset, sectors);
+		bitmap_counter_t *bmc = &bitmap->counts[chunk];
+
+		if (!(*bmc & BITMAP_COUNTER_MAX)) {
+			MD_BUG();
+			break;
+		}
+		if (!success || bitmap->mddev->degraded)
+			*bmc |= BITMAP_NEEDED;
+		if ((*bmc & BITMAP_COUNTER_MAX) == BITMAP_COUNTER_MAX)
+			wake_up(&bitmap->overflow_wait);
+		(*bmc)--;
+		if (!(*bmc & (BITMAP_COUNTER_MAX|BITMAP_NEEDED))) {
+			*bmc |= BITMAP_PENDING;
+			bitmap->pending++;
+		}
+
+		offset += len;
+		sectors -= len;
+	}
+	if (bitmap->pending && !timer_pending(&bitmap->timer))
+		mod_timer(&bitmap->timer, jiffies + BITMAP_DAEMON_DELAY);
+	spin_unlock_irqrestore(&bitmap->lock, flags);
+}
+
+/*
+ * Called by md_do_sync() for each position it reaches.  Returns 0 if
+ * the chunk holding 'offset' is known to be in sync and can be
+ * skipped, and sets *sectors to the distance to the next chunk.
+ */
+int bitmap_start_sync(struct bitmap *bitmap, sector_t offset, int *sectors)
+{
+	unsigned long chunk;
+	int rv;
+
+	if (!bitmap)
+		return 1;
+
+	chunk = offset >> bitmap->chunkshift;
+	spin_lock_irq(&bitmap->lock);
+	rv = ext2_test_bit(chunk_bit(chunk), chunk_page(bitmap, chunk)) ||
+		(bitmap->counts[chunk] & (BITMAP_COUNTER_MAX|BITMAP_NEEDED));
+	spin_unlock_irq(&bitmap->lock);
+
+	*sectors = chunk_left(bitmap, offset, bitmap->chunksize);
+	if (offset + *sectors > bitmap->sync_size)
+		*sectors = bitmap->sync_size - offset;
+	return rv;
+}
+
+/*
+ * A resync or recovery has completed and the array is fully redundant:
+ * every idle chunk can now be cleared.  The whole bitmap is rewritten
+ * so that devices which have just been recovered get a complete copy.
+ *
+ * Called from md_check_recovery() with the mddev locked.
+ */
+void bitmap_close_sync(struct bitmap *bitmap)
+{
+	unsigned long chunk;
+
+	if (!bitmap || bitmap->mddev->degraded)
+		return;
+
+	spin_lock_irq(&bitmap->lock);
+	for (chunk = 0; chunk < bitmap->chunks; chunk++) {
+		bitmap_counter_t *bmc = &bitmap->counts[chunk];
+
+		*bmc &= ~BITMAP_NEEDED;
+		if (*bmc & (BITMAP_COUNTER_MAX|BITMAP_PENDING))
+			continue;
+		if (ext2_test_bit(chunk_bit(chunk), chunk_page(bitmap, chunk))) {
+			*bmc |= BITMAP_PENDING;
+			bitmap->pending++;
+		}
+	}
+	bitmap->dirty = (1UL << bitmap->blocks) - 1;
+	if (bitmap->pending && !timer_pending(&bitmap->timer))
+		mod_timer(&bitmap->timer, jiffies + BITMAP_DAEMON_DELAY);
+	spin_unlock_irq(&bitmap->lock);
+
+	bitmap_flush(bitmap);
+}
+
+/*
+ * Lazily clear the bits of chunks that have been idle for at least
+ * BITMAP_DAEMON_DELAY.  Called from md_check_recovery(), i.e. from the
+ * personality's thread; the timer makes sure that thread wakes up.
+ */
+void bitmap_daemon_work(struct bitmap *bitmap)
+{
+	mddev_t *mddev;
+	int blk;
+
+	if (!bitmap ||
+	    time_before(jiffies, bitmap->daemon_lastrun + BITMAP_DAEMON_DELAY))
+		return;
+	mddev = bitmap->mddev;
+	if (mddev_trylock(mddev))
+		return;
+	bitmap->daemon_lastrun = jiffies;
+
+	/*
+	 * Bits must stay set while part of the array may be out of sync,
+	 * or while a device is missing and might come back.
+	 */
+	if (mddev->recovery_cp != MaxSector || mddev->degraded)
+		goto out;
+
+	for (blk = 0; blk < bitmap->blocks; blk++) {
+		unsigned long chunk = blk * BITMAP_BLOCK_BITS;
+		unsigned long end = chunk + BITMAP_BLOCK_BITS;
+
+		if (end > bitmap->chunks)
+			end = bitmap->chunks;
+
+		spin_lock_irq(&bitmap->lock);
+		if (!bitmap->pending) {
+			spin_unlock_irq(&bitmap->lock);
+			break;
+		}
+		for (; chunk < end; chunk++) {
+			bitmap_counter_t *bmc = &bitmap->counts[chunk];
+
+			if (!(*bmc & BITMAP_PENDING))
+				continue;
+			if (!(*bmc & BITMAP_AGED)) {
+				*bmc |= BITMAP_AGED;
+				continue;
+			}
+			*bmc = 0;
+			bitmap->pending--;
+			if (ext2_clear_bit(chunk_bit(chunk), chunk_page(bitmap, chunk))) {
+				bitmap->nr_dirty--;
+				bitmap->dirty |= 1UL << blk;
+			}
+		}
+		spin_unlock_irq(&bitmap->lock);
+	}
+
+	spin_lock_irq(&bitmap->lock);
+	if (bitmap->pending)
+		mod_timer(&bitmap->timer, jiffies + BITMAP_DAEMON_DELAY);
+	spin_unlock_irq(&bitmap->lock);
+out:
+	bitmap_flush(bitmap);
+	mddev_unlock(mddev);
+}
+
+void bitmap_status(struct seq_file *seq, struct bitmap *bitmap)
+{
+	if (!bitmap)
+		return;
+	seq_printf(seq, "\n      bitmap: %lu/%lu chunks dirty, %luk chunks",
+		bitmap->nr_dirty, bitmap->chunks, bitmap->chunksize >> 1);
+}
+
+static void bitmap_free(struct bitmap *bitmap)
+{
+	int i;
+
+	for (i = 0; i < BITMAP_BLOCKS; i++)
+		if (bitmap->pages[i])
+			__free_page(bitmap->pages[i]);
+	if (bitmap->sb_page)
+		__free_page(bitmap->sb_page);
+	if (bitmap->counts)
+		vfree(bitmap->counts);
+	kfree(bitmap);
+}
+
+static int bitmap_read(struct bitmap *bitmap)
+{
+	mddev_t *mddev = bitmap->mddev;
+	mdk_rdev_t *rdev, *src = NULL;
+	struct list_head *tmp;
+	bitmap_super_t *sb;
+	sector_t sector;
+	int i;
+
+	ITERATE_RDEV(mddev,rdev,tmp)
+		if (rdev->in_sync && !rdev->faulty) {
+			src = rdev;
+			break;
+		}
+	if (!src)
+		return 0;
+
+	sector = (src->sb_offset<<1) + MD_SB_SECTORS;
+	if (!sync_page_io(src->bdev, sector, BITMAP_BLOCK_SIZE,
+			  bitmap->sb_page, READ))
+		return 0;
+
+	sb = page_address(bitmap->sb_page);
+	if (sb->magic != BITMAP_MAGIC || sb->version != BITMAP_MAJOR ||
+	    memcmp(sb->uuid, mddev->uuid, 16) ||
+	    sb->events != mddev->events ||
+	    sb->sync_size != bitmap->sync_size ||
+	    sb->chunksize != bitmap->chunksize)
+		return 0;
+
+	for (i = 0; i < bitmap->blocks; i++) {
+		sector += BITMAP_BLOCK_SECTORS;
+		if (!sync_page_io(src->bdev, sector, BITMAP_BLOCK_SIZE,
+				  bitmap->pages[i], READ))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Set up the bitmap of a freshly started array.  Only redundant arrays
+ * with 0.90 superblocks have room for one.  Called from do_md_run()
+ * with the mddev locked, after the personality has been started.
+ */
+int bitmap_create(mddev_t *mddev)
+{
+	struct bitmap *bitmap;
+	unsigned long chunk;
+	int i;
+
+	if (!mddev->persistent || mddev->major_version != 0)
+		return 0;
+	if (mddev->level != 1 && mddev->level != 4 &&
+	    mddev->level != 5 && mddev->level != 6)
+		return 0;
+	if (!mddev->size)
+		return 0;
+
+	bitmap = kmalloc(sizeof(*bitmap), GFP_KERNEL);
+	if (!bitmap)
+		return -ENOMEM;
+	memset(bitmap, 0, sizeof(*bitmap));
+
+	bitmap->mddev = mddev;
+	bitmap->lock = SPIN_LOCK_UNLOCKED;
+	init_waitqueue_head(&bitmap->overflow_wait);
+	init_MUTEX(&bitmap->flush_sem);
+	init_timer(&bitmap->timer);
+	bitmap->timer.function = bitmap_timeout;
+	bitmap->timer.data = (unsigned long) bitmap;
+
+	bitmap->sync_size = mddev->size << 1;
+	bitmap->chunksize = BITMAP_MIN_CHUNK;
+	bitmap->chunkshift = ffz(~BITMAP_MIN_CHUNK);
+	while (((bitmap->sync_size + bitmap->chunksize - 1) >> bitmap->chunkshift)
+	       > BITMAP_MAX_CHUNKS) {
+		bitmap->chunksize <<= 1;
+		bitmap->chunkshift++;
+	}
+	bitmap->chunks = (bitmap->sync_size + bitmap->chunksize - 1)
+		>> bitmap->chunkshift;
+	bitmap->blocks = chunk_block(bitmap->chunks - 1) + 1;
+
+	bitmap->counts = vmalloc(bitmap->chunks * sizeof(bitmap_counter_t));
+	if (!bitmap->counts)
+		goto abort;
+	memset(bitmap->counts, 0, bitmap->chunks * sizeof(bitmap_counter_t));
+
+	bitmap->sb_page = alloc_page(GFP_KERNEL);
+	if (!bitmap->sb_page)
+		goto abort;
+	memset(page_address(bitmap->sb_page), 0, PAGE_SIZE);
+	for (i = 0; i < bitmap->blocks; i++) {
+		bitmap->pages[i] = alloc_page(GFP_KERNEL);
+		if (!bitmap->pages[i])
+			goto abort;
+		memset(page_address(bitmap->pages[i]), 0, PAGE_SIZE);
+	}
+
+	if (!bitmap_read(bitmap)) {
+		/*
+		 * No usable bitmap on disk.  If the array is dirty we
+		 * have no idea what might be out of sync.
+		 */
+		for (i = 0; i < bitmap->blocks; i++)
+			memset(page_address(bitmap->pages[i]),
+			       mddev->recovery_cp == MaxSector ? 0 : 0xff,
+			       BITMAP_BLOCK_SIZE);
+	}
+
+	for (chunk = 0; chunk < bitmap->chunks; chunk++) {
+		if (!ext2_test_bit(chunk_bit(chunk), chunk_page(bitmap, chunk)))
+			continue;
+		bitmap->nr_dirty++;
+		if (mddev->degraded)
+			bitmap->counts[chunk] = BITMAP_NEEDED;
+		else if (mddev->recovery_cp == MaxSector) {
+			bitmap->counts[chunk] = BITMAP_PENDING;
+			bitmap->pending++;
+		}
+	}
+
+	printk(KERN_INFO "md%d: bitmap: %lu chunks of %luk, %lu dirty\n",
+		mdidx(mddev), bitmap->chunks, bitmap->chunksize >> 1,
+		bitmap->nr_dirty);
+
+	/* give every device a complete, current copy */
+	bitmap->dirty = (1UL << bitmap->blocks) - 1;
+	bitmap_flush(bitmap);
+	bitmap_update_sb(bitmap);
+
+	bitmap->daemon_lastrun = jiffies;
+	if (bitmap->pending)
+		mod_timer(&bitmap->timer, jiffies + BITMAP_DAEMON_DELAY);
+	mddev->bitmap = bitmap;
+	return 0;
+
+abort:
+	bitmap_free(bitmap);
+	return -ENOMEM;
+}
+
+/*
+ * Called from do_md_stop() with the mddev locked, once the personality
+ * has been stopped and the superblocks have been written.  If the array
+ * was shut down cleanly nothing is out of sync any more, so the bits
+ * are cleared before the bitmap is written for the last time.
+ */
+void bitmap_destroy(mddev_t *mddev)
+{
+	struct bitmap *bitmap = mddev->bitmap;
+	unsigned long chunk;
+
+	if (!bitmap)
+		return;
+
+	del_timer_sync(&bitmap->timer);
+
+	if (mddev->in_sync && mddev->recovery_cp == MaxSector &&
+	    !mddev->degraded) {
+		spin_lock_irq(&bitmap->lock);
+		for (chunk = 0; chunk < bitmap->chunks; chunk++) {
+			if (bitmap->counts[chunk] &
+			    (BITMAP_COUNTER_MAX|BITMAP_NEEDED))
+				continue;
+			bitmap->counts[chunk] = 0;
+			if (ext2_clear_bit(chunk_bit(chunk),
+					   chunk_page(bitmap, chunk))) {
+				bitmap->nr_dirty--;
+				bitmap->dirty |= 1UL << chunk_block(chunk);
+			}
+		}
+		bitmap->pending = 0;
+		spin_unlock_irq(&bitmap->lock);
+	}
+	bitmap_flush(bitmap);
+	bitmap_update_sb(bitmap);
+
+	mddev->bitmap = NULL;
+	bitmap_free(bitmap);
+}
+
+EXPORT_SYMBOL(bitmap_startwrite);
+EXPORT_SYMBOL(bitmap_endwrite);
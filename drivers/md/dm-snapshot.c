@@ -0,0 +1,1147 @@
+/*
+ * dm-snapshot.c
+ *
+ * Copyright (C) 2001-2003 Sistina Software (UK) Limited.
+ *
+ * This file is released under the GPL.
+ */
+
+#include <linux/blkdev.h>
+#include <linux/config.h>
+#include <linux/ctype.h>
+#include <linux/list.h>
+#include <linux/fs.h>
+#include <linux/mempool.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+#include "dm-snapshot.h"
+#include "dm-bio-list.h"
+#include "kcopyd.h"
+
+/*
+ * The pages the kcopyd client of each snapshot reserves: 256k on
+ * i386, enough for a few chunks to be copied at once.
+ */
+#define SNAPSHOT_PAGES 64
+
+struct pending_exception {
+	struct exception e;
+
+	/*
+	 * Origin writes waiting for this to complete are held
+	 * in a bio list, and resubmitted through the origin
+	 * when it has: they may still have to wait for other
+	 * snapshots.
+	 */
+	struct bio_list origin_bios;
+	struct bio_list snapshot_bios;
+
+	/* Pointer back to snapshot context */
+	struct dm_snapshot *snap;
+
+	/*
+	 * 1 indicates the exception has already been sent to
+	 * kcopyd.
+	 */
+	int started;
+};
+
+static kmem_cache_t *exception_cache;
+static kmem_cache_t *pending_cache;
+static mempool_t *pending_pool;
+
+/*
+ * The destructor of a snapshot waits here for copies started by
+ * writes to the origin.
+ */
+static DECLARE_WAIT_QUEUE_HEAD(_pending_wait);
+
+/*
+ * One of these for every origin device that has snapshots, held
+ * in the _origins hash table below.
+ */
+struct origin {
+	/* The origin device */
+	struct block_device *bdev;
+
+	struct list_head hash_list;
+
+	/* List of snapshots for this origin */
+	struct list_head snapshots;
+};
+
+/*
+ * Hash table mapping origin volumes to lists of snapshots and
+ * a lock to protect it.  If we make this the size of the minors
+ * list then it should be nearly perfect.
+ */
+#define ORIGIN_HASH_SIZE 256
+#define ORIGIN_MASK      0xFF
+static struct list_head *_origins;
+static struct rw_semaphore _origins_lock;
+
+static int init_origin_hash(void)
+{
+	int i;
+
+	_origins = kmalloc(ORIGIN_HASH_SIZE * sizeof(struct list_head),
+			   GFP_KERNEL);
+	if (!_origins) {
+		DMERR("snapshot: unable to allocate origin hash");
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < ORIGIN_HASH_SIZE; i++)
+		INIT_LIST_HEAD(_origins + i);
+	init_rwsem(&_origins_lock);
+
+	return 0;
+}
+
+static void exit_origin_hash(void)
+{
+	kfree(_origins);
+}
+
+static inline unsigned int origin_hash(struct block_device *bdev)
+{
+	return bdev->bd_dev & ORIGIN_MASK;
+}
+
+static struct origin *__lookup_origin(struct block_device *origin)
+{
+	struct list_head *slot, *ol;
+	struct origin *o;
+
+	ol = &_origins[origin_hash(origin)];
+	list_for_each(slot, ol) {
+		o = list_entry(slot, struct origin, hash_list);
+
+		if (o->bdev == origin)
+			return o;
+	}
+
+	return NULL;
+}
+
+static void __insert_origin(struct origin *o)
+{
+	struct list_head *sl = &_origins[origin_hash(o->bdev)];
+	list_add_tail(&o->hash_list, sl);
+}
+
+/*
+ * Make a note of the snapshot and its origin so we can look it
+ * up when the origin has a write on it.
+ */
+static int register_snapshot(struct dm_snapshot *snap)
+{
+	struct origin *o;
+	struct block_device *bdev = snap->origin->bdev;
+
+	down_write(&_origins_lock);
+	o = __lookup_origin(bdev);
+
+	if (!o) {
+		/* New origin */
+		o = kmalloc(sizeof(*o), GFP_KERNEL);
+		if (!o) {
+			up_write(&_origins_lock);
+			return -ENOMEM;
+		}
+
+		/* Initialise the struct */
+		INIT_LIST_HEAD(&o->snapshots);
+		o->bdev = bdev;
+
+		__insert_origin(o);
+	}
+
+	list_add_tail(&snap->list, &o->snapshots);
+
+	up_write(&_origins_lock);
+	return 0;
+}
+
+static void unregister_snapshot(struct dm_snapshot *s)
+{
+	struct origin *o;
+
+	down_write(&_origins_lock);
+	o = __lookup_origin(s->origin->bdev);
+
+	list_del(&s->list);
+	if (list_empty(&o->snapshots)) {
+		list_del(&o->hash_list);
+		kfree(o);
+	}
+
+	up_write(&_origins_lock);
+}
+
+/*
+ * Implementation of the exception hash tables.
+ */
+static int init_exception_table(struct exception_table *et, uint32_t size)
+{
+	unsigned int i;
+
+	et->hash_mask = size - 1;
+	et->table = vmalloc(sizeof(struct list_head) * size);
+	if (!et->table)
+		return -ENOMEM;
+
+	for (i = 0; i < size; i++)
+		INIT_LIST_HEAD(et->table + i);
+
+	return 0;
+}
+
+static void exit_exception_table(struct exception_table *et, kmem_cache_t *mem)
+{
+	struct list_head *slot, *entry, *temp;
+	struct exception *ex;
+	int i, size;
+
+	size = et->hash_mask + 1;
+	for (i = 0; i < size; i++) {
+		slot = et->table + i;
+
+		list_for_each_safe(entry, temp, slot) {
+			ex = list_entry(entry, struct exception, hash_list);
+			kmem_cache_free(mem, ex);
+		}
+	}
+
+	vfree(et->table);
+}
+
+static inline uint32_t exception_hash(struct exception_table *et, chunk_t chunk)
+{
+	return chunk & et->hash_mask;
+}
+
+static void insert_exception(struct exception_table *eh, struct exception *e)
+{
+	struct list_head *l = &eh->table[exception_hash(eh, e->old_chunk)];
+	list_add(&e->hash_list, l);
+}
+
+static inline void remove_exception(struct exception *e)
+{
+	list_del(&e->hash_list);
+}
+
+/*
+ * Return the exception data for a sector, or NULL if not
+ * remapped.
+ */
+static struct exception *lookup_exception(struct exception_table *et,
+					  chunk_t chunk)
+{
+	struct list_head *slot, *el;
+	struct exception *e;
+
+	slot = &et->table[exception_hash(et, chunk)];
+	list_for_each(el, slot) {
+		e = list_entry(el, struct exception, hash_list);
+		if (e->old_chunk == chunk)
+			return e;
+	}
+
+	return NULL;
+}
+
+static inline struct exception *alloc_exception(void)
+{
+	return kmem_cache_alloc(exception_cache, GFP_NOIO);
+}
+
+static inline struct pending_exception *alloc_pending_exception(void)
+{
+	return mempool_alloc(pending_pool, GFP_NOIO);
+}
+
+static inline void free_exception(struct exception *e)
+{
+	kmem_cache_free(exception_cache, e);
+}
+
+static inline void free_pending_exception(struct pending_exception *pe)
+{
+	mempool_free(pe, pending_pool);
+}
+
+/*
+ * Called when reading in the metadata.
+ */
+int dm_add_exception(struct dm_snapshot *s, chunk_t old, chunk_t new)
+{
+	struct exception *e;
+
+	e = alloc_exception();
+	if (!e)
+		return -ENOMEM;
+
+	e->old_chunk = old;
+	e->new_chunk = new;
+	insert_exception(&s->complete, e);
+	return 0;
+}
+
+/*
+ * Hard coded magic.
+ */
+static int calc_max_buckets(void)
+{
+	/* use a fixed size of 2MB */
+	unsigned long mem = 2 * 1024 * 1024;
+	mem /= sizeof(struct list_head);
+
+	return mem;
+}
+
+/*
+ * Rounds a number down to a power of 2.
+ */
+static inline uint32_t round_down(uint32_t n)
+{
+	while (n & (n - 1))
+		n &= (n - 1);
+	return n;
+}
+
+/*
+ * Allocate room for a suitable hash table.
+ */
+static int init_hash_tables(struct dm_snapshot *s)
+{
+	sector_t hash_size, cow_dev_size, origin_dev_size, max_buckets;
+
+	/*
+	 * Calculate based on the size of the original volume or
+	 * the COW volume...
+	 */
+	cow_dev_size = get_dev_size(s->cow->bdev);
+	origin_dev_size = get_dev_size(s->origin->bdev);
+	max_buckets = calc_max_buckets();
+
+	hash_size = min(origin_dev_size, cow_dev_size) >> s->chunk_shift;
+	hash_size = min(hash_size, max_buckets);
+
+	/* Round it down to a power of 2 */
+	hash_size = round_down(hash_size);
+	if (hash_size < 64)
+		hash_size = 64;
+
+	if (init_exception_table(&s->complete, hash_size))
+		return -ENOMEM;
+
+	/*
+	 * Allocate hash table for in-flight exceptions
+	 * Make this smaller than the real hash table
+	 */
+	hash_size >>= 3;
+	if (hash_size < 64)
+		hash_size = 64;
+
+	if (init_exception_table(&s->pending, hash_size)) {
+		exit_exception_table(&s->complete, exception_cache);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*
+ * Construct a snapshot mapping: <origin_dev> <COW-dev> <p/n> <chunk-size>
+ */
+static int snapshot_ctr(struct dm_target *ti, unsigned int argc, char **argv)
+{
+	struct dm_snapshot *s;
+	unsigned long chunk_size;
+	int r = -EINVAL;
+	char persistent;
+	char *origin_path;
+	char *cow_path;
+	char *value;
+	int blocksize;
+
+	if (argc != 4) {
+		ti->error = "dm-snapshot: requires exactly 4 arguments";
+		r = -EINVAL;
+		goto bad1;
+	}
+
+	origin_path = argv[0];
+	cow_path = argv[1];
+	persistent = toupper(*argv[2]);
+
+	if (persistent != 'P' && persistent != 'N') {
+		ti->error = "Persistent flag is not P or N";
+		r = -EINVAL;
+		goto bad1;
+	}
+
+	chunk_size = simple_strtoul(argv[3], &value, 10);
+	if (chunk_size == 0 || *value) {
+		ti->error = "Invalid chunk size";
+		r = -EINVAL;
+		goto bad1;
+	}
+
+	s = kmalloc(sizeof(*s), GFP_KERNEL);
+	if (s == NULL) {
+		ti->error = "Cannot allocate snapshot context private "
+		    "structure";
+		r = -ENOMEM;
+		goto bad1;
+	}
+
+	r = dm_get_device(ti, origin_path, 0, ti->len, FMODE_READ, &s->origin);
+	if (r) {
+		ti->error = "Cannot get origin device";
+		goto bad2;
+	}
+
+	r = dm_get_device(ti, cow_path, 0, 0,
+			  FMODE_READ | FMODE_WRITE, &s->cow);
+	if (r) {
+		dm_put_device(ti, s->origin);
+		ti->error = "Cannot get COW device";
+		goto bad2;
+	}
+
+	/*
+	 * Chunk size must be multiple of page size.  Silently
+	 * round up if it's not.
+	 */
+	chunk_size = dm_round_up(chunk_size, PAGE_SIZE >> SECTOR_SHIFT);
+
+	/* Validate the chunk size against the device block size */
+	blocksize = bdev_hardsect_size(s->cow->bdev);
+	if (chunk_size % (blocksize >> SECTOR_SHIFT)) {
+		ti->error = "Chunk size is not a multiple of device blocksize";
+		r = -EINVAL;
+		goto bad3;
+	}
+
+	/* Check chunk_size is a power of 2 */
+	if (chunk_size & (chunk_size - 1)) {
+		ti->error = "Chunk size is not a power of 2";
+		r = -EINVAL;
+		goto bad3;
+	}
+
+	s->chunk_size = chunk_size;
+	s->chunk_mask = chunk_size - 1;
+	s->type = persistent;
+	for (s->chunk_shift = 0; chunk_size; s->chunk_shift++)
+		chunk_size >>= 1;
+	s->chunk_shift--;
+
+	s->valid = 1;
+	atomic_set(&s->pending_count, 0);
+	init_rwsem(&s->lock);
+	s->table = ti->table;
+
+	/* Allocate hash table for COW data */
+	if (init_hash_tables(s)) {
+		ti->error = "Unable to allocate hash table space";
+		r = -ENOMEM;
+		goto bad3;
+	}
+
+	/*
+	 * Check the persistent flag - done here because we need the
+	 * COW device to read the header.
+	 */
+	s->store.snap = s;
+
+	if (persistent == 'P')
+		r = dm_create_persistent(&s->store, s->chunk_size);
+	else
+		r = dm_create_transient(&s->store);
+
+	if (r) {
+		ti->error = "Couldn't create exception store";
+		r = -EINVAL;
+		goto bad4;
+	}
+
+	r = s->store.read_metadata(&s->store);
+	if (r < 0) {
+		ti->error = "Failed to read snapshot metadata";
+		goto bad5;
+	} else if (r > 0)
+		/* the snapshot was invalidated before, keep it that way */
+		s->valid = 0;
+
+	r = kcopyd_client_create(SNAPSHOT_PAGES, &s->kcopyd_client);
+	if (r) {
+		ti->error = "Could not create kcopyd client";
+		goto bad5;
+	}
+
+	/* Add snapshot to the list of snapshots for this origin */
+	if (register_snapshot(s)) {
+		r = -EINVAL;
+		ti->error = "Cannot register snapshot origin";
+		goto bad6;
+	}
+
+	ti->private = s;
+	ti->split_io = s->chunk_size;
+	return 0;
+
+      bad6:
+	kcopyd_client_destroy(s->kcopyd_client);
+
+      bad5:
+	s->store.destroy(&s->store);
+
+      bad4:
+	exit_exception_table(&s->pending, pending_cache);
+	exit_exception_table(&s->complete, exception_cache);
+
+      bad3:
+	dm_put_device(ti, s->cow);
+	dm_put_device(ti, s->origin);
+
+      bad2:
+	kfree(s);
+
+      bad1:
+	return r;
+}
+
+static void snapshot_dtr(struct dm_target *ti)
+{
+	struct dm_snapshot *s = (struct dm_snapshot *) ti->private;
+
+	/* Prevent further origin writes from using this snapshot. */
+	unregister_snapshot(s);
+
+	/* Wait for the copies that are already under way. */
+	wait_event(_pending_wait, !atomic_read(&s->pending_count));
+
+	exit_exception_table(&s->pending, pending_cache);
+	exit_exception_table(&s->complete, exception_cache);
+
+	/* Deallocate memory used */
+	s->store.destroy(&s->store);
+
+	dm_put_device(ti, s->origin);
+	dm_put_device(ti, s->cow);
+
+	kcopyd_client_destroy(s->kcopyd_client);
+	kfree(s);
+}
+
+/*
+ * Flush a list of bios, or fail them.
+ */
+static void flush_bios(struct bio *bio)
+{
+	struct bio *n;
+
+	while (bio) {
+		n = bio->bi_next;
+		bio->bi_next = NULL;
+		generic_make_request(bio);
+		bio = n;
+	}
+}
+
+static void error_bios(struct bio *bio)
+{
+	struct bio *n;
+
+	while (bio) {
+		n = bio->bi_next;
+		bio->bi_next = NULL;
+		bio_io_error(bio, bio->bi_size);
+		bio = n;
+	}
+}
+
+static int do_origin(struct dm_dev *origin, struct bio *bio);
+
+/*
+ * Origin writes that were waiting for a copy have to go through
+ * the origin again, other snapshots may still need a copy too.
+ */
+static void retry_origin_bios(struct dm_snapshot *s, struct bio *bio)
+{
+	struct bio *n;
+
+	while (bio) {
+		n = bio->bi_next;
+		bio->bi_next = NULL;
+		if (do_origin(s->origin, bio) == 1)
+			generic_make_request(bio);
+		bio = n;
+	}
+}
+
+/*
+ * Must be called with s->lock held for writing.
+ */
+static void __invalidate_snapshot(struct dm_snapshot *s, const char *why)
+{
+	if (!s->valid)
+		return;
+
+	DMERR("Invalidating snapshot: %s", why);
+	s->valid = 0;
+	if (s->store.drop_snapshot)
+		s->store.drop_snapshot(&s->store);
+
+	dm_table_event(s->table);
+}
+
+static inline void remap_exception(struct dm_snapshot *s, struct exception *e,
+				   struct bio *bio)
+{
+	bio->bi_bdev = s->cow->bdev;
+	bio->bi_sector = chunk_to_sector(s, e->new_chunk) +
+	    (bio->bi_sector & s->chunk_mask);
+}
+
+/*
+ * Called once the metadata of an exception is on disk, or the
+ * copy or the metadata write failed.
+ */
+static void commit_callback(void *context, int success)
+{
+	struct pending_exception *pe = (struct pending_exception *) context;
+	struct dm_snapshot *s = pe->snap;
+	struct exception *e = NULL;
+	struct bio *snapshot_bios, *origin_bios, *bio;
+
+	down_write(&s->lock);
+	if (!success)
+		__invalidate_snapshot(s, "error writing metadata");
+
+	else if (s->valid) {
+		e = alloc_exception();
+		if (!e)
+			__invalidate_snapshot(s, "unable to allocate exception");
+		else {
+			e->old_chunk = pe->e.old_chunk;
+			e->new_chunk = pe->e.new_chunk;
+			insert_exception(&s->complete, e);
+		}
+	}
+	remove_exception(&pe->e);
+
+	snapshot_bios = bio_list_get(&pe->snapshot_bios);
+	origin_bios = bio_list_get(&pe->origin_bios);
+	if (e)
+		for (bio = snapshot_bios; bio; bio = bio->bi_next)
+			remap_exception(s, e, bio);
+	up_write(&s->lock);
+
+	/* Submit any pending write bios */
+	if (e)
+		flush_bios(snapshot_bios);
+	else
+		error_bios(snapshot_bios);
+
+	retry_origin_bios(s, origin_bios);
+
+	free_pending_exception(pe);
+
+	/* this must be the last reference to the snapshot */
+	if (atomic_dec_and_test(&s->pending_count))
+		wake_up(&_pending_wait);
+}
+
+/*
+ * Called when the copy I/O has finished.  The exception is
+ * committed even if the copy failed, so that the store sees every
+ * exception it prepared; the snapshot is invalid by then and
+ * commit_callback() fails the io.
+ */
+static void copy_callback(int read_err, unsigned int write_err, void *context)
+{
+	struct pending_exception *pe = (struct pending_exception *) context;
+	struct dm_snapshot *s = pe->snap;
+
+	if (read_err || write_err) {
+		down_write(&s->lock);
+		__invalidate_snapshot(s, read_err ? "error reading origin" :
+				      "error writing COW device");
+		up_write(&s->lock);
+	}
+
+	/* Update the metadata if we are persistent */
+	s->store.commit_exception(&s->store, &pe->e, commit_callback, pe);
+}
+
+/*
+ * Dispatches the copy operation to kcopyd.
+ */
+static void start_copy(struct pending_exception *pe)
+{
+	struct dm_snapshot *s = pe->snap;
+	struct io_region src, dest;
+	struct block_device *bdev = s->origin->bdev;
+	sector_t dev_size;
+
+	dev_size = get_dev_size(bdev);
+
+	src.bdev = bdev;
+	src.sector = chunk_to_sector(s, pe->e.old_chunk);
+	src.count = s->chunk_size;
+	if (src.count > dev_size - src.sector)
+		src.count = dev_size - src.sector;
+
+	dest.bdev = s->cow->bdev;
+	dest.sector = chunk_to_sector(s, pe->e.new_chunk);
+	dest.count = src.count;
+
+	/* Hand over to kcopyd */
+	if (kcopyd_copy(s->kcopyd_client, &src, 1, &dest, copy_callback, pe))
+		copy_callback(1, 0, pe);
+}
+
+static inline struct pending_exception *
+__lookup_pending_exception(struct dm_snapshot *s, chunk_t chunk)
+{
+	struct exception *e = lookup_exception(&s->pending, chunk);
+
+	return e ? container_of(e, struct pending_exception, e) : NULL;
+}
+
+/*
+ * Sets up a new pending exception and finds room for it in the
+ * store.  Called with s->lock held for writing.
+ */
+static int __insert_pending_exception(struct dm_snapshot *s,
+				      struct pending_exception *pe,
+				      chunk_t chunk)
+{
+	int r;
+
+	pe->e.old_chunk = chunk;
+	bio_list_init(&pe->origin_bios);
+	bio_list_init(&pe->snapshot_bios);
+	pe->snap = s;
+	pe->started = 0;
+
+	r = s->store.prepare_exception(&s->store, &pe->e);
+	if (r)
+		return r;
+
+	insert_exception(&s->pending, &pe->e);
+	atomic_inc(&s->pending_count);
+	return 0;
+}
+
+static int snapshot_map(struct dm_target *ti, struct bio *bio)
+{
+	struct exception *e;
+	struct dm_snapshot *s = (struct dm_snapshot *) ti->private;
+	struct pending_exception *pe, *spare = NULL;
+	chunk_t chunk;
+	int r = 1, start = 0;
+
+	bio->bi_sector -= ti->begin;
+	chunk = sector_to_chunk(s, bio->bi_sector);
+
+	/* Full snapshots are not usable */
+	if (!s->valid)
+		return -1;
+
+      again:
+	down_write(&s->lock);
+
+	if (!s->valid) {
+		r = -1;
+		goto out;
+	}
+
+	/* If the block is already remapped - use that */
+	e = lookup_exception(&s->complete, chunk);
+	if (e) {
+		remap_exception(s, e, bio);
+		goto out;
+	}
+
+	pe = __lookup_pending_exception(s, chunk);
+	if (!pe && bio_rw(bio) == WRITE) {
+		if (!spare) {
+			/* don't wait for memory with the lock held */
+			up_write(&s->lock);
+			spare = alloc_pending_exception();
+			goto again;
+		}
+
+		pe = spare;
+		spare = NULL;
+		if (__insert_pending_exception(s, pe, chunk)) {
+			free_pending_exception(pe);
+			__invalidate_snapshot(s, "snapshot is full");
+			r = -1;
+			goto out;
+		}
+	}
+
+	if (pe) {
+		/*
+		 * Wait for the copy, the io then goes to the COW
+		 * device.  Reads wait too, so that they can't race
+		 * with the origin writes that the copy is holding up.
+		 */
+		bio_list_add(&pe->snapshot_bios, bio);
+		start = !pe->started;
+		pe->started = 1;
+		r = 0;
+	} else
+		/* Unchanged chunks are read from the origin */
+		bio->bi_bdev = s->origin->bdev;
+
+      out:
+	up_write(&s->lock);
+
+	if (spare)
+		free_pending_exception(spare);
+
+	if (start)
+		start_copy(pe);
+
+	return r;
+}
+
+static int snapshot_status(struct dm_target *ti, status_type_t type,
+			   char *result, unsigned int maxlen)
+{
+	struct dm_snapshot *snap = (struct dm_snapshot *) ti->private;
+	char cow[BDEVNAME_SIZE];
+	char org[BDEVNAME_SIZE];
+
+	switch (type) {
+	case STATUSTYPE_INFO:
+		if (!snap->valid)
+			snprintf(result, maxlen, "Invalid");
+		else {
+			sector_t numerator, denominator;
+
+			snap->store.fraction_full(&snap->store,
+						  &numerator, &denominator);
+			snprintf(result, maxlen,
+				 SECTOR_FORMAT "/" SECTOR_FORMAT,
+				 numerator, denominator);
+		}
+		break;
+
+	case STATUSTYPE_TABLE:
+		snprintf(result, maxlen, "%s %s %c " SECTOR_FORMAT,
+			 bdevname(snap->origin->bdev, org),
+			 bdevname(snap->cow->bdev, cow),
+			 snap->type, snap->chunk_size);
+		break;
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------
+ * Origin methods
+ *---------------------------------------------------------------*/
+
+/*
+ * Makes sure that a chunk of one snapshot is being copied, and
+ * queues the bio on the copy if 'queue' is set.  Returns 1 if the
+ * bio was queued.
+ */
+static int __origin_chunk(struct dm_snapshot *snap, chunk_t chunk,
+			  struct bio *bio, int queue)
+{
+	struct pending_exception *pe, *spare = NULL;
+	int queued = 0, start = 0;
+
+      again:
+	down_write(&snap->lock);
+
+	/* Only deal with valid snapshots, that don't have a copy yet */
+	if (!snap->valid || lookup_exception(&snap->complete, chunk))
+		goto out;
+
+	pe = __lookup_pending_exception(snap, chunk);
+	if (!pe) {
+		if (!spare) {
+			up_write(&snap->lock);
+			spare = alloc_pending_exception();
+			goto again;
+		}
+
+		pe = spare;
+		spare = NULL;
+		if (__insert_pending_exception(snap, pe, chunk)) {
+			free_pending_exception(pe);
+			__invalidate_snapshot(snap, "snapshot is full");
+			goto out;
+		}
+	}
+
+	if (queue) {
+		bio_list_add(&pe->origin_bios, bio);
+		queued = 1;
+	}
+
+	start = !pe->started;
+	pe->started = 1;
+
+      out:
+	up_write(&snap->lock);
+
+	if (spare)
+		free_pending_exception(spare);
+
+	if (start)
+		start_copy(pe);
+
+	return queued;
+}
+
+/*
+ * Starts a copy in every snapshot whose chunks under the bio have
+ * not been copied yet.  The bio is held by the first of these copies,
+ * and will come back here when that is done.
+ */
+static int __origin_write(struct list_head *snapshots, struct bio *bio)
+{
+	int r = 1;
+	struct dm_snapshot *snap;
+	chunk_t chunk, last;
+
+	list_for_each_entry (snap, snapshots, list) {
+		chunk = sector_to_chunk(snap, bio->bi_sector);
+		last = sector_to_chunk(snap, bio->bi_sector + bio_sectors(bio) - 1);
+
+		for (; chunk <= last; chunk++)
+			if (__origin_chunk(snap, chunk, bio, r))
+				r = 0;
+	}
+
+	return r;
+}
+
+/*
+ * Called on a write from the origin driver.
+ */
+static int do_origin(struct dm_dev *origin, struct bio *bio)
+{
+	struct origin *o;
+	int r = 1;
+
+	down_read(&_origins_lock);
+	o = __lookup_origin(origin->bdev);
+	if (o)
+		r = __origin_write(&o->snapshots, bio);
+	up_read(&_origins_lock);
+
+	return r;
+}
+
+/*
+ * Origin: maps a linear range of a device, with hooks for snapshotting.
+ */
+
+/*
+ * Construct an origin mapping: <dev_path>
+ * The context for an origin is merely a 'struct dm_dev *'
+ * pointing to the real device.
+ */
+static int origin_ctr(struct dm_target *ti, unsigned int argc, char **argv)
+{
+	int r;
+	struct dm_dev *dev;
+
+	if (argc != 1) {
+		ti->error = "dm-origin: incorrect number of arguments";
+		return -EINVAL;
+	}
+
+	r = dm_get_device(ti, argv[0], 0, ti->len,
+			  dm_table_get_mode(ti->table), &dev);
+	if (r) {
+		ti->error = "Cannot get target device";
+		return r;
+	}
+
+	ti->private = dev;
+	return 0;
+}
+
+static void origin_dtr(struct dm_target *ti)
+{
+	struct dm_dev *dev = (struct dm_dev *) ti->private;
+	dm_put_device(ti, dev);
+}
+
+static int origin_map(struct dm_target *ti, struct bio *bio)
+{
+	struct dm_dev *dev = (struct dm_dev *) ti->private;
+	bio->bi_bdev = dev->bdev;
+	bio->bi_sector -= ti->begin;
+
+	/* Only tell snapshots if this is a write */
+	return (bio_rw(bio) == WRITE) ? do_origin(dev, bio) : 1;
+}
+
+static inline chunk_t min_not_zero(chunk_t l, chunk_t r)
+{
+	if (!l)
+		return r;
+	if (!r)
+		return l;
+	return min(l, r);
+}
+
+/*
+ * Set the target "split_io" field to the minimum of all the snapshots'
+ * chunk sizes, so that most writes only touch one chunk.
+ */
+static void origin_resume(struct dm_target *ti)
+{
+	struct dm_dev *dev = (struct dm_dev *) ti->private;
+	struct dm_snapshot *snap;
+	struct origin *o;
+	chunk_t chunk_size = 0;
+
+	down_read(&_origins_lock);
+	o = __lookup_origin(dev->bdev);
+	if (o)
+		list_for_each_entry (snap, &o->snapshots, list)
+			chunk_size = min_not_zero(chunk_size, snap->chunk_size);
+	up_read(&_origins_lock);
+
+	ti->split_io = chunk_size;
+}
+
+static int origin_status(struct dm_target *ti, status_type_t type, char *result,
+			 unsigned int maxlen)
+{
+	struct dm_dev *dev = (struct dm_dev *) ti->private;
+	char buffer[BDEVNAME_SIZE];
+
+	switch (type) {
+	case STATUSTYPE_INFO:
+		result[0] = '\0';
+		break;
+
+	case STATUSTYPE_TABLE:
+		snprintf(result, maxlen, "%s", bdevname(dev->bdev, buffer));
+		break;
+	}
+
+	return 0;
+}
+
+static struct target_type origin_target = {
+	.name   = "snapshot-origin",
+	.module = THIS_MODULE,
+	.ctr    = origin_ctr,
+	.dtr    = origin_dtr,
+	.map    = origin_map,
+	.resume = origin_resume,
+	.status = origin_status,
+};
+
+static struct target_type snapshot_target = {
+	.name   = "snapshot",
+	.module = THIS_MODULE,
+	.ctr    = snapshot_ctr,
+	.dtr    = snapshot_dtr,
+	.map    = snapshot_map,
+	.status = snapshot_status,
+};
+
+int __init dm_snapshot_init(void)
+{
+	int r;
+
+	r = dm_register_target(&snapshot_target);
+	if (r) {
+		DMERR("snapshot target register failed %d", r);
+		return r;
+	}
+
+	r = dm_register_target(&origin_target);
+	if (r < 0) {
+		DMERR("origin target register failed %d", r);
+		goto bad1;
+	}
+
+	r = init_origin_hash();
+	if (r) {
+		DMERR("init_origin_hash failed.");
+		goto bad2;
+	}
+
+	exception_cache = kmem_cache_create("dm-snapshot-ex",
+					    sizeof(struct exception),
+					    __alignof__(struct exception),
+					    0, NULL, NULL);
+	if (!exception_cache) {
+		DMERR("Couldn't create exception cache.");
+		r = -ENOMEM;
+		goto bad3;
+	}
+
+	pending_cache =
+	    kmem_cache_create("dm-snapshot-in",
+			      sizeof(struct pending_exception),
+			      __alignof__(struct pending_exception),
+			      0, NULL, NULL);
+	if (!pending_cache) {
+		DMERR("Couldn't create pending cache.");
+		r = -ENOMEM;
+		goto bad4;
+	}
+
+	pending_pool = mempool_create(128, mempool_alloc_slab,
+				      mempool_free_slab, pending_cache);
+	if (!pending_pool) {
+		DMERR("Couldn't create pending pool.");
+		r = -ENOMEM;
+		goto bad5;
+	}
+
+	return 0;
+
+      bad5:
+	kmem_cache_destroy(pending_cache);
+      bad4:
+	kmem_cache_destroy(exception_cache);
+      bad3:
+	exit_origin_hash();
+      bad2:
+	dm_unregister_target(&origin_target);
+      bad1:
+	dm_unregister_target(&snapshot_target);
+	return r;
+}
+
+void dm_snapshot_exit(void)
+{
+	int r;
+
+	r = dm_unregister_target(&snapshot_target);
+	if (r)
+		DMERR("snapshot unregister failed %d", r);
+
+	r = dm_unregister_target(&origin_target);
+	if (r)
+		DMERR("origin unregister failed %d", r);
+
+	exit_origin_hash();
+	mempool_destroy(pending_pool);
+	kmem_cache_destroy(pending_cache);
+	kmem_cache_destroy(exception_cache);
+}
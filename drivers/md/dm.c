@@ -118,6 +118,8 @@ static struct {
 	xx(dm_target)
 	xx(dm_linear)
 	xx(dm_stripe)
+	xx(kcopyd)
+	xx(dm_snapshot)
 	xx(dm_interface)
 #undef xx
 };
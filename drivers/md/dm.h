@@ -159,4 +159,13 @@ void dm_linear_exit(void);
 int dm_stripe_init(void);
 void dm_stripe_exit(void);
 
+/*
+ * Snapshots, and the copy engine that they use
+ */
+int kcopyd_init(void);
+void kcopyd_exit(void);
+
+int dm_snapshot_init(void);
+void dm_snapshot_exit(void);
+
 #endif
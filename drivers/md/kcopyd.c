@@ -0,0 +1,593 @@
+/*
+ * Copyright (C) 2003 Sistina Software (UK) Limited.
+ *
+ * This file is released under the GPL.
+ *
+ * Kcopyd provides a simple interface for copying an area of one
+ * block-device to one or more other block-devices, with an asynchronous
+ * completion notification.
+ *
+ * All the work is done by a single thread that runs through three
+ * lists of jobs: those waiting for pages, those ready for io and those
+ * that are complete.  Every io that becomes ready during a pass is
+ * submitted before the queues are unplugged, so that concurrent copies
+ * are batched together at the block layer.
+ */
+
+#include "kcopyd.h"
+
+#include <linux/init.h>
+#include <linux/bio.h>
+#include <linux/mempool.h>
+#include <linux/slab.h>
+#include <linux/smp_lock.h>
+#include <linux/suspend.h>
+#include <linux/completion.h>
+
+/*
+ * Large copies are split into sub jobs of this many sectors, which
+ * run in parallel.
+ */
+#define SUB_JOB_SIZE 128
+#define SUB_JOB_PAGES (((SUB_JOB_SIZE << SECTOR_SHIFT) + PAGE_SIZE - 1) / PAGE_SIZE)
+
+#define MIN_JOBS 64
+
+/*-----------------------------------------------------------------
+ * Each client reserves a pool of pages when it's created.
+ *---------------------------------------------------------------*/
+struct kcopyd_client {
+	spinlock_t lock;
+	struct list_head pages;
+	unsigned int nr_pages;
+	unsigned int nr_free_pages;
+};
+
+static int client_alloc_pages(struct kcopyd_client *kc, unsigned int nr)
+{
+	struct page *page;
+
+	while (nr--) {
+		page = alloc_page(GFP_KERNEL);
+		if (!page)
+			return -ENOMEM;
+
+		list_add(&page->lru, &kc->pages);
+		kc->nr_pages++;
+		kc->nr_free_pages++;
+	}
+
+	return 0;
+}
+
+static void client_free_pages(struct kcopyd_client *kc)
+{
+	struct list_head *p, *n;
+
+	BUG_ON(kc->nr_free_pages != kc->nr_pages);
+
+	list_for_each_safe (p, n, &kc->pages) {
+		list_del(p);
+		__free_page(list_entry(p, struct page, lru));
+	}
+	kc->nr_pages = kc->nr_free_pages = 0;
+}
+
+static int kcopyd_get_pages(struct kcopyd_client *kc,
+			    unsigned int nr, struct list_head *pages)
+{
+	spin_lock(&kc->lock);
+	if (kc->nr_free_pages < nr) {
+		spin_unlock(&kc->lock);
+		return -ENOMEM;
+	}
+
+	kc->nr_free_pages -= nr;
+	while (nr--)
+		list_move(kc->pages.next, pages);
+	spin_unlock(&kc->lock);
+
+	return 0;
+}
+
+static void kcopyd_put_pages(struct kcopyd_client *kc,
+			     unsigned int nr, struct list_head *pages)
+{
+	spin_lock(&kc->lock);
+	list_splice_init(pages, &kc->pages);
+	kc->nr_free_pages += nr;
+	spin_unlock(&kc->lock);
+}
+
+/*-----------------------------------------------------------------
+ * Jobs
+ *---------------------------------------------------------------*/
+struct kcopyd_job;
+
+/*
+ * Every bio points at one of these so that the end_io routine
+ * knows which region failed.
+ */
+struct kcopyd_io {
+	struct kcopyd_job *job;
+	unsigned int region;
+};
+
+struct kcopyd_job {
+	struct kcopyd_client *kc;
+	struct list_head list;
+
+	/*
+	 * Error state of the job, filled in by the end_io routine.
+	 */
+	int read_err;
+	unsigned long write_err;
+
+	/*
+	 * Either READ (copying from the source) or WRITE (to the
+	 * destinations).
+	 */
+	int rw;
+	struct io_region source;
+	unsigned int num_dests;
+	struct io_region dests[KCOPYD_MAX_REGIONS];
+	struct kcopyd_io io[KCOPYD_MAX_REGIONS];
+
+	/*
+	 * The pages holding the data, and the number of bios
+	 * still in flight for the current phase.
+	 */
+	unsigned int nr_pages;
+	struct list_head pages;
+	atomic_t io_count;
+
+	/*
+	 * Set this to ensure you are notified when the job has
+	 * completed.  'context' is for callback to use.
+	 */
+	kcopyd_notify_fn fn;
+	void *context;
+
+	/*
+	 * A split job just counts its outstanding sub jobs.
+	 */
+	atomic_t sub_jobs;
+};
+
+static kmem_cache_t *_job_cache;
+static mempool_t *_job_pool;
+
+/*
+ * We maintain three lists of jobs:
+ *
+ * i)   jobs waiting for pages
+ * ii)  jobs that have pages, and are waiting for the io to be issued.
+ * iii) jobs that have completed.
+ *
+ * All three of these are protected by _job_lock.
+ */
+static spinlock_t _job_lock = SPIN_LOCK_UNLOCKED;
+
+static LIST_HEAD(_complete_jobs);
+static LIST_HEAD(_io_jobs);
+static LIST_HEAD(_pages_jobs);
+
+static void wake(void);
+
+static inline struct kcopyd_job *pop(struct list_head *jobs)
+{
+	struct kcopyd_job *job = NULL;
+	unsigned long flags;
+
+	spin_lock_irqsave(&_job_lock, flags);
+	if (!list_empty(jobs)) {
+		job = list_entry(jobs->next, struct kcopyd_job, list);
+		list_del(&job->list);
+	}
+	spin_unlock_irqrestore(&_job_lock, flags);
+
+	return job;
+}
+
+static inline void push(struct list_head *jobs, struct kcopyd_job *job)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&_job_lock, flags);
+	list_add_tail(&job->list, jobs);
+	spin_unlock_irqrestore(&_job_lock, flags);
+}
+
+static inline void push_head(struct list_head *jobs, struct kcopyd_job *job)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&_job_lock, flags);
+	list_add(&job->list, jobs);
+	spin_unlock_irqrestore(&_job_lock, flags);
+}
+
+/*
+ * Drops a reference on the io of the current phase; the last one
+ * moves the job on to writing, or to completion.
+ */
+static void dec_count(struct kcopyd_job *job)
+{
+	if (!atomic_dec_and_test(&job->io_count))
+		return;
+
+	if (job->rw == READ && !job->read_err) {
+		job->rw = WRITE;
+		push(&_io_jobs, job);
+	} else
+		push(&_complete_jobs, job);
+
+	wake();
+}
+
+static int endio(struct bio *bio, unsigned int done, int error)
+{
+	struct kcopyd_io *io = bio->bi_private;
+	struct kcopyd_job *job = io->job;
+
+	if (bio->bi_size)
+		return 1;
+
+	if (error || !test_bit(BIO_UPTODATE, &bio->bi_flags)) {
+		if (job->rw == READ)
+			job->read_err = 1;
+		else
+			set_bit(io->region, &job->write_err);
+	}
+
+	bio_put(bio);
+	dec_count(job);
+	return 0;
+}
+
+/*
+ * Issue the bios for one region, taking the data from the job's
+ * pages in order.
+ */
+static void dispatch_region(struct kcopyd_job *job, unsigned int region,
+			    struct io_region *where)
+{
+	struct list_head *p = job->pages.next;
+	sector_t sector = where->sector;
+	sector_t remaining = where->count;
+	struct bio *bio;
+	struct page *page;
+	unsigned int len;
+
+	while (remaining) {
+		bio = bio_alloc(GFP_NOIO, job->nr_pages);
+		bio->bi_sector = sector;
+		bio->bi_bdev = where->bdev;
+		bio->bi_end_io = endio;
+		bio->bi_private = job->io + region;
+
+		while (remaining) {
+			page = list_entry(p, struct page, lru);
+			len = PAGE_SIZE;
+			if (remaining < (PAGE_SIZE >> SECTOR_SHIFT))
+				len = remaining << SECTOR_SHIFT;
+
+			if (!bio_add_page(bio, page, len, 0))
+				break;
+
+			p = p->next;
+			sector += len >> SECTOR_SHIFT;
+			remaining -= len >> SECTOR_SHIFT;
+		}
+
+		if (!bio->bi_size) {
+			/* the queue won't even take a single page */
+			bio_put(bio);
+			if (job->rw == READ)
+				job->read_err = 1;
+			else
+				set_bit(region, &job->write_err);
+			return;
+		}
+
+		atomic_inc(&job->io_count);
+		submit_bio(job->rw, bio);
+	}
+}
+
+/*
+ * These three functions process 1 item from the corresponding
+ * job list.
+ *
+ * They return:
+ * < 0: error
+ *   0: success
+ * > 0: can't process yet.
+ */
+static int run_complete_job(struct kcopyd_job *job)
+{
+	int read_err = job->read_err;
+	unsigned int write_err = job->write_err;
+	kcopyd_notify_fn fn = job->fn;
+	void *context = job->context;
+
+	kcopyd_put_pages(job->kc, job->nr_pages, &job->pages);
+	mempool_free(job, _job_pool);
+	fn(read_err, write_err, context);
+	return 0;
+}
+
+static int run_io_job(struct kcopyd_job *job)
+{
+	unsigned int i;
+
+	atomic_set(&job->io_count, 1);
+	if (job->rw == READ)
+		dispatch_region(job, 0, &job->source);
+	else
+		for (i = 0; i < job->num_dests; i++)
+			dispatch_region(job, i, job->dests + i);
+	dec_count(job);
+
+	return 0;
+}
+
+static int run_pages_job(struct kcopyd_job *job)
+{
+	if (kcopyd_get_pages(job->kc, job->nr_pages, &job->pages))
+		return 1;
+
+	push(&_io_jobs, job);
+	return 0;
+}
+
+/*
+ * Run through a list for as long as we can.
+ */
+static void process_jobs(struct list_head *jobs, int (*fn) (struct kcopyd_job *))
+{
+	struct kcopyd_job *job;
+
+	while ((job = pop(jobs))) {
+		if (fn(job) > 0) {
+			/* the job couldn't proceed, put it back */
+			push_head(jobs, job);
+			break;
+		}
+	}
+}
+
+/*
+ * kcopyd does this every time it's woken up.  Completing jobs
+ * first frees pages for the ones that are waiting.
+ */
+static void do_work(void)
+{
+	process_jobs(&_complete_jobs, run_complete_job);
+	process_jobs(&_pages_jobs, run_pages_job);
+	process_jobs(&_io_jobs, run_io_job);
+	blk_run_queues();
+}
+
+/*-----------------------------------------------------------------
+ * The kcopyd thread.
+ *---------------------------------------------------------------*/
+#define KCOPYD_WAKEUP 0
+
+static DECLARE_WAIT_QUEUE_HEAD(_kcopyd_wait);
+static unsigned long _kcopyd_flags;
+static int _kcopyd_run;
+static struct completion _kcopyd_event;
+
+static void wake(void)
+{
+	set_bit(KCOPYD_WAKEUP, &_kcopyd_flags);
+	wake_up(&_kcopyd_wait);
+}
+
+static int kcopyd_thread(void *arg)
+{
+	lock_kernel();
+	daemonize("kcopyd");
+	unlock_kernel();
+
+	complete(&_kcopyd_event);
+	while (_kcopyd_run) {
+		wait_event_interruptible(_kcopyd_wait,
+					 test_bit(KCOPYD_WAKEUP, &_kcopyd_flags));
+		if (current->flags & PF_FREEZE)
+			refrigerator(PF_IOTHREAD);
+
+		clear_bit(KCOPYD_WAKEUP, &_kcopyd_flags);
+		do_work();
+
+		if (signal_pending(current))
+			flush_signals(current);
+	}
+
+	complete_and_exit(&_kcopyd_event, 0);
+}
+
+/*-----------------------------------------------------------------
+ * Copy interface
+ *---------------------------------------------------------------*/
+static void queue_job(struct kcopyd_job *job)
+{
+	push(&_pages_jobs, job);
+	wake();
+}
+
+static void init_job(struct kcopyd_job *job, struct kcopyd_client *kc,
+		     struct io_region *from, unsigned int num_dests,
+		     struct io_region *dests, kcopyd_notify_fn fn,
+		     void *context)
+{
+	unsigned int i;
+
+	memset(job, 0, sizeof(*job));
+	job->kc = kc;
+	job->rw = READ;
+	job->source = *from;
+	job->num_dests = num_dests;
+	for (i = 0; i < num_dests; i++)
+		job->dests[i] = dests[i];
+	for (i = 0; i < KCOPYD_MAX_REGIONS; i++) {
+		job->io[i].job = job;
+		job->io[i].region = i;
+	}
+	INIT_LIST_HEAD(&job->pages);
+	job->nr_pages = dm_div_up(from->count << SECTOR_SHIFT, PAGE_SIZE);
+	job->fn = fn;
+	job->context = context;
+}
+
+static void segment_complete(int read_err, unsigned int write_err,
+			     void *context)
+{
+	struct kcopyd_job *master = context;
+
+	/* sub jobs are only ever completed by the kcopyd thread */
+	if (read_err)
+		master->read_err = 1;
+	master->write_err |= write_err;
+
+	if (atomic_dec_and_test(&master->sub_jobs)) {
+		push(&_complete_jobs, master);
+		wake();
+	}
+}
+
+int kcopyd_copy(struct kcopyd_client *kc, struct io_region *from,
+		unsigned int num_dests, struct io_region *dests,
+		kcopyd_notify_fn fn, void *context)
+{
+	struct kcopyd_job *job, *sub;
+	struct io_region sub_from, sub_dests[KCOPYD_MAX_REGIONS];
+	sector_t offset, count;
+	unsigned int i;
+
+	if (!num_dests || num_dests > KCOPYD_MAX_REGIONS)
+		return -EINVAL;
+
+	job = mempool_alloc(_job_pool, GFP_NOIO);
+	init_job(job, kc, from, num_dests, dests, fn, context);
+
+	if (from->count <= SUB_JOB_SIZE) {
+		queue_job(job);
+		return 0;
+	}
+
+	/*
+	 * Too big for the page reserve of a single job: split it.
+	 * The master job carries no pages of its own and is put
+	 * on the complete list once the last sub job has finished.
+	 */
+	job->nr_pages = 0;
+	atomic_set(&job->sub_jobs, 1);
+	for (offset = 0; offset < from->count; offset += count) {
+		count = from->count - offset;
+		if (count > SUB_JOB_SIZE)
+			count = SUB_JOB_SIZE;
+
+		sub_from = *from;
+		sub_from.sector += offset;
+		sub_from.count = count;
+		for (i = 0; i < num_dests; i++) {
+			sub_dests[i] = dests[i];
+			sub_dests[i].sector += offset;
+			sub_dests[i].count = count;
+		}
+
+		sub = mempool_alloc(_job_pool, GFP_NOIO);
+		init_job(sub, kc, &sub_from, num_dests, sub_dests,
+			 segment_complete, job);
+		atomic_inc(&job->sub_jobs);
+		queue_job(sub);
+	}
+
+	if (atomic_dec_and_test(&job->sub_jobs)) {
+		push(&_complete_jobs, job);
+		wake();
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------
+ * Client setup
+ *---------------------------------------------------------------*/
+int kcopyd_client_create(unsigned int nr_pages, struct kcopyd_client **result)
+{
+	struct kcopyd_client *kc;
+
+	/* every job must be able to get the pages it needs */
+	if (nr_pages < SUB_JOB_PAGES)
+		nr_pages = SUB_JOB_PAGES;
+
+	kc = kmalloc(sizeof(*kc), GFP_KERNEL);
+	if (!kc)
+		return -ENOMEM;
+
+	kc->lock = SPIN_LOCK_UNLOCKED;
+	INIT_LIST_HEAD(&kc->pages);
+	kc->nr_pages = kc->nr_free_pages = 0;
+	if (client_alloc_pages(kc, nr_pages)) {
+		client_free_pages(kc);
+		kfree(kc);
+		return -ENOMEM;
+	}
+
+	*result = kc;
+	return 0;
+}
+
+/*
+ * The client must have no copies in flight.
+ */
+void kcopyd_client_destroy(struct kcopyd_client *kc)
+{
+	client_free_pages(kc);
+	kfree(kc);
+}
+
+int __init kcopyd_init(void)
+{
+	int r;
+
+	_job_cache = kmem_cache_create("kcopyd-jobs", sizeof(struct kcopyd_job),
+				       __alignof__(struct kcopyd_job),
+				       0, NULL, NULL);
+	if (!_job_cache)
+		return -ENOMEM;
+
+	_job_pool = mempool_create(MIN_JOBS, mempool_alloc_slab,
+				   mempool_free_slab, _job_cache);
+	if (!_job_pool) {
+		kmem_cache_destroy(_job_cache);
+		return -ENOMEM;
+	}
+
+	_kcopyd_run = 1;
+	init_completion(&_kcopyd_event);
+	r = kernel_thread(kcopyd_thread, NULL, 0);
+	if (r < 0) {
+		DMERR("couldn't start kcopyd thread");
+		mempool_destroy(_job_pool);
+		kmem_cache_destroy(_job_cache);
+		return r;
+	}
+	wait_for_completion(&_kcopyd_event);
+
+	return 0;
+}
+
+void kcopyd_exit(void)
+{
+	init_completion(&_kcopyd_event);
+	_kcopyd_run = 0;
+	wake();
+	wait_for_completion(&_kcopyd_event);
+
+	mempool_destroy(_job_pool);
+	kmem_cache_destroy(_job_cache);
+}
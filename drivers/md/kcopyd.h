@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2003 Sistina Software (UK) Limited.
+ *
+ * This file is released under the GPL.
+ */
+
+#ifndef DM_KCOPYD_H
+#define DM_KCOPYD_H
+
+#include "dm.h"
+
+/*
+ * kcopyd copies an area of one block device to one or more other
+ * areas, calling back once every destination has been written.
+ */
+#define KCOPYD_MAX_REGIONS 8
+
+struct io_region {
+	struct block_device *bdev;
+	sector_t sector;
+	sector_t count;
+};
+
+/*
+ * A client reserves the pages its copies will use when it is
+ * created, so that copies can make progress under memory pressure.
+ */
+struct kcopyd_client;
+int kcopyd_client_create(unsigned int num_pages, struct kcopyd_client **result);
+void kcopyd_client_destroy(struct kcopyd_client *kc);
+
+/*
+ * read_err is a boolean, write_err is a bitset with one bit for
+ * each destination region that failed.
+ */
+typedef void (*kcopyd_notify_fn)(int read_err, unsigned int write_err,
+				 void *context);
+
+/*
+ * The notify function is called from the kcopyd thread, so it may
+ * block, but it must not wait for other copies to complete.
+ */
+int kcopyd_copy(struct kcopyd_client *kc, struct io_region *from,
+		unsigned int num_dests, struct io_region *dests,
+		kcopyd_notify_fn fn, void *context);
+
+#endif
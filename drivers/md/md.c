@@ -224,26 +224,6 @@ static mddev_t * mddev_find(int unit)
 	goto retry;
 }
 
-static inline int mddev_lock(mddev_t * mddev)
-{
-	return down_interruptible(&mddev->reconfig_sem);
-}
-
-static inline void mddev_lock_uninterruptible(mddev_t * mddev)
-{
-	down(&mddev->reconfig_sem);
-}
-
-static inline int mddev_trylock(mddev_t * mddev)
-{
-	return down_trylock(&mddev->reconfig_sem);
-}
-
-static inline void mddev_unlock(mddev_t * mddev)
-{
-	up(&mddev->reconfig_sem);
-}
-
 mdk_rdev_t * find_rdev_nr(mddev_t *mddev, int nr)
 {
 	mdk_rdev_t * rdev;
@@ -320,7 +300,7 @@ static int bi_complete(struct bio *bio, unsigned int bytes_done, int error)
 	return 0;
 }
 
-static int sync_page_io(struct block_device *bdev, sector_t sector, int size,
+int sync_page_io(struct block_device *bdev, sector_t sector, int size,
 		   struct page *page, int rw)
 {
 	struct bio bio;
@@ -610,6 +590,7 @@ static int super_90_validate(mddev_t *mddev, mdk_rdev_t *rdev)
 		rdev->in_sync = rdev->faulty = 0;
 		desc = sb->disks + rdev->desc_nr;
 
+		rdev->write_mostly = (desc->state & (1<<MD_DISK_WRITEMOSTLY)) != 0;
 		if (desc->state & (1<<MD_DISK_FAULTY))
 			rdev->faulty = 1;
 		else if (desc->state & (1<<MD_DISK_SYNC) &&
@@ -712,6 +693,8 @@ static void super_90_sync(mddev_t *mddev, mdk_rdev_t *rdev)
 			spare++;
 			working++;
 		}
+		if (rdev2->write_mostly)
+			d->state |= (1<<MD_DISK_WRITEMOSTLY);
 		if (rdev2->desc_nr > highest)
 			highest = rdev2->desc_nr;
 	}
@@ -1018,7 +1001,12 @@ static int bind_rdev_to_array(mdk_rdev_t * rdev, mddev_t * mddev)
 			return -EBUSY;
 	}
 			
+	/* bitmap_flush() walks the list without the mddev lock */
+	if (mddev->bitmap)
+		down(&mddev->bitmap->flush_sem);
 	list_add(&rdev->same_set, &mddev->disks);
+	if (mddev->bitmap)
+		up(&mddev->bitmap->flush_sem);
 	rdev->mddev = mddev;
 	printk(KERN_INFO "md: bind<%s>\n", bdevname(rdev->bdev,b));
 	return 0;
@@ -1031,7 +1019,11 @@ static void unbind_rdev_from_array(mdk_rdev_t * rdev)
 		MD_BUG();
 		return;
 	}
+	if (rdev->mddev->bitmap)
+		down(&rdev->mddev->bitmap->flush_sem);
 	list_del_init(&rdev->same_set);
+	if (rdev->mddev->bitmap)
+		up(&rdev->mddev->bitmap->flush_sem);
 	printk(KERN_INFO "md: unbind<%s>\n", bdevname(rdev->bdev,b));
 	rdev->mddev = NULL;
 }
@@ -1288,6 +1280,7 @@ repeat:
 		printk(KERN_ERR \
 			"md: excessive errors occurred during superblock update, exiting\n");
 	}
+	bitmap_update_sb(mddev->bitmap);
 }
 
 /*
@@ -1434,7 +1427,8 @@ static int analyze_sbs(mddev_t * mddev)
 	}
 
 	if ((mddev->recovery_cp != MaxSector) && ((mddev->level == 1) ||
-			(mddev->level == 4) || (mddev->level == 5)))
+			(mddev->level == 4) || (mddev->level == 5) ||
+			(mddev->level == 6)))
 		printk(KERN_ERR "md: md%d: raid array is not clean"
 			" -- starting background reconstruction\n", 
 			mdidx(mddev));
@@ -1627,6 +1621,11 @@ static int do_md_run(mddev_t * mddev)
 	mddev->safemode_timer.data = (unsigned long) mddev;
 	mddev->safemode_delay = (20 * HZ)/1000 +1; /* 20 msec delay */
 	mddev->in_sync = 1;
+
+	if (bitmap_create(mddev))
+		printk(KERN_WARNING
+			"md: md%d: could not set up write-intent bitmap\n",
+			mdidx(mddev));
 	
 	set_bit(MD_RECOVERY_NEEDED, &mddev->recovery);
 	md_wakeup_thread(mddev->thread);
@@ -1718,6 +1717,8 @@ static int do_md_stop(mddev_t * mddev, int ro)
 			mddev->in_sync = 1;
 			md_update_sb(mddev);
 		}
+		if (!ro)
+			bitmap_destroy(mddev);
 		if (ro)
 			set_disk_ro(disk, 1);
 	}
@@ -1997,6 +1998,8 @@ static int get_disk_info(mddev_t * mddev, void * arg)
 			info.state |= (1<<MD_DISK_ACTIVE);
 			info.state |= (1<<MD_DISK_SYNC);
 		}
+		if (rdev->write_mostly)
+			info.state |= (1<<MD_DISK_WRITEMOSTLY);
 	} else {
 		info.major = info.minor = 0;
 		info.raid_disk = -1;
@@ -2068,6 +2071,8 @@ static int add_new_disk(mddev_t * mddev, mdu_disk_info_t *info)
 		}
 		rdev->in_sync = 0; /* just to be sure */
 		rdev->raid_disk = -1;
+		if (info->state & (1<<MD_DISK_WRITEMOSTLY))
+			rdev->write_mostly = 1;
 		err = bind_rdev_to_array(rdev, mddev);
 		if (err)
 			export_rdev(rdev);
@@ -2105,6 +2110,7 @@ static int add_new_disk(mddev_t * mddev, mdu_disk_info_t *info)
 			rdev->in_sync = (info->state & (1<<MD_DISK_SYNC));
 		else
 			rdev->in_sync = 0;
+		rdev->write_mostly = (info->state & (1<<MD_DISK_WRITEMOSTLY)) != 0;
 
 		err = bind_rdev_to_array(rdev, mddev);
 		if (err) {
@@ -2846,7 +2852,8 @@ static void status_resync(struct seq_file *seq, mddev_t * mddev)
 	 */
 	dt = ((jiffies - mddev->resync_mark) / HZ);
 	if (!dt) dt++;
-	db = resync - (mddev->resync_mark_cnt/2);
+	db = (mddev->curr_mark_cnt - atomic_read(&mddev->recovery_active))/2
+		- (mddev->resync_mark_cnt/2);
 	rt = (dt * ((max_blocks-resync) / (db/100+1)))/100;
 
 	seq_printf(seq, " finish=%lu.%lumin", rt / 60, (rt % 60)/6);
@@ -2956,6 +2963,8 @@ static int md_seq_show(struct seq_file *seq, void *v)
 			char b[BDEVNAME_SIZE];
 			seq_printf(seq, " %s[%d]",
 				bdevname(rdev->bdev,b), rdev->desc_nr);
+			if (rdev->write_mostly)
+				seq_printf(seq, "(W)");
 			if (rdev->faulty) {
 				seq_printf(seq, "(F)");
 				continue;
@@ -2974,6 +2983,7 @@ static int md_seq_show(struct seq_file *seq, void *v)
 
 		if (mddev->pers) {
 			mddev->pers->status (seq, mddev);
+			bitmap_status(seq, mddev->bitmap);
 	 		seq_printf(seq, "\n      ");
 			if (mddev->curr_resync > 2)
 				status_resync (seq, mddev);
@@ -3143,7 +3153,7 @@ static void md_do_sync(mddev_t *mddev)
 {
 	mddev_t *mddev2;
 	unsigned int max_sectors, currspeed = 0,
-		j, window;
+		j, window, io_sectors = 0;
 	unsigned long mark[SYNC_MARKS];
 	unsigned long mark_cnt[SYNC_MARKS];
 	int last_mark,m;
@@ -3207,11 +3217,12 @@ static void md_do_sync(mddev_t *mddev)
 		j = 0;
 	for (m = 0; m < SYNC_MARKS; m++) {
 		mark[m] = jiffies;
-		mark_cnt[m] = j;
+		mark_cnt[m] = 0;
 	}
 	last_mark = 0;
 	mddev->resync_mark = mark[last_mark];
 	mddev->resync_mark_cnt = mark_cnt[last_mark];
+	mddev->curr_mark_cnt = 0;
 
 	/*
 	 * Tune reconstruction:
@@ -3232,6 +3243,21 @@ static void md_do_sync(mddev_t *mddev)
 	while (j < max_sectors) {
 		int sectors;
 
+		/*
+		 * When resyncing, chunks which the write-intent bitmap
+		 * knows to be clean are skipped without any I/O; only
+		 * real I/O counts towards the speed limits.
+		 */
+		if (test_bit(MD_RECOVERY_SYNC, &mddev->recovery) &&
+		    !bitmap_start_sync(mddev->bitmap, j, &sectors)) {
+			j += sectors;
+			mddev->curr_resync = j;
+			if (test_bit(MD_RECOVERY_INTR, &mddev->recovery))
+				break;
+			cond_resched();
+			continue;
+		}
+
 		sectors = mddev->pers->sync_request(mddev, j, currspeed < sysctl_speed_limit_min);
 		if (sectors < 0) {
 			set_bit(MD_RECOVERY_ERR, &mddev->recovery);
@@ -3239,12 +3265,14 @@ static void md_do_sync(mddev_t *mddev)
 		}
 		atomic_add(sectors, &mddev->recovery_active);
 		j += sectors;
+		io_sectors += sectors;
+		mddev->curr_mark_cnt = io_sectors;
 		if (j>1) mddev->curr_resync = j;
 
-		if (last_check + window > j)
+		if (last_check + window > io_sectors)
 			continue;
 
-		last_check = j;
+		last_check = io_sectors;
 
 		if (test_bit(MD_RECOVERY_INTR, &mddev->recovery) ||
 		    test_bit(MD_RECOVERY_ERR, &mddev->recovery))
@@ -3260,7 +3288,7 @@ static void md_do_sync(mddev_t *mddev)
 			mddev->resync_mark = mark[next];
 			mddev->resync_mark_cnt = mark_cnt[next];
 			mark[next] = jiffies;
-			mark_cnt[next] = j - atomic_read(&mddev->recovery_active);
+			mark_cnt[next] = io_sectors - atomic_read(&mddev->recovery_active);
 			last_mark = next;
 		}
 
@@ -3286,7 +3314,7 @@ static void md_do_sync(mddev_t *mddev)
 		 */
 		cond_resched();
 
-		currspeed = (j-mddev->resync_mark_cnt)/2/((jiffies-mddev->resync_mark)/HZ +1) +1;
+		currspeed = (io_sectors-mddev->resync_mark_cnt)/2/((jiffies-mddev->resync_mark)/HZ +1) +1;
 
 		if (currspeed > sysctl_speed_limit_min) {
 			if ((currspeed > sysctl_speed_limit_max) ||
@@ -3360,6 +3388,9 @@ void md_check_recovery(mddev_t *mddev)
 
 	if (mddev->ro)
 		return;
+
+	bitmap_daemon_work(mddev->bitmap);
+
 	if ( ! (
 		mddev->sb_dirty ||
 		test_bit(MD_RECOVERY_NEEDED, &mddev->recovery) ||
@@ -3382,6 +3413,9 @@ void md_check_recovery(mddev_t *mddev)
 				/* success...*/
 				/* activate any spares */
 				mddev->pers->spare_active(mddev);
+				if (!test_bit(MD_RECOVERY_INTR, &mddev->recovery) &&
+				    mddev->recovery_cp == MaxSector)
+					bitmap_close_sync(mddev->bitmap);
 			}
 			md_update_sb(mddev);
 			mddev->recovery = 0;
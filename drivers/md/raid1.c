@@ -23,6 +23,7 @@
  */
 
 #include <linux/raid/raid1.h>
+#include <linux/moduleparam.h>
 
 #define MAJOR_NR MD_MAJOR
 #define MD_DRIVER
@@ -34,6 +35,15 @@
  */
 #define	NR_RAID1_BIOS 256
 
+/*
+ * Write-behind: how many writes per array may be completed to the
+ * submitter before they have reached the write-mostly mirrors.
+ * 0 disables write-behind, so writes wait for every mirror.
+ */
+static int max_write_behind;
+module_param(max_write_behind, int, 0);
+MODULE_PARM_DESC(max_write_behind, "outstanding writes to write-mostly mirrors per array (0 = off)");
+
 static mdk_personality_t raid1_personality;
 static spinlock_t retry_list_lock = SPIN_LOCK_UNLOCKED;
 static LIST_HEAD(retry_list_head);
@@ -149,6 +159,18 @@ static void put_all_bios(conf_t *conf, r1bio_t *r1_bio)
 	}
 }
 
+static void free_behind_pages(r1bio_t *r1_bio)
+{
+	int i;
+
+	for (i = 0; i < r1_bio->behind_page_count; i++)
+		if (r1_bio->behind_pages[i])
+			__free_page(r1_bio->behind_pages[i]);
+	kfree(r1_bio->behind_pages);
+	r1_bio->behind_pages = NULL;
+	r1_bio->behind_page_count = 0;
+}
+
 static inline void free_r1bio(r1bio_t *r1_bio)
 {
 	unsigned long flags;
@@ -166,6 +188,11 @@ static inline void free_r1bio(r1bio_t *r1_bio)
 	}
 	spin_unlock_irqrestore(&conf->resync_lock, flags);
 
+	if (r1_bio->behind_pages) {
+		free_behind_pages(r1_bio);
+		if (atomic_dec_and_test(&conf->behind_writes))
+			wake_up(&conf->wait_behind);
+	}
 	put_all_bios(conf, r1_bio);
 	mempool_free(r1_bio, conf->r1bio_pool);
 }
@@ -245,11 +272,39 @@ static void raid_end_bio_io(r1bio_t *r1_bio)
 {
 	struct bio *bio = r1_bio->master_bio;
 
-	bio_endio(bio, bio->bi_size,
-		test_bit(R1BIO_Uptodate, &r1_bio->state) ? 0 : -EIO);
+	/* in write-behind mode the master bio may be done already */
+	if (!test_and_set_bit(R1BIO_Returned, &r1_bio->state))
+		bio_endio(bio, bio->bi_size,
+			test_bit(R1BIO_Uptodate, &r1_bio->state) ? 0 : -EIO);
 	free_r1bio(r1_bio);
 }
 
+/*
+ * In write-behind mode, complete the master bio as soon as the only
+ * writes still outstanding are those to write-mostly mirrors.  The
+ * caller still holds its reference on ->remaining, which it is about
+ * to drop, so the r1bio cannot go away under us.
+ */
+static void return_behind_write(r1bio_t *r1_bio)
+{
+	struct bio *bio = r1_bio->master_bio;
+	int remaining;
+
+	if (!test_bit(R1BIO_BehindIO, &r1_bio->state) ||
+	    !test_bit(R1BIO_Uptodate, &r1_bio->state))
+		return;
+	/*
+	 * read ->remaining first: ->behind_remaining drops before
+	 * ->remaining does for the same write, so this cannot
+	 * overlook a write to a normal mirror.
+	 */
+	remaining = atomic_read(&r1_bio->remaining) - 1;
+	smp_rmb();
+	if (atomic_read(&r1_bio->behind_remaining) >= remaining &&
+	    !test_and_set_bit(R1BIO_Returned, &r1_bio->state))
+		bio_endio(bio, bio->bi_size, 0);
+}
+
 /*
  * Update disk head position estimator based on IRQ completion info.
  */
@@ -258,7 +313,7 @@ static inline void update_head_pos(int disk, r1bio_t *r1_bio)
 	conf_t *conf = mddev_to_conf(r1_bio->mddev);
 
 	conf->mirrors[disk].head_position =
-		r1_bio->sector + (r1_bio->master_bio->bi_size >> 9);
+		r1_bio->sector + r1_bio->sectors;
 }
 
 static int raid1_end_request(struct bio *bio, unsigned int bytes_done, int error)
@@ -281,9 +336,10 @@ static int raid1_end_request(struct bio *bio, unsigned int bytes_done, int error
 	/*
 	 * this branch is our 'one mirror IO has finished' event handler:
 	 */
-	if (!uptodate)
+	if (!uptodate) {
 		md_error(r1_bio->mddev, conf->mirrors[mirror].rdev);
-	else
+		set_bit(R1BIO_Degraded, &r1_bio->state);
+	} else
 		/*
 		 * Set R1BIO_Uptodate in our master bio, so that
 		 * we will return a good error code for to the higher
@@ -323,10 +379,17 @@ static int raid1_end_request(struct bio *bio, unsigned int bytes_done, int error
 		 * Let's see if all mirrored write operations have finished
 		 * already.
 		 */
+		if (test_bit(R1BIO_BehindIO, &r1_bio->state) &&
+		    conf->mirrors[mirror].rdev->write_mostly)
+			atomic_dec(&r1_bio->behind_remaining);
+		return_behind_write(r1_bio);
 		if (atomic_dec_and_test(&r1_bio->remaining)) {
+			bitmap_endwrite(r1_bio->mddev->bitmap, r1_bio->sector,
+					r1_bio->sectors,
+					!test_bit(R1BIO_Degraded, &r1_bio->state));
 			md_write_end(r1_bio->mddev);
 			raid_end_bio_io(r1_bio);
-		}	
+		}
 	}
 	atomic_dec(&conf->mirrors[mirror].rdev->nr_pending);
 	return 0;
@@ -334,12 +397,17 @@ static int raid1_end_request(struct bio *bio, unsigned int bytes_done, int error
 
 /*
  * This routine returns the disk from which the requested read should
- * be done. There is a per-array 'next expected sequential IO' sector
- * number - if this matches on the next IO then we use the last disk.
- * There is also a per-disk 'last know head position' sector that is
- * maintained from IRQ contexts, both the normal and the resync IO
- * completion handlers update this position correctly. If there is no
- * perfect sequential match then we pick the disk whose head is closest.
+ * be done. Every mirror remembers where the last read sent to it
+ * ended - if a read continues one of these streams it goes to the
+ * same mirror, so that several sequential readers each keep a disk
+ * of their own. There is also a per-disk 'last know head position'
+ * sector that is maintained from IRQ contexts, both the normal and
+ * the resync IO completion handlers update this position correctly.
+ * Other reads go to the mirror with the fewest requests in flight,
+ * and among those to the one whose head is closest.
+ *
+ * Write-mostly mirrors are only read from when no other mirror is
+ * available.
  *
  * If there are 2 mirrors in the same 2 devices, performance degrades
  * because position is mirror, not device based.
@@ -348,10 +416,11 @@ static int raid1_end_request(struct bio *bio, unsigned int bytes_done, int error
  */
 static int read_balance(conf_t *conf, struct bio *bio, r1bio_t *r1_bio)
 {
-	const unsigned long this_sector = r1_bio->sector;
-	int new_disk = conf->last_used, disk = new_disk;
+	const sector_t this_sector = r1_bio->sector;
 	const int sectors = bio->bi_size >> 9;
-	sector_t new_distance, current_distance;
+	int new_disk = -1, wm_disk = -1, disk, i;
+	int pending, best_pending = INT_MAX;
+	sector_t distance, best_distance = MaxSector;
 
 	spin_lock_irq(&conf->device_lock);
 	/*
@@ -360,70 +429,61 @@ static int read_balance(conf_t *conf, struct bio *bio, r1bio_t *r1_bio)
 	 * We take the first readable disk when above the resync window.
 	 */
 	if (!conf->mddev->in_sync && (this_sector + sectors >= conf->next_resync)) {
-		/* make sure that disk is operational */
-		new_disk = 0;
-
-		while (!conf->mirrors[new_disk].rdev ||
-		       !conf->mirrors[new_disk].rdev->in_sync) {
-			new_disk++;
-			if (new_disk == conf->raid_disks) {
-				new_disk = 0;
+		for (disk = 0; disk < conf->raid_disks; disk++) {
+			mdk_rdev_t *rdev = conf->mirrors[disk].rdev;
+
+			if (!rdev || !rdev->in_sync)
+				continue;
+			if (!rdev->write_mostly) {
+				new_disk = disk;
 				break;
 			}
+			if (wm_disk < 0)
+				wm_disk = disk;
 		}
 		goto rb_out;
 	}
 
+	for (i = 0; i < conf->raid_disks; i++) {
+		mirror_info_t *mirror;
 
-	/* make sure the disk is operational */
-	while (!conf->mirrors[new_disk].rdev ||
-	       !conf->mirrors[new_disk].rdev->in_sync) {
-		if (new_disk <= 0)
-			new_disk = conf->raid_disks;
-		new_disk--;
-		if (new_disk == disk) {
-			new_disk = conf->last_used;
-			goto rb_out;
-		}
-	}
-	disk = new_disk;
-	/* now disk == new_disk == starting point for search */
-
-	/*
-	 * Don't change to another disk for sequential reads:
-	 */
-	if (conf->next_seq_sect == this_sector)
-		goto rb_out;
-	if (this_sector == conf->mirrors[new_disk].head_position)
-		goto rb_out;
-
-	current_distance = abs(this_sector - conf->mirrors[disk].head_position);
-
-	/* Find the disk whose head is closest */
-
-	do {
-		if (disk <= 0)
-			disk = conf->raid_disks;
-		disk--;
-
-		if (!conf->mirrors[disk].rdev ||
-		    !conf->mirrors[disk].rdev->in_sync)
+		/* start just after the last disk used, to spread ties */
+		disk = (conf->last_used + 1 + i) % conf->raid_disks;
+		mirror = conf->mirrors + disk;
+		if (!mirror->rdev || !mirror->rdev->in_sync)
+			continue;
+		if (mirror->rdev->write_mostly) {
+			if (wm_disk < 0)
+				wm_disk = disk;
 			continue;
+		}
 
-		if (!atomic_read(&conf->mirrors[disk].rdev->nr_pending)) {
+		/* don't change to another disk for sequential reads */
+		if (mirror->next_seq_sect == this_sector) {
 			new_disk = disk;
 			break;
 		}
-		new_distance = abs(this_sector - conf->mirrors[disk].head_position);
-		if (new_distance < current_distance) {
-			current_distance = new_distance;
+
+		pending = atomic_read(&mirror->rdev->nr_pending);
+		if (this_sector > mirror->head_position)
+			distance = this_sector - mirror->head_position;
+		else
+			distance = mirror->head_position - this_sector;
+		if (pending < best_pending ||
+		    (pending == best_pending && distance < best_distance)) {
+			best_pending = pending;
+			best_distance = distance;
 			new_disk = disk;
 		}
-	} while (disk != conf->last_used);
+	}
 
 rb_out:
+	if (new_disk < 0)
+		new_disk = wm_disk;
+	if (new_disk < 0)
+		new_disk = conf->last_used;
 	r1_bio->read_disk = new_disk;
-	conf->next_seq_sect = this_sector + sectors;
+	conf->mirrors[new_disk].next_seq_sect = this_sector + sectors;
 
 	conf->last_used = new_disk;
 
@@ -455,6 +515,60 @@ static void device_barrier(conf_t *conf, sector_t sect)
 	spin_unlock_irq(&conf->resync_lock);
 }
 
+/*
+ * Take a private copy of the data of a write, for the write-mostly
+ * mirrors to use after the master bio has been completed.
+ */
+static int alloc_behind_pages(r1bio_t *r1_bio, struct bio *bio)
+{
+	struct bio_vec *bvec;
+	int i;
+
+	r1_bio->behind_pages = kmalloc(bio->bi_vcnt * sizeof(struct page *),
+				       GFP_NOIO);
+	if (!r1_bio->behind_pages)
+		return -ENOMEM;
+	memset(r1_bio->behind_pages, 0, bio->bi_vcnt * sizeof(struct page *));
+	r1_bio->behind_page_count = bio->bi_vcnt;
+
+	bio_for_each_segment(bvec, bio, i) {
+		struct page *page = alloc_page(GFP_NOIO);
+		char *src, *dst;
+
+		if (!page) {
+			free_behind_pages(r1_bio);
+			return -ENOMEM;
+		}
+		r1_bio->behind_pages[i] = page;
+		src = kmap(bvec->bv_page);
+		dst = kmap(page);
+		memcpy(dst + bvec->bv_offset, src + bvec->bv_offset,
+		       bvec->bv_len);
+		kunmap(page);
+		kunmap(bvec->bv_page);
+	}
+	return 0;
+}
+
+/*
+ * Build the bio for a write-mostly mirror out of the private copy.
+ */
+static struct bio *behind_bio(r1bio_t *r1_bio, struct bio *bio)
+{
+	struct bio *mbio = bio_alloc(GFP_NOIO, bio->bi_vcnt);
+	int i;
+
+	for (i = bio->bi_idx; i < bio->bi_vcnt; i++) {
+		mbio->bi_io_vec[i].bv_page = r1_bio->behind_pages[i];
+		mbio->bi_io_vec[i].bv_offset = bio->bi_io_vec[i].bv_offset;
+		mbio->bi_io_vec[i].bv_len = bio->bi_io_vec[i].bv_len;
+	}
+	mbio->bi_idx = bio->bi_idx;
+	mbio->bi_vcnt = bio->bi_vcnt;
+	mbio->bi_size = bio->bi_size;
+	return mbio;
+}
+
 static int make_request(request_queue_t *q, struct bio * bio)
 {
 	mddev_t *mddev = q->queuedata;
@@ -463,6 +577,7 @@ static int make_request(request_queue_t *q, struct bio * bio)
 	r1bio_t *r1_bio;
 	struct bio *read_bio;
 	int i, disks = conf->raid_disks;
+	int targets = 0, wm_targets = 0;
 
 	/*
 	 * Register the new request and wait if the reconstruction
@@ -485,7 +600,12 @@ static int make_request(request_queue_t *q, struct bio * bio)
 
 	r1_bio->mddev = mddev;
 	r1_bio->sector = bio->bi_sector;
+	r1_bio->sectors = bio->bi_size >> 9;
 	r1_bio->cmd = bio_data_dir(bio);
+	r1_bio->state = 0;
+	r1_bio->behind_pages = NULL;
+	r1_bio->behind_page_count = 0;
+	atomic_set(&r1_bio->behind_remaining, 0);
 
 	if (r1_bio->cmd == READ) {
 		/*
@@ -493,6 +613,16 @@ static int make_request(request_queue_t *q, struct bio * bio)
 		 */
 		mirror = conf->mirrors + read_balance(conf, bio, r1_bio);
 
+		/*
+		 * Reading from a write-mostly mirror only happens when
+		 * nothing else is left; make sure that no write-behind
+		 * data is still on its way there.
+		 */
+		if (mirror->rdev->write_mostly &&
+		    atomic_read(&conf->behind_writes))
+			wait_event(conf->wait_behind,
+				   !atomic_read(&conf->behind_writes));
+
 		read_bio = bio_clone(bio, GFP_NOIO);
 		if (r1_bio->read_bio)
 			BUG();
@@ -521,19 +651,43 @@ static int make_request(request_queue_t *q, struct bio * bio)
 		    !conf->mirrors[i].rdev->faulty) {
 			atomic_inc(&conf->mirrors[i].rdev->nr_pending);
 			r1_bio->write_bios[i] = bio;
-		} else
+			targets++;
+			if (conf->mirrors[i].rdev->write_mostly)
+				wm_targets++;
+		} else {
 			r1_bio->write_bios[i] = NULL;
+			set_bit(R1BIO_Degraded, &r1_bio->state);
+		}
 	}
 	spin_unlock_irq(&conf->device_lock);
 
+	/*
+	 * Write-behind: if at least one normal mirror gets this write,
+	 * the write-mostly ones are sent a private copy of the data
+	 * and the submitter need not wait for them.
+	 */
+	if (max_write_behind && wm_targets && wm_targets < targets &&
+	    atomic_read(&conf->behind_writes) < max_write_behind &&
+	    alloc_behind_pages(r1_bio, bio) == 0) {
+		set_bit(R1BIO_BehindIO, &r1_bio->state);
+		atomic_inc(&conf->behind_writes);
+	}
+
 	atomic_set(&r1_bio->remaining, 1);
 	md_write_start(mddev);
+	bitmap_startwrite(mddev->bitmap, r1_bio->sector, r1_bio->sectors);
 	for (i = 0; i < disks; i++) {
 		struct bio *mbio;
+		int behind;
 		if (!r1_bio->write_bios[i])
 			continue;
 
-		mbio = bio_clone(bio, GFP_NOIO);
+		behind = test_bit(R1BIO_BehindIO, &r1_bio->state) &&
+			conf->mirrors[i].rdev->write_mostly;
+		if (behind)
+			mbio = behind_bio(r1_bio, bio);
+		else
+			mbio = bio_clone(bio, GFP_NOIO);
 		r1_bio->write_bios[i] = mbio;
 
 		mbio->bi_sector	= r1_bio->sector + conf->mirrors[i].rdev->data_offset;
@@ -543,10 +697,15 @@ static int make_request(request_queue_t *q, struct bio * bio)
 		mbio->bi_private = r1_bio;
 
 		atomic_inc(&r1_bio->remaining);
+		if (behind)
+			atomic_inc(&r1_bio->behind_remaining);
 		generic_make_request(mbio);
 	}
 
+	return_behind_write(r1_bio);
 	if (atomic_dec_and_test(&r1_bio->remaining)) {
+		bitmap_endwrite(mddev->bitmap, r1_bio->sector, r1_bio->sectors,
+				!test_bit(R1BIO_Degraded, &r1_bio->state));
 		md_write_end(mddev);
 		raid_end_bio_io(r1_bio);
 	}
@@ -679,6 +838,7 @@ static int raid1_add_disk(mddev_t *mddev, mdk_rdev_t *rdev)
 		if ( !(p=conf->mirrors+mirror)->rdev) {
 			p->rdev = rdev;
 			p->head_position = 0;
+			p->next_seq_sect = 0;
 			rdev->raid_disk = mirror;
 			found = 1;
 			break;
@@ -995,6 +1155,7 @@ static int sync_request(mddev_t *mddev, sector_t sector_nr, int go_faster)
 	nr_sectors = RESYNC_BLOCK_SIZE >> 9;
 	if (max_sector - sector_nr < nr_sectors)
 		nr_sectors = max_sector - sector_nr;
+	r1_bio->sectors = nr_sectors;
 	bio->bi_size = nr_sectors << 9;
 	bio->bi_vcnt = (bio->bi_size + PAGE_SIZE-1) / PAGE_SIZE;
 	/*
@@ -1089,6 +1250,8 @@ static int run(mddev_t *mddev)
 	conf->resync_lock = SPIN_LOCK_UNLOCKED;
 	init_waitqueue_head(&conf->wait_idle);
 	init_waitqueue_head(&conf->wait_resume);
+	atomic_set(&conf->behind_writes, 0);
+	init_waitqueue_head(&conf->wait_behind);
 
 	if (!conf->working_disks) {
 		printk(KERN_ERR "raid1: no operational mirrors for md%d\n",
@@ -930,6 +930,8 @@ static void handle_stripe(struct stripe_head *sh)
 			while (bi && bi->bi_sector < sh->dev[i].sector + STRIPE_SECTORS){
 				struct bio *nextbi = bi->bi_next;
 				clear_bit(BIO_UPTODATE, &bi->bi_flags);
+				bitmap_endwrite(conf->mddev->bitmap, sh->sector,
+						STRIPE_SECTORS, 0);
 				if (--bi->bi_phys_segments == 0) {
 					md_write_end(conf->mddev);
 					bi->bi_next = return_bi;
@@ -943,6 +945,8 @@ static void handle_stripe(struct stripe_head *sh)
 			while (bi && bi->bi_sector < sh->dev[i].sector + STRIPE_SECTORS) {
 				struct bio *bi2 = bi->bi_next;
 				clear_bit(BIO_UPTODATE, &bi->bi_flags);
+				bitmap_endwrite(conf->mddev->bitmap, sh->sector,
+						STRIPE_SECTORS, 0);
 				if (--bi->bi_phys_segments == 0) {
 					md_write_end(conf->mddev);
 					bi->bi_next = return_bi;
@@ -1001,6 +1005,8 @@ static void handle_stripe(struct stripe_head *sh)
 			    dev->written = NULL;
 			    while (wbi && wbi->bi_sector < dev->sector + STRIPE_SECTORS) {
 				    wbi2 = wbi->bi_next;
+				    bitmap_endwrite(conf->mddev->bitmap, sh->sector,
+						    STRIPE_SECTORS, !failed);
 				    if (--wbi->bi_phys_segments == 0) {
 					    md_write_end(conf->mddev);
 					    wbi->bi_next = return_bi;
@@ -1328,6 +1334,9 @@ static int make_request (request_queue_t *q, struct bio * bi)
 
 		sh = get_active_stripe(conf, new_sector, pd_idx, (bi->bi_rw&RWA_MASK));
 		if (sh) {
+			if (bio_data_dir(bi) == WRITE)
+				bitmap_startwrite(mddev->bitmap, new_sector,
+						  STRIPE_SECTORS);
 
 			add_stripe_bio(sh, bi, dd_idx, (bi->bi_rw&RW_MASK));
 
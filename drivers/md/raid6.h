@@ -0,0 +1,69 @@
+/*
+ * raid6.h : Multiple Devices driver for Linux
+ *
+ * Definitions for the RAID-6 (P+Q dual parity) personality and its
+ * syndrome generation and recovery library.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * (for example /usr/src/linux/COPYING); if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _RAID6_H
+#define _RAID6_H
+
+#include <linux/config.h>
+#include <linux/kernel.h>
+#include <linux/stddef.h>
+#include <linux/types.h>
+#include <linux/raid/md.h>
+#include <linux/raid/raid5.h>
+
+/*
+ * RAID-6 reuses the RAID-5 stripe cache and configuration structures;
+ * the only difference is that every stripe carries a second syndrome
+ * (Q) in the disk following the P disk.
+ */
+typedef raid5_conf_t raid6_conf_t;
+
+/*
+ * The Galois field is GF(2^8) with generator {02} and the polynomial
+ * x^8 + x^4 + x^3 + x^2 + 1, so at most 255 data disks can be given
+ * distinct Q coefficients.
+ */
+#define RAID6_MAX_DISKS		257
+
+/* Routine choices */
+struct raid6_calls {
+	void (*gen_syndrome)(int, size_t, void **);
+	int  (*valid)(void);	/* Returns 1 if this routine set is usable */
+	const char *name;	/* Name of this routine set */
+};
+
+/* Selected algorithm */
+extern struct raid6_calls raid6_call;
+
+/* Algorithm list */
+extern const struct raid6_calls * const raid6_algos[];
+int raid6_select_algo(void);
+
+/* Galois field tables, generated at build time by mktables */
+extern const u8 raid6_gfmul[256][256] __attribute__((aligned(256)));
+extern const u8 raid6_gfexp[256]      __attribute__((aligned(256)));
+extern const u8 raid6_gfinv[256]      __attribute__((aligned(256)));
+extern const u8 raid6_gfexi[256]      __attribute__((aligned(256)));
+
+/* A page worth of zeroes, standing in for missing data blocks */
+extern const char raid6_empty_zero_page[PAGE_SIZE];
+
+/* Recovery routines */
+void raid6_2data_recov(int disks, size_t bytes, int faila, int failb,
+		       void **ptrs);
+void raid6_datap_recov(int disks, size_t bytes, int faila, void **ptrs);
+
+#endif
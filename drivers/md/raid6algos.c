@@ -0,0 +1,129 @@
+/*
+ * raid6algos.c
+ *
+ * Algorithm list and algorithm selection for RAID-6.  Like
+ * calibrate_xor_block() in xor.c, every usable syndrome routine is
+ * timed over a few jiffies at start-up and the fastest one is used.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+
+#include "raid6.h"
+
+struct raid6_calls raid6_call;
+
+/* A page of zeroes used in place of failed data blocks during recovery */
+const char raid6_empty_zero_page[PAGE_SIZE] __attribute__((aligned(256)));
+
+/* Various routine sets */
+extern const struct raid6_calls raid6_intx1;
+extern const struct raid6_calls raid6_intx2;
+extern const struct raid6_calls raid6_intx4;
+extern const struct raid6_calls raid6_intx8;
+extern const struct raid6_calls raid6_mmxx1;
+extern const struct raid6_calls raid6_mmxx2;
+extern const struct raid6_calls raid6_sse1x1;
+extern const struct raid6_calls raid6_sse1x2;
+extern const struct raid6_calls raid6_sse2x1;
+extern const struct raid6_calls raid6_sse2x2;
+
+const struct raid6_calls * const raid6_algos[] = {
+	&raid6_intx1,
+	&raid6_intx2,
+	&raid6_intx4,
+	&raid6_intx8,
+#if defined(__i386__)
+	&raid6_mmxx1,
+	&raid6_mmxx2,
+	&raid6_sse1x1,
+	&raid6_sse1x2,
+	&raid6_sse2x1,
+	&raid6_sse2x2,
+#endif
+	NULL
+};
+
+/* Benchmark geometry: 6 data disks plus P and Q, one page each */
+#define BENCH_DISKS	8
+#define BENCH_ORDER	3
+
+static int
+do_raid6_speed(const struct raid6_calls *algo, void **dptrs)
+{
+	int speed;
+	unsigned long now;
+	int i, count, max;
+
+	/*
+	 * Count the number of syndromes generated during a whole jiffy,
+	 * best of five, and use this to calculate the speed in kB of
+	 * data per second.
+	 */
+	max = 0;
+	for (i = 0; i < 5; i++) {
+		now = jiffies;
+		count = 0;
+		while (jiffies == now) {
+			mb();
+			algo->gen_syndrome(BENCH_DISKS, PAGE_SIZE, dptrs);
+			mb();
+			count++;
+			mb();
+		}
+		if (count > max)
+			max = count;
+	}
+
+	speed = max * (HZ * (BENCH_DISKS - 2) * PAGE_SIZE / 1024);
+
+	printk("   %-10s: %5d.%03d MB/sec\n", algo->name,
+	       speed / 1000, speed % 1000);
+	return speed;
+}
+
+int __init raid6_select_algo(void)
+{
+	const struct raid6_calls * const * algo;
+	const struct raid6_calls *best;
+	void *dptrs[BENCH_DISKS];
+	char *buf;
+	int i, j, speed, bestspeed;
+
+	buf = (char *) __get_free_pages(GFP_KERNEL, BENCH_ORDER);
+	if (!buf) {
+		printk("raid6: Yikes!  No memory available.\n");
+		return -ENOMEM;
+	}
+
+	/* Any data will do, as long as it isn't all zeroes */
+	for (i = 0; i < BENCH_DISKS; i++) {
+		dptrs[i] = buf + i * PAGE_SIZE;
+		for (j = 0; j < PAGE_SIZE; j++)
+			((u8 *)dptrs[i])[j] = (u8)(i * 37 + j * 7);
+	}
+
+	printk(KERN_INFO "raid6: measuring syndrome generation speed\n");
+
+	best = NULL;
+	bestspeed = 0;
+	for (algo = raid6_algos; *algo; algo++) {
+		if ((*algo)->valid && !(*algo)->valid())
+			continue;
+		speed = do_raid6_speed(*algo, dptrs);
+		if (!best || speed > bestspeed) {
+			best = *algo;
+			bestspeed = speed;
+		}
+	}
+
+	free_pages((unsigned long)buf, BENCH_ORDER);
+
+	raid6_call = *best;
+	printk("raid6: using function: %s (%d.%03d MB/sec)\n",
+	       best->name, bestspeed / 1000, bestspeed % 1000);
+
+	return 0;
+}
@@ -845,8 +845,10 @@ int __set_page_dirty_buffers(struct page *page)
 	if (!TestSetPageDirty(page)) {
 		spin_lock(&mapping->page_lock);
 		if (page->mapping) {	/* Race with truncate? */
-			if (!mapping->backing_dev_info->memory_backed)
+			if (!mapping->backing_dev_info->memory_backed) {
 				inc_page_state(nr_dirty);
+				atomic_inc(&mapping->backing_dev_info->nr_dirty);
+			}
 			list_del(&page->list);
 			list_add(&page->list, &mapping->dirty_pages);
 		}
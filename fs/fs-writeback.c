@@ -276,19 +276,19 @@ sync_sb_inodes(struct super_block *sb, struct writeback_control *wbc)
 			break;
 		}
 
-		if (wbc->nonblocking && bdi_write_congested(bdi)) {
-			wbc->encountered_congestion = 1;
+		if (wbc->bdi && bdi != wbc->bdi) {
 			if (sb != blockdev_superblock)
-				break;		/* Skip a congested fs */
+				break;		/* fs has the wrong queue */
 			list_move(&inode->i_list, &sb->s_dirty);
-			continue;		/* Skip a congested blockdev */
+			continue;		/* blockdev has wrong queue */
 		}
 
-		if (wbc->bdi && bdi != wbc->bdi) {
+		if (wbc->nonblocking && bdi_write_congested(bdi)) {
+			wbc->encountered_congestion = 1;
 			if (sb != blockdev_superblock)
-				break;		/* fs has the wrong queue */
+				break;		/* Skip a congested fs */
 			list_move(&inode->i_list, &sb->s_dirty);
-			continue;		/* blockdev has wrong queue */
+			continue;		/* Skip a congested blockdev */
 		}
 
 		/* Was this inode dirtied after sync_sb_inodes was called? */
@@ -362,6 +362,71 @@ writeback_inodes(struct writeback_control *wbc)
 	spin_unlock(&inode_lock);
 }
 
+static int add_dirty_bdi(struct backing_dev_info *bdi,
+			struct backing_dev_info **bdis, int nr, int max)
+{
+	int i;
+
+	if (bdi->memory_backed)
+		return nr;
+	for (i = 0; i < nr; i++) {
+		if (bdis[i] == bdi)
+			return nr;
+	}
+	if (nr < max)
+		bdis[nr++] = bdi;
+	return nr;
+}
+
+static int add_dirty_list_bdis(struct list_head *head,
+			struct backing_dev_info **bdis, int nr, int max)
+{
+	struct list_head *l;
+
+	list_for_each(l, head) {
+		struct inode *inode = list_entry(l, struct inode, i_list);
+
+		nr = add_dirty_bdi(inode->i_mapping->backing_dev_info,
+					bdis, nr, max);
+	}
+	return nr;
+}
+
+/*
+ * Find the backing devices which have dirty inodes against them, so that
+ * writeback can be started against each one separately.  At most `max' are
+ * returned; any others will be found on a later pass.
+ *
+ * As in sync_sb_inodes(), all the inodes of a superblock other than the
+ * blockdev one are assumed to share a queue.
+ */
+int writeback_dirty_bdis(struct backing_dev_info **bdis, int max)
+{
+	struct super_block *sb;
+	int nr = 0;
+
+	spin_lock(&inode_lock);
+	spin_lock(&sb_lock);
+	sb = sb_entry(super_blocks.prev);
+	for (; sb != sb_entry(&super_blocks); sb = sb_entry(sb->s_list.prev)) {
+		if (sb == blockdev_superblock) {
+			nr = add_dirty_list_bdis(&sb->s_io, bdis, nr, max);
+			nr = add_dirty_list_bdis(&sb->s_dirty, bdis, nr, max);
+		} else if (!list_empty(&sb->s_io)) {
+			nr = add_dirty_bdi(list_entry(sb->s_io.prev,
+					struct inode, i_list)->i_mapping->
+					backing_dev_info, bdis, nr, max);
+		} else if (!list_empty(&sb->s_dirty)) {
+			nr = add_dirty_bdi(list_entry(sb->s_dirty.prev,
+					struct inode, i_list)->i_mapping->
+					backing_dev_info, bdis, nr, max);
+		}
+	}
+	spin_unlock(&sb_lock);
+	spin_unlock(&inode_lock);
+	return nr;
+}
+
 /*
  * writeback and wait upon the filesystem's dirty inodes.  The caller will
  * do this in two passes - one to write, and one to wait.  WB_SYNC_HOLD is
@@ -142,6 +142,7 @@ static struct inode *alloc_inode(struct super_block *sb)
 		mapping->a_ops = &empty_aops;
  		mapping->host = inode;
 		mapping->gfp_mask = GFP_HIGHUSER;
+		mapping->flags = 0;
 		mapping->dirtied_when = 0;
 		mapping->assoc_mapping = NULL;
 		mapping->backing_dev_info = &default_backing_dev_info;
@@ -232,6 +233,7 @@ void clear_inode(struct inode *inode)
        
 	if (inode->i_data.nrpages)
 		BUG();
+	clear_shadow_entries(&inode->i_data, 0);
 	if (!(inode->i_state & I_FREEING))
 		BUG();
 	if (inode->i_state & I_CLEAR)
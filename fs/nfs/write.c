@@ -368,6 +368,7 @@ nfs_mark_request_dirty(struct nfs_page *req)
 	nfsi->ndirty++;
 	spin_unlock(&nfs_wreq_lock);
 	inc_page_state(nr_dirty);
+	atomic_inc(&inode->i_mapping->backing_dev_info->nr_dirty);
 	mark_inode_dirty(inode);
 }
 
@@ -464,6 +465,7 @@ nfs_scan_dirty(struct inode *inode, struct list_head *dst, struct file *file, un
 	res = nfs_scan_list(&nfsi->dirty, dst, file, idx_start, npages);
 	nfsi->ndirty -= res;
 	sub_page_state(nr_dirty,res);
+	atomic_sub(res, &inode->i_mapping->backing_dev_info->nr_dirty);
 	if ((nfsi->ndirty == 0) != list_empty(&nfsi->dirty))
 		printk(KERN_ERR "NFS: desynchronized value of nfs_i.ndirty.\n");
 	return res;
@@ -190,7 +190,10 @@ int do_truncate(struct dentry *dentry, loff_t length)
 	newattrs.ia_size = length;
 	newattrs.ia_valid = ATTR_SIZE | ATTR_CTIME;
 	down(&dentry->d_inode->i_sem);
-	err = notify_change(dentry, &newattrs);
+	if (IS_PINNED(dentry->d_inode))
+		err = -ETXTBSY;
+	else
+		err = notify_change(dentry, &newattrs);
 	up(&dentry->d_inode->i_sem);
 	return err;
 }
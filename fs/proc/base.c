@@ -32,6 +32,7 @@
 #include <linux/mount.h>
 #include <linux/security.h>
 #include <linux/ptrace.h>
+#include <linux/swap.h>
 
 /*
  * For hysterical raisins we keep the same inumbers as in the old procfs.
@@ -58,6 +59,8 @@ enum pid_directory_inos {
 	PROC_PID_MAPS,
 	PROC_PID_MOUNTS,
 	PROC_PID_WCHAN,
+	PROC_PID_OOM_SCORE,
+	PROC_PID_OOM_ADJUST,
 #ifdef CONFIG_SECURITY
 	PROC_PID_ATTR,
 	PROC_PID_ATTR_CURRENT,
@@ -89,6 +92,8 @@ static struct pid_entry base_stuff[] = {
   E(PROC_PID_ROOT,	"root",		S_IFLNK|S_IRWXUGO),
   E(PROC_PID_EXE,	"exe",		S_IFLNK|S_IRWXUGO),
   E(PROC_PID_MOUNTS,	"mounts",	S_IFREG|S_IRUGO),
+  E(PROC_PID_OOM_SCORE,	"oom_score",	S_IFREG|S_IRUGO),
+  E(PROC_PID_OOM_ADJUST,"oom_adj",	S_IFREG|S_IRUGO|S_IWUSR),
 #ifdef CONFIG_SECURITY
   E(PROC_PID_ATTR,	"attr",		S_IFDIR|S_IRUGO|S_IXUGO),
 #endif
@@ -288,6 +293,20 @@ static int proc_pid_wchan(struct task_struct *task, char *buffer)
 }
 #endif /* CONFIG_KALLSYMS */
 
+/*
+ * The score the OOM killer gives the task: the one with the highest is
+ * killed first.
+ */
+static int proc_oom_score(struct task_struct *task, char *buffer)
+{
+	unsigned long points;
+
+	read_lock(&tasklist_lock);
+	points = oom_badness(task);
+	read_unlock(&tasklist_lock);
+	return sprintf(buffer, "%lu\n", points);
+}
+
 /************************************************************************/
 /*                       Here the fs part begins                        */
 /************************************************************************/
@@ -1026,6 +1045,60 @@ static struct inode_operations proc_fd_inode_operations = {
 	.permission	= proc_permission,
 };
 
+static ssize_t oom_adjust_read(struct file *file, char *buf,
+				size_t count, loff_t *ppos)
+{
+	struct task_struct *task = proc_task(file->f_dentry->d_inode);
+	char buffer[8];
+	size_t len;
+	loff_t pos = *ppos;
+
+	len = sprintf(buffer, "%i\n", task->oomkilladj);
+	if (pos >= len)
+		return 0;
+	if (count > len - pos)
+		count = len - pos;
+	if (copy_to_user(buf, buffer + pos, count))
+		return -EFAULT;
+	*ppos = pos + count;
+	return count;
+}
+
+/*
+ * Anyone who may write the file can make the task a likelier victim, but
+ * making it a less likely one takes CAP_SYS_RESOURCE.
+ */
+static ssize_t oom_adjust_write(struct file *file, const char *buf,
+				size_t count, loff_t *ppos)
+{
+	struct task_struct *task = proc_task(file->f_dentry->d_inode);
+	char buffer[8], *end;
+	int oom_adjust;
+
+	memset(buffer, 0, sizeof(buffer));
+	if (count > sizeof(buffer) - 1)
+		count = sizeof(buffer) - 1;
+	if (copy_from_user(buffer, buf, count))
+		return -EFAULT;
+	oom_adjust = simple_strtol(buffer, &end, 0);
+	if (end == buffer)
+		return -EINVAL;
+	if ((oom_adjust < OOM_ADJUST_MIN || oom_adjust > OOM_ADJUST_MAX) &&
+	    oom_adjust != OOM_DISABLE)
+		return -EINVAL;
+	if (oom_adjust < task->oomkilladj && !capable(CAP_SYS_RESOURCE))
+		return -EACCES;
+	if (*end == '\n')
+		end++;
+	task->oomkilladj = oom_adjust;
+	return end - buffer;
+}
+
+static struct file_operations proc_oom_adjust_operations = {
+	.read		= oom_adjust_read,
+	.write		= oom_adjust_write,
+};
+
 #ifdef CONFIG_SECURITY
 static ssize_t proc_pid_attr_read(struct file * file, char * buf,
 				  size_t count, loff_t *ppos)
@@ -1206,6 +1279,13 @@ static struct dentry *proc_pident_lookup(struct inode *dir,
 			ei->op.proc_read = proc_pid_wchan;
 			break;
 #endif
+		case PROC_PID_OOM_SCORE:
+			inode->i_fop = &proc_info_file_operations;
+			ei->op.proc_read = proc_oom_score;
+			break;
+		case PROC_PID_OOM_ADJUST:
+			inode->i_fop = &proc_oom_adjust_operations;
+			break;
 		default:
 			printk("procfs: impossible type (%d)",p->type);
 			iput(inode);
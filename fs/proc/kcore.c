@@ -438,7 +438,7 @@ static ssize_t read_kcore(struct file *file, char *buffer, size_t buflen, loff_t
 				curstart = vmstart + vmsize;
 				cursize -= vmsize;
 				/* don't dump ioremap'd stuff! (TA) */
-				if (m->flags & VM_IOREMAP)
+				if (m->flags & (VM_IOREMAP | VM_LAZYFREE))
 					continue;
 				memcpy(elf_buf + (vmstart - start),
 					(char *)vmstart, vmsize);
@@ -121,7 +121,8 @@ static struct vmalloc_info get_vmalloc_info(void)
 	for (vma = vmlist; vma; vma = vma->next) {
 		unsigned long free_area_size =
 			(unsigned long)vma->addr - prev_end;
-		vmi.used += vma->size;
+		if (!(vma->flags & VM_LAZYFREE))
+			vmi.used += vma->size;
 		if (vmi.largest_chunk < free_area_size )
 
 			vmi.largest_chunk = free_area_size;
@@ -204,6 +205,7 @@ static int meminfo_read_proc(char *page, char **start, off_t off,
 		"Slab:         %8lu kB\n"
 		"Committed_AS: %8u kB\n"
 		"PageTables:   %8lu kB\n"
+		"PreZeroed:    %8lu kB\n"
 		"VmallocTotal: %8lu kB\n"
 		"VmallocUsed:  %8lu kB\n"
 		"VmallocChunk: %8lu kB\n",
@@ -226,12 +228,15 @@ static int meminfo_read_proc(char *page, char **start, off_t off,
 		K(ps.nr_slab),
 		K(committed),
 		K(ps.nr_page_table_pages),
+		K(nr_prezeroed_pages()),
 		vmtot,
 		vmi.used,
 		vmi.largest_chunk
 		);
 
 		len += hugetlb_report_meminfo(page + len);
+		len += swap_compress_report_meminfo(page + len);
+		len += merge_report_meminfo(page + len);
 
 	return proc_calc_metrics(page, start, off, count, eof, len);
 #undef K
@@ -251,6 +256,19 @@ static struct file_operations fragmentation_file_operations = {
 	.release	= seq_release,
 };
 
+extern struct seq_operations pagetypeinfo_op;
+static int pagetypeinfo_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &pagetypeinfo_op);
+}
+
+static struct file_operations pagetypeinfo_file_operations = {
+	.open		= pagetypeinfo_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= seq_release,
+};
+
 static int version_read_proc(char *page, char **start, off_t off,
 				 int count, int *eof, void *data)
 {
@@ -650,6 +668,7 @@ void __init proc_misc_init(void)
 #endif
 	create_seq_entry("slabinfo",S_IWUSR|S_IRUGO,&proc_slabinfo_operations);
 	create_seq_entry("buddyinfo",S_IRUGO, &fragmentation_file_operations);
+	create_seq_entry("pagetypeinfo", S_IRUGO, &pagetypeinfo_file_operations);
 	create_seq_entry("vmstat",S_IRUGO, &proc_vmstat_file_operations);
 	create_seq_entry("diskstats", 0, &proc_diskstats_operations);
 #ifdef CONFIG_MODULES
@@ -40,6 +40,8 @@
 #define MADV_WILLNEED	3		/* will need these pages */
 #define	MADV_SPACEAVAIL	5		/* ensure resources are available */
 #define MADV_DONTNEED	6		/* don't need these pages */
+#define MADV_MERGEABLE	12		/* may merge identical pages */
+#define MADV_UNMERGEABLE 13		/* undo MADV_MERGEABLE */
 
 /* compatibility flags */
 #define MAP_ANON	MAP_ANONYMOUS
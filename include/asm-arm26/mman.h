@@ -33,6 +33,8 @@
 #define MADV_SEQUENTIAL	0x2		/* read-ahead aggressively */
 #define MADV_WILLNEED	0x3		/* pre-fault pages */
 #define MADV_DONTNEED	0x4		/* discard these pages */
+#define MADV_MERGEABLE	0xc		/* may merge identical pages */
+#define MADV_UNMERGEABLE	0xd		/* undo MADV_MERGEABLE */
 
 /* compatibility flags */
 #define MAP_ANON	MAP_ANONYMOUS
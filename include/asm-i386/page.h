@@ -36,6 +36,14 @@
 #define clear_user_page(page, vaddr, pg)	clear_page(page)
 #define copy_user_page(to, from, vaddr, pg)	copy_page(to, from)
 
+#define __HAVE_ARCH_CLEAR_PAGE_NOCACHE
+extern void clear_page_nocache(void *page);
+
+/* No cache aliasing, so pages zeroed in advance can be mapped anywhere */
+#define __HAVE_ARCH_ALLOC_ZEROED_USER_HIGHPAGE
+#define alloc_zeroed_user_highpage(vma, vaddr) \
+	alloc_page_vma(GFP_HIGHUSER | __GFP_ZERO, vma, vaddr)
+
 /*
  * These are used to make use of C type-checking..
  */
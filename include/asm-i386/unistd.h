@@ -276,8 +276,13 @@
 #define __NR_statfs64		268
 #define __NR_fstatfs64		269
 #define __NR_tgkill		270
+#define __NR_mbind		271
+#define __NR_get_mempolicy	272
+#define __NR_set_mempolicy	273
+#define __NR_migrate_pages	274
+#define __NR_fincore		275
 
-#define NR_syscalls 271
+#define NR_syscalls 276
 
 /* user-visible error numbers are in the range -1 - -124: see <asm-i386/errno.h> */
 
@@ -46,6 +46,8 @@
 #define MADV_4M_PAGES   22              /* Use 4 Megabyte pages */
 #define MADV_16M_PAGES  24              /* Use 16 Megabyte pages */
 #define MADV_64M_PAGES  26              /* Use 64 Megabyte pages */
+#define MADV_MERGEABLE  65              /* may merge identical pages */
+#define MADV_UNMERGEABLE 66             /* undo MADV_MERGEABLE */
 
 /* compatibility flags */
 #define MAP_ANON	MAP_ANONYMOUS
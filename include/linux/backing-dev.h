@@ -24,6 +24,11 @@ struct backing_dev_info {
 	unsigned long ra_pages;	/* max readahead in PAGE_CACHE_SIZE units */
 	unsigned long state;	/* Always use atomic bitops on this */
 	int memory_backed;	/* Cannot clean pages with writepage */
+	atomic_t nr_dirty;	/* Dirty pages against this device */
+	atomic_t completions;	/* Recent writeback completions, decaying */
+	unsigned long period;	/* Writeback period `completions' is for */
+	atomic_t ra_hits;	/* Readahead markers reached */
+	atomic_t ra_misses;	/* Reads which readahead did not foresee */
 };
 
 extern struct backing_dev_info default_backing_dev_info;
@@ -31,6 +36,7 @@ extern struct backing_dev_info default_backing_dev_info;
 int writeback_acquire(struct backing_dev_info *bdi);
 int writeback_in_progress(struct backing_dev_info *bdi);
 void writeback_release(struct backing_dev_info *bdi);
+void bdi_writeout_inc(struct backing_dev_info *bdi);
 
 static inline int bdi_read_congested(struct backing_dev_info *bdi)
 {
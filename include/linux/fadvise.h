@@ -8,4 +8,8 @@
 #define POSIX_FADV_DONTNEED	4 /* Don't need these pages.  */
 #define POSIX_FADV_NOREUSE	5 /* Data will be accessed once.  */
 
+/* Linux specific */
+#define FADV_KEEP		8 /* Keep the file's pages resident.  */
+#define FADV_NOKEEP		9 /* Undo FADV_KEEP.  */
+
 #endif	/* FADVISE_H_INCLUDED */
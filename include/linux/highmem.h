@@ -49,6 +49,35 @@ static inline void clear_highpage(struct page *page)
 	kunmap_atomic(kaddr, KM_USER0);
 }
 
+#ifndef __HAVE_ARCH_CLEAR_PAGE_NOCACHE
+#define clear_page_nocache(page)	clear_page(page)
+#endif
+
+/* For pages cleared in advance, which needn't be in the cache */
+static inline void clear_highpage_nocache(struct page *page)
+{
+	void *kaddr = kmap_atomic(page, KM_USER0);
+	clear_page_nocache(kaddr);
+	kunmap_atomic(kaddr, KM_USER0);
+}
+
+#ifndef __HAVE_ARCH_ALLOC_ZEROED_USER_HIGHPAGE
+/*
+ * A zeroed page for user space at vaddr.  Architectures without cache
+ * aliasing can use a page zeroed in advance (__GFP_ZERO); the others
+ * have to clear it through a mapping of the right colour.
+ */
+static inline struct page *
+alloc_zeroed_user_highpage(struct vm_area_struct *vma, unsigned long vaddr)
+{
+	struct page *page = alloc_page_vma(GFP_HIGHUSER, vma, vaddr);
+
+	if (page)
+		clear_user_highpage(page, vaddr);
+	return page;
+}
+#endif
+
 /*
  * Same but also flushes aliased cache contents to RAM.
  */
@@ -41,6 +41,43 @@ mark_mm_hugetlb(struct mm_struct *mm, struct vm_area_struct *vma)
 #define is_hugepage_only_range(addr, len)	0
 #endif
 
+#ifdef CONFIG_ANON_HUGEPAGES
+struct mmu_gather;
+
+extern int sysctl_anon_hugepages;
+
+int anon_hugepage_fault(struct mm_struct *, struct vm_area_struct *,
+			unsigned long, pmd_t *, int);
+void zap_anon_hugepage(struct mmu_gather *, pmd_t *);
+void change_anon_hugepage(pmd_t *, pgprot_t);
+void anon_hugepage_write_fault(struct vm_area_struct *, unsigned long, pmd_t *);
+int split_anon_hugepage(struct vm_area_struct *, unsigned long);
+int split_anon_hugepages(struct vm_area_struct *, unsigned long, unsigned long);
+
+/*
+ * Split the huge pages which [start, end) covers only part of.
+ */
+static inline int split_anon_hugepage_edges(struct vm_area_struct *vma,
+				unsigned long start, unsigned long end)
+{
+	int err = 0;
+
+	if (start & ~HPAGE_MASK)
+		err = split_anon_hugepage(vma, start);
+	if (!err && (end & ~HPAGE_MASK))
+		err = split_anon_hugepage(vma, end);
+	return err;
+}
+#else
+#define anon_hugepage_fault(mm, vma, addr, pmd, write)	0
+#define zap_anon_hugepage(tlb, pmd)			BUG()
+#define change_anon_hugepage(pmd, newprot)		BUG()
+#define anon_hugepage_write_fault(vma, addr, pmd)	do { } while (0)
+#define split_anon_hugepage(vma, addr)			0
+#define split_anon_hugepages(vma, start, end)		0
+#define split_anon_hugepage_edges(vma, start, end)	0
+#endif
+
 #else /* !CONFIG_HUGETLB_PAGE */
 
 static inline int is_vm_hugetlb_page(struct vm_area_struct *vma)
@@ -63,6 +100,13 @@ static inline int is_vm_hugetlb_page(struct vm_area_struct *vma)
 #define is_aligned_hugepage_range(addr, len)	0
 #define pmd_huge(x)	0
 #define is_hugepage_only_range(addr, len)	0
+#define anon_hugepage_fault(mm, vma, addr, pmd, write)	0
+#define zap_anon_hugepage(tlb, pmd)			BUG()
+#define change_anon_hugepage(pmd, newprot)		BUG()
+#define anon_hugepage_write_fault(vma, addr, pmd)	do { } while (0)
+#define split_anon_hugepage(vma, addr)			0
+#define split_anon_hugepages(vma, start, end)		0
+#define split_anon_hugepage_edges(vma, start, end)	0
 
 #ifndef HPAGE_MASK
 #define HPAGE_MASK	0		/* Keep the compiler happy */
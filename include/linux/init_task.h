@@ -40,6 +40,7 @@
 	.mmap_sem	= __RWSEM_INITIALIZER(name.mmap_sem),	\
 	.page_table_lock =  SPIN_LOCK_UNLOCKED, 		\
 	.mmlist		= LIST_HEAD_INIT(name.mmlist),		\
+	.merge_list	= LIST_HEAD_INIT(name.merge_list),	\
 	.default_kioctx = INIT_KIOCTX(name.default_kioctx, name),	\
 }
 
@@ -26,6 +26,7 @@ enum {
 };
 
 struct loop_func_table;
+struct loop_extent;
 
 struct loop_device {
 	int		lo_number;
@@ -53,6 +54,17 @@ struct loop_device {
 
 	int		old_gfp_mask;
 
+	/*
+	 * Where the backing file sits on its filesystem's device, when
+	 * it could be mapped; io then bypasses the backing page cache.
+	 * The file is pinned (S_PINNED) for as long as lo_extents is set.
+	 */
+	struct block_device	*lo_extent_bdev;
+	struct loop_extent	*lo_extents;
+	int			lo_nr_extents;
+	sector_t		lo_extent_sects;
+	int			lo_extent_written;	/* mtime is stale */
+
 	spinlock_t		lo_lock;
 	struct bio 		*lo_bio;
 	struct bio		*lo_biotail;
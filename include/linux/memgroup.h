@@ -0,0 +1,126 @@
+#ifndef _LINUX_MEMGROUP_H
+#define _LINUX_MEMGROUP_H
+
+/*
+ * Memory resource groups: the tasks in a group share a limit on the
+ * pages, anonymous and page cache, which they bring onto the LRU.
+ * See mm/memgroup.c.
+ */
+
+#include <linux/config.h>
+#include <linux/errno.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+
+#define MEMGROUP_MAX	16	/* groups are numbered 1 to MEMGROUP_MAX */
+
+#ifdef CONFIG_MEMGROUP
+
+struct mem_group {
+	spinlock_t lru_lock;		/* protects lru and usage */
+	struct list_head lru;		/* charged pages, oldest first */
+	unsigned long usage;		/* pages charged */
+	unsigned long failcnt;		/* charges which went over the limit */
+	unsigned long reclaimed;	/* pages reclaimed for the limit */
+};
+
+extern struct mem_group mem_groups[MEMGROUP_MAX];
+extern unsigned long sysctl_memgroup_limit[MEMGROUP_MAX];
+
+static inline int memgroup_id(struct mem_group *grp)
+{
+	return grp - mem_groups + 1;
+}
+
+/* The limit in pages, zero for none */
+static inline unsigned long memgroup_limit(struct mem_group *grp)
+{
+	return sysctl_memgroup_limit[grp - mem_groups] >> (PAGE_SHIFT - 10);
+}
+
+static inline int memgroup_over_limit(struct mem_group *grp)
+{
+	unsigned long limit = memgroup_limit(grp);
+
+	return limit && grp->usage > limit;
+}
+
+static inline int memgroup_mm_over_limit(struct mm_struct *mm)
+{
+	return mm->mem_group && memgroup_over_limit(mm->mem_group);
+}
+
+extern void __memgroup_charge(struct page *page, struct mem_group *grp);
+extern void __memgroup_uncharge(struct page *page);
+extern void __memgroup_enforce(struct mem_group *grp, unsigned int gfp_mask);
+extern int memgroup_oldest(struct mem_group *grp, struct page **pages, int nr);
+extern int memgroup_get(void);
+extern int memgroup_set(int id);
+
+/* mm/vmscan.c */
+extern int shrink_mem_group(struct mem_group *grp, unsigned int gfp_mask,
+				int nr_pages);
+extern int shrink_mem_groups(unsigned int gfp_mask);
+
+/*
+ * Charge a page which is going onto the LRU to the group of the
+ * current task.
+ */
+static inline void memgroup_charge(struct page *page)
+{
+	struct mm_struct *mm = current->mm;
+
+	if (mm && mm->mem_group && !page->mem_group)
+		__memgroup_charge(page, mm->mem_group);
+}
+
+/* A page replacing `old' stays charged to the same group */
+static inline void memgroup_inherit(struct page *page, struct page *old)
+{
+	if (old->mem_group && !page->mem_group)
+		__memgroup_charge(page, old->mem_group);
+}
+
+static inline void memgroup_uncharge(struct page *page)
+{
+	if (page->mem_group)
+		__memgroup_uncharge(page);
+}
+
+/*
+ * Called by the page allocator: a task whose group is over its limit
+ * reclaims from the group before it gets more memory.
+ */
+static inline void memgroup_enforce(unsigned int gfp_mask)
+{
+	struct mm_struct *mm;
+
+	if (!(gfp_mask & __GFP_WAIT))
+		return;
+	mm = current->mm;
+	if (mm && memgroup_mm_over_limit(mm))
+		__memgroup_enforce(mm->mem_group, gfp_mask);
+}
+
+#else /* !CONFIG_MEMGROUP */
+
+#define memgroup_mm_over_limit(mm)	0
+#define memgroup_charge(page)		do { } while (0)
+#define memgroup_inherit(page, old)	do { } while (0)
+#define memgroup_uncharge(page)		do { } while (0)
+#define memgroup_enforce(gfp_mask)	do { } while (0)
+#define shrink_mem_groups(gfp_mask)	0
+
+static inline int memgroup_get(void)
+{
+	return -EINVAL;
+}
+
+static inline int memgroup_set(int id)
+{
+	return -EINVAL;
+}
+
+#endif /* CONFIG_MEMGROUP */
+
+#endif /* _LINUX_MEMGROUP_H */
@@ -0,0 +1,90 @@
+#ifndef _LINUX_MEMPOLICY_H
+#define _LINUX_MEMPOLICY_H 1
+
+/*
+ * NUMA memory policies: which nodes the memory of a task, or of a range
+ * of its address space, is allocated from.  See mm/mempolicy.c.
+ */
+
+/* Policies */
+#define MPOL_DEFAULT	0	/* Local node, falling back to the nearest */
+#define MPOL_PREFERRED	1	/* One node, falling back to the nearest */
+#define MPOL_BIND	2	/* Only the given nodes */
+#define MPOL_INTERLEAVE	3	/* Round robin over the given nodes */
+
+#define MPOL_MAX MPOL_INTERLEAVE
+
+/* Flags for get_mempolicy */
+#define MPOL_F_NODE	(1<<0)	/* return a node rather than the policy */
+#define MPOL_F_ADDR	(1<<1)	/* look up the vma policy at addr */
+
+/* Flags for mbind */
+#define MPOL_MF_STRICT	(1<<0)	/* fail if pages already in the range don't fit */
+#define MPOL_MF_MOVE	(1<<1)	/* move the pages which don't fit */
+
+#ifdef __KERNEL__
+
+#include <linux/config.h>
+#include <linux/types.h>
+#include <linux/mmzone.h>
+#include <asm/atomic.h>
+
+struct vm_area_struct;
+
+#ifdef CONFIG_NUMA
+
+/*
+ * A policy is never changed once set up, only replaced, so tasks and
+ * vmas simply share one by reference.  A NULL policy is MPOL_DEFAULT.
+ */
+struct mempolicy {
+	atomic_t refcnt;
+	short policy;
+	short preferred_node;			/* MPOL_PREFERRED, -1 is local */
+	DECLARE_BITMAP(nodes, MAX_NUMNODES);	/* MPOL_BIND, MPOL_INTERLEAVE */
+	struct zonelist *zonelists;		/* MPOL_BIND, per GFP zone */
+};
+
+extern void __mpol_free(struct mempolicy *pol);
+
+static inline void mpol_free(struct mempolicy *pol)
+{
+	if (pol)
+		__mpol_free(pol);
+}
+
+static inline void mpol_get(struct mempolicy *pol)
+{
+	if (pol)
+		atomic_inc(&pol->refcnt);
+}
+
+extern int __mpol_equal(struct mempolicy *a, struct mempolicy *b);
+
+static inline int mpol_equal(struct mempolicy *a, struct mempolicy *b)
+{
+	if (a == b)
+		return 1;
+	return __mpol_equal(a, b);
+}
+
+#define vma_policy(vma)		((vma)->vm_policy)
+#define vma_set_policy(vma, pol) ((vma)->vm_policy = (pol))
+
+extern struct page *alloc_page_policy(unsigned int gfp_mask,
+				struct mempolicy *pol, unsigned long ilx);
+
+#else /* !CONFIG_NUMA */
+
+struct mempolicy {};
+
+#define mpol_free(pol)		do { } while (0)
+#define mpol_get(pol)		do { } while (0)
+#define mpol_equal(a, b)	1
+#define vma_policy(vma)		NULL
+#define vma_set_policy(vma, pol) do { } while (0)
+
+#endif /* CONFIG_NUMA */
+#endif /* __KERNEL__ */
+
+#endif /* _LINUX_MEMPOLICY_H */
@@ -25,8 +25,25 @@
 #define MAX_ORDER CONFIG_FORCE_MAX_ZONEORDER
 #endif
 
+/*
+ * Free pages are kept on separate lists according to how easily the
+ * memory allocated from them can be got back, so that the pages which
+ * stay allocated for good do not end up scattered over every block of
+ * the zone.  See __rmqueue().
+ */
+#define MIGRATE_UNMOVABLE	0	/* Kernel memory */
+#define MIGRATE_RECLAIMABLE	1	/* Slab caches the VM can shrink */
+#define MIGRATE_MOVABLE		2	/* User and pagecache pages */
+#define MIGRATE_TYPES		3
+
+/*
+ * Each MAX_ORDER-1 sized block of a zone belongs to one of the types,
+ * and its free pages go onto that type's lists.
+ */
+#define PAGEBLOCK_ORDER		(MAX_ORDER - 1)
+
 struct free_area {
-	struct list_head	free_list;
+	struct list_head	free_list[MIGRATE_TYPES];
 	unsigned long		*map;
 };
 
@@ -52,7 +69,7 @@ struct per_cpu_pages {
 	int low;		/* low watermark, refill needed */
 	int high;		/* high watermark, emptying needed */
 	int batch;		/* chunk size for buddy add/remove */
-	struct list_head list;	/* the list of pages */
+	struct list_head list[MIGRATE_TYPES];	/* the lists of pages */
 };
 
 struct per_cpu_pageset {
@@ -86,6 +103,7 @@ struct zone {
 	unsigned long		nr_inactive;
 	int			all_unreclaimable; /* All pages pinned */
 	unsigned long		pages_scanned;	   /* since last reclaim */
+	atomic_t		inactive_age;	   /* evictions + activations */
 
 	ZONE_PADDING(_pad2_)
 
@@ -93,6 +111,23 @@ struct zone {
 	 * free areas of different sizes
 	 */
 	struct free_area	free_area[MAX_ORDER];
+	unsigned char		*pageblock_type;	/* MIGRATE_ type per block */
+
+	/*
+	 * Free pages kzerod has cleared for __GFP_ZERO allocations.  They
+	 * are included in free_pages, and protected by lock.
+	 */
+	struct list_head	zero_list;
+	unsigned long		nr_zero;
+
+	/*
+	 * Compaction: where the next scan starts, and how many of the
+	 * allocator's attempts are skipped after one that didn't help.
+	 * Unlocked hints.
+	 */
+	unsigned long		compact_cursor;
+	unsigned int		compact_considered;
+	unsigned int		compact_defer_shift;
 
 	/*
 	 * wait_table		-- the array holding the hash table
@@ -270,6 +305,9 @@ struct ctl_table;
 struct file;
 int min_free_kbytes_sysctl_handler(struct ctl_table *, int, struct file *, 
 					  void *, size_t *);
+extern int sysctl_compact_memory;
+int compact_memory_sysctl_handler(struct ctl_table *, int, struct file *,
+					  void *, size_t *);
 extern void setup_per_zone_pages_min(void);
 
 
@@ -75,6 +75,7 @@
 #define PG_mappedtodisk		17	/* Has blocks allocated on-disk */
 #define PG_reclaim		18	/* To be reclaimed asap */
 #define PG_compound		19	/* Part of a compound page */
+#define PG_readahead		20	/* Readahead marker, see readahead.c */
 
 
 /*
@@ -116,6 +117,23 @@ struct page_state {
 	unsigned long pageoutrun;	/* kswapd's calls to page reclaim */
 	unsigned long allocstall;	/* direct reclaim calls */
 	unsigned long pgrotated;	/* pages rotated to tail of the LRU */
+	unsigned long pgfallback;	/* allocs from another type's lists */
+	unsigned long pgmigrate;	/* pages moved by compaction */
+	unsigned long compactstall;	/* direct compaction calls */
+	unsigned long compactsuccess;	/* ... which made room */
+	unsigned long pgzstore;		/* swapouts kept compressed */
+	unsigned long pgzreject;	/* swapouts which went to disk */
+	unsigned long pgzload;		/* swapins from compressed cache */
+	unsigned long pgzevict;		/* pushed out to the swap device */
+	unsigned long pgmergescan;	/* pages scanned by kmerged */
+	unsigned long pgmerged;		/* pages replaced by a merged one */
+	unsigned long mergepass;	/* full kmerged passes */
+	unsigned long pgzerohit;	/* __GFP_ZERO allocs given a zeroed page */
+	unsigned long pgzeromiss;	/* ... which had to clear one */
+	unsigned long pgprezeroed;	/* pages cleared by kzerod */
+	unsigned long kmapflush;	/* pkmap TLB flushes */
+	unsigned long pgrefault;	/* evicted page cache pages read back */
+	unsigned long pgprotected;	/* ... which went to the active list */
 } ____cacheline_aligned;
 
 DECLARE_PER_CPU(struct page_state, page_states);
@@ -263,6 +281,10 @@ extern void get_full_page_state(struct page_state *ret);
 #define ClearPageReclaim(page)	clear_bit(PG_reclaim, &(page)->flags)
 #define TestClearPageReclaim(page) test_and_clear_bit(PG_reclaim, &(page)->flags)
 
+#define PageReadahead(page)	test_bit(PG_readahead, &(page)->flags)
+#define SetPageReadahead(page)	set_bit(PG_readahead, &(page)->flags)
+#define TestClearPageReadahead(page) test_and_clear_bit(PG_readahead, &(page)->flags)
+
 #define PageCompound(page)	test_bit(PG_compound, &(page)->flags)
 #define SetPageCompound(page)	set_bit(PG_compound, &(page)->flags)
 #define ClearPageCompound(page)	clear_bit(PG_compound, &(page)->flags)
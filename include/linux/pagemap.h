@@ -23,6 +23,16 @@
 #define PAGE_CACHE_MASK		PAGE_MASK
 #define PAGE_CACHE_ALIGN(addr)	(((addr)+PAGE_CACHE_SIZE-1)&PAGE_CACHE_MASK)
 
+/*
+ * Bits in mapping->flags.
+ */
+#define AS_KEEP		0	/* reclaim should leave the pages alone */
+
+static inline int mapping_keep(struct address_space *mapping)
+{
+	return test_bit(AS_KEEP, &mapping->flags);
+}
+
 #define page_cache_get(page)		get_page(page)
 #define page_cache_release(page)	put_page(page)
 void release_pages(struct page **pages, int nr, int cold);
@@ -73,6 +83,7 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 				unsigned long index, int gfp_mask);
 extern void remove_from_page_cache(struct page *page);
 extern void __remove_from_page_cache(struct page *page);
+extern void __remove_from_page_cache_shadow(struct page *page, void *shadow);
 
 extern atomic_t nr_pagecache;
 
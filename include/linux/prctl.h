@@ -34,4 +34,8 @@
 # define PR_FP_EXC_ASYNC	2	/* async recoverable exception mode */
 # define PR_FP_EXC_PRECISE	3	/* precise exception mode */
 
+/* Get/set the memory resource group of the address space */
+#define PR_GET_MEMGROUP	13
+#define PR_SET_MEMGROUP	14
+
 #endif /* _LINUX_PRCTL_H */
@@ -34,6 +34,18 @@ struct radix_tree_root {
 #define RADIX_TREE(name, mask) \
 	struct radix_tree_root name = RADIX_TREE_INIT(mask)
 
+/*
+ * An item with the low bit set is not a pointer but a value the user keeps
+ * in the tree, like the shadow entries of the page cache.  They are skipped
+ * by radix_tree_gang_lookup().
+ */
+#define RADIX_TREE_EXCEPTIONAL_ENTRY	1
+
+static inline int radix_tree_exceptional_entry(void *item)
+{
+	return (unsigned long)item & RADIX_TREE_EXCEPTIONAL_ENTRY;
+}
+
 #define INIT_RADIX_TREE(root, mask)	\
 do {					\
 	(root)->height = 0;		\
@@ -43,10 +55,15 @@ do {					\
 
 extern int radix_tree_insert(struct radix_tree_root *, unsigned long, void *);
 extern void *radix_tree_lookup(struct radix_tree_root *, unsigned long);
+extern void **radix_tree_lookup_slot(struct radix_tree_root *, unsigned long);
 extern void *radix_tree_delete(struct radix_tree_root *, unsigned long);
 extern unsigned int
 radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
 			unsigned long first_index, unsigned int max_items);
+extern unsigned int
+radix_tree_gang_lookup_exceptional(struct radix_tree_root *root,
+			void **results, unsigned long *indices,
+			unsigned long first_index, unsigned int max_items);
 int radix_tree_preload(int gfp_mask);
 
 static inline void radix_tree_preload_end(void)
@@ -0,0 +1,115 @@
+/*
+   bitmap.h : write-intent bitmap for Linux RAID arrays
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   You should have received a copy of the GNU General Public License
+   (for example /usr/src/linux/COPYING); if not, write to the Free
+   Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef _BITMAP_H
+#define _BITMAP_H
+
+/*
+ * The write-intent bitmap keeps one bit per 'chunk' of each component
+ * device.  A bit is set on disk before the first write to its chunk is
+ * issued, and is only cleared again once the chunk has seen no writes
+ * for a while and the array is fully redundant.  After an unclean
+ * shutdown only chunks with their bit set need to be resynced.
+ *
+ * The bitmap lives in the part of the 0.90 reserved area that follows
+ * the 4k superblock, and is written to every working device:
+ *
+ *	block	0	bitmap superblock (bitmap_super_t)
+ *	block	1 - 14	the bits, little-endian like the ext2 bitmaps
+ *
+ * Blocks are BITMAP_BLOCK_SIZE bytes whatever the PAGE_SIZE.  The bits
+ * are only trusted if the bitmap superblock carries the same event
+ * count as the md superblock, so an array that was last run by a kernel
+ * without bitmap support gets a full resync as before.
+ */
+#define BITMAP_MAGIC		0x6d746962	/* "bitm" */
+#define BITMAP_MAJOR		1
+
+#define BITMAP_BLOCK_SIZE	4096
+#define BITMAP_BLOCK_SECTORS	(BITMAP_BLOCK_SIZE / 512)
+#define BITMAP_BLOCK_BITS	(BITMAP_BLOCK_SIZE * 8)
+#define BITMAP_BLOCKS		((MD_RESERVED_BYTES - MD_SB_BYTES) / BITMAP_BLOCK_SIZE - 1)
+#define BITMAP_MAX_CHUNKS	(BITMAP_BLOCKS * BITMAP_BLOCK_BITS)
+#define BITMAP_MIN_CHUNK	((64 * 1024) / 512)	/* sectors */
+
+typedef struct bitmap_super_s {
+	__u32 magic;		/*  0 BITMAP_MAGIC			      */
+	__u32 version;		/*  1 BITMAP_MAJOR			      */
+	__u8  uuid[16];		/*  2 copy of the array uuid		      */
+	__u64 events;		/*  6 md superblock events the bits match     */
+	__u64 sync_size;	/*  8 sectors covered on each device	      */
+	__u32 chunksize;	/* 10 sectors per bit			      */
+	__u32 nr_dirty;		/* 11 number of bits set, informational       */
+} bitmap_super_t;
+
+/*
+ * In memory every chunk has a counter of writes in flight, plus a few
+ * state bits:
+ *
+ *   NEEDED:  a write failed or went to a degraded array, so the chunk
+ *	      must stay dirty until the next successful resync/recovery.
+ *   PENDING: no writes in flight; the bit may be cleared by the daemon.
+ *   AGED:    the daemon has seen this chunk PENDING once already.
+ */
+typedef __u16 bitmap_counter_t;
+
+#define BITMAP_NEEDED		((bitmap_counter_t) 0x8000)
+#define BITMAP_PENDING		((bitmap_counter_t) 0x4000)
+#define BITMAP_AGED		((bitmap_counter_t) 0x2000)
+#define BITMAP_COUNTER_MAX	((bitmap_counter_t) 0x1fff)
+
+/* how long a chunk must be idle before its bit is cleared */
+#define BITMAP_DAEMON_DELAY	(5 * HZ)
+
+struct bitmap {
+	mddev_t			*mddev;
+	spinlock_t		lock;
+
+	sector_t		sync_size;	/* sectors covered on each device */
+	unsigned long		chunksize;	/* sectors per bit */
+	int			chunkshift;
+	unsigned long		chunks;
+	int			blocks;		/* bit blocks in use */
+
+	bitmap_counter_t	*counts;	/* per chunk, vmalloc()ed */
+	struct page		*sb_page;
+	struct page		*pages[BITMAP_BLOCKS];
+
+	unsigned long		nr_dirty;	/* bits currently set */
+	unsigned long		dirty;		/* blocks changed in memory */
+	unsigned long		writing;	/* blocks being written out */
+	struct semaphore	flush_sem;	/* serialises bitmap_flush(),
+						 * and holds off changes to the
+						 * disk list meanwhile */
+
+	unsigned long		pending;	/* chunks waiting to be cleared */
+	unsigned long		daemon_lastrun;
+	struct timer_list	timer;
+	wait_queue_head_t	overflow_wait;
+};
+
+extern int  bitmap_create(mddev_t *mddev);
+extern void bitmap_destroy(mddev_t *mddev);
+extern void bitmap_update_sb(struct bitmap *bitmap);
+extern void bitmap_daemon_work(struct bitmap *bitmap);
+extern void bitmap_close_sync(struct bitmap *bitmap);
+extern void bitmap_status(struct seq_file *seq, struct bitmap *bitmap);
+
+extern void bitmap_startwrite(struct bitmap *bitmap, sector_t offset,
+			      unsigned long sectors);
+extern void bitmap_endwrite(struct bitmap *bitmap, sector_t offset,
+			    unsigned long sectors, int success);
+extern int  bitmap_start_sync(struct bitmap *bitmap, sector_t offset,
+			      int *sectors);
+
+#endif
@@ -23,7 +23,8 @@
 #define TRANSLUCENT       5UL
 #define HSM               6UL
 #define MULTIPATH         7UL
-#define MAX_PERSONALITY   8UL
+#define RAID6             8UL
+#define MAX_PERSONALITY   9UL
 
 #define	LEVEL_MULTIPATH		(-4)
 #define	LEVEL_LINEAR		(-1)
@@ -41,6 +42,7 @@ static inline int pers_to_level (int pers)
 		case RAID0:		return 0;
 		case RAID1:		return 1;
 		case RAID5:		return 5;
+		case RAID6:		return 6;
 	}
 	BUG();
 	return MD_RESERVED;
@@ -57,6 +59,7 @@ static inline int level_to_pers (int level)
 		case 1: return RAID1;
 		case 4:
 		case 5: return RAID5;
+		case 6: return RAID6;
 	}
 	return MD_RESERVED;
 }
@@ -171,6 +174,9 @@ struct mdk_rdev_s
 	 */
 	int faulty;			/* if faulty do not issue IO requests */
 	int in_sync;			/* device is a full member of the array */
+	int write_mostly;		/* only read from here if there is
+					 * no other choice (raid1)
+					 */
 
 	int desc_nr;			/* descriptor index in the superblock */
 	int raid_disk;			/* role of device in array */
@@ -213,6 +219,10 @@ struct mddev_s
 	unsigned long			curr_resync;	/* blocks scheduled */
 	unsigned long			resync_mark;	/* a recent timestamp */
 	unsigned long			resync_mark_cnt;/* blocks written at resync_mark */
+	unsigned long			curr_mark_cnt;	/* blocks actually resynced,
+							 * excluding those skipped
+							 * thanks to the bitmap
+							 */
 
 	/* recovery/resync flags 
 	 * NEEDED:   we might need to start a resync/recover
@@ -249,6 +259,8 @@ struct mddev_s
 	atomic_t			writes_pending; 
 	request_queue_t			queue;	/* for plugging ... */
 
+	struct bitmap			*bitmap; /* write-intent bitmap, if any */
+
 	struct list_head		all_mddevs;
 };
 
@@ -271,6 +283,26 @@ struct mdk_personality_s
 };
 
 
+static inline int mddev_lock(mddev_t * mddev)
+{
+	return down_interruptible(&mddev->reconfig_sem);
+}
+
+static inline void mddev_lock_uninterruptible(mddev_t * mddev)
+{
+	down(&mddev->reconfig_sem);
+}
+
+static inline int mddev_trylock(mddev_t * mddev)
+{
+	return down_trylock(&mddev->reconfig_sem);
+}
+
+static inline void mddev_unlock(mddev_t * mddev)
+{
+	up(&mddev->reconfig_sem);
+}
+
 /*
  * Currently we index md_array directly, based on the minor
  * number. This will have to change to dynamic allocation
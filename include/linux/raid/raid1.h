@@ -8,6 +8,7 @@ typedef struct mirror_info mirror_info_t;
 struct mirror_info {
 	mdk_rdev_t	*rdev;
 	sector_t	head_position;
+	sector_t	next_seq_sect;	/* where the last read from here ended */
 };
 
 typedef struct r1bio_s r1bio_t;
@@ -18,9 +19,14 @@ struct r1_private_data_s {
 	int			raid_disks;
 	int			working_disks;
 	int			last_used;
-	sector_t		next_seq_sect;
 	spinlock_t		device_lock;
 
+	/* r1bios whose writes to write-mostly mirrors may still
+	 * be in flight after the master bio has been completed:
+	 */
+	atomic_t		behind_writes;
+	wait_queue_head_t	wait_behind;
+
 	/* for use when syncing mirrors: */
 
 	spinlock_t		resync_lock;
@@ -56,6 +62,7 @@ struct r1bio_s {
 					    */
 	int			cmd;
 	sector_t		sector;
+	int			sectors;
 	unsigned long		state;
 	mddev_t			*mddev;
 	/*
@@ -68,6 +75,15 @@ struct r1bio_s {
 	struct bio		*read_bio;
 	int			read_disk;
 
+	/*
+	 * in write-behind mode, the writes to write-mostly mirrors use
+	 * a private copy of the data, as the master bio is completed
+	 * before they are:
+	 */
+	atomic_t		behind_remaining;
+	struct page		**behind_pages;
+	int			behind_page_count;
+
 	r1bio_t			*next_r1; /* next for retry or in free list */
 	struct list_head	retry_list;
 	/*
@@ -79,5 +95,8 @@ struct r1bio_s {
 
 /* bits for r1bio.state */
 #define	R1BIO_Uptodate	1
+#define	R1BIO_Degraded	2	/* a mirror missed the write */
+#define	R1BIO_BehindIO	3	/* write-behind to write-mostly mirrors */
+#define	R1BIO_Returned	4	/* master bio has been completed */
 
 #endif
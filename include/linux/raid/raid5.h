@@ -160,6 +160,8 @@ struct stripe_head {
 #define READ_MODIFY_WRITE	2
 /* not a write method, but a compute_parity mode */
 #define	CHECK_PARITY		3
+/* RAID-6 only: recompute P and Q without taking new data */
+#define	UPDATE_PARITY		4
 
 /*
  * Stripe state
@@ -223,6 +225,7 @@ struct raid5_private_data {
 							 * waiting for 25% to be free
 							 */        
 	spinlock_t		device_lock;
+	struct page		*spare_page; /* Used when checking P/Q in raid6 */
 	struct disk_info	disks[0];
 };
 
@@ -174,6 +174,7 @@ extern signed long FASTCALL(schedule_timeout(signed long timeout));
 asmlinkage void schedule(void);
 
 struct namespace;
+struct mem_group;
 
 /* Maximum number of active map areas.. This is a random (large) number */
 #define MAX_MAP_COUNT	(65536)
@@ -196,6 +197,9 @@ struct mm_struct {
 						 * together off init_mm.mmlist, and are protected
 						 * by mmlist_lock
 						 */
+	struct list_head merge_list;		/* On kmerged's list once MADV_MERGEABLE
+						 * has been used, under mmlist_lock
+						 */
 
 	unsigned long start_code, end_code, start_data, end_data;
 	unsigned long start_brk, brk, start_stack;
@@ -208,6 +212,12 @@ struct mm_struct {
 	unsigned dumpable:1;
 #ifdef CONFIG_HUGETLB_PAGE
 	int used_hugetlb;
+#endif
+#ifdef CONFIG_ANON_HUGEPAGES
+	unsigned long anon_hugepages;	/* Huge pmds mapping anonymous memory */
+#endif
+#ifdef CONFIG_MEMGROUP
+	struct mem_group *mem_group;	/* Memory resource group, or NULL */
 #endif
 	/* Architecture-specific MM context */
 	mm_context_t context;
@@ -323,6 +333,7 @@ struct k_itimer {
 
 struct io_context;			/* See blkdev.h */
 void exit_io_context(void);
+struct mempolicy;			/* See mempolicy.h */
 
 struct task_struct {
 	volatile long state;	/* -1 unrunnable, 0 runnable, >0 stopped */
@@ -354,6 +365,7 @@ struct task_struct {
 	struct linux_binfmt *binfmt;
 	int exit_code, exit_signal;
 	int pdeath_signal;  /*  The signal sent when the parent dies  */
+	int oomkilladj;	/* OOM kill score adjustment (bit shift) */
 	/* ??? */
 	unsigned long personality;
 	int did_exec:1;
@@ -454,6 +466,11 @@ struct task_struct {
 
 	struct io_context *io_context;
 
+#ifdef CONFIG_NUMA
+	struct mempolicy *mempolicy;
+	short il_next;			/* next interleave node */
+#endif
+
 	unsigned long ptrace_message;
 	siginfo_t *last_siginfo; /* For ptrace use.  */
 };
@@ -16,6 +16,9 @@ struct shmem_inode_info {
 	unsigned long		swapped;    /* subtotal assigned to swap */
 	unsigned long		flags;
 	struct list_head	list;
+#ifdef CONFIG_NUMA
+	struct mempolicy	*policy;    /* NUMA policy of the whole object */
+#endif
 	struct inode		vfs_inode;
 };
 
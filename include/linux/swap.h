@@ -151,6 +151,15 @@ struct swap_list_t {
 
 /* linux/mm/oom_kill.c */
 extern void out_of_memory(void);
+extern unsigned long oom_badness(struct task_struct *);
+
+/* /proc/<pid>/oom_adj values */
+#define OOM_DISABLE	-17	/* never kill the task */
+#define OOM_ADJUST_MIN	-16
+#define OOM_ADJUST_MAX	15
+
+/* linux/mm/mempressure.c */
+extern void mem_pressure_notify(int);
 
 /* linux/mm/memory.c */
 extern void swapin_readahead(swp_entry_t);
@@ -160,9 +169,11 @@ extern unsigned long totalram_pages;
 extern unsigned long totalhigh_pages;
 extern int nr_swap_pages;	/* XXX: shouldn't this be ulong? --hch */
 extern unsigned int nr_free_pages(void);
+extern unsigned long nr_prezeroed_pages(void);
 extern unsigned int nr_free_pages_pgdat(pg_data_t *pgdat);
 extern unsigned int nr_free_buffer_pages(void);
 extern unsigned int nr_free_pagecache_pages(void);
+extern void drain_local_pages(void);
 
 /* linux/mm/swap.c */
 extern void FASTCALL(lru_cache_add(struct page *));
@@ -177,6 +188,41 @@ extern void swap_setup(void);
 extern int try_to_free_pages(struct zone *, unsigned int, unsigned int);
 extern int shrink_all_memory(int);
 extern int vm_swappiness;
+extern int vm_pressure_priority;
+
+/* linux/mm/workingset.c */
+extern void *workingset_eviction(struct address_space *, struct page *);
+extern int workingset_refault(void *);
+extern void workingset_activation(struct zone *);
+
+/* linux/mm/migrate.c */
+#ifdef CONFIG_MMU
+extern int migrate_page(struct page *, struct page *, unsigned int);
+extern int migrate_page_to(struct page *, struct page *, unsigned int);
+extern int isolate_lru_page(struct page *, struct list_head *);
+extern void putback_lru_pages(struct list_head *);
+#endif
+
+/* linux/mm/compaction.c */
+#ifdef CONFIG_MMU
+extern int compact_zone(struct zone *, unsigned int, unsigned int, int);
+extern int try_to_compact_pages(struct zone **, unsigned int, unsigned int);
+extern void wakeup_kcompactd(unsigned int);
+#else
+#define try_to_compact_pages(zones, order, gfp_mask)	0
+#define wakeup_kcompactd(order)				do { } while (0)
+#endif
+
+/* linux/mm/pagemerge.c */
+#ifdef CONFIG_MMU
+extern int sysctl_merge_pages_to_scan;
+extern int sysctl_merge_sleep_millisecs;
+extern void merge_register_mm(struct mm_struct *);
+extern int merge_report_meminfo(char *);
+#else
+#define merge_register_mm(mm)				do { } while (0)
+#define merge_report_meminfo(buf)			0
+#endif
 
 /* linux/mm/rmap.c */
 #ifdef CONFIG_MMU
@@ -185,6 +231,7 @@ struct pte_chain *FASTCALL(page_add_rmap(struct page *, pte_t *,
 					struct pte_chain *));
 void FASTCALL(page_remove_rmap(struct page *, pte_t *));
 int FASTCALL(try_to_unmap(struct page *));
+int page_single_mapping(struct page *, struct mm_struct **, unsigned long *);
 
 /* linux/mm/shmem.c */
 extern int shmem_unuse(swp_entry_t entry, struct page *page);
@@ -204,6 +251,20 @@ extern int swap_readpage(struct file *, struct page *);
 extern int swap_writepage(struct page *page, struct writeback_control *wbc);
 extern int rw_swap_page_sync(int, swp_entry_t, struct page *);
 
+/* linux/mm/swap_compress.c */
+#ifdef CONFIG_SWAP_COMPRESS
+extern int sysctl_swap_compress_percent;
+extern int swap_compress_store(struct page *);
+extern int swap_compress_load(struct page *);
+extern void swap_compress_invalidate(swp_entry_t);
+extern int swap_compress_report_meminfo(char *);
+#else
+#define swap_compress_store(page)		(-ENOMEM)
+#define swap_compress_load(page)		(-ENOENT)
+#define swap_compress_invalidate(entry)		do { } while (0)
+#define swap_compress_report_meminfo(buf)	0
+#endif
+
 /* linux/mm/swap_state.c */
 extern struct address_space swapper_space;
 #define total_swapcache_pages  swapper_space.nrpages
@@ -225,6 +286,7 @@ extern unsigned int nr_swapfiles;
 extern struct swap_info_struct swap_info[];
 extern void si_swapinfo(struct sysinfo *);
 extern swp_entry_t get_swap_page(void);
+extern swp_entry_t get_swap_page_near(struct mm_struct *, unsigned long);
 extern int swap_duplicate(swp_entry_t);
 extern int valid_swaphandles(swp_entry_t, unsigned long *);
 extern void swap_free(swp_entry_t);
@@ -267,6 +329,7 @@ extern spinlock_t swaplock;
 #define move_from_swap_cache(p, i, m)		1
 #define __delete_from_swap_cache(p)		/*NOTHING*/
 #define delete_from_swap_cache(p)		/*NOTHING*/
+#define swap_compress_report_meminfo(buf)	0
 
 static inline swp_entry_t get_swap_page(void)
 {
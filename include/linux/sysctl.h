@@ -157,6 +157,14 @@ enum
 	VM_SWAPPINESS=19,	/* Tendency to steal mapped memory */
 	VM_LOWER_ZONE_PROTECTION=20,/* Amount of protection of lower zones */
 	VM_MIN_FREE_KBYTES=21,	/* Minimum free kilobytes to maintain */
+	VM_FAULT_AROUND=22,	/* Pages to map around a file fault */
+	VM_ANON_HUGEPAGES=23,	/* Use huge pages for anonymous memory */
+	VM_COMPACT_MEMORY=24,	/* Free blocks of the given order */
+	VM_SWAP_COMPRESS=25,	/* Percent of memory for compressed swap */
+	VM_MERGE_PAGES=26,	/* Pages kmerged scans at a time */
+	VM_MERGE_SLEEP=27,	/* Time kmerged sleeps in between */
+	VM_MEMGROUP_LIMIT=28,	/* Memory resource group limits */
+	VM_PRESSURE_PRIORITY=29, /* Reclaim priority signalling pressure */
 };
 
 
@@ -2,12 +2,14 @@
 #define _LINUX_VMALLOC_H
 
 #include <linux/spinlock.h>
+#include <linux/rbtree.h>
 #include <asm/page.h>		/* pgprot_t */
 
 /* bits in vm_struct->flags */
 #define VM_IOREMAP	0x00000001	/* ioremap() and friends */
 #define VM_ALLOC	0x00000002	/* vmalloc() */
 #define VM_MAP		0x00000004	/* vmap()ed pages */
+#define VM_LAZYFREE	0x00000008	/* freed, waiting for the TLB flush */
 
 struct vm_struct {
 	void			*addr;
@@ -17,6 +19,7 @@ struct vm_struct {
 	unsigned int		nr_pages;
 	unsigned long		phys_addr;
 	struct vm_struct	*next;
+	struct rb_node		rb;
 };
 
 /*
@@ -39,6 +42,8 @@ extern struct vm_struct *remove_vm_area(void *addr);
 extern int map_vm_area(struct vm_struct *area, pgprot_t prot,
 			struct page ***pages);
 extern void unmap_vm_area(struct vm_struct *area);
+extern void purge_vm_lazy(void);
+extern void register_vm_area(struct vm_struct *area);
 
 /*
  *	Internals.  Dont't use..
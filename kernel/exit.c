@@ -709,6 +709,10 @@ NORET_TYPE void do_exit(long code)
 	exit_namespace(tsk);
 	exit_itimers(tsk);
 	exit_thread();
+#ifdef CONFIG_NUMA
+	mpol_free(tsk->mempolicy);
+	tsk->mempolicy = NULL;
+#endif
 
 	if (tsk->leader)
 		disassociate_ctty(1);
@@ -30,6 +30,7 @@
 #include <linux/futex.h>
 #include <linux/ptrace.h>
 #include <linux/mount.h>
+#include <linux/hugetlb.h>
 
 #include <asm/pgtable.h>
 #include <asm/pgalloc.h>
@@ -277,6 +278,9 @@ static inline int dup_mmap(struct mm_struct * mm, struct mm_struct * oldmm)
 	spin_lock(&mmlist_lock);
 	list_add(&mm->mmlist, &current->mm->mmlist);
 	mmlist_nr++;
+	/* The mergeable vmas are copied, so kmerged should see them too */
+	if (!list_empty(&current->mm->merge_list))
+		list_add(&mm->merge_list, &current->mm->merge_list);
 	spin_unlock(&mmlist_lock);
 
 	for (mpnt = current->mm->mmap ; mpnt ; mpnt = mpnt->vm_next) {
@@ -284,6 +288,9 @@ static inline int dup_mmap(struct mm_struct * mm, struct mm_struct * oldmm)
 
 		if(mpnt->vm_flags & VM_DONTCOPY)
 			continue;
+		/* Anonymous huge pages are not shared with the child */
+		if (split_anon_hugepages(mpnt, mpnt->vm_start, mpnt->vm_end))
+			goto fail_nomem;
 		if (mpnt->vm_flags & VM_ACCOUNT) {
 			unsigned int len = (mpnt->vm_end - mpnt->vm_start) >> PAGE_SHIFT;
 			if (security_vm_enough_memory(len))
@@ -294,6 +301,7 @@ static inline int dup_mmap(struct mm_struct * mm, struct mm_struct * oldmm)
 		if (!tmp)
 			goto fail_nomem;
 		*tmp = *mpnt;
+		mpol_get(vma_policy(tmp));
 		tmp->vm_flags &= ~VM_LOCKED;
 		tmp->vm_mm = mm;
 		tmp->vm_next = NULL;
@@ -372,11 +380,19 @@ static struct mm_struct * mm_init(struct mm_struct * mm)
 	atomic_set(&mm->mm_users, 1);
 	atomic_set(&mm->mm_count, 1);
 	init_rwsem(&mm->mmap_sem);
+	INIT_LIST_HEAD(&mm->merge_list);
 	mm->core_waiters = 0;
 	mm->page_table_lock = SPIN_LOCK_UNLOCKED;
 	mm->ioctx_list_lock = RW_LOCK_UNLOCKED;
 	mm->default_kioctx = (struct kioctx)INIT_KIOCTX(mm->default_kioctx, *mm);
 	mm->free_area_cache = TASK_UNMAPPED_BASE;
+#ifdef CONFIG_ANON_HUGEPAGES
+	mm->anon_hugepages = 0;
+#endif
+#ifdef CONFIG_MEMGROUP
+	/* Both fork and exec stay in the group */
+	mm->mem_group = current->mm ? current->mm->mem_group : NULL;
+#endif
 
 	if (likely(!mm_alloc_pgd(mm))) {
 		mm->def_flags = 0;
@@ -421,6 +437,7 @@ void mmput(struct mm_struct *mm)
 {
 	if (atomic_dec_and_lock(&mm->mm_users, &mmlist_lock)) {
 		list_del(&mm->mmlist);
+		list_del_init(&mm->merge_list);
 		mmlist_nr--;
 		spin_unlock(&mmlist_lock);
 		exit_aio(mm);
@@ -788,6 +805,9 @@ struct task_struct *copy_process(unsigned long clone_flags,
 	p = dup_task_struct(current);
 	if (!p)
 		goto fork_out;
+#ifdef CONFIG_NUMA
+	mpol_get(p->mempolicy);
+#endif
 
 	retval = -EAGAIN;
 	if (atomic_read(&p->user->processes) >= p->rlim[RLIMIT_NPROC].rlim_cur) {
@@ -1047,6 +1067,9 @@ bad_fork_cleanup_count:
 	atomic_dec(&p->user->processes);
 	free_uid(p->user);
 bad_fork_free:
+#ifdef CONFIG_NUMA
+	mpol_free(p->mempolicy);
+#endif
 	free_task(p);
 	goto fork_out;
 }
@@ -23,6 +23,7 @@
 #include <linux/security.h>
 #include <linux/dcookies.h>
 #include <linux/suspend.h>
+#include <linux/memgroup.h>
 
 #include <asm/uaccess.h>
 #include <asm/io.h>
@@ -233,6 +234,10 @@ cond_syscall(compat_sys_futex)
 cond_syscall(sys_epoll_create)
 cond_syscall(sys_epoll_ctl)
 cond_syscall(sys_epoll_wait)
+cond_syscall(sys_mbind)
+cond_syscall(sys_get_mempolicy)
+cond_syscall(sys_set_mempolicy)
+cond_syscall(sys_migrate_pages)
 
 static int set_one_prio(struct task_struct *p, int niceval, int error)
 {
@@ -1398,6 +1403,12 @@ asmlinkage long sys_prctl(int option, unsigned long arg2, unsigned long arg3,
 			}
 			current->keep_capabilities = arg2;
 			break;
+		case PR_GET_MEMGROUP:
+			error = memgroup_get();
+			break;
+		case PR_SET_MEMGROUP:
+			error = memgroup_set(arg2);
+			break;
 		default:
 			error = -EINVAL;
 			break;
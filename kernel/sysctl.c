@@ -35,6 +35,7 @@
 #include <linux/writeback.h>
 #include <linux/hugetlb.h>
 #include <linux/security.h>
+#include <linux/memgroup.h>
 #include <asm/uaccess.h>
 
 #ifdef CONFIG_ROOT_NFS
@@ -558,6 +559,8 @@ static ctl_table kern_table[] = {
    We use these as one-element integer vectors. */
 static int zero = 0;
 static int one_hundred = 100;
+static int fault_around_max = FAULT_AROUND_MAX;
+static int compact_order_max = MAX_ORDER - 1;
 
 
 static ctl_table vm_table[] = {
@@ -642,6 +645,14 @@ static ctl_table vm_table[] = {
 		.extra1		= &zero,
 		.extra2		= &one_hundred,
 	},
+	{
+		.ctl_name	= VM_PRESSURE_PRIORITY,
+		.procname	= "pressure_priority",
+		.data		= &vm_pressure_priority,
+		.maxlen		= sizeof(vm_pressure_priority),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec,
+	},
 #ifdef CONFIG_HUGETLB_PAGE
 	 {
 		.ctl_name	= VM_HUGETLB_PAGES,
@@ -651,6 +662,16 @@ static ctl_table vm_table[] = {
 		.mode		= 0644,
 		.proc_handler	= &hugetlb_sysctl_handler,
 	 },
+#endif
+#ifdef CONFIG_ANON_HUGEPAGES
+	{
+		.ctl_name	= VM_ANON_HUGEPAGES,
+		.procname	= "anon_hugepages",
+		.data		= &sysctl_anon_hugepages,
+		.maxlen		= sizeof(sysctl_anon_hugepages),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec,
+	},
 #endif
 	{
 		.ctl_name	= VM_LOWER_ZONE_PROTECTION,
@@ -672,6 +693,73 @@ static ctl_table vm_table[] = {
 		.strategy	= &sysctl_intvec,
 		.extra1		= &zero,
 	},
+	{
+		.ctl_name	= VM_FAULT_AROUND,
+		.procname	= "fault_around_pages",
+		.data		= &fault_around_pages,
+		.maxlen		= sizeof(fault_around_pages),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec_minmax,
+		.strategy	= &sysctl_intvec,
+		.extra1		= &zero,
+		.extra2		= &fault_around_max,
+	},
+#ifdef CONFIG_MMU
+	{
+		.ctl_name	= VM_COMPACT_MEMORY,
+		.procname	= "compact_memory",
+		.data		= &sysctl_compact_memory,
+		.maxlen		= sizeof(sysctl_compact_memory),
+		.mode		= 0644,
+		.proc_handler	= &compact_memory_sysctl_handler,
+		.strategy	= &sysctl_intvec,
+		.extra1		= &zero,
+		.extra2		= &compact_order_max,
+	},
+	{
+		.ctl_name	= VM_MERGE_PAGES,
+		.procname	= "merge_pages_to_scan",
+		.data		= &sysctl_merge_pages_to_scan,
+		.maxlen		= sizeof(sysctl_merge_pages_to_scan),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec_minmax,
+		.strategy	= &sysctl_intvec,
+		.extra1		= &zero,
+	},
+	{
+		.ctl_name	= VM_MERGE_SLEEP,
+		.procname	= "merge_sleep_millisecs",
+		.data		= &sysctl_merge_sleep_millisecs,
+		.maxlen		= sizeof(sysctl_merge_sleep_millisecs),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec_minmax,
+		.strategy	= &sysctl_intvec,
+		.extra1		= &zero,
+	},
+#endif
+#ifdef CONFIG_SWAP_COMPRESS
+	{
+		.ctl_name	= VM_SWAP_COMPRESS,
+		.procname	= "swap_compress_percent",
+		.data		= &sysctl_swap_compress_percent,
+		.maxlen		= sizeof(sysctl_swap_compress_percent),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec_minmax,
+		.strategy	= &sysctl_intvec,
+		.extra1		= &zero,
+		.extra2		= &one_hundred,
+	},
+#endif
+#ifdef CONFIG_MEMGROUP
+	{
+		.ctl_name	= VM_MEMGROUP_LIMIT,
+		.procname	= "memgroup_limit",
+		.data		= &sysctl_memgroup_limit,
+		.maxlen		= sizeof(sysctl_memgroup_limit),
+		.mode		= 0644,
+		.proc_handler	= &proc_doulongvec_minmax,
+	},
+#endif
 	{ .ctl_name = 0 }
 };
 
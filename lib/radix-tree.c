@@ -215,13 +215,15 @@ int radix_tree_insert(struct radix_tree_root *root, unsigned long index, void *i
 EXPORT_SYMBOL(radix_tree_insert);
 
 /**
- *	radix_tree_lookup    -    perform lookup operation on a radix tree
+ *	radix_tree_lookup_slot    -    lookup a slot in a radix tree
  *	@root:		radix tree root
  *	@index:		index key
  *
- *	Lookup them item at the position @index in the radix tree @root.
+ *	Lookup the slot corresponding to the position @index in the radix tree
+ *	@root, so that the item in it can be replaced.  Returns NULL if the
+ *	slot does not exist; an existing slot may be empty.
  */
-void *radix_tree_lookup(struct radix_tree_root *root, unsigned long index)
+void **radix_tree_lookup_slot(struct radix_tree_root *root, unsigned long index)
 {
 	unsigned int height, shift;
 	struct radix_tree_node **slot;
@@ -243,13 +245,35 @@ void *radix_tree_lookup(struct radix_tree_root *root, unsigned long index)
 		height--;
 	}
 
-	return (void *) *slot;
+	return (void **)slot;
+}
+EXPORT_SYMBOL(radix_tree_lookup_slot);
+
+/**
+ *	radix_tree_lookup    -    perform lookup operation on a radix tree
+ *	@root:		radix tree root
+ *	@index:		index key
+ *
+ *	Lookup them item at the position @index in the radix tree @root.
+ */
+void *radix_tree_lookup(struct radix_tree_root *root, unsigned long index)
+{
+	void **slot;
+
+	slot = radix_tree_lookup_slot(root, index);
+	return slot ? *slot : NULL;
 }
 EXPORT_SYMBOL(radix_tree_lookup);
 
+/*
+ * Collect the items at and after `index' which are exceptional entries if
+ * `exceptional' is set, or ordinary ones if not, and their indices if
+ * `indices' is not NULL.
+ */
 static /* inline */ unsigned int
-__lookup(struct radix_tree_root *root, void **results, unsigned long index,
-	unsigned int max_items, unsigned long *next_index)
+__lookup(struct radix_tree_root *root, void **results, unsigned long *indices,
+	unsigned long index, unsigned int max_items, int exceptional,
+	unsigned long *next_index)
 {
 	unsigned int nr_found = 0;
 	unsigned int shift;
@@ -277,9 +301,14 @@ __lookup(struct radix_tree_root *root, void **results, unsigned long index,
 			unsigned long j = index & RADIX_TREE_MAP_MASK;
 
 			for ( ; j < RADIX_TREE_MAP_SIZE; j++) {
+				void *item = slot->slots[j];
+
 				index++;
-				if (slot->slots[j]) {
-					results[nr_found++] = slot->slots[j];
+				if (item && radix_tree_exceptional_entry(item)
+						== exceptional) {
+					if (indices)
+						indices[nr_found] = index - 1;
+					results[nr_found++] = item;
 					if (nr_found == max_items)
 						goto out;
 				}
@@ -293,22 +322,10 @@ out:
 	return nr_found;
 }
 
-/**
- *	radix_tree_gang_lookup - perform multiple lookup on a radix tree
- *	@root:		radix tree root
- *	@results:	where the results of the lookup are placed
- *	@first_index:	start the lookup from this key
- *	@max_items:	place up to this many items at *results
- *
- *	Performs an index-ascending scan of the tree for present items.  Places
- *	them at *@results and returns the number of items which were placed at
- *	*@results.
- *
- *	The implementation is naive.
- */
-unsigned int
-radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
-			unsigned long first_index, unsigned int max_items)
+static unsigned int
+__gang_lookup(struct radix_tree_root *root, void **results,
+	unsigned long *indices, unsigned long first_index,
+	unsigned int max_items, int exceptional)
 {
 	const unsigned long max_index = radix_tree_maxindex(root->height);
 	unsigned long cur_index = first_index;
@@ -317,11 +334,12 @@ radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
 	if (root->rnode == NULL)
 		goto out;
 	if (max_index == 0) {			/* Bah.  Special case */
-		if (first_index == 0) {
-			if (max_items > 0) {
-				*results = root->rnode;
-				ret = 1;
-			}
+		if (first_index == 0 && max_items > 0 &&
+		    radix_tree_exceptional_entry(root->rnode) == exceptional) {
+			if (indices)
+				*indices = 0;
+			*results = root->rnode;
+			ret = 1;
 		}
 		goto out;
 	}
@@ -331,8 +349,9 @@ radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
 
 		if (cur_index > max_index)
 			break;
-		nr_found = __lookup(root, results + ret, cur_index,
-					max_items - ret, &next_index);
+		nr_found = __lookup(root, results + ret,
+					indices ? indices + ret : NULL, cur_index,
+					max_items - ret, exceptional, &next_index);
 		ret += nr_found;
 		if (next_index == 0)
 			break;
@@ -341,8 +360,48 @@ radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
 out:
 	return ret;
 }
+
+/**
+ *	radix_tree_gang_lookup - perform multiple lookup on a radix tree
+ *	@root:		radix tree root
+ *	@results:	where the results of the lookup are placed
+ *	@first_index:	start the lookup from this key
+ *	@max_items:	place up to this many items at *results
+ *
+ *	Performs an index-ascending scan of the tree for present items.  Places
+ *	them at *@results and returns the number of items which were placed at
+ *	*@results.  Exceptional entries are skipped.
+ *
+ *	The implementation is naive.
+ */
+unsigned int
+radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
+			unsigned long first_index, unsigned int max_items)
+{
+	return __gang_lookup(root, results, NULL, first_index, max_items, 0);
+}
 EXPORT_SYMBOL(radix_tree_gang_lookup);
 
+/**
+ *	radix_tree_gang_lookup_exceptional - find exceptional entries
+ *	@root:		radix tree root
+ *	@results:	where the entries are placed
+ *	@indices:	where their indices are placed
+ *	@first_index:	start the lookup from this key
+ *	@max_items:	place up to this many entries at *results
+ *
+ *	Like radix_tree_gang_lookup(), but finds only the exceptional entries,
+ *	and returns their indices as well.
+ */
+unsigned int
+radix_tree_gang_lookup_exceptional(struct radix_tree_root *root,
+			void **results, unsigned long *indices,
+			unsigned long first_index, unsigned int max_items)
+{
+	return __gang_lookup(root, results, indices, first_index, max_items, 1);
+}
+EXPORT_SYMBOL(radix_tree_gang_lookup_exceptional);
+
 /**
  *	radix_tree_delete    -    delete an item from a radix tree
  *	@root:		radix tree root
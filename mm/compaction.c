@@ -0,0 +1,393 @@
+/*
+ *  linux/mm/compaction.c
+ *
+ *  Memory compaction: assemble free blocks of a given order by moving the
+ *  pagecache and anonymous pages which sit in them elsewhere, with
+ *  migrate_page().
+ */
+
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/pagemap.h>
+#include <linux/init.h>
+#include <linux/suspend.h>
+#include <linux/mm_inline.h>
+#include <linux/pagevec.h>
+#include <linux/sysctl.h>
+
+/*
+ * Give up on a block if more of the pages allocated to move its contents
+ * land inside it than this.
+ */
+#define COMPACT_MAX_CAPTURED	32
+
+/*
+ * compact_zone() looks for the cheapest block among this many pages (or
+ * 16 blocks, if that is more) from where its last scan of the zone
+ * stopped, unless it is asked to free everything.
+ */
+#define COMPACT_SCAN_PAGES	8192
+
+/*
+ * After compaction fails to produce a block, the allocator's next
+ * 1 << compact_defer_shift attempts in that zone go straight to reclaim.
+ */
+#define COMPACT_MAX_DEFER_SHIFT	6
+
+/*
+ * Returns the number of pages in the block which would have to be moved
+ * to free it, or -1 if something in it can't be moved at all.  Unlocked,
+ * so it is only a guess.
+ */
+static int block_cost(struct page *start, int nr)
+{
+	int cost = 0;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		struct page *page = start + i;
+
+		if (PageReserved(page) || PageSlab(page) || PageCompound(page))
+			return -1;
+		if (PageLRU(page))
+			cost++;
+		else if (page_count(page))
+			return -1;
+	}
+	return cost;
+}
+
+/*
+ * Take the block's pages off the LRU, each with a reference held.
+ */
+static int isolate_block(struct zone *zone, struct page *start, int nr,
+			 struct list_head *list)
+{
+	int isolated = 0;
+	int i;
+
+	spin_lock_irq(&zone->lru_lock);
+	for (i = 0; i < nr; i++) {
+		struct page *page = start + i;
+
+		if (!TestClearPageLRU(page))
+			continue;
+		if (page_count(page) == 0) {
+			/* It is currently in pagevec_release() */
+			SetPageLRU(page);
+			continue;
+		}
+		list_del(&page->lru);
+		if (PageActive(page))
+			zone->nr_active--;
+		else
+			zone->nr_inactive--;
+		page_cache_get(page);
+		list_add_tail(&page->lru, list);
+		isolated++;
+	}
+	spin_unlock_irq(&zone->lru_lock);
+	return isolated;
+}
+
+static void putback_block(struct zone *zone, struct list_head *list)
+{
+	struct pagevec pvec;
+	struct page *page;
+
+	pagevec_init(&pvec, 1);
+	spin_lock_irq(&zone->lru_lock);
+	while (!list_empty(list)) {
+		page = list_entry(list->next, struct page, lru);
+		if (TestSetPageLRU(page))
+			BUG();
+		list_del(&page->lru);
+		if (PageActive(page))
+			add_page_to_active_list(zone, page);
+		else
+			add_page_to_inactive_list(zone, page);
+		if (!pagevec_add(&pvec, page)) {
+			spin_unlock_irq(&zone->lru_lock);
+			__pagevec_release(&pvec);
+			spin_lock_irq(&zone->lru_lock);
+		}
+	}
+	spin_unlock_irq(&zone->lru_lock);
+	pagevec_release(&pvec);
+}
+
+static void drain_cpu_pages(void *dummy)
+{
+	drain_local_pages();
+}
+
+/*
+ * Move everything out of the `nr' pages at `start'.  The new pages are
+ * allocated without sleeping: compaction only helps when there is free
+ * memory to move into, and it must not recurse into the allocator's slow
+ * path.  Gives up at the first page which can't be moved.
+ */
+static int evacuate_block(struct zone *zone, struct page *start, int nr,
+			  unsigned int gfp_mask)
+{
+	LIST_HEAD(pages);
+	LIST_HEAD(captured);
+	struct page *page, *newpage;
+	int nr_captured = 0;
+	int err = 0;
+
+	isolate_block(zone, start, nr, &pages);
+
+	while (!list_empty(&pages)) {
+		unsigned int alloc_mask;
+
+		page = list_entry(pages.next, struct page, lru);
+
+		alloc_mask = PageHighMem(page) ? GFP_HIGHUSER : GFP_USER;
+		alloc_mask = (alloc_mask & ~__GFP_WAIT) | __GFP_NOWARN;
+		for (;;) {
+			newpage = alloc_page(alloc_mask);
+			if (!newpage || newpage < start || newpage >= start + nr)
+				break;
+			/* Hang on to it, so that the block is whole once freed */
+			list_add(&newpage->lru, &captured);
+			if (++nr_captured > COMPACT_MAX_CAPTURED) {
+				newpage = NULL;
+				break;
+			}
+		}
+		if (!newpage) {
+			err = -ENOMEM;
+			break;
+		}
+
+		err = migrate_page_to(page, newpage, gfp_mask);
+		if (err)
+			break;
+	}
+	putback_block(zone, &pages);
+
+	while (!list_empty(&captured)) {
+		page = list_entry(captured.next, struct page, lru);
+		list_del(&page->lru);
+		__free_page(page);
+	}
+
+	/* The freed pages may still be sitting on per-cpu lists */
+	on_each_cpu(drain_cpu_pages, NULL, 0, 1);
+	return err;
+}
+
+/*
+ * Is there a free block of at least `order' pages in the zone?
+ */
+static int zone_has_free_block(struct zone *zone, unsigned int order)
+{
+	unsigned long flags;
+	int type;
+	int ret = 0;
+
+	spin_lock_irqsave(&zone->lock, flags);
+	for ( ; order < MAX_ORDER && !ret; order++) {
+		for (type = 0; type < MIGRATE_TYPES; type++) {
+			if (!list_empty(&zone->free_area[order].free_list[type])) {
+				ret = 1;
+				break;
+			}
+		}
+	}
+	spin_unlock_irqrestore(&zone->lock, flags);
+	return ret;
+}
+
+/**
+ * compact_zone - move pages out of the way to free blocks of a given order
+ * @zone: the zone to compact
+ * @order: size of the blocks wanted
+ * @gfp_mask: what the page moving may do to release buffers and the like
+ * @all: free every block possible, rather than just the cheapest one found
+ *	near where the last scan stopped
+ *
+ * Returns the number of blocks that were emptied.
+ */
+int compact_zone(struct zone *zone, unsigned int order,
+		 unsigned int gfp_mask, int all)
+{
+	int nr = 1 << order;
+	struct page *best = NULL;
+	int best_cost = INT_MAX;
+	int freed = 0;
+	unsigned long nr_blocks = zone->spanned_pages >> order;
+	unsigned long scan, i, n;
+
+	if (all) {
+		scan = nr_blocks;
+		i = 0;
+	} else {
+		scan = max(COMPACT_SCAN_PAGES >> order, 16UL);
+		if (scan > nr_blocks)
+			scan = nr_blocks;
+		i = zone->compact_cursor & ~(nr - 1UL);
+	}
+
+	lru_add_drain();
+	for (n = 0; n < scan; n++, i += nr) {
+		struct page *start;
+		int cost;
+
+		if (i + nr > zone->spanned_pages)
+			i = 0;
+		start = zone->zone_mem_map + i;
+		cost = block_cost(start, nr);
+
+		/* Already free, or can't be freed */
+		if (cost <= 0)
+			continue;
+		if (all) {
+			if (!evacuate_block(zone, start, nr, gfp_mask))
+				freed++;
+			cond_resched();
+			continue;
+		}
+		if (cost < best_cost) {
+			best = start;
+			best_cost = cost;
+			if (cost == 1)
+				break;
+		}
+	}
+	/* Carry on after the block it stopped at, or where it ran out */
+	if (!all)
+		zone->compact_cursor = n < scan ? i + nr : i;
+
+	if (best && !evacuate_block(zone, best, nr, gfp_mask))
+		freed++;
+	return freed;
+}
+
+/*
+ * Should the allocator skip compacting the zone this time, because it
+ * didn't help the last times?
+ */
+static int compaction_deferred(struct zone *zone)
+{
+	unsigned int limit = 1U << zone->compact_defer_shift;
+
+	if (++zone->compact_considered > limit)
+		zone->compact_considered = limit;
+	return zone->compact_considered < limit;
+}
+
+static void defer_compaction(struct zone *zone)
+{
+	zone->compact_considered = 0;
+	if (zone->compact_defer_shift < COMPACT_MAX_DEFER_SHIFT)
+		zone->compact_defer_shift++;
+}
+
+/*
+ * Called from the allocator's slow path, before it starts reclaiming,
+ * for an allocation of `order' pages from `zones' which failed for want
+ * of a free block big enough.  Returns non-zero if there should be one
+ * now.
+ */
+int try_to_compact_pages(struct zone **zones, unsigned int order,
+			 unsigned int gfp_mask)
+{
+	int i;
+
+	inc_page_state(compactstall);
+	for (i = 0; zones[i] != NULL; i++) {
+		struct zone *zone = zones[i];
+
+		/* Too little free memory to move pages into: reclaim first */
+		if (zone->free_pages < zone->pages_low + (2UL << order))
+			continue;
+		if (compaction_deferred(zone))
+			continue;
+		compact_zone(zone, order, gfp_mask, 0);
+		if (zone_has_free_block(zone, order)) {
+			zone->compact_considered = 0;
+			zone->compact_defer_shift = 0;
+			inc_page_state(compactsuccess);
+			return 1;
+		}
+		defer_compaction(zone);
+	}
+	return 0;
+}
+
+/*
+ * Allocations which can't sleep just ask kcompactd to make room for the
+ * next attempt.  It remembers the largest order wanted since it last ran.
+ */
+static DECLARE_WAIT_QUEUE_HEAD(kcompactd_wait);
+static unsigned long kcompactd_order;
+
+void wakeup_kcompactd(unsigned int order)
+{
+	if (order > kcompactd_order)
+		kcompactd_order = order;
+	if (!waitqueue_active(&kcompactd_wait))
+		return;
+	wake_up_interruptible(&kcompactd_wait);
+}
+
+static int kcompactd(void *p)
+{
+	DEFINE_WAIT(wait);
+
+	daemonize("kcompactd");
+
+	for ( ; ; ) {
+		struct zone *zone;
+		unsigned int order;
+
+		if (current->flags & PF_FREEZE)
+			refrigerator(PF_IOTHREAD);
+		prepare_to_wait(&kcompactd_wait, &wait, TASK_INTERRUPTIBLE);
+		if (!kcompactd_order)
+			schedule();
+		finish_wait(&kcompactd_wait, &wait);
+
+		order = xchg(&kcompactd_order, 0);
+		if (!order)
+			continue;
+		for_each_zone(zone) {
+			if (!zone->present_pages || zone_has_free_block(zone, order))
+				continue;
+			compact_zone(zone, order, GFP_KERNEL, 0);
+		}
+	}
+	return 0;
+}
+
+/*
+ * Writing an order to /proc/sys/vm/compact_memory frees as many blocks of
+ * that order as it can in every zone, eg. before growing the hugetlb pool.
+ */
+int sysctl_compact_memory;
+
+int compact_memory_sysctl_handler(ctl_table *table, int write,
+		struct file *file, void *buffer, size_t *length)
+{
+	struct zone *zone;
+
+	proc_dointvec_minmax(table, write, file, buffer, length);
+	if (write) {
+		for_each_zone(zone) {
+			if (zone->present_pages)
+				compact_zone(zone, sysctl_compact_memory,
+						GFP_KERNEL, 1);
+		}
+	}
+	return 0;
+}
+
+static int __init kcompactd_init(void)
+{
+	kernel_thread(kcompactd, NULL, CLONE_KERNEL);
+	return 0;
+}
+
+module_init(kcompactd_init)
@@ -19,6 +19,9 @@
 /*
  * POSIX_FADV_WILLNEED could set PG_Referenced, and POSIX_FADV_NOREUSE could
  * deactivate the pages and clear PG_Referenced.
+ *
+ * FADV_KEEP applies to the whole file, not the given range: reclaim passes
+ * over its pages until it is under real pressure.
  */
 long sys_fadvise64(int fd, loff_t offset, size_t len, int advice)
 {
@@ -68,6 +71,12 @@ long sys_fadvise64(int fd, loff_t offset, size_t len, int advice)
 		invalidate_mapping_pages(mapping, offset >> PAGE_CACHE_SHIFT,
 				(len >> PAGE_CACHE_SHIFT) + 1);
 		break;
+	case FADV_KEEP:
+		set_bit(AS_KEEP, &mapping->flags);
+		break;
+	case FADV_NOKEEP:
+		clear_bit(AS_KEEP, &mapping->flags);
+		break;
 	default:
 		ret = -EINVAL;
 	}
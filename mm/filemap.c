@@ -89,6 +89,28 @@ void __remove_from_page_cache(struct page *page)
 	pagecache_acct(-1);
 }
 
+/*
+ * Like __remove_from_page_cache(), but leave `shadow' in the page's slot for
+ * add_to_page_cache() to find if the page is read in again.  See
+ * mm/workingset.c.
+ */
+void __remove_from_page_cache_shadow(struct page *page, void *shadow)
+{
+	struct address_space *mapping = page->mapping;
+
+	if (!shadow) {
+		__remove_from_page_cache(page);
+		return;
+	}
+	*radix_tree_lookup_slot(&mapping->page_tree, page->index) = shadow;
+	list_del(&page->list);
+	page->mapping = NULL;
+
+	mapping->nrshadows++;
+	mapping->nrpages--;
+	pagecache_acct(-1);
+}
+
 void remove_from_page_cache(struct page *page)
 {
 	struct address_space *mapping = page->mapping;
@@ -216,6 +238,8 @@ restart:
  * set up by swap_out_add_to_swap_cache().
  *
  * This function does not add the page to the LRU.  The caller must do that.
+ * If the page replaces the shadow entry of one reclaim evicted not long ago,
+ * it is marked active, and goes to the active list when it is added.
  */
 int add_to_page_cache(struct page *page, struct address_space *mapping,
 		pgoff_t offset, int gfp_mask)
@@ -223,9 +247,20 @@ int add_to_page_cache(struct page *page, struct address_space *mapping,
 	int error = radix_tree_preload(gfp_mask & ~__GFP_HIGHMEM);
 
 	if (error == 0) {
+		void **slot;
+
 		page_cache_get(page);
 		spin_lock(&mapping->page_lock);
-		error = radix_tree_insert(&mapping->page_tree, offset, page);
+		slot = radix_tree_lookup_slot(&mapping->page_tree, offset);
+		if (slot && *slot && radix_tree_exceptional_entry(*slot)) {
+			if (workingset_refault(*slot))
+				SetPageActive(page);
+			*slot = page;
+			mapping->nrshadows--;
+		} else {
+			error = radix_tree_insert(&mapping->page_tree,
+							offset, page);
+		}
 		if (!error) {
 			SetPageLocked(page);
 			___add_to_page_cache(page, mapping, offset);
@@ -314,6 +349,8 @@ void end_page_writeback(struct page *page)
 {
 	wait_queue_head_t *waitqueue = page_waitqueue(page);
 
+	if (page->mapping)
+		bdi_writeout_inc(page->mapping->backing_dev_info);
 	if (!TestClearPageReclaim(page) || rotate_reclaimable_page(page)) {
 		smp_mb__before_clear_bit();
 		if (!TestClearPageWriteback(page))
@@ -363,6 +400,8 @@ struct page * find_get_page(struct address_space *mapping, unsigned long offset)
 	 */
 	spin_lock(&mapping->page_lock);
 	page = radix_tree_lookup(&mapping->page_tree, offset);
+	if (page && radix_tree_exceptional_entry(page))
+		page = NULL;
 	if (page)
 		page_cache_get(page);
 	spin_unlock(&mapping->page_lock);
@@ -378,7 +417,8 @@ struct page *find_trylock_page(struct address_space *mapping, unsigned long offs
 
 	spin_lock(&mapping->page_lock);
 	page = radix_tree_lookup(&mapping->page_tree, offset);
-	if (page && TestSetPageLocked(page))
+	if (page && (radix_tree_exceptional_entry(page) ||
+			TestSetPageLocked(page)))
 		page = NULL;
 	spin_unlock(&mapping->page_lock);
 	return page;
@@ -403,6 +443,8 @@ struct page *find_lock_page(struct address_space *mapping,
 	spin_lock(&mapping->page_lock);
 repeat:
 	page = radix_tree_lookup(&mapping->page_tree, offset);
+	if (page && radix_tree_exceptional_entry(page))
+		page = NULL;
 	if (page) {
 		page_cache_get(page);
 		if (TestSetPageLocked(page)) {
@@ -544,13 +586,15 @@ void do_generic_mapping_read(struct address_space *mapping,
 			     read_actor_t actor)
 {
 	struct inode *inode = mapping->host;
-	unsigned long index, offset;
+	unsigned long index, offset, last_index;
 	struct page *cached_page;
 	int error;
 
 	cached_page = NULL;
 	index = *ppos >> PAGE_CACHE_SHIFT;
 	offset = *ppos & ~PAGE_CACHE_MASK;
+	last_index = (*ppos + desc->count + PAGE_CACHE_SIZE - 1)
+						>> PAGE_CACHE_SHIFT;
 
 	for (;;) {
 		struct page *page;
@@ -568,18 +612,25 @@ void do_generic_mapping_read(struct address_space *mapping,
 		}
 
 		cond_resched();
-		page_cache_readahead(mapping, ra, filp, index);
 
 		nr = nr - offset;
 find_page:
 		page = find_get_page(mapping, index);
 		if (unlikely(page == NULL)) {
-			handle_ra_miss(mapping, ra, index);
-			goto no_cached_page;
+			page_cache_sync_readahead(mapping, ra, filp,
+						index, last_index - index);
+			page = find_get_page(mapping, index);
+			if (unlikely(page == NULL))
+				goto no_cached_page;
 		}
+		if (PageReadahead(page))
+			page_cache_async_readahead(mapping, ra, filp, page,
+						index, last_index - index);
 		if (!PageUptodate(page))
 			goto page_not_up_to_date;
 page_ok:
+		ra->prev_page = index;
+
 		/* If users can be writing to this page using arbitrary
 		 * virtual addresses, take care about potential aliasing
 		 * before reading the page on the kernel side.
@@ -967,23 +1018,19 @@ retry_all:
 		size = endoff;
 
 	/*
-	 * The readahead code wants to be told about each and every page
-	 * so it can build and shrink its windows appropriately
+	 * Do we have something in the page cache already?
 	 *
 	 * For sequential accesses, we use the generic readahead logic.
 	 */
-	if (VM_SequentialReadHint(area))
-		page_cache_readahead(mapping, ra, file, pgoff);
-
-	/*
-	 * Do we have something in the page cache already?
-	 */
 retry_find:
 	page = find_get_page(mapping, pgoff);
 	if (!page) {
 		if (VM_SequentialReadHint(area)) {
-			handle_ra_miss(mapping, ra, pgoff);
-			goto no_cached_page;
+			if (did_readaround)
+				goto no_cached_page;
+			did_readaround = 1;
+			page_cache_sync_readahead(mapping, ra, file, pgoff, 1);
+			goto retry_find;
 		}
 		ra->mmap_miss++;
 
@@ -1002,6 +1049,13 @@ retry_find:
 	if (!did_readaround)
 		ra->mmap_hit++;
 
+	if (VM_SequentialReadHint(area)) {
+		if (PageReadahead(page))
+			page_cache_async_readahead(mapping, ra, file, page,
+						pgoff, 1);
+		ra->prev_page = pgoff;
+	}
+
 	/*
 	 * Ok, found a page in the page cache, now we need to check
 	 * that it's up-to-date.
@@ -1271,6 +1325,10 @@ int generic_file_mmap(struct file * file, struct vm_area_struct * vma)
 
 	if (!mapping->a_ops->readpage)
 		return -ENOEXEC;
+	/* A loop device is writing to the file's blocks directly */
+	if (IS_PINNED(inode) &&
+	    (vma->vm_flags & VM_SHARED) && (vma->vm_flags & VM_MAYWRITE))
+		return -ETXTBSY;
 	update_atime(inode);
 	vma->vm_ops = &generic_file_vm_ops;
 	return 0;
@@ -1542,6 +1600,9 @@ inline int generic_write_checks(struct inode *inode,
         }
 
 	if (!isblk) {
+		if (unlikely(IS_PINNED(inode)))
+			return -ETXTBSY;
+
 		/* FIXME: this is for backwards compatibility with 2.4 */
 		if (file->f_flags & O_APPEND)
                         *pos = inode->i_size;
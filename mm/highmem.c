@@ -48,20 +48,82 @@ static void page_pool_free(void *page, void *data)
  *  1 means that there are no users, but it has been mapped
  *    since the last TLB flush - so we can't use it.
  *  n means that there are (n-1) current users of it.
+ *
+ * The pkmap area is split into segments, one per cpu as far as that
+ * leaves at least 64 entries in each, and every segment has its own
+ * lock.  A cpu takes new mappings from its own segment, and only when
+ * that is full from one of the others which is not busy.  The count of
+ * an entry is protected by the lock of the segment it is in.
+ *
+ * Entries whose count has dropped to 1 are only unmapped when no clean
+ * entry is left anywhere, all at once and with a single TLB flush.
  */
 #ifdef CONFIG_HIGHMEM
+
+#define PKMAP_SEGS	(NR_CPUS < LAST_PKMAP / 64 ? NR_CPUS : LAST_PKMAP / 64)
+#define PKMAP_SEG_SIZE	(LAST_PKMAP / PKMAP_SEGS)
+
+struct pkmap_seg {
+	spinlock_t lock;
+	unsigned int last;		/* last entry handed out */
+	unsigned int nr_used;		/* entries with a non-zero count */
+} ____cacheline_aligned_in_smp;
+
 static int pkmap_count[LAST_PKMAP];
-static unsigned int last_pkmap_nr;
-static spinlock_t kmap_lock __cacheline_aligned_in_smp = SPIN_LOCK_UNLOCKED;
+static struct pkmap_seg pkmap_segs[PKMAP_SEGS] = {
+	[0 ... PKMAP_SEGS - 1] = { .lock = SPIN_LOCK_UNLOCKED },
+};
+static spinlock_t pkmap_flush_lock = SPIN_LOCK_UNLOCKED;
+
+/*
+ * Serialises setting up a new mapping of a page, so that two cpus
+ * kmapping it at the same time don't both give it an entry.
+ */
+#define PKMAP_PAGE_LOCK_ORDER	5
+static spinlock_t pkmap_page_locks[1 << PKMAP_PAGE_LOCK_ORDER] = {
+	[0 ... (1 << PKMAP_PAGE_LOCK_ORDER) - 1] = SPIN_LOCK_UNLOCKED,
+};
 
 pte_t * pkmap_page_table;
 
 static DECLARE_WAIT_QUEUE_HEAD(pkmap_map_wait);
 
-static void flush_all_zero_pkmaps(void)
+static inline spinlock_t *pkmap_page_lock(struct page *page)
 {
+	return &pkmap_page_locks[hash_ptr(page, PKMAP_PAGE_LOCK_ORDER)];
+}
+
+/* The last segment also gets the entries left over by the division */
+static inline unsigned int pkmap_seg_start(int seg)
+{
+	return seg * PKMAP_SEG_SIZE;
+}
+
+static inline unsigned int pkmap_seg_end(int seg)
+{
+	return seg == PKMAP_SEGS - 1 ? LAST_PKMAP : (seg + 1) * PKMAP_SEG_SIZE;
+}
+
+static inline struct pkmap_seg *pkmap_seg_of(unsigned long nr)
+{
+	unsigned long seg = nr / PKMAP_SEG_SIZE;
+
+	return &pkmap_segs[seg < PKMAP_SEGS ? seg : PKMAP_SEGS - 1];
+}
+
+/*
+ * Unmap all unused entries and flush the TLBs once for all of them.
+ * Returns the number of entries which became usable.
+ */
+static int flush_all_zero_pkmaps(void)
+{
+	int freed = 0;
 	int i;
 
+	spin_lock(&pkmap_flush_lock);
+	for (i = 0; i < PKMAP_SEGS; i++)
+		spin_lock(&pkmap_segs[i].lock);
+
 	flush_cache_all();
 
 	for (i = 0; i < LAST_PKMAP; i++) {
@@ -76,6 +138,8 @@ static void flush_all_zero_pkmaps(void)
 		if (pkmap_count[i] != 1)
 			continue;
 		pkmap_count[i] = 0;
+		pkmap_seg_of(i)->nr_used--;
+		freed++;
 
 		/* sanity check */
 		if (pte_none(pkmap_page_table[i]))
@@ -85,7 +149,7 @@ static void flush_all_zero_pkmaps(void)
 		 * Don't need an atomic fetch-and-clear op here;
 		 * no-one has the page mapped, and cannot get at
 		 * its virtual address (and hence PTE) without first
-		 * getting the kmap_lock (which is held here).
+		 * getting the segment lock (which is held here).
 		 * So no dangers, even with speculative execution.
 		 */
 		page = pte_page(pkmap_page_table[i]);
@@ -93,90 +157,174 @@ static void flush_all_zero_pkmaps(void)
 
 		set_page_address(page, NULL);
 	}
-	flush_tlb_kernel_range(PKMAP_ADDR(0), PKMAP_ADDR(LAST_PKMAP));
+	if (freed) {
+		flush_tlb_kernel_range(PKMAP_ADDR(0), PKMAP_ADDR(LAST_PKMAP));
+		inc_page_state(kmapflush);
+	}
+
+	for (i = PKMAP_SEGS - 1; i >= 0; i--)
+		spin_unlock(&pkmap_segs[i].lock);
+	spin_unlock(&pkmap_flush_lock);
+
+	/* Others may be waiting for entries which are usable now */
+	if (freed && waitqueue_active(&pkmap_map_wait))
+		wake_up(&pkmap_map_wait);
+	return freed;
 }
 
-static inline unsigned long map_new_virtual(struct page *page)
+/*
+ * Map the page at a clean entry of the segment, which has one.  The
+ * segment lock is held.
+ */
+static unsigned long pkmap_seg_map(int seg, struct page *page)
 {
+	struct pkmap_seg *s = &pkmap_segs[seg];
+	unsigned int start = pkmap_seg_start(seg);
+	unsigned int end = pkmap_seg_end(seg);
+	unsigned int nr = start + s->last;
 	unsigned long vaddr;
-	int count;
-
-start:
-	count = LAST_PKMAP;
-	/* Find an empty entry */
-	for (;;) {
-		last_pkmap_nr = (last_pkmap_nr + 1) & LAST_PKMAP_MASK;
-		if (!last_pkmap_nr) {
-			flush_all_zero_pkmaps();
-			count = LAST_PKMAP;
-		}
-		if (!pkmap_count[last_pkmap_nr])
-			break;	/* Found a usable entry */
-		if (--count)
-			continue;
 
-		/*
-		 * Sleep for somebody else to unmap their entries
-		 */
-		{
-			DECLARE_WAITQUEUE(wait, current);
-
-			__set_current_state(TASK_UNINTERRUPTIBLE);
-			add_wait_queue(&pkmap_map_wait, &wait);
-			spin_unlock(&kmap_lock);
-			schedule();
-			remove_wait_queue(&pkmap_map_wait, &wait);
-			spin_lock(&kmap_lock);
-
-			/* Somebody else might have mapped it while we slept */
-			if (page_address(page))
-				return (unsigned long)page_address(page);
-
-			/* Re-start */
-			goto start;
-		}
-	}
-	vaddr = PKMAP_ADDR(last_pkmap_nr);
-	set_pte(&(pkmap_page_table[last_pkmap_nr]), mk_pte(page, kmap_prot));
+	do {
+		if (++nr == end)
+			nr = start;
+	} while (pkmap_count[nr]);
+	s->last = nr - start;
+	s->nr_used++;
+
+	vaddr = PKMAP_ADDR(nr);
+	set_pte(&(pkmap_page_table[nr]), mk_pte(page, kmap_prot));
 
-	pkmap_count[last_pkmap_nr] = 1;
+	pkmap_count[nr] = 2;
 	set_page_address(page, (void *)vaddr);
 
 	return vaddr;
 }
 
+/*
+ * Find a clean entry for the page, in this cpu's segment if possible,
+ * and map it there with the count taken.  Returns 0 if there is none.
+ */
+static unsigned long pkmap_get_entry(struct page *page)
+{
+	unsigned long vaddr;
+	int this, seg, i;
+
+	this = smp_processor_id() % PKMAP_SEGS;
+	do {
+		for (i = 0; i < PKMAP_SEGS; i++) {
+			struct pkmap_seg *s;
+
+			seg = (this + i) % PKMAP_SEGS;
+			s = &pkmap_segs[seg];
+			if (!i)
+				spin_lock(&s->lock);
+			else if (!spin_trylock(&s->lock))
+				continue;
+			vaddr = 0;
+			if (s->nr_used < pkmap_seg_end(seg) - pkmap_seg_start(seg))
+				vaddr = pkmap_seg_map(seg, page);
+			spin_unlock(&s->lock);
+			if (vaddr)
+				return vaddr;
+		}
+	} while (flush_all_zero_pkmaps());
+	return 0;
+}
+
+static inline int pkmap_clean_entries(void)
+{
+	int i;
+
+	for (i = 0; i < PKMAP_SEGS; i++)
+		if (pkmap_segs[i].nr_used <
+				pkmap_seg_end(i) - pkmap_seg_start(i))
+			return 1;
+	return 0;
+}
+
+/*
+ * Give the page a new mapping.  Returns 0 if the caller has to look
+ * again, because somebody else has mapped the page meanwhile or
+ * because we had to sleep for an entry.
+ */
+static unsigned long map_new_virtual(struct page *page)
+{
+	spinlock_t *lock = pkmap_page_lock(page);
+	unsigned long vaddr = 0;
+	DEFINE_WAIT(wait);
+
+	spin_lock(lock);
+	if (!page_address(page))
+		vaddr = pkmap_get_entry(page);
+	spin_unlock(lock);
+	if (vaddr || page_address(page))
+		return vaddr;
+
+	/*
+	 * Sleep for somebody else to unmap their entries
+	 */
+	prepare_to_wait(&pkmap_map_wait, &wait, TASK_UNINTERRUPTIBLE);
+	if (!pkmap_clean_entries() && !flush_all_zero_pkmaps())
+		schedule();
+	finish_wait(&pkmap_map_wait, &wait);
+	return 0;
+}
+
+/*
+ * Take another reference to the page's existing mapping, if it has one.
+ */
+static unsigned long kmap_existing(struct page *page)
+{
+	struct pkmap_seg *s;
+	unsigned long vaddr;
+
+	vaddr = (unsigned long)page_address(page);
+	if (!vaddr)
+		return 0;
+	s = pkmap_seg_of(PKMAP_NR(vaddr));
+	spin_lock(&s->lock);
+	/* It might have been unmapped before we got the lock */
+	if ((unsigned long)page_address(page) == vaddr) {
+		pkmap_count[PKMAP_NR(vaddr)]++;
+		if (pkmap_count[PKMAP_NR(vaddr)] < 2)
+			BUG();
+	} else
+		vaddr = 0;
+	spin_unlock(&s->lock);
+	return vaddr;
+}
+
 void *kmap_high(struct page *page)
 {
 	unsigned long vaddr;
 
 	/*
 	 * For highmem pages, we can't trust "virtual" until
-	 * after we have the lock.
+	 * after we have the segment lock.
 	 *
 	 * We cannot call this from interrupts, as it may block
 	 */
-	spin_lock(&kmap_lock);
-	vaddr = (unsigned long)page_address(page);
-	if (!vaddr)
-		vaddr = map_new_virtual(page);
-	pkmap_count[PKMAP_NR(vaddr)]++;
-	if (pkmap_count[PKMAP_NR(vaddr)] < 2)
-		BUG();
-	spin_unlock(&kmap_lock);
+	do {
+		vaddr = kmap_existing(page);
+		if (!vaddr)
+			vaddr = map_new_virtual(page);
+	} while (!vaddr);
 	return (void*) vaddr;
 }
 
 void kunmap_high(struct page *page)
 {
+	struct pkmap_seg *s;
 	unsigned long vaddr;
 	unsigned long nr;
 	int need_wakeup;
 
-	spin_lock(&kmap_lock);
 	vaddr = (unsigned long)page_address(page);
 	if (!vaddr)
 		BUG();
 	nr = PKMAP_NR(vaddr);
+	s = pkmap_seg_of(nr);
+	spin_lock(&s->lock);
 
 	/*
 	 * A count must never go down to zero
@@ -191,15 +339,10 @@ void kunmap_high(struct page *page)
 		 * Avoid an unnecessary wake_up() function call.
 		 * The common case is pkmap_count[] == 1, but
 		 * no waiters.
-		 * The tasks queued in the wait-queue are guarded
-		 * by both the lock in the wait-queue-head and by
-		 * the kmap_lock.  As the kmap_lock is held here,
-		 * no need for the wait-queue-head's lock.  Simply
-		 * test if the queue is empty.
 		 */
 		need_wakeup = waitqueue_active(&pkmap_map_wait);
 	}
-	spin_unlock(&kmap_lock);
+	spin_unlock(&s->lock);
 
 	/* do wake-up, if needed, race-free outside of the spin lock */
 	if (need_wakeup)
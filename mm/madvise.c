@@ -7,6 +7,8 @@
 
 #include <linux/mman.h>
 #include <linux/pagemap.h>
+#include <linux/hugetlb.h>
+#include <linux/swap.h>
 
 
 /*
@@ -32,7 +34,12 @@ static long madvise_behavior(struct vm_area_struct * vma, unsigned long start,
 	}
 
 	spin_lock(&mm->page_table_lock);
-	VM_ClearReadHint(vma);
+	if (behavior == MADV_MERGEABLE)
+		vma->vm_flags |= VM_MERGEABLE;
+	else if (behavior == MADV_UNMERGEABLE)
+		vma->vm_flags &= ~VM_MERGEABLE;
+	else
+		VM_ClearReadHint(vma);
 
 	switch (behavior) {
 	case MADV_SEQUENTIAL:
@@ -95,6 +102,8 @@ static long madvise_dontneed(struct vm_area_struct * vma,
 	if (vma->vm_flags & VM_LOCKED)
 		return -EINVAL;
 
+	if (split_anon_hugepage_edges(vma, start, end))
+		return -ENOMEM;
 	zap_page_range(vma, start, end - start);
 	return 0;
 }
@@ -108,9 +117,21 @@ static long madvise_vma(struct vm_area_struct * vma, unsigned long start,
 	case MADV_NORMAL:
 	case MADV_SEQUENTIAL:
 	case MADV_RANDOM:
+	case MADV_UNMERGEABLE:
 		error = madvise_behavior(vma, start, end, behavior);
 		break;
 
+	case MADV_MERGEABLE:
+		/* Only private memory has anonymous pages to merge */
+		error = -EINVAL;
+		if (vma->vm_flags & (VM_SHARED | VM_IO | VM_RESERVED |
+							VM_HUGETLB))
+			break;
+		error = madvise_behavior(vma, start, end, behavior);
+		if (!error)
+			merge_register_mm(vma->vm_mm);
+		break;
+
 	case MADV_WILLNEED:
 		error = madvise_willneed(vma, start, end);
 		break;
@@ -149,6 +170,10 @@ static long madvise_vma(struct vm_area_struct * vma, unsigned long start,
  *		some pages ahead.
  *  MADV_DONTNEED - the application is finished with the given range,
  *		so the kernel can free resources associated with it.
+ *  MADV_MERGEABLE - the range is likely to contain pages identical to
+ *		others, which kmerged may replace by a shared copy.
+ *  MADV_UNMERGEABLE - stop looking for such pages in the range.  Pages
+ *		already shared stay so until they are written to.
  *
  * return values:
  *  zero    - success
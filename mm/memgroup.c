@@ -0,0 +1,201 @@
+/*
+ *  linux/mm/memgroup.c
+ *
+ *  Memory resource groups.
+ *
+ *  An address space can be put into one of MEMGROUP_MAX groups with
+ *  prctl(PR_SET_MEMGROUP), and stays in it over fork and exec.  Every
+ *  page its tasks bring onto the LRU, anonymous or page cache, is charged
+ *  to the group until it is freed, and kept on the group's own LRU list
+ *  besides the zone's.
+ *
+ *  vm.memgroup_limit holds the limits of the groups in kB.  A task whose
+ *  group is over its limit reclaims from the group's pages, oldest first,
+ *  before the page allocator gives it more memory, and global reclaim
+ *  goes for groups over their limit before the zone LRUs.  Charging never
+ *  fails: a group can go over its limit for as long as its pages cannot
+ *  be reclaimed, which is counted in failcnt.
+ *
+ *  Tasks outside any group are not accounted at all.
+ */
+
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/init.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/blkdev.h>
+#include <linux/memgroup.h>
+
+struct mem_group mem_groups[MEMGROUP_MAX];
+unsigned long sysctl_memgroup_limit[MEMGROUP_MAX];
+
+/*
+ * How many rounds of reclaim an allocating task does for its group before
+ * it gives up and allocates over the limit.
+ */
+#define MEMGROUP_RECLAIM_RETRIES	4
+
+void __memgroup_charge(struct page *page, struct mem_group *grp)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&grp->lru_lock, flags);
+	page->mem_group = grp;
+	list_add_tail(&page->group_lru, &grp->lru);
+	grp->usage++;
+	if (memgroup_over_limit(grp))
+		grp->failcnt++;
+	spin_unlock_irqrestore(&grp->lru_lock, flags);
+}
+
+/*
+ * Called when the page is freed, possibly from interrupt context.
+ */
+void __memgroup_uncharge(struct page *page)
+{
+	struct mem_group *grp = page->mem_group;
+	unsigned long flags;
+
+	spin_lock_irqsave(&grp->lru_lock, flags);
+	list_del(&page->group_lru);
+	grp->usage--;
+	page->mem_group = NULL;
+	spin_unlock_irqrestore(&grp->lru_lock, flags);
+}
+
+/*
+ * Collect up to `nr' of the group's oldest pages for reclaim, moving
+ * them to the young end of its list so that the next call gets others.
+ * The pages are not pinned: the caller has to check under the zone's
+ * lru_lock that they are still on the LRU and in the group.
+ */
+int memgroup_oldest(struct mem_group *grp, struct page **pages, int nr)
+{
+	int i;
+
+	spin_lock_irq(&grp->lru_lock);
+	for (i = 0; i < nr && i < grp->usage; i++) {
+		struct page *page;
+
+		page = list_entry(grp->lru.next, struct page, group_lru);
+		list_move_tail(&page->group_lru, &grp->lru);
+		pages[i] = page;
+	}
+	spin_unlock_irq(&grp->lru_lock);
+	return i;
+}
+
+void __memgroup_enforce(struct mem_group *grp, unsigned int gfp_mask)
+{
+	int tries;
+
+	/* Reclaim itself must not recurse in here */
+	if (current->flags & PF_MEMALLOC)
+		return;
+
+	current->flags |= PF_MEMALLOC;
+	for (tries = 0; tries < MEMGROUP_RECLAIM_RETRIES &&
+			memgroup_over_limit(grp); tries++) {
+		if (shrink_mem_group(grp, gfp_mask, SWAP_CLUSTER_MAX))
+			continue;
+		if (!(gfp_mask & __GFP_FS))
+			break;
+		/* Wait for some writeback to complete */
+		blk_congestion_wait(WRITE, HZ/10);
+	}
+	current->flags &= ~PF_MEMALLOC;
+}
+
+int memgroup_get(void)
+{
+	struct mem_group *grp = current->mm->mem_group;
+
+	return grp ? memgroup_id(grp) : 0;
+}
+
+/*
+ * Move the current address space to group `id', or out of any group if
+ * it is zero.  The pages it has already are left charged where they are.
+ */
+int memgroup_set(int id)
+{
+	if (!capable(CAP_SYS_RESOURCE))
+		return -EPERM;
+	if (id < 0 || id > MEMGROUP_MAX)
+		return -EINVAL;
+	current->mm->mem_group = id ? &mem_groups[id - 1] : NULL;
+	return 0;
+}
+
+#ifdef CONFIG_PROC_FS
+static void *memgroup_start(struct seq_file *m, loff_t *pos)
+{
+	return *pos < MEMGROUP_MAX ? &mem_groups[*pos] : NULL;
+}
+
+static void *memgroup_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	++*pos;
+	return memgroup_start(m, pos);
+}
+
+static void memgroup_stop(struct seq_file *m, void *v)
+{
+}
+
+static int memgroup_show(struct seq_file *m, void *v)
+{
+	struct mem_group *grp = v;
+
+	if (grp == mem_groups)
+		seq_puts(m, "Group\tUsage\tLimit\tFailcnt\tReclaimed\n");
+	seq_printf(m, "%d\t%lu\t%lu\t%lu\t%lu\n",
+		memgroup_id(grp),
+		grp->usage << (PAGE_SHIFT - 10),
+		sysctl_memgroup_limit[grp - mem_groups],
+		grp->failcnt,
+		grp->reclaimed << (PAGE_SHIFT - 10));
+	return 0;
+}
+
+static struct seq_operations memgroup_op = {
+	.start =	memgroup_start,
+	.next =		memgroup_next,
+	.stop =		memgroup_stop,
+	.show =		memgroup_show
+};
+
+static int memgroup_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &memgroup_op);
+}
+
+static struct file_operations proc_memgroup_operations = {
+	.open		= memgroup_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= seq_release,
+};
+#endif /* CONFIG_PROC_FS */
+
+static int __init memgroup_init(void)
+{
+#ifdef CONFIG_PROC_FS
+	struct proc_dir_entry *entry;
+#endif
+	int i;
+
+	for (i = 0; i < MEMGROUP_MAX; i++) {
+		spin_lock_init(&mem_groups[i].lru_lock);
+		INIT_LIST_HEAD(&mem_groups[i].lru);
+	}
+#ifdef CONFIG_PROC_FS
+	entry = create_proc_entry("memgroup", 0, NULL);
+	if (entry)
+		entry->proc_fops = &proc_memgroup_operations;
+#endif
+	return 0;
+}
+
+__initcall(memgroup_init);
@@ -65,6 +65,12 @@ unsigned long num_physpages;
 void * high_memory;
 struct page *highmem_start_page;
 
+/*
+ * Number of pages around a file fault which do_no_page() will map if
+ * they are already uptodate in the pagecache.  0 or 1 turns it off.
+ */
+int fault_around_pages = 16;
+
 /*
  * We special-case the C-O-W ZERO_PAGE, because it's such
  * a common occurrence (no need to read the page to know
@@ -384,6 +390,12 @@ zap_pte_range(struct mmu_gather *tlb, pmd_t * pmd,
 
 	if (pmd_none(*pmd))
 		return;
+	if (pmd_huge(*pmd)) {
+		/* Partly covered huge pmds have been split by the caller */
+		if (!(address & ~PMD_MASK) && size >= PMD_SIZE)
+			zap_anon_hugepage(tlb, pmd);
+		return;
+	}
 	if (pmd_bad(*pmd)) {
 		pmd_ERROR(*pmd);
 		pmd_clear(pmd);
@@ -600,6 +612,9 @@ void zap_page_range(struct vm_area_struct *vma,
 		return;
 	}
 
+	/* If this fails, the partly covered huge pages stay mapped */
+	split_anon_hugepage_edges(vma, address, end);
+
 	lru_add_drain();
 	spin_lock(&mm->page_table_lock);
 	tlb = tlb_gather_mmu(mm, 0);
@@ -1025,7 +1040,7 @@ static int do_wp_page(struct mm_struct *mm, struct vm_area_struct * vma,
 	pte_chain = pte_chain_alloc(GFP_KERNEL);
 	if (!pte_chain)
 		goto no_mem;
-	new_page = alloc_page(GFP_HIGHUSER);
+	new_page = alloc_page_vma(GFP_HIGHUSER, vma, address);
 	if (!new_page)
 		goto no_mem;
 	copy_cow_page(old_page,new_page,address);
@@ -1165,6 +1180,54 @@ void swapin_readahead(swp_entry_t entry)
 	lru_add_drain();	/* Push any new pages onto the LRU now */
 }
 
+#define SWAP_RA_MAX	32
+
+/*
+ * Swap readahead for a process fault goes by virtual address instead: it
+ * reads the swap entries of the ptes in the aligned block of
+ * (1 << page_cluster) pages around the fault, within the vma.  The pages
+ * of a mapping are given swap slots next to each other (see
+ * get_swap_page_near()), so this is normally one sequential read, and
+ * unlike reading the neighbouring slots it only brings in pages of the
+ * faulting mapping.  The faulting entry is read as part of the block.
+ */
+static void swapin_readahead_vma(struct mm_struct *mm,
+		struct vm_area_struct *vma, pmd_t *pmd, unsigned long address)
+{
+	swp_entry_t entries[SWAP_RA_MAX];
+	unsigned long start, end, size;
+	struct page *page;
+	pte_t *ptep;
+	int i, nr = 0;
+
+	if (!page_cluster)
+		return;
+	size = min(1UL << page_cluster, (unsigned long)SWAP_RA_MAX) << PAGE_SHIFT;
+	/* An aligned block never crosses a page table */
+	start = max(address & ~(size - 1), vma->vm_start);
+	end = min((address & ~(size - 1)) + size, vma->vm_end);
+
+	spin_lock(&mm->page_table_lock);
+	ptep = pte_offset_map(pmd, start);
+	for (i = 0; start + i * PAGE_SIZE < end; i++) {
+		pte_t pte = ptep[i];
+
+		if (pte_none(pte) || pte_present(pte) || pte_file(pte))
+			continue;
+		entries[nr++] = pte_to_swp_entry(pte);
+	}
+	pte_unmap(ptep);
+	spin_unlock(&mm->page_table_lock);
+
+	for (i = 0; i < nr; i++) {
+		/* NULL if the entry was freed meanwhile */
+		page = read_swap_cache_async(entries[i]);
+		if (page)
+			page_cache_release(page);
+	}
+	lru_add_drain();	/* Push any new pages onto the LRU now */
+}
+
 /*
  * We hold the mm semaphore and the page_table_lock on entry and
  * should release the pagetable lock on exit..
@@ -1183,7 +1246,7 @@ static int do_swap_page(struct mm_struct * mm,
 	spin_unlock(&mm->page_table_lock);
 	page = lookup_swap_cache(entry);
 	if (!page) {
-		swapin_readahead(entry);
+		swapin_readahead_vma(mm, vma, pmd, address);
 		page = read_swap_cache_async(entry);
 		if (!page) {
 			/*
@@ -1289,10 +1352,9 @@ do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		pte_unmap(page_table);
 		spin_unlock(&mm->page_table_lock);
 
-		page = alloc_page(GFP_HIGHUSER);
+		page = alloc_zeroed_user_highpage(vma, addr);
 		if (!page)
 			goto no_mem;
-		clear_user_highpage(page, addr);
 
 		spin_lock(&mm->page_table_lock);
 		page_table = pte_offset_map(pmd, addr);
@@ -1328,6 +1390,117 @@ out:
 	return ret;
 }
 
+/*
+ * Gather the pagecache pages in the fault_around_pages sized, aligned
+ * block of the vma around address, not crossing a page table.  Returns
+ * the number of pages, each with a reference held.  No locks are needed.
+ */
+static int
+gather_fault_around(struct vm_area_struct *vma, unsigned long address,
+		struct page **pages)
+{
+	struct address_space *mapping;
+	unsigned long start, end, pgoff, end_pgoff;
+	int nr = fault_around_pages;
+	int i, ret;
+
+	if (nr > FAULT_AROUND_MAX)
+		nr = FAULT_AROUND_MAX;
+	if (nr <= 1 || VM_RandomReadHint(vma) ||
+	    vma->vm_ops->nopage != filemap_nopage)
+		return 0;
+
+	address &= PAGE_MASK;
+	start = address - ((address >> PAGE_SHIFT) % nr) * PAGE_SIZE;
+	end = start + nr * PAGE_SIZE;
+	if (start < vma->vm_start)
+		start = vma->vm_start;
+	if (start < (address & PMD_MASK))
+		start = address & PMD_MASK;
+	if (end > vma->vm_end)
+		end = vma->vm_end;
+	if (end - 1 > (address & PMD_MASK) + PMD_SIZE - 1)
+		end = (address & PMD_MASK) + PMD_SIZE;
+
+	mapping = vma->vm_file->f_dentry->d_inode->i_mapping;
+	pgoff = ((start - vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
+	end_pgoff = pgoff + ((end - start) >> PAGE_SHIFT);
+	nr = (end - start) >> PAGE_SHIFT;
+
+	ret = find_get_pages(mapping, pgoff, nr, pages);
+	for (i = 0; i < ret; i++) {
+		if (pages[i]->index >= end_pgoff) {
+			while (i < ret)
+				page_cache_release(pages[--ret]);
+			break;
+		}
+	}
+	return ret;
+}
+
+/*
+ * Map the gathered pages which are uptodate and have nothing mapped at
+ * their address yet, read-only unless the vma is shared.  Called with
+ * the page_table_lock held, after the faulting pte has been set.  The
+ * references of the pages which were mapped are passed to their ptes,
+ * the rest are left in pages[] for the caller to drop.
+ */
+static int
+map_fault_around(struct mm_struct *mm, struct vm_area_struct *vma,
+		pmd_t *pmd, struct page **pages, int nr,
+		struct pte_chain **pte_chainp)
+{
+	struct address_space *mapping;
+	unsigned long size;
+	int i, mapped = 0;
+
+	mapping = vma->vm_file->f_dentry->d_inode->i_mapping;
+	size = (mapping->host->i_size + PAGE_CACHE_SIZE - 1) >>
+							PAGE_CACHE_SHIFT;
+	for (i = 0; i < nr; i++) {
+		struct page *page = pages[i];
+		unsigned long addr;
+		pte_t *pte;
+		pte_t entry;
+
+		if (page->index >= size)
+			break;
+		addr = vma->vm_start +
+			((page->index - vma->vm_pgoff) << PAGE_SHIFT);
+		if (!PageUptodate(page) || TestSetPageLocked(page))
+			continue;
+		if (page->mapping != mapping || !PageUptodate(page)) {
+			unlock_page(page);
+			continue;
+		}
+		pte = pte_offset_map(pmd, addr);
+		if (!pte_none(*pte)) {
+			pte_unmap(pte);
+			unlock_page(page);
+			continue;
+		}
+		if (!*pte_chainp) {
+			*pte_chainp = pte_chain_alloc(GFP_ATOMIC);
+			if (!*pte_chainp) {
+				pte_unmap(pte);
+				unlock_page(page);
+				break;
+			}
+		}
+		++mm->rss;
+		flush_icache_page(vma, page);
+		entry = mk_pte(page, vma->vm_page_prot);
+		set_pte(pte, entry);
+		*pte_chainp = page_add_rmap(page, pte, *pte_chainp);
+		pte_unmap(pte);
+		update_mmu_cache(vma, addr, entry);
+		unlock_page(page);
+		pages[i] = NULL;
+		mapped++;
+	}
+	return mapped;
+}
+
 /*
  * do_no_page() tries to create a new page mapping. It aggressively
  * tries to share with existing pages, but makes a separate copy if
@@ -1337,6 +1510,9 @@ out:
  * As this is called only for pages that do not currently exist, we
  * do not need to flush old virtual caches or the TLB.
  *
+ * For pagecache backed vmas, neighbouring pages which are already
+ * uptodate are mapped as well, see fault_around_pages.
+ *
  * This is called with the MM semaphore held and the page table
  * spinlock held. Exit with the spinlock released.
  */
@@ -1347,7 +1523,9 @@ do_no_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	struct page * new_page;
 	pte_t entry;
 	struct pte_chain *pte_chain;
-	int ret;
+	struct page *around[FAULT_AROUND_MAX];
+	int nr_around;
+	int i, ret;
 
 	if (!vma->vm_ops || !vma->vm_ops->nopage)
 		return do_anonymous_page(mm, vma, page_table,
@@ -1363,6 +1541,8 @@ do_no_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	if (new_page == NOPAGE_OOM)
 		return VM_FAULT_OOM;
 
+	nr_around = gather_fault_around(vma, address, around);
+
 	pte_chain = pte_chain_alloc(GFP_KERNEL);
 	if (!pte_chain)
 		goto oom;
@@ -1371,7 +1551,7 @@ do_no_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	 * Should we do an early C-O-W break?
 	 */
 	if (write_access && !(vma->vm_flags & VM_SHARED)) {
-		struct page * page = alloc_page(GFP_HIGHUSER);
+		struct page * page = alloc_page_vma(GFP_HIGHUSER, vma, address);
 		if (!page) {
 			page_cache_release(new_page);
 			goto oom;
@@ -1405,6 +1585,9 @@ do_no_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		set_pte(page_table, entry);
 		pte_chain = page_add_rmap(new_page, page_table, pte_chain);
 		pte_unmap(page_table);
+		if (nr_around)
+			map_fault_around(mm, vma, pmd, around, nr_around,
+					&pte_chain);
 	} else {
 		/* One of our sibling threads was faster, back out. */
 		pte_unmap(page_table);
@@ -1422,6 +1605,9 @@ do_no_page(struct mm_struct *mm, struct vm_area_struct *vma,
 oom:
 	ret = VM_FAULT_OOM;
 out:
+	for (i = 0; i < nr_around; i++)
+		if (around[i])
+			page_cache_release(around[i]);
 	pte_chain_free(pte_chain);
 	return ret;
 }
@@ -1540,7 +1726,25 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct * vma,
 	pmd = pmd_alloc(mm, pgd, address);
 
 	if (pmd) {
-		pte_t * pte = pte_alloc_map(mm, pmd, address);
+		pte_t * pte;
+
+		if (pmd_none(*pmd)) {
+			int ret = anon_hugepage_fault(mm, vma, address,
+							pmd, write_access);
+			if (ret)
+				return ret;
+		}
+		if (pmd_huge(*pmd)) {
+			/*
+			 * Another thread mapped a huge page here, or this is
+			 * a write after mprotect() made it writable again.
+			 */
+			if (write_access)
+				anon_hugepage_write_fault(vma, address, pmd);
+			spin_unlock(&mm->page_table_lock);
+			return VM_FAULT_MINOR;
+		}
+		pte = pte_alloc_map(mm, pmd, address);
 		if (pte)
 			return handle_pte_fault(mm, vma, address, write_access, pte, pmd);
 	}
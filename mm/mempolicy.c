@@ -0,0 +1,831 @@
+/*
+ * Simple NUMA memory policy for the Linux kernel.
+ *
+ * A policy says which nodes the pages of a task, or of a range of its
+ * address space, are allocated from:
+ *
+ * default	Allocate on the local node, falling back to the nearest
+ *		others as the normal zonelists do.
+ *
+ * preferred	Try the given node first, then fall back as above.
+ *
+ * bind		Only allocate on the given nodes.  The allocation fails,
+ *		and the OOM handling kicks in, when they are all full.
+ *
+ * interleave	Spread the pages round robin over the given nodes.  For a
+ *		task policy the next node is kept in the task; for a vma
+ *		policy it is chosen by the page's offset in the mapping, so
+ *		that the placement does not depend on the order of faults.
+ *
+ * The task policy is set with set_mempolicy(), and applies to everything
+ * the task allocates in process context.  mbind() sets the policy of a
+ * range of vmas, splitting them as necessary; it only applies to pages
+ * faulted in after the call, unless MPOL_MF_MOVE asks for the pages
+ * already there to be moved as well.  Shared memory objects keep one
+ * policy for the whole object, through the set_policy/get_policy vm
+ * operations.
+ *
+ * migrate_pages() moves the pages of a running task from one set of nodes
+ * to another, eg. after it has been moved to other cpus.
+ *
+ * Policies are reference counted and never changed once set up.  The task
+ * policy is only replaced by the task itself, and vma policies only under
+ * mmap_sem held for writing, so readers need take no reference.
+ */
+
+#include <linux/config.h>
+#include <linux/mempolicy.h>
+#include <linux/mm.h>
+#include <linux/highmem.h>
+#include <linux/hugetlb.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/swap.h>
+#include <linux/string.h>
+#include <linux/interrupt.h>
+#include <linux/init.h>
+#include <asm/uaccess.h>
+
+#define NODEMASK_LONGS	BITS_TO_LONGS(MAX_NUMNODES)
+
+static inline int page_node(struct page *page)
+{
+	return page_zone(page)->zone_pgdat->node_id;
+}
+
+/* Do sanity checking on a policy */
+static int mpol_check_policy(int mode, unsigned long *nodes)
+{
+	int empty = find_first_bit(nodes, MAX_NUMNODES) >= MAX_NUMNODES;
+	int nd;
+
+	switch (mode) {
+	case MPOL_DEFAULT:
+		if (!empty)
+			return -EINVAL;
+		break;
+	case MPOL_BIND:
+	case MPOL_INTERLEAVE:
+		/* Preferred only uses the first node, or none for local */
+		if (empty)
+			return -EINVAL;
+		break;
+	}
+	for (nd = find_first_bit(nodes, MAX_NUMNODES); nd < MAX_NUMNODES;
+	     nd = find_next_bit(nodes, MAX_NUMNODES, nd + 1))
+		if (!node_online(nd))
+			return -EINVAL;
+	return 0;
+}
+
+/*
+ * Copy a node mask of maxnode bits in from user space.  Bits for nodes
+ * the kernel does not know about have to be clear.
+ */
+static int get_nodes(unsigned long *nodes, unsigned long __user *nmask,
+		     unsigned long maxnode, int mode)
+{
+	unsigned long nlongs;
+	unsigned long endmask;
+	unsigned long bits;
+
+	CLEAR_BITMAP(nodes, MAX_NUMNODES);
+	if (maxnode == 0 || !nmask)
+		return mpol_check_policy(mode, nodes);
+	if (maxnode > PAGE_SIZE * 8)
+		return -EINVAL;
+
+	nlongs = BITS_TO_LONGS(maxnode);
+	if (maxnode % BITS_PER_LONG)
+		endmask = (1UL << (maxnode % BITS_PER_LONG)) - 1;
+	else
+		endmask = ~0UL;
+
+	if (nlongs > NODEMASK_LONGS) {
+		unsigned long k;
+
+		for (k = NODEMASK_LONGS; k < nlongs; k++) {
+			unsigned long t;
+
+			if (get_user(t, nmask + k))
+				return -EFAULT;
+			if (k == nlongs - 1)
+				t &= endmask;
+			if (t)
+				return -EINVAL;
+		}
+		nlongs = NODEMASK_LONGS;
+		endmask = ~0UL;
+	}
+
+	if (copy_from_user(nodes, nmask, nlongs * sizeof(unsigned long)))
+		return -EFAULT;
+	nodes[nlongs - 1] &= endmask;
+
+	bits = nlongs * BITS_PER_LONG;
+	if (find_next_bit(nodes, bits, MAX_NUMNODES) < bits)
+		return -EINVAL;
+	return mpol_check_policy(mode, nodes);
+}
+
+/*
+ * Build the zonelists for a bind policy: one per GFP zone modifier, as
+ * build_zonelists() does, but containing only the zones of the given
+ * nodes.
+ */
+static struct zonelist *bind_zonelists(unsigned long *nodes)
+{
+	struct zonelist *zl;
+	int i, j, k, nd;
+
+	zl = kmalloc(MAX_NR_ZONES * sizeof(struct zonelist), GFP_KERNEL);
+	if (!zl)
+		return NULL;
+	for (i = 0; i < MAX_NR_ZONES; i++) {
+		j = 0;
+		k = ZONE_NORMAL;
+		if (i & __GFP_HIGHMEM)
+			k = ZONE_HIGHMEM;
+		if (i & __GFP_DMA)
+			k = ZONE_DMA;
+		for (; k >= 0; k--) {
+			for (nd = find_first_bit(nodes, MAX_NUMNODES);
+			     nd < MAX_NUMNODES;
+			     nd = find_next_bit(nodes, MAX_NUMNODES, nd + 1)) {
+				struct zone *z = &NODE_DATA(nd)->node_zones[k];
+
+				if (z->present_pages)
+					zl[i].zones[j++] = z;
+			}
+		}
+		zl[i].zones[j] = NULL;
+	}
+	return zl;
+}
+
+/* Create a new policy */
+static struct mempolicy *mpol_new(int mode, unsigned long *nodes)
+{
+	struct mempolicy *policy;
+
+	if (mode == MPOL_DEFAULT)
+		return NULL;
+	policy = kmalloc(sizeof(struct mempolicy), GFP_KERNEL);
+	if (!policy)
+		return ERR_PTR(-ENOMEM);
+	atomic_set(&policy->refcnt, 1);
+	policy->policy = mode;
+	policy->preferred_node = -1;
+	policy->zonelists = NULL;
+	memcpy(policy->nodes, nodes, sizeof(policy->nodes));
+
+	switch (mode) {
+	case MPOL_PREFERRED:
+		policy->preferred_node = find_first_bit(nodes, MAX_NUMNODES);
+		if (policy->preferred_node >= MAX_NUMNODES)
+			policy->preferred_node = -1;
+		break;
+	case MPOL_BIND:
+		policy->zonelists = bind_zonelists(nodes);
+		if (!policy->zonelists) {
+			kfree(policy);
+			return ERR_PTR(-ENOMEM);
+		}
+		break;
+	}
+	return policy;
+}
+
+void __mpol_free(struct mempolicy *pol)
+{
+	if (!atomic_dec_and_test(&pol->refcnt))
+		return;
+	if (pol->zonelists)
+		kfree(pol->zonelists);
+	kfree(pol);
+}
+
+int __mpol_equal(struct mempolicy *a, struct mempolicy *b)
+{
+	if (!a || !b)
+		return 0;
+	if (a->policy != b->policy)
+		return 0;
+	switch (a->policy) {
+	case MPOL_PREFERRED:
+		return a->preferred_node == b->preferred_node;
+	case MPOL_BIND:
+	case MPOL_INTERLEAVE:
+		return !memcmp(a->nodes, b->nodes, sizeof(a->nodes));
+	}
+	return 1;
+}
+
+/*
+ * Check that the range is mapped without holes and, for MPOL_MF_STRICT,
+ * that the pages already present are on the policy's nodes.
+ */
+static int verify_pages(struct mm_struct *mm, unsigned long addr,
+			unsigned long end, unsigned long *nodes)
+{
+	int err = 0;
+
+	spin_lock(&mm->page_table_lock);
+	for (; addr < end; addr += PAGE_SIZE) {
+		struct page *page = follow_page(mm, addr, 0);
+
+		if (!page || PageReserved(page))
+			continue;
+		if (!test_bit(page_node(page), nodes)) {
+			err = -EIO;
+			break;
+		}
+	}
+	spin_unlock(&mm->page_table_lock);
+	return err;
+}
+
+static struct vm_area_struct *
+check_range(struct mm_struct *mm, unsigned long start, unsigned long end,
+	    unsigned long *nodes, unsigned long flags)
+{
+	struct vm_area_struct *first, *vma, *prev;
+	int err;
+
+	first = find_vma(mm, start);
+	if (!first || first->vm_start > start)
+		return ERR_PTR(-EFAULT);
+	prev = NULL;
+	for (vma = first; vma && vma->vm_start < end; vma = vma->vm_next) {
+		if (prev && prev->vm_end < vma->vm_start)
+			return ERR_PTR(-EFAULT);
+		if (vma->vm_end < end &&
+		    (!vma->vm_next || vma->vm_next->vm_start > vma->vm_end))
+			return ERR_PTR(-EFAULT);
+		if ((flags & MPOL_MF_STRICT) &&
+		    !(vma->vm_flags & (VM_IO | VM_RESERVED))) {
+			unsigned long s = max(start, vma->vm_start);
+			unsigned long e = min(end, vma->vm_end);
+
+			err = verify_pages(mm, s, e, nodes);
+			if (err)
+				return ERR_PTR(err);
+		}
+		prev = vma;
+	}
+	return first;
+}
+
+/* Apply a policy to a single vma */
+static int policy_vma(struct vm_area_struct *vma, struct mempolicy *new)
+{
+	struct mempolicy *old = vma->vm_policy;
+	int err = 0;
+
+	if (vma->vm_ops && vma->vm_ops->set_policy)
+		err = vma->vm_ops->set_policy(vma, new);
+	if (!err) {
+		mpol_get(new);
+		vma->vm_policy = new;
+		mpol_free(old);
+	}
+	return err;
+}
+
+/* Step through the vmas in the range, splitting them at its edges */
+static int mbind_range(struct vm_area_struct *vma, unsigned long start,
+		       unsigned long end, struct mempolicy *new)
+{
+	struct vm_area_struct *next;
+	int err = 0;
+
+	for (; vma && vma->vm_start < end; vma = next) {
+		next = vma->vm_next;
+		if (vma->vm_start < start)
+			err = split_vma(vma->vm_mm, vma, start, 1);
+		if (!err && vma->vm_end > end)
+			err = split_vma(vma->vm_mm, vma, end, 0);
+		if (!err)
+			err = policy_vma(vma, new);
+		if (err)
+			break;
+	}
+	return err;
+}
+
+/* Fill a node mask with the nodes of a policy */
+static void get_zonemask(struct mempolicy *p, unsigned long *nodes)
+{
+	CLEAR_BITMAP(nodes, MAX_NUMNODES);
+	if (!p)
+		return;
+	switch (p->policy) {
+	case MPOL_BIND:
+	case MPOL_INTERLEAVE:
+		memcpy(nodes, p->nodes, sizeof(p->nodes));
+		break;
+	case MPOL_PREFERRED:
+		/* An empty mask means the local node */
+		if (p->preferred_node >= 0)
+			set_bit(p->preferred_node, nodes);
+		break;
+	}
+}
+
+/*
+ * Isolate the page mapped at addr if it is on one of the given nodes or,
+ * with `on' clear, if it is not.  Pages mapped more than once are left
+ * alone unless `shared' is set.
+ */
+static struct page *isolate_mapped_page(struct mm_struct *mm,
+		unsigned long addr, unsigned long *nodes, int on, int shared,
+		struct list_head *list)
+{
+	struct page *page;
+
+	spin_lock(&mm->page_table_lock);
+	page = follow_page(mm, addr, 0);
+	if (page && (PageReserved(page) || PageCompound(page) ||
+		     !!test_bit(page_node(page), nodes) != on ||
+		     (!shared && !PageDirect(page)) ||
+		     !isolate_lru_page(page, list)))
+		page = NULL;
+	spin_unlock(&mm->page_table_lock);
+	return page;
+}
+
+static inline unsigned int migrate_gfp(struct page *page)
+{
+	return (PageHighMem(page) ? GFP_HIGHUSER : GFP_USER) |
+				__GFP_NOWARN | __GFP_NORETRY;
+}
+
+/*
+ * The allocator falls back to other nodes when the one asked for is
+ * short of memory; there is no point in moving a page there.
+ */
+static int move_to(struct page *page, struct page *newpage,
+		   unsigned long *nodes)
+{
+	if (!newpage)
+		return -ENOMEM;
+	if (!test_bit(page_node(newpage), nodes)) {
+		__free_page(newpage);
+		return -ENOMEM;
+	}
+	return migrate_page_to(page, newpage, GFP_KERNEL);
+}
+
+/*
+ * Move the pages in the range which are not on the policy's nodes to
+ * where the policy allocates now.
+ */
+static void mbind_move(struct vm_area_struct *vma, unsigned long start,
+		      unsigned long end, unsigned long *nodes)
+{
+	LIST_HEAD(pagelist);
+
+	for (; vma && vma->vm_start < end; vma = vma->vm_next) {
+		unsigned long addr = max(start, vma->vm_start);
+		unsigned long e = min(end, vma->vm_end);
+
+		if (vma->vm_flags & (VM_IO | VM_RESERVED))
+			continue;
+		for (; addr < e; addr += PAGE_SIZE) {
+			struct page *page, *newpage;
+
+			page = isolate_mapped_page(vma->vm_mm, addr, nodes,
+							0, 0, &pagelist);
+			if (!page)
+				continue;
+			newpage = alloc_page_vma(migrate_gfp(page), vma, addr);
+			move_to(page, newpage, nodes);
+			cond_resched();
+		}
+		putback_lru_pages(&pagelist);
+	}
+}
+
+asmlinkage long sys_mbind(unsigned long start, unsigned long len,
+			  unsigned long mode, unsigned long __user *nmask,
+			  unsigned long maxnode, unsigned int flags)
+{
+	struct mm_struct *mm = current->mm;
+	struct vm_area_struct *vma;
+	struct mempolicy *new;
+	unsigned long end;
+	DECLARE_BITMAP(nodes, MAX_NUMNODES);
+	int err;
+
+	if ((flags & ~(MPOL_MF_STRICT | MPOL_MF_MOVE)) || mode > MPOL_MAX)
+		return -EINVAL;
+	if (start & ~PAGE_MASK)
+		return -EINVAL;
+	len = (len + PAGE_SIZE - 1) & PAGE_MASK;
+	end = start + len;
+	if (end < start)
+		return -EINVAL;
+	if (end == start)
+		return 0;
+
+	err = get_nodes(nodes, nmask, maxnode, mode);
+	if (err)
+		return err;
+
+	new = mpol_new(mode, nodes);
+	if (IS_ERR(new))
+		return PTR_ERR(new);
+	/* Where the policy puts pages: a preferred policy uses one node */
+	get_zonemask(new, nodes);
+	/* The local node can't be checked against in advance */
+	if (find_first_bit(nodes, MAX_NUMNODES) >= MAX_NUMNODES)
+		flags &= ~(MPOL_MF_STRICT | MPOL_MF_MOVE);
+
+	down_write(&mm->mmap_sem);
+	vma = check_range(mm, start, end, nodes,
+			  (flags & MPOL_MF_MOVE) ? 0 : flags);
+	err = PTR_ERR(vma);
+	if (!IS_ERR(vma))
+		err = mbind_range(vma, start, end, new);
+	if (!err && (flags & MPOL_MF_MOVE)) {
+		/* find_vma() again, mbind_range() may have split the first */
+		mbind_move(find_vma(mm, start), start, end, nodes);
+		/* Shared pages and those that didn't move count for STRICT */
+		if (flags & MPOL_MF_STRICT) {
+			vma = check_range(mm, start, end, nodes, MPOL_MF_STRICT);
+			if (IS_ERR(vma))
+				err = PTR_ERR(vma);
+		}
+	}
+	up_write(&mm->mmap_sem);
+	mpol_free(new);
+	return err;
+}
+
+/* Set the process memory policy */
+asmlinkage long sys_set_mempolicy(int mode, unsigned long __user *nmask,
+				  unsigned long maxnode)
+{
+	struct mempolicy *new;
+	DECLARE_BITMAP(nodes, MAX_NUMNODES);
+	int err;
+
+	if (mode < 0 || mode > MPOL_MAX)
+		return -EINVAL;
+	err = get_nodes(nodes, nmask, maxnode, mode);
+	if (err)
+		return err;
+	new = mpol_new(mode, nodes);
+	if (IS_ERR(new))
+		return PTR_ERR(new);
+	mpol_free(current->mempolicy);
+	current->mempolicy = new;
+	if (new && new->policy == MPOL_INTERLEAVE)
+		current->il_next = find_first_bit(new->nodes, MAX_NUMNODES);
+	return 0;
+}
+
+static int lookup_node(struct mm_struct *mm, unsigned long addr)
+{
+	struct page *p;
+	int err;
+
+	err = get_user_pages(current, mm, addr & PAGE_MASK, 1, 0, 0, &p, NULL);
+	if (err >= 0) {
+		err = page_node(p);
+		put_page(p);
+	}
+	return err;
+}
+
+/* Copy a kernel node mask to user space */
+static int copy_nodes_to_user(unsigned long __user *mask,
+			      unsigned long maxnode, unsigned long *nodes)
+{
+	unsigned long copy = BITS_TO_LONGS(maxnode) * sizeof(unsigned long);
+
+	if (copy > sizeof(unsigned long) * NODEMASK_LONGS) {
+		if (copy > PAGE_SIZE)
+			return -EINVAL;
+		if (clear_user((char __user *)mask +
+				sizeof(unsigned long) * NODEMASK_LONGS,
+				copy - sizeof(unsigned long) * NODEMASK_LONGS))
+			return -EFAULT;
+		copy = sizeof(unsigned long) * NODEMASK_LONGS;
+	}
+	return copy_to_user(mask, nodes, copy) ? -EFAULT : 0;
+}
+
+/* Retrieve a policy, of the task or of the vma at addr */
+asmlinkage long sys_get_mempolicy(int __user *policy,
+				  unsigned long __user *nmask,
+				  unsigned long maxnode,
+				  unsigned long addr, unsigned long flags)
+{
+	struct mm_struct *mm = current->mm;
+	struct vm_area_struct *vma = NULL;
+	struct mempolicy *pol = current->mempolicy;
+	int err, pval;
+
+	if (flags & ~(MPOL_F_NODE | MPOL_F_ADDR))
+		return -EINVAL;
+	if (nmask != NULL && maxnode < MAX_NUMNODES)
+		return -EINVAL;
+
+	if (flags & MPOL_F_ADDR) {
+		down_read(&mm->mmap_sem);
+		vma = find_vma(mm, addr);
+		if (!vma || vma->vm_start > addr) {
+			up_read(&mm->mmap_sem);
+			return -EFAULT;
+		}
+		if (vma->vm_ops && vma->vm_ops->get_policy)
+			pol = vma->vm_ops->get_policy(vma, addr);
+		else {
+			pol = vma->vm_policy;
+			mpol_get(pol);
+		}
+	} else {
+		if (addr)
+			return -EINVAL;
+		mpol_get(pol);
+	}
+
+	if (flags & MPOL_F_NODE) {
+		if (flags & MPOL_F_ADDR) {
+			err = lookup_node(mm, addr);
+			if (err < 0)
+				goto out;
+			pval = err;
+		} else if (pol && pol->policy == MPOL_INTERLEAVE) {
+			pval = current->il_next;
+		} else {
+			err = -EINVAL;
+			goto out;
+		}
+	} else
+		pval = pol ? pol->policy : MPOL_DEFAULT;
+
+	err = 0;
+	if (policy && put_user(pval, policy)) {
+		err = -EFAULT;
+		goto out;
+	}
+	if (nmask) {
+		DECLARE_BITMAP(nodes, MAX_NUMNODES);
+
+		get_zonemask(pol, nodes);
+		err = copy_nodes_to_user(nmask, maxnode, nodes);
+	}
+out:
+	if (vma)
+		up_read(&mm->mmap_sem);
+	mpol_free(pol);
+	return err;
+}
+
+/*
+ * The node pages on `node' are moved to: the nth node of `from' maps to
+ * the nth node of `to', wrapping around if `to' has fewer nodes.
+ */
+static int node_remap(int node, unsigned long *from, unsigned long *to)
+{
+	int n = 0, w = 0, nid;
+
+	for (nid = find_first_bit(from, MAX_NUMNODES); nid < node;
+	     nid = find_next_bit(from, MAX_NUMNODES, nid + 1))
+		n++;
+	for (nid = find_first_bit(to, MAX_NUMNODES); nid < MAX_NUMNODES;
+	     nid = find_next_bit(to, MAX_NUMNODES, nid + 1))
+		w++;
+	n %= w;
+	for (nid = find_first_bit(to, MAX_NUMNODES); n > 0; n--)
+		nid = find_next_bit(to, MAX_NUMNODES, nid + 1);
+	return nid;
+}
+
+/*
+ * Move the pages of mm which are on the nodes in `from'.  Every address
+ * is looked at once, so a page moved to a node which is in `from' too
+ * isn't moved on again.  Returns the number of pages that stayed.
+ */
+static int do_migrate_pages(struct mm_struct *mm, unsigned long *from,
+			    unsigned long *to, int shared)
+{
+	struct vm_area_struct *vma;
+	LIST_HEAD(pagelist);
+	DECLARE_BITMAP(dst, MAX_NUMNODES);
+	int nr_failed = 0;
+
+	down_read(&mm->mmap_sem);
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		unsigned long addr;
+
+		if (vma->vm_flags & (VM_IO | VM_RESERVED))
+			continue;
+		for (addr = vma->vm_start; addr < vma->vm_end;
+						addr += PAGE_SIZE) {
+			struct page *page, *newpage;
+			int nid;
+
+			page = isolate_mapped_page(mm, addr, from, 1, shared,
+							&pagelist);
+			if (!page)
+				continue;
+			nid = node_remap(page_node(page), from, to);
+			if (nid == page_node(page))
+				continue;	/* putback below */
+			CLEAR_BITMAP(dst, MAX_NUMNODES);
+			set_bit(nid, dst);
+			newpage = alloc_pages_node(nid, migrate_gfp(page), 0);
+			if (move_to(page, newpage, dst))
+				nr_failed++;
+			cond_resched();
+		}
+		putback_lru_pages(&pagelist);
+	}
+	up_read(&mm->mmap_sem);
+	return nr_failed;
+}
+
+/*
+ * Move the pages of a task from one set of nodes to another.  Pages which
+ * other tasks map as well are only moved for a caller with CAP_SYS_NICE.
+ * Returns the number of pages which could not be moved.
+ */
+asmlinkage long sys_migrate_pages(pid_t pid, unsigned long maxnode,
+				  unsigned long __user *old_nodes,
+				  unsigned long __user *new_nodes)
+{
+	struct task_struct *task;
+	struct mm_struct *mm;
+	DECLARE_BITMAP(from, MAX_NUMNODES);
+	DECLARE_BITMAP(to, MAX_NUMNODES);
+	int err;
+
+	err = get_nodes(from, old_nodes, maxnode, MPOL_BIND);
+	if (err)
+		return err;
+	err = get_nodes(to, new_nodes, maxnode, MPOL_BIND);
+	if (err)
+		return err;
+
+	read_lock(&tasklist_lock);
+	task = pid ? find_task_by_pid(pid) : current;
+	if (!task) {
+		read_unlock(&tasklist_lock);
+		return -ESRCH;
+	}
+	if ((current->euid != task->euid) && (current->euid != task->uid) &&
+			!capable(CAP_SYS_NICE)) {
+		read_unlock(&tasklist_lock);
+		return -EPERM;
+	}
+	mm = get_task_mm(task);
+	read_unlock(&tasklist_lock);
+	if (!mm)
+		return -EINVAL;
+
+	err = do_migrate_pages(mm, from, to, capable(CAP_SYS_NICE));
+	mmput(mm);
+	return err;
+}
+
+/* Return the zonelist an allocation under a policy should use */
+static struct zonelist *zonelist_policy(unsigned int gfp, struct mempolicy *pol)
+{
+	int nd = numa_node_id();
+
+	if (pol) {
+		switch (pol->policy) {
+		case MPOL_PREFERRED:
+			if (pol->preferred_node >= 0)
+				nd = pol->preferred_node;
+			break;
+		case MPOL_BIND:
+			/*
+			 * None of the bound nodes may have the zone asked
+			 * for, eg. for a GFP_DMA allocation.  Those are
+			 * kernel allocations and aren't worth failing.
+			 */
+			if (pol->zonelists[gfp & GFP_ZONEMASK].zones[0])
+				return pol->zonelists + (gfp & GFP_ZONEMASK);
+			break;
+		}
+	}
+	return NODE_DATA(nd)->node_zonelists + (gfp & GFP_ZONEMASK);
+}
+
+/* Do dynamic interleaving for a process */
+static unsigned interleave_nodes(struct mempolicy *policy)
+{
+	unsigned nid, next;
+	struct task_struct *me = current;
+
+	nid = me->il_next;
+	if (nid >= MAX_NUMNODES || !test_bit(nid, policy->nodes))
+		nid = find_first_bit(policy->nodes, MAX_NUMNODES);
+	next = find_next_bit(policy->nodes, MAX_NUMNODES, nid + 1);
+	if (next >= MAX_NUMNODES)
+		next = find_first_bit(policy->nodes, MAX_NUMNODES);
+	me->il_next = next;
+	return nid;
+}
+
+/* Do static interleaving for an offset into a vma or an object */
+static unsigned offset_il_node(struct mempolicy *pol, unsigned long off)
+{
+	unsigned nnodes = 0;
+	unsigned target;
+	int nid, c;
+
+	for (nid = find_first_bit(pol->nodes, MAX_NUMNODES); nid < MAX_NUMNODES;
+	     nid = find_next_bit(pol->nodes, MAX_NUMNODES, nid + 1))
+		nnodes++;
+	target = off % nnodes;
+	c = 0;
+	nid = -1;
+	do {
+		nid = find_next_bit(pol->nodes, MAX_NUMNODES, nid + 1);
+		c++;
+	} while (c <= target);
+	return nid;
+}
+
+static inline struct page *alloc_page_interleave(unsigned int gfp,
+					unsigned int order, unsigned nid)
+{
+	return __alloc_pages(gfp, order,
+			NODE_DATA(nid)->node_zonelists + (gfp & GFP_ZONEMASK));
+}
+
+/**
+ * alloc_page_policy - allocate a page under a given policy
+ * @gfp_mask: the usual GFP flags
+ * @pol: the policy, NULL for the default one
+ * @ilx: offset of the page in the object, for interleaving
+ *
+ * For users which keep the policy themselves, like shared memory objects.
+ */
+struct page *alloc_page_policy(unsigned int gfp_mask, struct mempolicy *pol,
+			       unsigned long ilx)
+{
+	if (pol && pol->policy == MPOL_INTERLEAVE)
+		return alloc_page_interleave(gfp_mask, 0,
+					     offset_il_node(pol, ilx));
+	return __alloc_pages(gfp_mask, 0, zonelist_policy(gfp_mask, pol));
+}
+
+/**
+ * alloc_page_vma - allocate a page for a vma
+ * @gfp_mask: the usual GFP flags
+ * @vma: the vma the page will be mapped into
+ * @addr: the virtual address the page will be mapped at
+ *
+ * Uses the policy of the vma if it has one, else that of the task.
+ * mmap_sem must be held.
+ */
+struct page *alloc_page_vma(unsigned int gfp_mask, struct vm_area_struct *vma,
+			    unsigned long addr)
+{
+	struct mempolicy *pol = NULL;
+	struct mempolicy *shared = NULL;
+	unsigned long off = 0;
+	struct page *page;
+
+	if (vma) {
+		/* get_policy() hands back a reference */
+		if (vma->vm_ops && vma->vm_ops->get_policy)
+			pol = shared = vma->vm_ops->get_policy(vma, addr);
+		else
+			pol = vma->vm_policy;
+		off = vma->vm_pgoff + ((addr - vma->vm_start) >> PAGE_SHIFT);
+	}
+	if (!pol)
+		pol = current->mempolicy;
+	page = alloc_page_policy(gfp_mask, pol, off);
+	mpol_free(shared);
+	return page;
+}
+
+/**
+ * alloc_pages_current - allocate pages under the task's policy
+ * @gfp: the usual GFP flags
+ * @order: the order of the allocation
+ *
+ * Allocations from interrupt context, and by tasks with no policy of
+ * their own, are made on the local node.
+ */
+struct page *alloc_pages_current(unsigned int gfp, unsigned int order)
+{
+	struct mempolicy *pol = current->mempolicy;
+
+	if (in_interrupt() || !pol)
+		return __alloc_pages(gfp, order,
+			NODE_DATA(numa_node_id())->node_zonelists +
+						(gfp & GFP_ZONEMASK));
+	if (pol->policy == MPOL_INTERLEAVE)
+		return alloc_page_interleave(gfp, order, interleave_nodes(pol));
+	return __alloc_pages(gfp, order, zonelist_policy(gfp, pol));
+}
@@ -0,0 +1,127 @@
+/*
+ *  linux/mm/mempressure.c
+ *
+ *  Memory pressure notification.
+ *
+ *  When direct reclaim in try_to_free_pages() has to go down to priority
+ *  vm.pressure_priority without freeing enough, the machine is on its way
+ *  to running out of memory, and out_of_memory() is what comes next if it
+ *  goes on like that.  Each such event makes /proc/mempressure readable,
+ *  so that user space which polls it can shed load in time, rather than
+ *  leave the OOM killer to pick a victim.
+ *
+ *  A read returns the number of events so far and the lowest priority the
+ *  last one got to (0 is the last pass before the OOM killer), and blocks
+ *  until there is an event the reader has not seen yet.  Events less than
+ *  MEMPRESSURE_INTERVAL apart are merged into one.
+ */
+
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/init.h>
+#include <linux/poll.h>
+#include <linux/proc_fs.h>
+#include <linux/sched.h>
+#include <asm/uaccess.h>
+
+#define MEMPRESSURE_INTERVAL	(HZ / 5)
+
+static spinlock_t mempressure_lock = SPIN_LOCK_UNLOCKED;
+static DECLARE_WAIT_QUEUE_HEAD(mempressure_wait);
+static unsigned long mempressure_events;
+static unsigned long mempressure_stamp;	/* jiffies of the last event */
+static int mempressure_priority;	/* lowest priority it got to */
+
+/**
+ * mem_pressure_notify - signal memory pressure to user space
+ * @priority: the reclaim priority which failed to free enough
+ */
+void mem_pressure_notify(int priority)
+{
+	spin_lock(&mempressure_lock);
+	if (mempressure_events &&
+	    time_before(jiffies, mempressure_stamp + MEMPRESSURE_INTERVAL)) {
+		if (priority < mempressure_priority)
+			mempressure_priority = priority;
+		spin_unlock(&mempressure_lock);
+		return;
+	}
+	mempressure_events++;
+	mempressure_stamp = jiffies;
+	mempressure_priority = priority;
+	spin_unlock(&mempressure_lock);
+	wake_up_interruptible(&mempressure_wait);
+}
+
+#ifdef CONFIG_PROC_FS
+/*
+ * file->private_data is the number of events the reader has seen.
+ */
+static inline int mempressure_pending(struct file *file)
+{
+	return (unsigned long)file->private_data != mempressure_events;
+}
+
+static int mempressure_open(struct inode *inode, struct file *file)
+{
+	file->private_data = (void *)mempressure_events;
+	return 0;
+}
+
+static ssize_t mempressure_read(struct file *file, char *buf,
+				size_t count, loff_t *ppos)
+{
+	unsigned long events;
+	char buffer[32];
+	int priority;
+	int len;
+
+	if (!mempressure_pending(file)) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		if (wait_event_interruptible(mempressure_wait,
+					mempressure_pending(file)))
+			return -ERESTARTSYS;
+	}
+
+	spin_lock(&mempressure_lock);
+	events = mempressure_events;
+	priority = mempressure_priority;
+	spin_unlock(&mempressure_lock);
+
+	len = sprintf(buffer, "%lu %d\n", events, priority);
+	if (count < len)
+		return -EINVAL;
+	if (copy_to_user(buf, buffer, len))
+		return -EFAULT;
+	file->private_data = (void *)events;
+	return len;
+}
+
+static unsigned int mempressure_poll(struct file *file, poll_table *wait)
+{
+	poll_wait(file, &mempressure_wait, wait);
+	if (mempressure_pending(file))
+		return POLLIN | POLLRDNORM;
+	return 0;
+}
+
+static struct file_operations proc_mempressure_operations = {
+	.open		= mempressure_open,
+	.read		= mempressure_read,
+	.poll		= mempressure_poll,
+	.llseek		= no_llseek,
+};
+
+static int __init mempressure_init(void)
+{
+	struct proc_dir_entry *entry;
+
+	entry = create_proc_entry("mempressure", S_IRUGO, NULL);
+	if (entry)
+		entry->proc_fops = &proc_mempressure_operations;
+	return 0;
+}
+
+__initcall(mempressure_init);
+#endif /* CONFIG_PROC_FS */
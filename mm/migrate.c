@@ -0,0 +1,200 @@
+/*
+ *  linux/mm/migrate.c
+ *
+ *  Moving the contents of pages to other pages, for memory compaction and
+ *  for NUMA placement.
+ *
+ *  A page is moved the way shrink_list() would free it: it is unmapped
+ *  through the reverse map, anonymous pages getting a swap cache entry
+ *  first, and once nobody but the cache holds a reference its place in the
+ *  radix tree is taken by a copy.  Faults find the copy there, exactly as
+ *  if the page had been reclaimed and read back in - without any I/O.
+ */
+
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include <linux/buffer_head.h>	/* for try_to_release_page() */
+#include <linux/mm_inline.h>
+#include <linux/pagevec.h>
+#include <linux/rmap-locking.h>
+#include <linux/memgroup.h>
+
+/*
+ * Move `page', which is isolated from the LRU and locked, to `newpage'.
+ * Returns zero on success.  On failure nothing has changed, except that
+ * an anonymous page may have been added to the swap cache and unmapped.
+ */
+int migrate_page(struct page *page, struct page *newpage,
+			unsigned int gfp_mask)
+{
+	struct address_space *mapping;
+
+	if (PageWriteback(page))
+		return -EBUSY;
+
+	pte_chain_lock(page);
+#ifdef CONFIG_SWAP
+	if (page_mapped(page) && !page->mapping && !PagePrivate(page)) {
+		pte_chain_unlock(page);
+		if (!(gfp_mask & __GFP_IO) || !add_to_swap(page))
+			return -ENOMEM;
+		pte_chain_lock(page);
+	}
+#endif
+	mapping = page->mapping;
+	if (!mapping) {
+		pte_chain_unlock(page);
+		return -EINVAL;
+	}
+	if (page_mapped(page) && try_to_unmap(page) != SWAP_SUCCESS) {
+		pte_chain_unlock(page);
+		return -EAGAIN;
+	}
+	pte_chain_unlock(page);
+
+	/* Buffers point at the page, so they have to go */
+	if (PagePrivate(page) && !try_to_release_page(page, gfp_mask))
+		return -EBUSY;
+
+	if (radix_tree_preload(gfp_mask & ~__GFP_HIGHMEM))
+		return -ENOMEM;
+
+	spin_lock(&mapping->page_lock);
+	/* pagecache + us, as in shrink_list() */
+	if (page_count(page) != 2 || page->mapping != mapping) {
+		spin_unlock(&mapping->page_lock);
+		radix_tree_preload_end();
+		return -EAGAIN;
+	}
+
+	/*
+	 * Nobody can look the page up while we hold page_lock, and nobody
+	 * has it mapped, so the copy can't go stale under us.
+	 */
+	copy_highpage(newpage, page);
+
+	SetPageLocked(newpage);
+	SetPageUptodate(newpage);
+	if (PageError(page))
+		SetPageError(newpage);
+	if (PageReferenced(page))
+		SetPageReferenced(newpage);
+	if (PageChecked(page))
+		SetPageChecked(newpage);
+	if (PageMappedToDisk(page))
+		SetPageMappedToDisk(newpage);
+	if (PageReadahead(page))
+		SetPageReadahead(newpage);
+	/* The dirty page count stays the same */
+	if (PageDirty(page)) {
+		ClearPageDirty(page);
+		SetPageDirty(newpage);
+	}
+	newpage->mapping = mapping;
+	newpage->index = page->index;
+	page_cache_get(newpage);
+
+	radix_tree_delete(&mapping->page_tree, page->index);
+	radix_tree_insert(&mapping->page_tree, newpage->index, newpage);
+	/* Same place on the clean/dirty list */
+	list_add(&newpage->list, &page->list);
+	list_del(&page->list);
+	page->mapping = NULL;
+	spin_unlock(&mapping->page_lock);
+	radix_tree_preload_end();
+
+	__put_page(page);		/* The pagecache ref */
+	memgroup_inherit(newpage, page);
+	if (TestClearPageActive(page))
+		lru_cache_add_active(newpage);
+	else
+		lru_cache_add(newpage);
+	unlock_page(newpage);
+	return 0;
+}
+
+/*
+ * Take a page off the LRU, with a reference held, and put it on `list'.
+ * Returns zero if it wasn't on the LRU.  The caller must hold a reference
+ * or otherwise keep the page from being freed, eg. the page_table_lock of
+ * an mm which maps it.
+ */
+int isolate_lru_page(struct page *page, struct list_head *list)
+{
+	struct zone *zone = page_zone(page);
+	int ret = 0;
+
+	spin_lock_irq(&zone->lru_lock);
+	if (TestClearPageLRU(page)) {
+		list_del(&page->lru);
+		if (PageActive(page))
+			zone->nr_active--;
+		else
+			zone->nr_inactive--;
+		page_cache_get(page);
+		list_add_tail(&page->lru, list);
+		ret = 1;
+	}
+	spin_unlock_irq(&zone->lru_lock);
+	return ret;
+}
+
+/*
+ * Put pages isolated by isolate_lru_page() back onto the LRU, and drop
+ * the references taken there.
+ */
+void putback_lru_pages(struct list_head *list)
+{
+	struct page *page;
+
+	while (!list_empty(list)) {
+		struct zone *zone;
+
+		page = list_entry(list->next, struct page, lru);
+		zone = page_zone(page);
+		spin_lock_irq(&zone->lru_lock);
+		if (TestSetPageLRU(page))
+			BUG();
+		list_del(&page->lru);
+		if (PageActive(page))
+			add_page_to_active_list(zone, page);
+		else
+			add_page_to_inactive_list(zone, page);
+		spin_unlock_irq(&zone->lru_lock);
+		page_cache_release(page);
+	}
+}
+
+/**
+ * migrate_page_to - move an isolated page to a newly allocated one
+ * @page: a page isolated by isolate_lru_page()
+ * @newpage: the page to move it to, as returned by the allocator
+ * @gfp_mask: what the move may do to release buffers and the like
+ *
+ * On success the old page is taken off its list and both references are
+ * dropped, so that it is freed as soon as any racing lookups are done
+ * with it.  On failure @newpage is freed and @page left where it was.
+ */
+int migrate_page_to(struct page *page, struct page *newpage,
+		    unsigned int gfp_mask)
+{
+	int err;
+
+	if (TestSetPageLocked(page)) {
+		err = -EAGAIN;
+	} else {
+		err = migrate_page(page, newpage, gfp_mask);
+		unlock_page(page);
+	}
+	if (err) {
+		__free_page(newpage);
+		return err;
+	}
+	list_del(&page->lru);
+	page_cache_release(newpage);
+	page_cache_release(page);
+	inc_page_state(pgmigrate);
+	return 0;
+}
@@ -5,10 +5,12 @@
  */
 
 /*
- * The mincore() system call.
+ * The mincore() and fincore() system calls.
  */
 #include <linux/slab.h>
 #include <linux/pagemap.h>
+#include <linux/pagevec.h>
+#include <linux/file.h>
 #include <linux/mm.h>
 #include <linux/mman.h>
 
@@ -173,3 +175,115 @@ out:
 	up_read(&current->mm->mmap_sem);
 	return error;
 }
+
+/*
+ * Set the bits of the uptodate pages of `mapping' in [start, end) in the
+ * bitmap `tmp', which is clear.  Only the pages which are there are looked
+ * at, so that a large file which is mostly not cached is cheap to scan.
+ */
+static void fincore_chunk(struct address_space *mapping, pgoff_t start,
+	pgoff_t end, unsigned char *tmp)
+{
+	struct pagevec pvec;
+	pgoff_t next = start;
+	int i;
+
+	pagevec_init(&pvec, 0);
+	while (next < end && pagevec_lookup(&pvec, mapping, next,
+				min(end - next, (pgoff_t)PAGEVEC_SIZE))) {
+		for (i = 0; i < pagevec_count(&pvec); i++) {
+			struct page *page = pvec.pages[i];
+			pgoff_t index = page->index;
+
+			if (index >= end) {
+				next = end;
+				break;
+			}
+			if (index >= next)
+				next = index + 1;
+			if (PageUptodate(page))
+				tmp[(index - start) >> 3] |=
+					1 << ((index - start) & 7);
+		}
+		pagevec_release(&pvec);
+		cond_resched();
+	}
+}
+
+/*
+ * The fincore(2) system call.
+ *
+ * fincore() returns the page cache residency status of the pages of the
+ * file open on fd in [start, start + len), without it having to be mapped.
+ * The status is returned in a bitmap: bit (n % 8) of byte (n / 8) of vec
+ * is 1 if the nth page of the range is in memory and up to date, otherwise
+ * it is zero.  vec must have room for one bit per page of the range,
+ * rounded up to a whole byte.
+ *
+ * As with mincore(), the result may be stale by the time it is returned.
+ *
+ * return values:
+ *  zero    - success
+ *  -EBADF  - fd is not an open file descriptor
+ *  -EFAULT - vec points to an illegal address
+ *  -EINVAL - start is not a multiple of PAGE_CACHE_SIZE, or the range
+ *		is beyond the largest possible file
+ *  -EAGAIN - A kernel resource was temporarily unavailable.
+ */
+asmlinkage long sys_fincore(unsigned int fd, loff_t start, size_t len,
+	unsigned char __user * vec)
+{
+	struct address_space *mapping;
+	struct file *file;
+	unsigned char *tmp;
+	pgoff_t index, end;
+	unsigned long bytes;
+	long error = -EINVAL;
+
+	if ((start & ~PAGE_CACHE_MASK) || start < 0 ||
+	    start + len < start || start + len > MAX_LFS_FILESIZE)
+		return error;
+	index = start >> PAGE_CACHE_SHIFT;
+	/* In loff_t: len + PAGE_CACHE_SIZE - 1 can wrap a 32-bit size_t */
+	end = (start + len + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
+	bytes = (end - index + 7) >> 3;
+
+	if (!access_ok(VERIFY_WRITE, (unsigned long) vec, bytes))
+		return -EFAULT;
+	if (!bytes)
+		return 0;
+
+	file = fget(fd);
+	if (!file)
+		return -EBADF;
+	mapping = file->f_dentry->d_inode->i_mapping;
+
+	error = -EAGAIN;
+	tmp = (unsigned char *) __get_free_page(GFP_KERNEL);
+	if (!tmp)
+		goto out;
+
+	/* Each round covers PAGE_SIZE bytes of the bitmap */
+	error = 0;
+	while (bytes) {
+		unsigned long thispiece = min(bytes, PAGE_SIZE);
+		pgoff_t stop = index + thispiece * 8;
+
+		if (stop > end)
+			stop = end;
+		memset(tmp, 0, thispiece);
+		fincore_chunk(mapping, index, stop, tmp);
+		if (copy_to_user(vec, tmp, thispiece)) {
+			error = -EFAULT;
+			break;
+		}
+		vec += thispiece;
+		bytes -= thispiece;
+		index = stop;
+	}
+
+	free_page((unsigned long) tmp);
+out:
+	fput(file);
+	return error;
+}
@@ -87,6 +87,9 @@ static void remove_shared_vm_struct(struct vm_area_struct *vma)
 	}
 }
 
+static int __do_munmap(struct mm_struct *mm, unsigned long start, size_t len,
+	int downgrade);
+
 /*
  *  sys_brk() for the most part doesn't need the global kernel
  *  lock, except when an application is doing something nasty
@@ -111,8 +114,18 @@ asmlinkage unsigned long sys_brk(unsigned long brk)
 
 	/* Always allow shrinking brk. */
 	if (brk <= mm->brk) {
-		if (!do_munmap(mm, newbrk, oldbrk-newbrk))
-			goto set_brk;
+		unsigned long origbrk = mm->brk;
+		int ret;
+
+		/* Set it before mmap_sem may get downgraded */
+		mm->brk = brk;
+		ret = __do_munmap(mm, newbrk, oldbrk-newbrk, 1);
+		if (ret == 1) {
+			up_read(&mm->mmap_sem);
+			return brk;
+		}
+		if (ret)
+			mm->brk = origbrk;
 		goto out;
 	}
 
@@ -319,6 +332,9 @@ static inline int is_mergeable_vma(struct vm_area_struct *vma,
 		return 0;
 	if (vma->vm_private_data)
 		return 0;
+	/* New mappings start out with the default policy */
+	if (vma_policy(vma))
+		return 0;
 	return 1;
 }
 
@@ -623,6 +639,7 @@ munmap_back:
 	vma->vm_file = NULL;
 	vma->vm_private_data = NULL;
 	vma->vm_next = NULL;
+	vma_set_policy(vma, NULL);
 	INIT_LIST_HEAD(&vma->shared);
 
 	if (file) {
@@ -1066,27 +1083,39 @@ no_mmaps:
  */
 static void unmap_vma(struct mm_struct *mm, struct vm_area_struct *area)
 {
-	size_t len = area->vm_end - area->vm_start;
-
-	area->vm_mm->total_vm -= len >> PAGE_SHIFT;
-	if (area->vm_flags & VM_LOCKED)
-		area->vm_mm->locked_vm -= len >> PAGE_SHIFT;
-	/*
-	 * Is this a new hole at the lowest possible address?
-	 */
-	if (area->vm_start >= TASK_UNMAPPED_BASE &&
-				area->vm_start < area->vm_mm->free_area_cache)
-	      area->vm_mm->free_area_cache = area->vm_start;
-
 	remove_shared_vm_struct(area);
 
 	if (area->vm_ops && area->vm_ops->close)
 		area->vm_ops->close(area);
 	if (area->vm_file)
 		fput(area->vm_file);
+	mpol_free(vma_policy(area));
 	kmem_cache_free(vm_area_cachep, area);
 }
 
+/*
+ * Take the detached vmas out of the mm's counters.  This needs mmap_sem
+ * for writing, unlike the rest of the teardown.
+ */
+static void unaccount_vma_list(struct mm_struct *mm,
+	struct vm_area_struct *area)
+{
+	do {
+		size_t len = area->vm_end - area->vm_start;
+
+		mm->total_vm -= len >> PAGE_SHIFT;
+		if (area->vm_flags & VM_LOCKED)
+			mm->locked_vm -= len >> PAGE_SHIFT;
+		/*
+		 * Is this a new hole at the lowest possible address?
+		 */
+		if (area->vm_start >= TASK_UNMAPPED_BASE &&
+					area->vm_start < mm->free_area_cache)
+		      mm->free_area_cache = area->vm_start;
+		area = area->vm_next;
+	} while (area != NULL);
+}
+
 /*
  * Update the VMA and inode share lists.
  *
@@ -1163,12 +1192,17 @@ int split_vma(struct mm_struct * mm, struct vm_area_struct * vma,
 	if (mm->map_count >= MAX_MAP_COUNT)
 		return -ENOMEM;
 
+	/* A huge pmd must not straddle two vmas */
+	if ((addr & ~HPAGE_MASK) && split_anon_hugepage(vma, addr))
+		return -ENOMEM;
+
 	new = kmem_cache_alloc(vm_area_cachep, SLAB_KERNEL);
 	if (!new)
 		return -ENOMEM;
 
 	/* most fields are the same, copy all, and then fixup */
 	*new = *vma;
+	mpol_get(vma_policy(new));
 
 	INIT_LIST_HEAD(&new->shared);
 
@@ -1196,11 +1230,18 @@ int split_vma(struct mm_struct * mm, struct vm_area_struct * vma,
  * what needs doing, and the areas themselves, which do the
  * work.  This now handles partial unmappings.
  * Jeremy Fitzhardinge <jeremy@goop.org>
+ *
+ * With `downgrade' set, mmap_sem is downgraded to a read lock as soon
+ * as the vmas are off the list, so that page faults and other readers
+ * in the rest of the address space can go ahead while the pages are
+ * zapped.  Returns 1 if it was downgraded; the caller then does
+ * up_read() rather than up_write().
  */
-int do_munmap(struct mm_struct *mm, unsigned long start, size_t len)
+static int __do_munmap(struct mm_struct *mm, unsigned long start, size_t len,
+	int downgrade)
 {
 	unsigned long end;
-	struct vm_area_struct *mpnt, *prev, *last;
+	struct vm_area_struct *mpnt, *prev, *last, *next;
 
 	if ((start & ~PAGE_MASK) || start > TASK_SIZE || len > TASK_SIZE-start)
 		return -EINVAL;
@@ -1256,13 +1297,31 @@ int do_munmap(struct mm_struct *mm, unsigned long start, size_t len)
 	 */
 	spin_lock(&mm->page_table_lock);
 	detach_vmas_to_be_unmapped(mm, mpnt, prev, end);
+	unaccount_vma_list(mm, mpnt);
+
+	/*
+	 * A stack next to the hole could be expanded into it under the
+	 * read lock, while we are still freeing its page tables.
+	 */
+	next = prev ? prev->vm_next : mm->mmap;
+	if ((next && (next->vm_flags & VM_GROWSDOWN)) ||
+	    (prev && (prev->vm_flags & VM_GROWSUP)))
+		downgrade = 0;
+	if (downgrade)
+		downgrade_write(&mm->mmap_sem);
+
 	unmap_region(mm, mpnt, prev, start, end);
 	spin_unlock(&mm->page_table_lock);
 
 	/* Fix up all other VM information */
 	unmap_vma_list(mm, mpnt);
 
-	return 0;
+	return downgrade;
+}
+
+int do_munmap(struct mm_struct *mm, unsigned long start, size_t len)
+{
+	return __do_munmap(mm, start, len, 0);
 }
 
 asmlinkage long sys_munmap(unsigned long addr, size_t len)
@@ -1271,7 +1330,11 @@ asmlinkage long sys_munmap(unsigned long addr, size_t len)
 	struct mm_struct *mm = current->mm;
 
 	down_write(&mm->mmap_sem);
-	ret = do_munmap(mm, addr, len);
+	ret = __do_munmap(mm, addr, len, 1);
+	if (ret == 1) {
+		up_read(&mm->mmap_sem);
+		return 0;
+	}
 	up_write(&mm->mmap_sem);
 	return ret;
 }
@@ -1349,6 +1412,7 @@ unsigned long do_brk(unsigned long addr, unsigned long len)
 	vma->vm_pgoff = 0;
 	vma->vm_file = NULL;
 	vma->vm_private_data = NULL;
+	vma_set_policy(vma, NULL);
 	INIT_LIST_HEAD(&vma->shared);
 
 	vma_link(mm, vma, prev, rb_link, rb_parent);
@@ -1423,6 +1487,7 @@ void exit_mmap(struct mm_struct *mm)
 		}
 		if (vma->vm_file)
 			fput(vma->vm_file);
+		mpol_free(vma_policy(vma));
 		kmem_cache_free(vm_area_cachep, vma);
 		vma = next;
 	}
@@ -32,6 +32,12 @@ change_pte_range(pmd_t *pmd, unsigned long address,
 
 	if (pmd_none(*pmd))
 		return;
+	if (pmd_huge(*pmd)) {
+		/* split_vma() has split any huge pmd we cover only part of */
+		if (!(address & ~PMD_MASK) && size >= PMD_SIZE)
+			change_anon_hugepage(pmd, newprot);
+		return;
+	}
 	if (pmd_bad(*pmd)) {
 		pmd_ERROR(*pmd);
 		pmd_clear(pmd);
@@ -124,6 +130,8 @@ mprotect_attempt_merge(struct vm_area_struct *vma, struct vm_area_struct *prev,
 		return 0;
 	if (vma->vm_file || (vma->vm_flags & VM_SHARED))
 		return 0;
+	if (!mpol_equal(vma_policy(prev), vma_policy(vma)))
+		return 0;
 
 	/*
 	 * If the whole area changes to the protection of the previous one
@@ -135,6 +143,7 @@ mprotect_attempt_merge(struct vm_area_struct *vma, struct vm_area_struct *prev,
 		__vma_unlink(mm, vma, prev);
 		spin_unlock(&mm->page_table_lock);
 
+		mpol_free(vma_policy(vma));
 		kmem_cache_free(vm_area_cachep, vma);
 		mm->map_count--;
 		return 1;
@@ -291,12 +300,14 @@ sys_mprotect(unsigned long start, size_t len, unsigned long prot)
 
 	if (next && prev->vm_end == next->vm_start &&
 			can_vma_merge(next, prev->vm_flags) &&
-			!prev->vm_file && !(prev->vm_flags & VM_SHARED)) {
+			!prev->vm_file && !(prev->vm_flags & VM_SHARED) &&
+			mpol_equal(vma_policy(prev), vma_policy(next))) {
 		spin_lock(&prev->vm_mm->page_table_lock);
 		prev->vm_end = next->vm_end;
 		__vma_unlink(prev->vm_mm, next, prev);
 		spin_unlock(&prev->vm_mm->page_table_lock);
 
+		mpol_free(vma_policy(next));
 		kmem_cache_free(vm_area_cachep, next);
 		prev->vm_mm->map_count--;
 	}
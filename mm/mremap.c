@@ -39,7 +39,7 @@ static pte_t *get_one_pte_map_nested(struct mm_struct *mm, unsigned long addr)
 	}
 
 	pmd = pmd_offset(pgd, addr);
-	if (pmd_none(*pmd))
+	if (pmd_none(*pmd) || pmd_huge(*pmd))
 		goto end;
 	if (pmd_bad(*pmd)) {
 		pmd_ERROR(*pmd);
@@ -193,12 +193,17 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 	int allocated_vma;
 	int split = 0;
 
+	/* move_page_tables() only knows about small ptes */
+	if (split_anon_hugepages(vma, addr, addr + old_len))
+		return -ENOMEM;
+
 	new_vma = NULL;
 	next = find_vma_prev(mm, new_addr, &prev);
 	if (next) {
 		if (prev && prev->vm_end == new_addr &&
 		    can_vma_merge(prev, vma->vm_flags) && !vma->vm_file &&
-					!(vma->vm_flags & VM_SHARED)) {
+				!(vma->vm_flags & VM_SHARED) &&
+				mpol_equal(vma_policy(prev), vma_policy(vma))) {
 			spin_lock(&mm->page_table_lock);
 			prev->vm_end = new_addr + new_len;
 			spin_unlock(&mm->page_table_lock);
@@ -206,7 +211,8 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 			if (next != prev->vm_next)
 				BUG();
 			if (prev->vm_end == next->vm_start &&
-					can_vma_merge(next, prev->vm_flags)) {
+					can_vma_merge(next, prev->vm_flags) &&
+				mpol_equal(vma_policy(prev), vma_policy(next))) {
 				spin_lock(&mm->page_table_lock);
 				prev->vm_end = next->vm_end;
 				__vma_unlink(mm, next, prev);
@@ -214,11 +220,13 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 				if (vma == next)
 					vma = prev;
 				mm->map_count--;
+				mpol_free(vma_policy(next));
 				kmem_cache_free(vm_area_cachep, next);
 			}
 		} else if (next->vm_start == new_addr + new_len &&
 			  	can_vma_merge(next, vma->vm_flags) &&
-				!vma->vm_file && !(vma->vm_flags & VM_SHARED)) {
+				!vma->vm_file && !(vma->vm_flags & VM_SHARED) &&
+				mpol_equal(vma_policy(next), vma_policy(vma))) {
 			spin_lock(&mm->page_table_lock);
 			next->vm_start = new_addr;
 			spin_unlock(&mm->page_table_lock);
@@ -228,7 +236,8 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 		prev = find_vma(mm, new_addr-1);
 		if (prev && prev->vm_end == new_addr &&
 		    can_vma_merge(prev, vma->vm_flags) && !vma->vm_file &&
-				!(vma->vm_flags & VM_SHARED)) {
+				!(vma->vm_flags & VM_SHARED) &&
+				mpol_equal(vma_policy(prev), vma_policy(vma))) {
 			spin_lock(&mm->page_table_lock);
 			prev->vm_end = new_addr + new_len;
 			spin_unlock(&mm->page_table_lock);
@@ -249,6 +258,7 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 
 		if (allocated_vma) {
 			*new_vma = *vma;
+			mpol_get(vma_policy(new_vma));
 			INIT_LIST_HEAD(&new_vma->shared);
 			new_vma->vm_start = new_addr;
 			new_vma->vm_end = new_addr+new_len;
@@ -20,6 +20,7 @@
 #include <linux/swap.h>
 #include <linux/timex.h>
 #include <linux/jiffies.h>
+#include <linux/memgroup.h>
 
 /* #define DEBUG */
 
@@ -55,9 +56,10 @@ static unsigned int int_sqrt(unsigned int x)
  *    of least surprise ... (be careful when you change it)
  */
 
-static int badness(struct task_struct *p)
+unsigned long oom_badness(struct task_struct *p)
 {
-	int points, cpu_time, run_time;
+	unsigned long points;
+	int cpu_time, run_time;
 
 	if (!p->mm)
 		return 0;
@@ -87,6 +89,13 @@ static int badness(struct task_struct *p)
 	if (task_nice(p) > 0)
 		points *= 2;
 
+	/*
+	 * A process in a memory group which is over its limit is the
+	 * likely culprit, so make it the first choice.
+	 */
+	if (memgroup_mm_over_limit(p->mm))
+		points *= 4;
+
 	/*
 	 * Superuser processes are usually more important, so we make it
 	 * less likely that we kill those.
@@ -103,8 +112,21 @@ static int badness(struct task_struct *p)
 	 */
 	if (cap_t(p->cap_effective) & CAP_TO_MASK(CAP_SYS_RAWIO))
 		points /= 4;
+
+	/*
+	 * Finally, user space knows best: /proc/<pid>/oom_adj doubles the
+	 * points for every step above zero and halves them for every step
+	 * below.
+	 */
+	if (p->oomkilladj > 0) {
+		if (points > (ULONG_MAX >> p->oomkilladj))
+			points = ULONG_MAX;
+		else
+			points <<= p->oomkilladj;
+	} else if (p->oomkilladj < 0)
+		points >>= -p->oomkilladj;
 #ifdef DEBUG
-	printk(KERN_DEBUG "OOMkill: task %d (%s) got %d points\n",
+	printk(KERN_DEBUG "OOMkill: task %d (%s) got %lu points\n",
 	p->pid, p->comm, points);
 #endif
 	return points;
@@ -118,13 +140,13 @@ static int badness(struct task_struct *p)
  */
 static struct task_struct * select_bad_process(void)
 {
-	int maxpoints = 0;
+	unsigned long maxpoints = 0;
 	struct task_struct *g, *p;
 	struct task_struct *chosen = NULL;
 
 	do_each_thread(g, p)
-		if (p->pid) {
-			int points = badness(p);
+		if (p->pid && p->oomkilladj != OOM_DISABLE) {
+			unsigned long points = oom_badness(p);
 			if (points > maxpoints) {
 				chosen = p;
 				maxpoints = points;
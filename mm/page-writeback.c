@@ -28,6 +28,9 @@
 #include <linux/smp.h>
 #include <linux/sysctl.h>
 #include <linux/cpu.h>
+#include <linux/suspend.h>
+
+#include <asm/div64.h>
 
 /*
  * The maximum number of pages to writeout in a single bdflush/kupdate
@@ -47,6 +50,12 @@ static long ratelimit_pages = 32;
 static long total_pages;	/* The total number of pages in the machine. */
 static int dirty_exceeded;	/* Dirty mem may be over limit */
 
+/*
+ * Each backing device may always dirty at least this fraction of the dirty
+ * memory limit, so that one which has not written anything yet can start.
+ */
+#define BDI_MIN_SHARE	32
+
 /*
  * When balance_dirty_pages decides that the caller needs to perform some
  * non-background writeback, this is how many pages it will attempt to write.
@@ -61,7 +70,7 @@ static inline long sync_writeback_pages(void)
 /* The following parameters are exported via /proc/sys/vm */
 
 /*
- * Start background writeback (via pdflush) at this percentage
+ * Start background writeback (via the per-device flushers) at this percentage
  */
 int dirty_background_ratio = 10;
 
@@ -137,6 +146,94 @@ get_dirty_limits(struct page_state *ps, long *pbackground, long *pdirty)
 	*pdirty = dirty;
 }
 
+/*
+ * The dirty memory limit is shared out between backing devices in proportion
+ * to the rate at which each has recently been completing writeback, so that a
+ * slow device cannot take all of it and throttle writers to fast ones.
+ *
+ * Completions are counted per device and in total.  Each time writeout_period
+ * more completions have been counted in total, a new period starts and all the
+ * counts are halved; for a device this is done lazily, when it is next looked
+ * at.  A device's share is its count over the total, which is then an average
+ * weighted towards recent periods.
+ */
+static atomic_t vm_completions = ATOMIC_INIT(0);
+static unsigned long vm_period;
+static long writeout_period = 1024;
+static spinlock_t writeout_period_lock = SPIN_LOCK_UNLOCKED;
+
+static void bdi_catch_up(struct backing_dev_info *bdi)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&writeout_period_lock, flags);
+	if (bdi->period != vm_period) {
+		unsigned long shift = vm_period - bdi->period;
+		int count = atomic_read(&bdi->completions);
+
+		if (shift < 8 * sizeof(count))
+			count -= count >> shift;
+		atomic_sub(count, &bdi->completions);
+		bdi->period = vm_period;
+	}
+	spin_unlock_irqrestore(&writeout_period_lock, flags);
+}
+
+/*
+ * Called as each page's writeback completes.  May be called from interrupt
+ * context.
+ */
+void bdi_writeout_inc(struct backing_dev_info *bdi)
+{
+	if (bdi->memory_backed)
+		return;
+
+	if (bdi->period != vm_period)
+		bdi_catch_up(bdi);
+	atomic_inc(&bdi->completions);
+	atomic_inc(&vm_completions);
+
+	if (atomic_read(&vm_completions) >= writeout_period) {
+		unsigned long flags;
+		int count;
+
+		spin_lock_irqsave(&writeout_period_lock, flags);
+		count = atomic_read(&vm_completions);
+		if (count >= writeout_period) {
+			atomic_sub(count / 2, &vm_completions);
+			vm_period++;
+		}
+		spin_unlock_irqrestore(&writeout_period_lock, flags);
+	}
+}
+
+/*
+ * Work out how many pages may be dirty against bdi, out of `dirty' for the
+ * machine as a whole.
+ */
+static long bdi_dirty_limit(struct backing_dev_info *bdi, long dirty)
+{
+	long count, total;
+	u64 limit;
+
+	if (dirty <= 0)
+		return 0;
+	if (bdi->period != vm_period)
+		bdi_catch_up(bdi);
+	count = atomic_read(&bdi->completions);
+	total = atomic_read(&vm_completions);
+	if (total <= 0)
+		return dirty;
+	if (count > total)
+		count = total;
+
+	limit = (u64)dirty * count;
+	do_div(limit, total);
+	if (limit < dirty / BDI_MIN_SHARE)
+		limit = dirty / BDI_MIN_SHARE;
+	return limit;
+}
+
 /*
  * balance_dirty_pages() must be called by processes which are generating dirty
  * data.  It looks at the number of dirty pages in the machine and will force
@@ -150,6 +247,7 @@ void balance_dirty_pages(struct address_space *mapping)
 	long nr_reclaimable;
 	long background_thresh;
 	long dirty_thresh;
+	long bdi_thresh;
 	unsigned long pages_written = 0;
 	unsigned long write_chunk = sync_writeback_pages();
 
@@ -168,6 +266,16 @@ void balance_dirty_pages(struct address_space *mapping)
 		if (nr_reclaimable + ps.nr_writeback <= dirty_thresh)
 			break;
 
+		/*
+		 * Over the limit: but only throttle if this device has more
+		 * than its share of the dirty pages which the limit leaves
+		 * room for, after those already under writeback.
+		 */
+		bdi_thresh = bdi_dirty_limit(bdi,
+				dirty_thresh - ps.nr_writeback - ps.nr_unstable);
+		if (atomic_read(&bdi->nr_dirty) <= bdi_thresh)
+			break;
+
 		dirty_exceeded = 1;
 
 		/* Note: nr_reclaimable denotes nr_dirty + nr_unstable.
@@ -229,14 +337,47 @@ void balance_dirty_pages_ratelimited(struct address_space *mapping)
 }
 
 /*
- * writeback at least _min_pages, and keep writing until the amount of dirty
- * memory is less than the background threshold, or until we're all clean.
+ * Background and periodic writeback are done per backing device.  Each device
+ * with dirty data gets a flusher thread of its own, so that writeback proceeds
+ * against many spindles at once, and a slow or congested device (an NFS
+ * server, a USB disk) cannot hold up writeback to the others.
+ *
+ * background_writeout() and wb_kupdate() just find the dirty devices and hand
+ * them over.  A flusher's slot in bdi_flushers[] records what is wanted of it;
+ * requests against a device which already has a flusher are merged into its
+ * slot.  A flusher exits once it has been idle for FLUSHER_IDLE.
+ *
+ * The backing_dev_info is only used as a key: it is compared against those of
+ * the inodes being written back, and never dereferenced.  So it does not
+ * matter if the device goes away while it still has a slot.
  */
-static void background_writeout(unsigned long _min_pages)
+#define MAX_FLUSHERS		32
+#define FLUSHER_IDLE		(5 * HZ)
+
+#define FLUSH_BACKGROUND	1
+#define FLUSH_KUPDATE		2
+
+struct bdi_flusher {
+	struct backing_dev_info *bdi;	/* NULL if the slot is free */
+	struct task_struct *task;	/* The thread, once it is running */
+	int running;			/* The thread has been started */
+	int work;			/* FLUSH_* */
+	long nr_pages;			/* Minimum for FLUSH_BACKGROUND */
+};
+
+static struct bdi_flusher bdi_flushers[MAX_FLUSHERS];
+static spinlock_t bdi_flush_lock = SPIN_LOCK_UNLOCKED;
+
+/*
+ * writeback at least min_pages against bdi, and keep writing until the amount
+ * of dirty memory is less than the background threshold, or until the device
+ * is all clean.
+ */
+static void background_writeout_bdi(struct backing_dev_info *bdi,
+					long min_pages)
 {
-	long min_pages = _min_pages;
 	struct writeback_control wbc = {
-		.bdi		= NULL,
+		.bdi		= bdi,
 		.sync_mode	= WB_SYNC_NONE,
 		.older_than_this = NULL,
 		.nr_to_write	= 0,
@@ -267,47 +408,23 @@ static void background_writeout(unsigned long _min_pages)
 }
 
 /*
- * Start writeback of `nr_pages' pages.  If `nr_pages' is zero, write back
- * the whole world.  Returns 0 if a pdflush thread was dispatched.  Returns
- * -1 if all pdflush threads were busy.
- */
-int wakeup_bdflush(long nr_pages)
-{
-	if (nr_pages == 0) {
-		struct page_state ps;
-
-		get_page_state(&ps);
-		nr_pages = ps.nr_dirty + ps.nr_unstable;
-	}
-	return pdflush_operation(background_writeout, nr_pages);
-}
-
-static struct timer_list wb_timer;
-
-/*
- * Periodic writeback of "old" data.
+ * Periodic writeback of "old" data against bdi.
  *
  * Define "old": the first time one of an inode's pages is dirtied, we mark the
  * dirtying-time in the inode's address_space.  So this periodic writeback code
  * just walks the superblock inode list, writing back any inodes which are
  * older than a specific point in time.
  *
- * Try to run once per dirty_writeback_centisecs.  But if a writeback event
- * takes longer than a dirty_writeback_centisecs interval, then leave a
- * one-second gap.
- *
  * older_than_this takes precedence over nr_to_write.  So we'll only write back
  * all dirty pages if they are all attached to "old" mappings.
  */
-static void wb_kupdate(unsigned long arg)
+static void wb_kupdate_bdi(struct backing_dev_info *bdi)
 {
 	unsigned long oldest_jif;
-	unsigned long start_jif;
-	unsigned long next_jif;
 	long nr_to_write;
 	struct page_state ps;
 	struct writeback_control wbc = {
-		.bdi		= NULL,
+		.bdi		= bdi,
 		.sync_mode	= WB_SYNC_NONE,
 		.older_than_this = &oldest_jif,
 		.nr_to_write	= 0,
@@ -315,12 +432,8 @@ static void wb_kupdate(unsigned long arg)
 		.for_kupdate	= 1,
 	};
 
-	sync_supers();
-
 	get_page_state(&ps);
 	oldest_jif = jiffies - (dirty_expire_centisecs * HZ) / 100;
-	start_jif = jiffies;
-	next_jif = start_jif + (dirty_writeback_centisecs * HZ) / 100;
 	nr_to_write = ps.nr_dirty + ps.nr_unstable +
 			(inodes_stat.nr_inodes - inodes_stat.nr_unused);
 	while (nr_to_write > 0) {
@@ -335,6 +448,163 @@ static void wb_kupdate(unsigned long arg)
 		}
 		nr_to_write -= MAX_WRITEBACK_PAGES - wbc.nr_to_write;
 	}
+}
+
+static int bdi_flusher_thread(void *data)
+{
+	struct bdi_flusher *flusher = data;
+	unsigned long idle_since = jiffies;
+
+	daemonize("flush/%d", (int)(flusher - bdi_flushers));
+	current->flags |= PF_FLUSHER;
+
+	spin_lock(&bdi_flush_lock);
+	flusher->task = current;
+	for ( ; ; ) {
+		struct backing_dev_info *bdi = flusher->bdi;
+		long nr_pages = flusher->nr_pages;
+		int work = flusher->work;
+
+		if (work) {
+			flusher->work = 0;
+			flusher->nr_pages = 0;
+			spin_unlock(&bdi_flush_lock);
+
+			if (work & FLUSH_KUPDATE)
+				wb_kupdate_bdi(bdi);
+			if (work & FLUSH_BACKGROUND)
+				background_writeout_bdi(bdi, nr_pages);
+			idle_since = jiffies;
+
+			spin_lock(&bdi_flush_lock);
+			continue;
+		}
+
+		if (time_after(jiffies, idle_since + FLUSHER_IDLE))
+			break;
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		spin_unlock(&bdi_flush_lock);
+		schedule_timeout(FLUSHER_IDLE);
+		if (current->flags & PF_FREEZE)
+			refrigerator(PF_IOTHREAD);
+		spin_lock(&bdi_flush_lock);
+	}
+	flusher->bdi = NULL;
+	flusher->task = NULL;
+	flusher->running = 0;
+	spin_unlock(&bdi_flush_lock);
+	return 0;
+}
+
+/*
+ * Hand some work to bdi's flusher, starting one if needed.  Returns -1 if
+ * the device could not be given a flusher, in which case the caller should
+ * do the work itself.
+ */
+static int bdi_start_flush(struct backing_dev_info *bdi, int work,
+				long nr_pages)
+{
+	struct bdi_flusher *flusher, *free = NULL;
+	int start = 0;
+
+	spin_lock(&bdi_flush_lock);
+	for (flusher = bdi_flushers;
+	     flusher < bdi_flushers + MAX_FLUSHERS; flusher++) {
+		if (flusher->bdi == bdi)
+			goto found;
+		if (!flusher->bdi && !free)
+			free = flusher;
+	}
+	if (!free) {
+		spin_unlock(&bdi_flush_lock);
+		return -1;
+	}
+	flusher = free;
+	flusher->bdi = bdi;
+found:
+	flusher->work |= work;
+	flusher->nr_pages += nr_pages;
+	if (flusher->task) {
+		wake_up_process(flusher->task);
+	} else if (!flusher->running) {
+		flusher->running = 1;
+		start = 1;
+	}
+	spin_unlock(&bdi_flush_lock);
+
+	if (start && kernel_thread(bdi_flusher_thread, flusher,
+					CLONE_KERNEL) < 0) {
+		spin_lock(&bdi_flush_lock);
+		flusher->bdi = NULL;
+		flusher->running = 0;
+		flusher->work = 0;
+		flusher->nr_pages = 0;
+		spin_unlock(&bdi_flush_lock);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * writeback at least _min_pages, and keep writing until the amount of dirty
+ * memory is less than the background threshold, or until we're all clean.
+ * The minimum is shared out between the dirty devices.
+ */
+static void background_writeout(unsigned long _min_pages)
+{
+	struct backing_dev_info *bdis[MAX_FLUSHERS];
+	long min_pages = _min_pages;
+	int i, nr;
+
+	nr = writeback_dirty_bdis(bdis, MAX_FLUSHERS);
+	for (i = 0; i < nr; i++) {
+		if (bdi_start_flush(bdis[i], FLUSH_BACKGROUND, min_pages / nr))
+			background_writeout_bdi(bdis[i], min_pages / nr);
+	}
+}
+
+/*
+ * Start writeback of `nr_pages' pages.  If `nr_pages' is zero, write back
+ * the whole world.  Returns 0 if a pdflush thread was dispatched.  Returns
+ * -1 if all pdflush threads were busy.
+ */
+int wakeup_bdflush(long nr_pages)
+{
+	if (nr_pages == 0) {
+		struct page_state ps;
+
+		get_page_state(&ps);
+		nr_pages = ps.nr_dirty + ps.nr_unstable;
+	}
+	return pdflush_operation(background_writeout, nr_pages);
+}
+
+static struct timer_list wb_timer;
+
+/*
+ * Start periodic writeback of old data against each dirty device.
+ *
+ * Try to run once per dirty_writeback_centisecs.  But if a writeback event
+ * takes longer than a dirty_writeback_centisecs interval, then leave a
+ * one-second gap.
+ */
+static void wb_kupdate(unsigned long arg)
+{
+	struct backing_dev_info *bdis[MAX_FLUSHERS];
+	unsigned long start_jif;
+	unsigned long next_jif;
+	int i, nr;
+
+	sync_supers();
+
+	start_jif = jiffies;
+	next_jif = start_jif + (dirty_writeback_centisecs * HZ) / 100;
+	nr = writeback_dirty_bdis(bdis, MAX_FLUSHERS);
+	for (i = 0; i < nr; i++) {
+		if (bdi_start_flush(bdis[i], FLUSH_KUPDATE, 0))
+			wb_kupdate_bdi(bdis[i]);
+	}
 	if (time_before(next_jif, jiffies + HZ))
 		next_jif = jiffies + HZ;
 	if (dirty_writeback_centisecs)
@@ -413,6 +683,8 @@ void __init page_writeback_init(void)
 	long correction;
 
 	total_pages = nr_free_pagecache_pages();
+	if (total_pages / 16 > writeout_period)
+		writeout_period = total_pages / 16;
 
 	correction = (100 * 4 * buffer_pages) / total_pages;
 
@@ -509,8 +781,11 @@ int __set_page_dirty_nobuffers(struct page *page)
 			spin_lock(&mapping->page_lock);
 			if (page->mapping) {	/* Race with truncate? */
 				BUG_ON(page->mapping != mapping);
-				if (!mapping->backing_dev_info->memory_backed)
+				if (!mapping->backing_dev_info->memory_backed) {
 					inc_page_state(nr_dirty);
+					atomic_inc(&mapping->backing_dev_info->
+							nr_dirty);
+				}
 				list_del(&page->list);
 				list_add(&page->list, &mapping->dirty_pages);
 			}
@@ -553,8 +828,10 @@ int test_clear_page_dirty(struct page *page)
 	if (TestClearPageDirty(page)) {
 		struct address_space *mapping = page->mapping;
 
-		if (mapping && !mapping->backing_dev_info->memory_backed)
+		if (mapping && !mapping->backing_dev_info->memory_backed) {
 			dec_page_state(nr_dirty);
+			atomic_dec(&mapping->backing_dev_info->nr_dirty);
+		}
 		return 1;
 	}
 	return 0;
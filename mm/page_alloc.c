@@ -31,6 +31,8 @@
 #include <linux/topology.h>
 #include <linux/sysctl.h>
 #include <linux/cpu.h>
+#include <linux/highmem.h>
+#include <linux/memgroup.h>
 
 #include <asm/tlbflush.h>
 
@@ -145,6 +147,35 @@ static void destroy_compound_page(struct page *page, unsigned long order)
 }
 #endif		/* CONFIG_HUGETLB_PAGE */
 
+/*
+ * Which free lists an allocation should come from.  Pages that the VM can
+ * get back on its own are kept apart from those which stay put, so that a
+ * few long-lived kernel allocations do not pin down every large block.
+ */
+static inline int gfpflags_to_type(unsigned int gfp_mask)
+{
+	if (gfp_mask & __GFP_MOVABLE)
+		return MIGRATE_MOVABLE;
+	if (gfp_mask & __GFP_RECLAIMABLE)
+		return MIGRATE_RECLAIMABLE;
+	return MIGRATE_UNMOVABLE;
+}
+
+static inline int get_pageblock_type(struct zone *zone, struct page *page)
+{
+	unsigned long idx = (page - zone->zone_mem_map) >> PAGEBLOCK_ORDER;
+
+	return zone->pageblock_type[idx];
+}
+
+static inline void set_pageblock_type(struct zone *zone, struct page *page,
+					int type)
+{
+	unsigned long idx = (page - zone->zone_mem_map) >> PAGEBLOCK_ORDER;
+
+	zone->pageblock_type[idx] = type;
+}
+
 /*
  * Freeing function for a buddy system allocator.
  *
@@ -206,7 +237,8 @@ static inline void __free_pages_bulk (struct page *page, struct page *base,
 		index >>= 1;
 		page_idx &= mask;
 	}
-	list_add(&(base + page_idx)->list, &area->free_list);
+	page = base + page_idx;
+	list_add(&page->list, &area->free_list[get_pageblock_type(zone, page)]);
 }
 
 static inline void free_pages_check(const char *function, struct page *page)
@@ -278,8 +310,8 @@ void __free_pages_ok(struct page *page, unsigned int order)
 	__change_bit((index) >> (1+(order)), (area)->map)
 
 static inline struct page *
-expand(struct zone *zone, struct page *page,
-	 unsigned long index, int low, int high, struct free_area *area)
+expand(struct zone *zone, struct page *page, unsigned long index,
+	int low, int high, struct free_area *area, int type)
 {
 	unsigned long size = 1 << high;
 
@@ -288,7 +320,7 @@ expand(struct zone *zone, struct page *page,
 		area--;
 		high--;
 		size >>= 1;
-		list_add(&page->list, &area->free_list);
+		list_add(&page->list, &area->free_list[type]);
 		MARK_USED(index, high, area);
 		index += size;
 		page += size;
@@ -330,33 +362,93 @@ static void prep_new_page(struct page *page, int order)
 
 	page->flags &= ~(1 << PG_uptodate | 1 << PG_error |
 			1 << PG_referenced | 1 << PG_arch_1 |
-			1 << PG_checked | 1 << PG_mappedtodisk);
+			1 << PG_checked | 1 << PG_mappedtodisk |
+			1 << PG_readahead);
 	set_page_refs(page, order);
 }
 
+static void prep_zero_page(struct page *page, int order)
+{
+	int i;
+
+	/* Free pages are unmapped with DEBUG_PAGEALLOC until got_pg */
+	kernel_map_pages(page, 1 << order, 1);
+	for (i = 0; i < (1 << order); i++) {
+		if (PageHighMem(page + i))
+			clear_highpage(page + i);
+		else
+			clear_page(page_address(page + i));
+	}
+}
+
+/*
+ * The order in which the other types' free lists are raided when an
+ * allocation's own lists are empty.
+ */
+static int fallbacks[MIGRATE_TYPES][MIGRATE_TYPES - 1] = {
+	[MIGRATE_UNMOVABLE]	= { MIGRATE_RECLAIMABLE, MIGRATE_MOVABLE },
+	[MIGRATE_RECLAIMABLE]	= { MIGRATE_UNMOVABLE, MIGRATE_MOVABLE },
+	[MIGRATE_MOVABLE]	= { MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE },
+};
+
+static inline struct page *
+take_block(struct zone *zone, struct page *page, unsigned int order,
+	   unsigned int current_order)
+{
+	struct free_area *area = zone->free_area + current_order;
+	unsigned int index;
+
+	list_del(&page->list);
+	index = page - zone->zone_mem_map;
+	if (current_order != MAX_ORDER-1)
+		MARK_USED(index, current_order, area);
+	zone->free_pages -= 1UL << order;
+	return expand(zone, page, index, order, current_order, area,
+			get_pageblock_type(zone, page));
+}
+
 /* 
  * Do the hard work of removing an element from the buddy allocator.
  * Call me with the zone->lock already held.
+ *
+ * If there is nothing suitable on the lists of the wanted type, the
+ * largest free block of another type is split instead, so that the
+ * types get mixed up in as few blocks as possible.  When that block is
+ * at least half a pageblock, the whole pageblock changes hands, and the
+ * pages freed in it later go onto the new type's lists.
  */
-static struct page *__rmqueue(struct zone *zone, unsigned int order)
+static struct page *__rmqueue(struct zone *zone, unsigned int order, int type)
 {
 	struct free_area * area;
-	unsigned int current_order;
+	int current_order;
 	struct page *page;
-	unsigned int index;
+	int i;
 
 	for (current_order = order; current_order < MAX_ORDER; ++current_order) {
 		area = zone->free_area + current_order;
-		if (list_empty(&area->free_list))
+		if (list_empty(&area->free_list[type]))
 			continue;
 
-		page = list_entry(area->free_list.next, struct page, list);
-		list_del(&page->list);
-		index = page - zone->zone_mem_map;
-		if (current_order != MAX_ORDER-1)
-			MARK_USED(index, current_order, area);
-		zone->free_pages -= 1UL << order;
-		return expand(zone, page, index, order, current_order, area);
+		page = list_entry(area->free_list[type].next, struct page, list);
+		return take_block(zone, page, order, current_order);
+	}
+
+	for (current_order = MAX_ORDER-1; current_order >= (int)order;
+							--current_order) {
+		area = zone->free_area + current_order;
+		for (i = 0; i < MIGRATE_TYPES - 1; i++) {
+			struct list_head *list;
+
+			list = &area->free_list[fallbacks[type][i]];
+			if (list_empty(list))
+				continue;
+
+			page = list_entry(list->next, struct page, list);
+			if (current_order >= PAGEBLOCK_ORDER - 1)
+				set_pageblock_type(zone, page, type);
+			inc_page_state(pgfallback);
+			return take_block(zone, page, order, current_order);
+		}
 	}
 
 	return NULL;
@@ -368,7 +460,7 @@ static struct page *__rmqueue(struct zone *zone, unsigned int order)
  * Returns the number of new pages which were placed at *list.
  */
 static int rmqueue_bulk(struct zone *zone, unsigned int order, 
-			unsigned long count, struct list_head *list)
+			unsigned long count, struct list_head *list, int type)
 {
 	unsigned long flags;
 	int i;
@@ -377,7 +469,7 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 	
 	spin_lock_irqsave(&zone->lock, flags);
 	for (i = 0; i < count; ++i) {
-		page = __rmqueue(zone, order);
+		page = __rmqueue(zone, order, type);
 		if (page == NULL)
 			break;
 		allocated++;
@@ -387,12 +479,144 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 	return allocated;
 }
 
+/*
+ * Pre-zeroed pages.
+ *
+ * While there are idle cpus, kzerod clears free pages, with stores which
+ * bypass the cache, and keeps up to pages_high of them per zone for
+ * __GFP_ZERO allocations, so that those needn't clear them.  They are
+ * still free pages, and other order-0 allocations take them when the
+ * buddy lists run dry.  They don't coalesce with their buddies though,
+ * so they go back to the buddy lists when a larger block is hard to get.
+ */
+static DECLARE_WAIT_QUEUE_HEAD(kzerod_wait);
+
+/*
+ * zone->lock is held.
+ */
+static struct page *take_zero_page(struct zone *zone)
+{
+	struct page *page;
+
+	if (list_empty(&zone->zero_list))
+		return NULL;
+	page = list_entry(zone->zero_list.next, struct page, list);
+	list_del(&page->list);
+	zone->nr_zero--;
+	zone->free_pages--;
+	return page;
+}
+
+static void wakeup_kzerod(struct zone *zone)
+{
+	if (zone->nr_zero >= zone->pages_high / 2)
+		return;
+	if (!waitqueue_active(&kzerod_wait))
+		return;
+	wake_up_interruptible(&kzerod_wait);
+}
+
+static void drain_zero_pages(struct zone *zone)
+{
+	unsigned long flags;
+	struct page *page;
+
+	if (!zone->nr_zero)
+		return;
+	spin_lock_irqsave(&zone->lock, flags);
+	while ((page = take_zero_page(zone)) != NULL)
+		__free_pages_bulk(page, zone->zone_mem_map, zone,
+					zone->free_area, ~0UL, 0);
+	spin_unlock_irqrestore(&zone->lock, flags);
+}
+
+static inline int zone_needs_zeroing(struct zone *zone)
+{
+	return zone->nr_zero < zone->pages_high &&
+		zone->free_pages > 2 * zone->pages_high;
+}
+
+/*
+ * Clear one more free page for the zone's pool.
+ */
+static int zero_one_page(struct zone *zone)
+{
+	struct page *page;
+
+	spin_lock_irq(&zone->lock);
+	page = __rmqueue(zone, 0, MIGRATE_MOVABLE);
+	spin_unlock_irq(&zone->lock);
+	if (!page)
+		return 0;
+
+	/* It stays a free page, so DEBUG_PAGEALLOC wants it unmapped again */
+	kernel_map_pages(page, 1, 1);
+	clear_highpage_nocache(page);
+	kernel_map_pages(page, 1, 0);
+
+	spin_lock_irq(&zone->lock);
+	list_add(&page->list, &zone->zero_list);
+	zone->nr_zero++;
+	zone->free_pages++;
+	spin_unlock_irq(&zone->lock);
+	inc_page_state(pgprezeroed);
+	return 1;
+}
+
+static int kzerod(void *p)
+{
+	DEFINE_WAIT(wait);
+
+	daemonize("kzerod");
+	set_user_nice(current, 19);
+
+	for ( ; ; ) {
+		struct zone *zone;
+
+		if (current->flags & PF_FREEZE)
+			refrigerator(PF_IOTHREAD);
+
+		for_each_zone(zone) {
+			/* Only while some cpu would be idle otherwise */
+			while (zone_needs_zeroing(zone) &&
+			       nr_running() <= num_online_cpus()) {
+				if (!zero_one_page(zone))
+					break;
+				cond_resched();
+			}
+		}
+
+		prepare_to_wait(&kzerod_wait, &wait, TASK_INTERRUPTIBLE);
+		schedule_timeout(HZ);
+		finish_wait(&kzerod_wait, &wait);
+	}
+	return 0;
+}
+
+static int __init kzerod_init(void)
+{
+	kernel_thread(kzerod, NULL, CLONE_KERNEL);
+	return 0;
+}
+
+module_init(kzerod_init)
+
+unsigned long nr_prezeroed_pages(void)
+{
+	unsigned long sum = 0;
+	struct zone *zone;
+
+	for_each_zone(zone)
+		sum += zone->nr_zero;
+	return sum;
+}
+
 #ifdef CONFIG_SOFTWARE_SUSPEND
 int is_head_of_free_region(struct page *page)
 {
         struct zone *zone = page_zone(page);
         unsigned long flags;
-	int order;
+	int order, type;
 	struct list_head *curr;
 
 	/*
@@ -401,7 +625,8 @@ int is_head_of_free_region(struct page *page)
 	 */
 	spin_lock_irqsave(&zone->lock, flags);
 	for (order = MAX_ORDER - 1; order >= 0; --order)
-		list_for_each(curr, &zone->free_area[order].free_list)
+	    for (type = 0; type < MIGRATE_TYPES; type++)
+		list_for_each(curr, &zone->free_area[order].free_list[type])
 			if (page == list_entry(curr, struct page, list)) {
 				spin_unlock_irqrestore(&zone->lock, flags);
 				return 1 << order;
@@ -409,6 +634,7 @@ int is_head_of_free_region(struct page *page)
 	spin_unlock_irqrestore(&zone->lock, flags);
         return 0;
 }
+#endif /* CONFIG_SOFTWARE_SUSPEND */
 
 /*
  * Spill all of this CPU's per-cpu pages back into the buddy allocator.
@@ -417,7 +643,7 @@ void drain_local_pages(void)
 {
 	unsigned long flags;
 	struct zone *zone;
-	int i;
+	int i, type;
 
 	local_irq_save(flags);	
 	for_each_zone(zone) {
@@ -428,13 +654,31 @@ void drain_local_pages(void)
 			struct per_cpu_pages *pcp;
 
 			pcp = &pset->pcp[i];
-			pcp->count -= free_pages_bulk(zone, pcp->count,
-						&pcp->list, 0);
+			for (type = 0; type < MIGRATE_TYPES; type++)
+				pcp->count -= free_pages_bulk(zone, pcp->count,
+						&pcp->list[type], 0);
 		}
 	}
 	local_irq_restore(flags);	
 }
-#endif /* CONFIG_SOFTWARE_SUSPEND */
+
+/*
+ * Give a batch of pages from the per-cpu lists back to the buddy lists,
+ * taking them from whichever types have some.
+ */
+static void pcp_free_batch(struct zone *zone, struct per_cpu_pages *pcp)
+{
+	int todo = pcp->batch;
+	int type;
+
+	for (type = 0; type < MIGRATE_TYPES && todo > 0; type++) {
+		int freed;
+
+		freed = free_pages_bulk(zone, todo, &pcp->list[type], 0);
+		pcp->count -= freed;
+		todo -= freed;
+	}
+}
 
 /*
  * Free a 0-order page
@@ -448,12 +692,13 @@ static void free_hot_cold_page(struct page *page, int cold)
 
 	kernel_map_pages(page, 1, 0);
 	inc_page_state(pgfree);
+	memgroup_uncharge(page);
 	free_pages_check(__FUNCTION__, page);
 	pcp = &zone->pageset[get_cpu()].pcp[cold];
 	local_irq_save(flags);
 	if (pcp->count >= pcp->high)
-		pcp->count -= free_pages_bulk(zone, pcp->batch, &pcp->list, 0);
-	list_add(&page->list, &pcp->list);
+		pcp_free_batch(zone, pcp);
+	list_add(&page->list, &pcp->list[get_pageblock_type(zone, page)]);
 	pcp->count++;
 	local_irq_restore(flags);
 	put_cpu();
@@ -475,21 +720,36 @@ void free_cold_page(struct page *page)
  * or two.
  */
 
-static struct page *buffered_rmqueue(struct zone *zone, int order, int cold)
+static struct page *
+buffered_rmqueue(struct zone *zone, int order, unsigned int gfp_mask)
 {
+	int cold = !!(gfp_mask & __GFP_COLD);
+	int type = gfpflags_to_type(gfp_mask);
 	unsigned long flags;
 	struct page *page = NULL;
+	int zeroed = 0;
 
-	if (order == 0) {
+	if (order == 0 && (gfp_mask & __GFP_ZERO) && zone->nr_zero) {
+		spin_lock_irqsave(&zone->lock, flags);
+		page = take_zero_page(zone);
+		spin_unlock_irqrestore(&zone->lock, flags);
+		if (page) {
+			zeroed = 1;
+			wakeup_kzerod(zone);
+		}
+	}
+
+	if (order == 0 && page == NULL) {
 		struct per_cpu_pages *pcp;
 
 		pcp = &zone->pageset[get_cpu()].pcp[cold];
 		local_irq_save(flags);
-		if (pcp->count <= pcp->low)
+		if (pcp->count <= pcp->low || list_empty(&pcp->list[type]))
 			pcp->count += rmqueue_bulk(zone, 0,
-						pcp->batch, &pcp->list);
-		if (pcp->count) {
-			page = list_entry(pcp->list.next, struct page, list);
+					pcp->batch, &pcp->list[type], type);
+		if (!list_empty(&pcp->list[type])) {
+			page = list_entry(pcp->list[type].next,
+						struct page, list);
 			list_del(&page->list);
 			pcp->count--;
 		}
@@ -499,7 +759,11 @@ static struct page *buffered_rmqueue(struct zone *zone, int order, int cold)
 
 	if (page == NULL) {
 		spin_lock_irqsave(&zone->lock, flags);
-		page = __rmqueue(zone, order);
+		page = __rmqueue(zone, order, type);
+		if (page == NULL && order == 0) {
+			page = take_zero_page(zone);
+			zeroed = page != NULL;
+		}
 		spin_unlock_irqrestore(&zone->lock, flags);
 		if (order && page)
 			prep_compound_page(page, order);
@@ -509,6 +773,14 @@ static struct page *buffered_rmqueue(struct zone *zone, int order, int cold)
 		BUG_ON(bad_range(zone, page));
 		mod_page_state(pgalloc, 1 << order);
 		prep_new_page(page, order);
+		if (gfp_mask & __GFP_ZERO) {
+			if (zeroed) {
+				inc_page_state(pgzerohit);
+			} else {
+				prep_zero_page(page, order);
+				inc_page_state(pgzeromiss);
+			}
+		}
 	}
 	return page;
 }
@@ -537,16 +809,13 @@ __alloc_pages(unsigned int gfp_mask, unsigned int order,
 	struct zone **zones, *classzone;
 	struct page *page;
 	int i;
-	int cold;
 	int do_retry;
 	struct reclaim_state reclaim_state;
 
 	if (wait)
 		might_sleep();
 
-	cold = 0;
-	if (gfp_mask & __GFP_COLD)
-		cold = 1;
+	memgroup_enforce(gfp_mask);
 
 	zones = zonelist->zones;  /* the list of zones suitable for gfp_mask */
 	classzone = zones[0]; 
@@ -561,7 +830,7 @@ __alloc_pages(unsigned int gfp_mask, unsigned int order,
 		min += z->pages_low;
 		if (z->free_pages >= min ||
 				(!wait && z->free_pages >= z->pages_high)) {
-			page = buffered_rmqueue(z, order, cold);
+			page = buffered_rmqueue(z, order, gfp_mask);
 			if (page)
 		       		goto got_pg;
 		}
@@ -571,6 +840,11 @@ __alloc_pages(unsigned int gfp_mask, unsigned int order,
 	/* we're somewhat low on memory, failed to find what we needed */
 	for (i = 0; zones[i] != NULL; i++)
 		wakeup_kswapd(zones[i]);
+	if (order) {
+		wakeup_kcompactd(order);
+		for (i = 0; zones[i] != NULL; i++)
+			drain_zero_pages(zones[i]);
+	}
 
 	/* Go through the zonelist again, taking __GFP_HIGH into account */
 	min = 1UL << order;
@@ -584,7 +858,7 @@ __alloc_pages(unsigned int gfp_mask, unsigned int order,
 		min += local_min;
 		if (z->free_pages >= min ||
 				(!wait && z->free_pages >= z->pages_high)) {
-			page = buffered_rmqueue(z, order, cold);
+			page = buffered_rmqueue(z, order, gfp_mask);
 			if (page)
 				goto got_pg;
 		}
@@ -599,7 +873,7 @@ rebalance:
 		for (i = 0; zones[i] != NULL; i++) {
 			struct zone *z = zones[i];
 
-			page = buffered_rmqueue(z, order, cold);
+			page = buffered_rmqueue(z, order, gfp_mask);
 			if (page)
 				goto got_pg;
 		}
@@ -610,6 +884,25 @@ rebalance:
 	if (!wait)
 		goto nopage;
 
+	/*
+	 * There may be plenty of memory free, just not in one piece: try
+	 * moving pages out of the way before throwing away any cache.
+	 */
+	if (order && try_to_compact_pages(zones, order, gfp_mask)) {
+		min = 1UL << order;
+		for (i = 0; zones[i] != NULL; i++) {
+			struct zone *z = zones[i];
+
+			min += z->pages_min;
+			if (z->free_pages >= min) {
+				page = buffered_rmqueue(z, order, gfp_mask);
+				if (page)
+					goto got_pg;
+			}
+			min += z->pages_low * sysctl_lower_zone_protection;
+		}
+	}
+
 	current->flags |= PF_MEMALLOC;
 	reclaim_state.reclaimed_slab = 0;
 	current->reclaim_state = &reclaim_state;
@@ -627,7 +920,7 @@ rebalance:
 		min += z->pages_min;
 		if (z->free_pages >= min ||
 				(!wait && z->free_pages >= z->pages_high)) {
-			page = buffered_rmqueue(z, order, cold);
+			page = buffered_rmqueue(z, order, gfp_mask);
 			if (page)
 				goto got_pg;
 		}
@@ -688,12 +981,9 @@ unsigned long get_zeroed_page(unsigned int gfp_mask)
 	 */
 	BUG_ON(gfp_mask & __GFP_HIGHMEM);
 
-	page = alloc_pages(gfp_mask, 0);
-	if (page) {
-		void *address = page_address(page);
-		clear_page(address);
-		return (unsigned long) address;
-	}
+	page = alloc_pages(gfp_mask | __GFP_ZERO, 0);
+	if (page)
+		return (unsigned long) page_address(page);
 	return 0;
 }
 
@@ -1003,9 +1293,13 @@ void show_free_areas(void)
 
 		spin_lock_irqsave(&zone->lock, flags);
 		for (order = 0; order < MAX_ORDER; order++) {
+			int type;
+
 			nr = 0;
-			list_for_each(elem, &zone->free_area[order].free_list)
-				++nr;
+			for (type = 0; type < MIGRATE_TYPES; type++)
+				list_for_each(elem,
+					&zone->free_area[order].free_list[type])
+					++nr;
 			total += nr << order;
 			printk("%lu*%lukB ", nr, K(1UL) << order);
 		}
@@ -1259,20 +1553,28 @@ static void __init free_area_init_core(struct pglist_data *pgdat,
 			pcp->low = 2 * batch;
 			pcp->high = 6 * batch;
 			pcp->batch = 1 * batch;
-			INIT_LIST_HEAD(&pcp->list);
+			for (i = 0; i < MIGRATE_TYPES; i++)
+				INIT_LIST_HEAD(&pcp->list[i]);
 
 			pcp = &zone->pageset[cpu].pcp[1];	/* cold */
 			pcp->count = 0;
 			pcp->low = 0;
 			pcp->high = 2 * batch;
 			pcp->batch = 1 * batch;
-			INIT_LIST_HEAD(&pcp->list);
+			for (i = 0; i < MIGRATE_TYPES; i++)
+				INIT_LIST_HEAD(&pcp->list[i]);
 		}
 		printk("  %s zone: %lu pages, LIFO batch:%lu\n",
 				zone_names[j], realsize, batch);
 		INIT_LIST_HEAD(&zone->active_list);
 		INIT_LIST_HEAD(&zone->inactive_list);
+		INIT_LIST_HEAD(&zone->zero_list);
+		zone->nr_zero = 0;
+		zone->compact_cursor = 0;
+		zone->compact_considered = 0;
+		zone->compact_defer_shift = 0;
 		atomic_set(&zone->refill_counter, 0);
+		atomic_set(&zone->inactive_age, 0);
 		zone->nr_active = 0;
 		zone->nr_inactive = 0;
 		if (!size)
@@ -1300,6 +1602,15 @@ static void __init free_area_init_core(struct pglist_data *pgdat,
 		if ((zone_start_pfn) & (zone_required_alignment-1))
 			printk("BUG: wrong zone alignment, it will crash\n");
 
+		/*
+		 * Everything starts out movable: the early kernel allocations
+		 * claim the blocks they need as they go.
+		 */
+		zone->pageblock_type = alloc_bootmem_node(pgdat,
+				(size >> PAGEBLOCK_ORDER) + 1);
+		memset(zone->pageblock_type, MIGRATE_MOVABLE,
+				(size >> PAGEBLOCK_ORDER) + 1);
+
 		memmap_init(lmem_map, size, nid, j, zone_start_pfn);
 
 		zone_start_pfn += size;
@@ -1307,8 +1618,10 @@ static void __init free_area_init_core(struct pglist_data *pgdat,
 
 		for (i = 0; ; i++) {
 			unsigned long bitmap_size;
+			int type;
 
-			INIT_LIST_HEAD(&zone->free_area[i].free_list);
+			for (type = 0; type < MIGRATE_TYPES; type++)
+				INIT_LIST_HEAD(&zone->free_area[i].free_list[type]);
 			if (i == MAX_ORDER-1) {
 				zone->free_area[i].map = NULL;
 				break;
@@ -1426,9 +1739,12 @@ static int frag_show(struct seq_file *m, void *arg)
 		for (order = 0; order < MAX_ORDER; ++order) {
 			unsigned long nr_bufs = 0;
 			struct list_head *elem;
+			int type;
 
-			list_for_each(elem, &(zone->free_area[order].free_list))
-				++nr_bufs;
+			for (type = 0; type < MIGRATE_TYPES; type++)
+				list_for_each(elem,
+				    &(zone->free_area[order].free_list[type]))
+					++nr_bufs;
 			seq_printf(m, "%6lu ", nr_bufs);
 		}
 		spin_unlock_irqrestore(&zone->lock, flags);
@@ -1444,6 +1760,66 @@ struct seq_operations fragmentation_op = {
 	.show	= frag_show,
 };
 
+static char *migratetype_names[MIGRATE_TYPES] = {
+	"Unmovable", "Reclaimable", "Movable"
+};
+
+/*
+ * Like /proc/buddyinfo, but with the free blocks of each type counted
+ * separately, followed by how many pageblocks each type owns.
+ */
+static int pagetype_show(struct seq_file *m, void *arg)
+{
+	pg_data_t *pgdat = (pg_data_t *)arg;
+	struct zone *zone;
+	struct zone *node_zones = pgdat->node_zones;
+	unsigned long flags;
+	int order, type;
+
+	for (zone = node_zones; zone - node_zones < MAX_NR_ZONES; ++zone) {
+		unsigned long nr_blocks[MIGRATE_TYPES] = { 0, };
+		unsigned long i;
+
+		if (!zone->present_pages)
+			continue;
+
+		spin_lock_irqsave(&zone->lock, flags);
+		for (type = 0; type < MIGRATE_TYPES; type++) {
+			seq_printf(m, "Node %d, zone %8s, type %12s ",
+				pgdat->node_id, zone->name,
+				migratetype_names[type]);
+			for (order = 0; order < MAX_ORDER; ++order) {
+				unsigned long nr_bufs = 0;
+				struct list_head *elem;
+
+				list_for_each(elem,
+				    &(zone->free_area[order].free_list[type]))
+					++nr_bufs;
+				seq_printf(m, "%6lu ", nr_bufs);
+			}
+			seq_putc(m, '\n');
+		}
+		for (i = 0; i < zone->spanned_pages; i += 1UL << PAGEBLOCK_ORDER)
+			nr_blocks[zone->pageblock_type[i >> PAGEBLOCK_ORDER]]++;
+		spin_unlock_irqrestore(&zone->lock, flags);
+
+		seq_printf(m, "Node %d, zone %8s, blocks", pgdat->node_id,
+				zone->name);
+		for (type = 0; type < MIGRATE_TYPES; type++)
+			seq_printf(m, " %s:%lu", migratetype_names[type],
+					nr_blocks[type]);
+		seq_putc(m, '\n');
+	}
+	return 0;
+}
+
+struct seq_operations pagetypeinfo_op = {
+	.start	= frag_start,
+	.next	= frag_next,
+	.stop	= frag_stop,
+	.show	= pagetype_show,
+};
+
 static char *vmstat_text[] = {
 	"nr_dirty",
 	"nr_writeback",
@@ -1474,6 +1850,23 @@ static char *vmstat_text[] = {
 	"pageoutrun",
 	"allocstall",
 	"pgrotated",
+	"pgfallback",
+	"pgmigrate",
+	"compactstall",
+	"compactsuccess",
+	"pgzstore",
+	"pgzreject",
+	"pgzload",
+	"pgzevict",
+	"pgmergescan",
+	"pgmerged",
+	"mergepass",
+	"pgzerohit",
+	"pgzeromiss",
+	"pgprezeroed",
+	"kmapflush",
+	"pgrefault",
+	"pgprotected",
 };
 
 static void *vmstat_start(struct seq_file *m, loff_t *pos)
@@ -96,6 +96,14 @@ int swap_writepage(struct page *page, struct writeback_control *wbc)
 		unlock_page(page);
 		goto out;
 	}
+	if (wbc->for_reclaim && !swap_compress_store(page)) {
+		SetPageWriteback(page);
+		unlock_page(page);
+		end_page_writeback(page);
+		goto out;
+	}
+	/* The disk copy supersedes any older compressed one */
+	swap_compress_invalidate((swp_entry_t){ .val = page->index });
 	bio = get_swap_bio(GFP_NOIO, page, end_swap_bio_write);
 	if (bio == NULL) {
 		set_page_dirty(page);
@@ -114,10 +122,21 @@ out:
 int swap_readpage(struct file *file, struct page *page)
 {
 	struct bio *bio;
-	int ret = 0;
+	int ret;
 
 	BUG_ON(!PageLocked(page));
 	ClearPageUptodate(page);
+	ret = swap_compress_load(page);
+	if (ret != -ENOENT) {
+		/* The only copy is in the cache: the disk was never written */
+		if (ret)
+			SetPageError(page);
+		else
+			SetPageUptodate(page);
+		unlock_page(page);
+		goto out;
+	}
+	ret = 0;
 	bio = get_swap_bio(GFP_KERNEL, page, end_swap_bio_read);
 	if (bio == NULL) {
 		unlock_page(page);
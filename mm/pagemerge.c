@@ -0,0 +1,614 @@
+/*
+ *  linux/mm/pagemerge.c
+ *
+ *  Merging of identical anonymous pages.
+ *
+ *  kmerged scans the private vmas which were marked with
+ *  madvise(MADV_MERGEABLE), a few pages at a time.  Only the mms which
+ *  have used it are looked at, and kmerged sleeps while there are none.
+ *  Each anonymous page it finds is checksummed and looked up in two hash
+ *  tables:
+ *
+ *  - the merged pages: write protected pages which already replace a
+ *    number of identical ones.  A match is mapped in place of the page.
+ *
+ *  - the pages seen earlier in this pass.  A match there becomes a new
+ *    merged page, which replaces both.
+ *
+ *  Merged pages are ordinary anonymous pages mapped read-only by several
+ *  ptes, exactly like the pages a fork leaves behind, and are aged and
+ *  swapped like them.  A write to one goes through do_wp_page(), which
+ *  gives the writer a copy of its own: the reference kmerged holds on
+ *  every merged page keeps do_wp_page() from ever reusing one in place.
+ */
+
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/hash.h>
+#include <linux/jhash.h>
+#include <linux/suspend.h>
+#include <linux/rmap-locking.h>
+#include <linux/hugetlb.h>
+#include <asm/pgalloc.h>
+#include <asm/tlbflush.h>
+
+#define MERGE_HASH_BITS		10
+#define MERGE_HASH_SIZE		(1 << MERGE_HASH_BITS)
+
+/* Only the start of a page is checksummed */
+#define MERGE_SUM_BYTES		1024
+
+struct merge_item {
+	struct list_head list;
+	u32 sum;
+	struct page *page;		/* a merged page, or ... */
+	struct mm_struct *mm;		/* ... where a page was seen */
+	unsigned long address;
+};
+
+static struct list_head merged_hash[MERGE_HASH_SIZE];
+static struct list_head seen_hash[MERGE_HASH_SIZE];
+static kmem_cache_t *merge_item_cachep;
+
+/* Only kmerged touches the tables, so they need no locking */
+static unsigned long nr_merged_pages;
+static unsigned long nr_merged_sharing;
+
+int sysctl_merge_pages_to_scan = 100;
+int sysctl_merge_sleep_millisecs = 20;
+
+/* Where the scan is */
+static struct mm_struct *merge_mm;
+static unsigned long merge_address;
+
+/* The mms which have used MADV_MERGEABLE, under mmlist_lock */
+static LIST_HEAD(merge_mm_list);
+static DECLARE_WAIT_QUEUE_HEAD(kmerged_wait);
+
+static u32 page_sum(struct page *page)
+{
+	void *addr = kmap_atomic(page, KM_USER0);
+	u32 sum = jhash(addr, MERGE_SUM_BYTES, 17);
+
+	kunmap_atomic(addr, KM_USER0);
+	return sum;
+}
+
+static int pages_identical(struct page *page1, struct page *page2)
+{
+	void *addr1 = kmap_atomic(page1, KM_USER0);
+	void *addr2 = kmap_atomic(page2, KM_USER1);
+	int ret = !memcmp(addr1, addr2, PAGE_SIZE);
+
+	kunmap_atomic(addr2, KM_USER1);
+	kunmap_atomic(addr1, KM_USER0);
+	return ret;
+}
+
+/*
+ * Find the pte mapping `address'.  page_table_lock is held; the pte must
+ * be unmapped with pte_unmap().
+ */
+static pte_t *merge_pte_map(struct mm_struct *mm, unsigned long address)
+{
+	pgd_t *pgd;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || pgd_bad(*pgd))
+		return NULL;
+	pmd = pmd_offset(pgd, address);
+	if (pmd_none(*pmd) || pmd_huge(*pmd) || pmd_bad(*pmd))
+		return NULL;
+	return pte_offset_map(pmd, address);
+}
+
+/*
+ * Move `*address' to the first present pte in [*address, end), skipping
+ * unpopulated page tables in one step.  Returns 0 if there is none.
+ */
+static int merge_find_pte(struct mm_struct *mm, unsigned long *address,
+			  unsigned long end)
+{
+	unsigned long addr = *address;
+	int found = 0;
+
+	spin_lock(&mm->page_table_lock);
+	while (addr < end) {
+		unsigned long next;
+		pgd_t *pgd;
+		pmd_t *pmd;
+		pte_t *pte;
+		int i;
+
+		pgd = pgd_offset(mm, addr);
+		if (pgd_none(*pgd) || pgd_bad(*pgd)) {
+			addr = (addr + PGDIR_SIZE) & PGDIR_MASK;
+			if (!addr)
+				break;
+			continue;
+		}
+		pmd = pmd_offset(pgd, addr);
+		next = (addr + PMD_SIZE) & PMD_MASK;
+		if (!next || next > end)
+			next = end;
+		if (pmd_none(*pmd) || pmd_huge(*pmd) || pmd_bad(*pmd)) {
+			addr = next;
+			continue;
+		}
+		pte = pte_offset_map(pmd, addr);
+		for (i = 0; addr < next; addr += PAGE_SIZE, i++) {
+			if (pte_present(pte[i])) {
+				found = 1;
+				break;
+			}
+		}
+		pte_unmap(pte);
+		if (found)
+			break;
+	}
+	spin_unlock(&mm->page_table_lock);
+	*address = found ? addr : end;
+	return found;
+}
+
+/*
+ * Take a reference on mm_users, unless the mm has exited already.
+ * mmput() drops the last mm_users under mmlist_lock.
+ */
+static int merge_get_mm_users(struct mm_struct *mm)
+{
+	int alive;
+
+	spin_lock(&mmlist_lock);
+	alive = atomic_read(&mm->mm_users) != 0;
+	if (alive)
+		atomic_inc(&mm->mm_users);
+	spin_unlock(&mmlist_lock);
+	return alive;
+}
+
+/*
+ * Return the anonymous page mapped at `address', with a reference held,
+ * if it is a candidate for merging: mapped by that pte only, and not in
+ * the swap cache.
+ */
+static struct page *get_anon_page(struct mm_struct *mm, unsigned long address)
+{
+	struct page *page = NULL;
+	pte_t *ptep;
+	pte_t pte;
+
+	spin_lock(&mm->page_table_lock);
+	ptep = merge_pte_map(mm, address);
+	if (ptep) {
+		pte = *ptep;
+		pte_unmap(ptep);
+		if (pte_present(pte) && pfn_valid(pte_pfn(pte))) {
+			page = pte_page(pte);
+			if (PageReserved(page) || PageCompound(page) ||
+			    page->mapping || !PageDirect(page))
+				page = NULL;
+			else
+				page_cache_get(page);
+		}
+	}
+	spin_unlock(&mm->page_table_lock);
+	return page;
+}
+
+/*
+ * Map `kpage' at `address' in place of `page', if the two are still
+ * identical.  The pte is cleared while they are compared, so that page
+ * can't be written to meanwhile.  The caller holds mmap_sem and a
+ * reference on both pages.
+ */
+static int merge_one(struct vm_area_struct *vma, unsigned long address,
+		     struct page *page, struct page *kpage)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct pte_chain *pte_chain;
+	pte_t *ptep;
+	pte_t entry;
+	int err = -EBUSY;
+
+	pte_chain = pte_chain_alloc(GFP_KERNEL);
+	if (!pte_chain)
+		return -ENOMEM;
+
+	spin_lock(&mm->page_table_lock);
+	ptep = merge_pte_map(mm, address);
+	if (!ptep)
+		goto out_unlock;
+	entry = *ptep;
+	/* Only the pte and the caller may hold references */
+	if (!pte_present(entry) || pte_page(entry) != page ||
+	    !PageDirect(page) || page_count(page) != 2)
+		goto out_unmap;
+
+	flush_cache_page(vma, address);
+	entry = ptep_get_and_clear(ptep);
+	flush_tlb_page(vma, address);
+	if (!pages_identical(page, kpage)) {
+		set_pte(ptep, entry);
+		goto out_unmap;
+	}
+
+	page_remove_rmap(page, ptep);
+	page_cache_release(page);
+	page_cache_get(kpage);
+	entry = pte_mkyoung(pte_wrprotect(mk_pte(kpage, vma->vm_page_prot)));
+	set_pte(ptep, entry);
+	pte_chain = page_add_rmap(kpage, ptep, pte_chain);
+	update_mmu_cache(vma, address, entry);
+	inc_page_state(pgmerged);
+	err = 0;
+out_unmap:
+	pte_unmap(ptep);
+out_unlock:
+	spin_unlock(&mm->page_table_lock);
+	pte_chain_free(pte_chain);
+	return err;
+}
+
+/*
+ * A merged page which nobody maps any more, or which reclaim has taken
+ * for swapping out, is only kept alive by us.
+ */
+static inline int merged_page_stale(struct page *page)
+{
+	return page_count(page) == 1 || !page_mapped(page) ||
+		PageSwapCache(page);
+}
+
+static void free_merge_item(struct merge_item *item)
+{
+	list_del(&item->list);
+	if (item->page) {
+		page_cache_release(item->page);
+		nr_merged_pages--;
+	}
+	if (item->mm)
+		mmdrop(item->mm);
+	kmem_cache_free(merge_item_cachep, item);
+}
+
+static struct page *find_merged_page(struct page *page, u32 sum)
+{
+	struct list_head *head = &merged_hash[hash_long(sum, MERGE_HASH_BITS)];
+	struct list_head *p, *n;
+
+	list_for_each_safe(p, n, head) {
+		struct merge_item *item;
+
+		item = list_entry(p, struct merge_item, list);
+		if (item->sum != sum)
+			continue;
+		if (merged_page_stale(item->page)) {
+			free_merge_item(item);
+			continue;
+		}
+		if (item->page == page || pages_identical(page, item->page))
+			return item->page;
+	}
+	return NULL;
+}
+
+static void add_merged_page(struct page *kpage, u32 sum)
+{
+	struct merge_item *item;
+
+	item = kmem_cache_alloc(merge_item_cachep, GFP_KERNEL);
+	if (!item)
+		return;
+	item->sum = sum;
+	item->page = kpage;
+	item->mm = NULL;
+	page_cache_get(kpage);
+	list_add(&item->list, &merged_hash[hash_long(sum, MERGE_HASH_BITS)]);
+	nr_merged_pages++;
+}
+
+static struct merge_item *find_seen_page(u32 sum)
+{
+	struct list_head *head = &seen_hash[hash_long(sum, MERGE_HASH_BITS)];
+	struct list_head *p;
+
+	list_for_each(p, head) {
+		struct merge_item *item;
+
+		item = list_entry(p, struct merge_item, list);
+		if (item->sum == sum)
+			return item;
+	}
+	return NULL;
+}
+
+static void add_seen_page(struct mm_struct *mm, unsigned long address,
+			  u32 sum)
+{
+	struct merge_item *item;
+
+	item = kmem_cache_alloc(merge_item_cachep, GFP_KERNEL);
+	if (!item)
+		return;
+	item->sum = sum;
+	item->page = NULL;
+	item->mm = mm;
+	item->address = address;
+	atomic_inc(&mm->mm_count);
+	list_add(&item->list, &seen_hash[hash_long(sum, MERGE_HASH_BITS)]);
+}
+
+/*
+ * `page' has the same checksum as the one seen at item->address.  If the
+ * two are identical, replace both by a merged page.  The other mm must
+ * still be alive, and its mmap_sem to be had without waiting; we already
+ * hold it if that is the mm being scanned.  A copy becomes the merged
+ * page, rather than one of the two, as there is no cheap way to write
+ * protect a page wherever it is mapped.
+ */
+static int merge_with_seen(struct merge_item *item, struct vm_area_struct *vma,
+			   unsigned long address, struct page *page, u32 sum)
+{
+	struct mm_struct *mm = item->mm;
+	struct vm_area_struct *vma2;
+	struct page *page2, *kpage;
+	int err = -EBUSY;
+
+	if (mm != vma->vm_mm) {
+		if (!merge_get_mm_users(mm))
+			return err;
+		if (!down_read_trylock(&mm->mmap_sem)) {
+			mmput(mm);
+			return err;
+		}
+	}
+
+	vma2 = find_vma(mm, item->address);
+	if (!vma2 || vma2->vm_start > item->address ||
+	    !(vma2->vm_flags & VM_MERGEABLE))
+		goto out;
+	page2 = get_anon_page(mm, item->address);
+	if (!page2)
+		goto out;
+	if (page2 == page || !pages_identical(page, page2))
+		goto out_release;
+
+	kpage = alloc_page(GFP_HIGHUSER | __GFP_NOWARN);
+	if (!kpage)
+		goto out_release;
+	copy_highpage(kpage, page);
+	lru_cache_add_active(kpage);
+	err = merge_one(vma, address, page, kpage);
+	if (!err) {
+		add_merged_page(kpage, sum);
+		merge_one(vma2, item->address, page2, kpage);
+	}
+	page_cache_release(kpage);
+out_release:
+	page_cache_release(page2);
+out:
+	if (mm != vma->vm_mm) {
+		up_read(&mm->mmap_sem);
+		mmput(mm);
+	}
+	return err;
+}
+
+static void merge_scan_page(struct vm_area_struct *vma,
+			    unsigned long address, struct page *page)
+{
+	struct merge_item *item;
+	struct page *kpage;
+	u32 sum;
+
+	inc_page_state(pgmergescan);
+	sum = page_sum(page);
+
+	kpage = find_merged_page(page, sum);
+	if (kpage) {
+		if (kpage != page)
+			merge_one(vma, address, page, kpage);
+		return;
+	}
+
+	item = find_seen_page(sum);
+	if (!item)
+		add_seen_page(vma->vm_mm, address, sum);
+	else if (!merge_with_seen(item, vma, address, page, sum))
+		free_merge_item(item);
+}
+
+/**
+ * merge_register_mm - have kmerged scan an mm
+ * @mm: the mm which has just marked a vma MADV_MERGEABLE
+ *
+ * The mm stays on kmerged's list until it goes away; unmarked vmas are
+ * skipped by the scan.
+ */
+void merge_register_mm(struct mm_struct *mm)
+{
+	int wake = 0;
+
+	spin_lock(&mmlist_lock);
+	if (list_empty(&mm->merge_list)) {
+		wake = list_empty(&merge_mm_list);
+		list_add_tail(&mm->merge_list, &merge_mm_list);
+	}
+	spin_unlock(&mmlist_lock);
+	if (wake)
+		wake_up_interruptible(&kmerged_wait);
+}
+
+/*
+ * The next mm on merge_mm_list, or NULL at the end of the list.  Only
+ * mm_count is held on it, so that kmerged sleeping between batches does
+ * not keep an exited mm's memory around; mmput() unlinks it meanwhile,
+ * and the pass then ends early.  Drops the reference on `mm'.
+ */
+static struct mm_struct *next_merge_mm(struct mm_struct *mm)
+{
+	struct list_head *p;
+	struct mm_struct *next = NULL;
+
+	spin_lock(&mmlist_lock);
+	if (!mm)
+		p = merge_mm_list.next;
+	else if (list_empty(&mm->merge_list))
+		p = &merge_mm_list;
+	else
+		p = mm->merge_list.next;
+	if (p != &merge_mm_list) {
+		next = list_entry(p, struct mm_struct, merge_list);
+		atomic_inc(&next->mm_count);
+	}
+	spin_unlock(&mmlist_lock);
+	if (mm)
+		mmdrop(mm);
+	return next;
+}
+
+/*
+ * At the end of a pass, forget the pages seen, and count how many ptes
+ * map the merged pages.
+ */
+static void end_merge_pass(void)
+{
+	unsigned long sharing = 0;
+	int i;
+
+	for (i = 0; i < MERGE_HASH_SIZE; i++) {
+		struct list_head *p, *n;
+
+		while (!list_empty(&seen_hash[i]))
+			free_merge_item(list_entry(seen_hash[i].next,
+						struct merge_item, list));
+		list_for_each_safe(p, n, &merged_hash[i]) {
+			struct merge_item *item;
+
+			item = list_entry(p, struct merge_item, list);
+			if (merged_page_stale(item->page))
+				free_merge_item(item);
+			else
+				sharing += page_count(item->page) - 1;
+		}
+	}
+	nr_merged_sharing = sharing;
+	inc_page_state(mergepass);
+}
+
+/*
+ * Scan up to `nr' present pages of mergeable vmas, carrying on where the
+ * last call stopped.  Returns at the end of a pass.
+ */
+static void merge_scan(int nr)
+{
+	while (nr > 0) {
+		struct mm_struct *mm;
+		struct vm_area_struct *vma;
+
+		if (!merge_mm) {
+			merge_mm = next_merge_mm(NULL);
+			merge_address = 0;
+			if (!merge_mm)
+				return;
+		}
+		mm = merge_mm;
+
+		/* Hold the mm's address space only while scanning it */
+		vma = NULL;
+		if (!merge_get_mm_users(mm))
+			goto next_mm;
+
+		down_read(&mm->mmap_sem);
+		for (vma = find_vma(mm, merge_address); vma;
+						vma = vma->vm_next) {
+			if (!(vma->vm_flags & VM_MERGEABLE))
+				continue;
+			if (merge_address < vma->vm_start)
+				merge_address = vma->vm_start;
+			while (nr > 0 && merge_find_pte(mm, &merge_address,
+							vma->vm_end)) {
+				struct page *page;
+
+				page = get_anon_page(mm, merge_address);
+				if (page) {
+					merge_scan_page(vma, merge_address,
+							page);
+					page_cache_release(page);
+				}
+				merge_address += PAGE_SIZE;
+				nr--;
+				cond_resched();
+			}
+			if (!nr)
+				break;
+		}
+		up_read(&mm->mmap_sem);
+		mmput(mm);
+
+next_mm:
+		if (!vma) {
+			merge_mm = next_merge_mm(mm);
+			merge_address = 0;
+			if (!merge_mm) {
+				end_merge_pass();
+				return;
+			}
+		}
+	}
+}
+
+static int kmerged(void *p)
+{
+	daemonize("kmerged");
+	set_user_nice(current, 19);
+
+	for ( ; ; ) {
+		long timeout;
+
+		if (current->flags & PF_FREEZE)
+			refrigerator(PF_IOTHREAD);
+		if (!merge_mm && list_empty(&merge_mm_list))
+			wait_event_interruptible(kmerged_wait,
+					!list_empty(&merge_mm_list));
+		merge_scan(sysctl_merge_pages_to_scan);
+
+		timeout = (sysctl_merge_sleep_millisecs * HZ + 999) / 1000;
+		set_current_state(TASK_INTERRUPTIBLE);
+		schedule_timeout(timeout ? timeout : 1);
+	}
+	return 0;
+}
+
+int merge_report_meminfo(char *buf)
+{
+	return sprintf(buf,
+		"Merged:       %8lu kB\n"
+		"MergedSharing:%8lu kB\n",
+		nr_merged_pages << (PAGE_SHIFT - 10),
+		nr_merged_sharing << (PAGE_SHIFT - 10));
+}
+
+static int __init kmerged_init(void)
+{
+	int i;
+
+	merge_item_cachep = kmem_cache_create("merge_item",
+				sizeof(struct merge_item), 0, 0, NULL, NULL);
+	if (!merge_item_cachep)
+		panic("Cannot create merge_item SLAB cache");
+	for (i = 0; i < MERGE_HASH_SIZE; i++) {
+		INIT_LIST_HEAD(&merged_hash[i]);
+		INIT_LIST_HEAD(&seen_hash[i]);
+	}
+	kernel_thread(kmerged, NULL, CLONE_KERNEL);
+	return 0;
+}
+
+module_init(kmerged_init)
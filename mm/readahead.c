@@ -118,77 +118,54 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 /*
  * Readahead design.
  *
- * The fields in struct file_ra_state represent the most-recently-executed
- * readahead attempt:
+ * Readahead is done on demand: a read which finds its pages in the pagecache
+ * costs nothing extra unless it comes across a readahead marker.
  *
- * start:	Page index at which we started the readahead
- * size:	Number of pages in that read
- *              Together, these form the "current window".
- *              Together, start and size represent the `readahead window'.
- * next_size:   The number of pages to read on the next readahead miss.
- *              Has the magical value -1UL if readahead has been disabled.
- * prev_page:   The page which the readahead algorithm most-recently inspected.
- *              prev_page is mainly an optimisation: if page_cache_readahead
- *		sees that it is again being called for a page which it just
- *		looked at, it can return immediately without making any state
- *		changes.
- * ahead_start,
- * ahead_size:  Together, these form the "ahead window".
- * ra_pages:	The externally controlled max readahead for this fd.
- *
- * When readahead is in the "maximally shrunk" state (next_size == -1UL),
- * readahead is disabled.  In this state, prev_page and size are used, inside
- * handle_ra_miss(), to detect the resumption of sequential I/O.  Once there
- * has been a decent run of sequential I/O (defined by get_min_readahead),
- * readahead is reenabled.
- *
- * The readahead code manages two windows - the "current" and the "ahead"
- * windows.  The intent is that while the application is walking the pages
- * in the current window, I/O is underway on the ahead window.  When the
- * current window is fully traversed, it is replaced by the ahead window
- * and the ahead window is invalidated.  When this copying happens, the
- * new current window's pages are probably still locked.  When I/O has
- * completed, we submit a new batch of I/O, creating a new ahead window.
- *
- * So:
- *
- *   ----|----------------|----------------|-----
- *       ^start           ^start+size
- *                        ^ahead_start     ^ahead_start+ahead_size
- *
- *         ^ When this page is read, we submit I/O for the
- *           ahead window.
+ * The fields in struct file_ra_state describe the most recent readahead:
  *
- * A `readahead hit' occurs when a read request is made against a page which is
- * inside the current window.  Hits are good, and the window size (next_size)
- * is grown aggressively when hits occur.  Two pages are added to the next
- * window size on each hit, which will end up doubling the next window size by
- * the time I/O is submitted for it.
- *
- * If readahead hits are more sparse (say, the application is only reading
- * every second page) then the window will build more slowly.
+ * start:	First page of the readahead window
+ * size:	Number of pages in the window
+ * async_size:	The marker page is this many pages before the end of the
+ *		window.  When the reader gets to it, I/O is started for the
+ *		next window while the reader is still busy with this one.
+ * prev_page:	The page which the reader most recently read.
+ * ra_pages:	The externally controlled max readahead for this fd.
  *
- * On a readahead miss (the application seeked away) the readahead window is
- * shrunk by 25%.  We don't want to drop it too aggressively, because it is a
- * good assumption that an application which has built a good readahead window
- * will continue to perform linear reads.  Either at the new file position, or
- * at the old one after another seek.
+ *   ----|--------------------|--------------------|-----
+ *       ^start    ^marker    ^start+size
+ *                            ^next start          ^next start+size
  *
- * After enough misses, readahead is fully disabled. (next_size = -1UL).
+ * The marker is a page flag (PG_readahead) rather than just an offset in the
+ * file_ra_state, so that one file_ra_state can serve several interleaved
+ * sequential streams: a server reading many offsets through one fd, or
+ * threads using pread() on a shared one.  When a reader hits a marker which
+ * its file_ra_state knows nothing about, the window that marker belonged to
+ * is worked out from the pagecache, and readahead carries on from there.
+ * Similarly, a cache miss just after a run of cached pages is taken to be
+ * the continuation of a sequential stream.
  *
- * There is a special-case: if the first page which the application tries to
- * read happens to be the first page of the file, it is assumed that a linear
- * read is about to happen and the window is immediately set to half of the
- * device maximum.
- * 
- * A page request at (start + size) is not a miss at all - it's just a part of
- * sequential file reading.
+ * Each time a stream reaches its marker, readahead has predicted the reader
+ * correctly, and the next window is made two or four times larger, up to
+ * ra_pages.  A cache miss means it did not, and readahead starts again from
+ * a small window.  A miss inside the current window means its pages were
+ * evicted before they could be used (readahead thrashing), and the window
+ * is halved.
  *
- * This function is to be called for every page which is read, rather than when
- * it is time to perform readahead.  This is so the readahead algorithm can
- * centrally work out the access patterns.  This could be costly with many tiny
- * read()s, so we specifically optimise for that case with prev_page.
+ * The hits and misses are counted against the backing device too, and shown
+ * in /sys/block/<disk>/readahead.
+ */
+
+/*
+ * Whether the page at `index' is in the pagecache.  Called under page_lock.
+ * A shadow entry left by reclaim does not count.
  */
+static inline int
+page_cache_present(struct address_space *mapping, unsigned long index)
+{
+	void *entry = radix_tree_lookup(&mapping->page_tree, index);
+
+	return entry && !radix_tree_exceptional_entry(entry);
+}
 
 /*
  * do_page_cache_readahead actually reads a chunk of disk.  It allocates all
@@ -196,11 +173,15 @@ static int read_pages(struct address_space *mapping, struct file *filp,
  * behaviour which would occur if page allocations are causing VM writeback.
  * We really don't want to intermingle reads and writes like that.
  *
+ * If lookahead_size is non-zero, the page that many pages before the end is
+ * marked as the readahead marker (see below).
+ *
  * Returns the number of pages which actually had IO started against them.
  */
 static inline int
 __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
-			unsigned long offset, unsigned long nr_to_read)
+			unsigned long offset, unsigned long nr_to_read,
+			unsigned long lookahead_size)
 {
 	struct inode *inode = mapping->host;
 	struct page *page;
@@ -224,8 +205,7 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		if (page_offset > end_index)
 			break;
 
-		page = radix_tree_lookup(&mapping->page_tree, page_offset);
-		if (page)
+		if (page_cache_present(mapping, page_offset))
 			continue;
 
 		spin_unlock(&mapping->page_lock);
@@ -234,6 +214,8 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		if (!page)
 			break;
 		page->index = page_offset;
+		if (page_idx == nr_to_read - lookahead_size)
+			SetPageReadahead(page);
 		list_add(&page->list, &page_pool);
 		ret++;
 	}
@@ -271,7 +253,7 @@ int do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		if (this_chunk > nr_to_read)
 			this_chunk = nr_to_read;
 		err = __do_page_cache_readahead(mapping, filp,
-						offset, this_chunk);
+						offset, this_chunk, 0);
 		if (err < 0) {
 			ret = err;
 			break;
@@ -284,201 +266,219 @@ int do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 }
 
 /*
- * Check how effective readahead is being.  If the amount of started IO is
- * less than expected then the file is partly or fully in pagecache and
- * readahead isn't helping.  Shrink the window.
- *
- * But don't shrink it too much - the application may read the same page
- * occasionally.
+ * Set up the initial window size: four times the request for small
+ * requests, twice for medium ones, the maximum for large ones.
  */
-static inline void
-check_ra_success(struct file_ra_state *ra, pgoff_t attempt,
-			pgoff_t actual, pgoff_t orig_next_size)
+static unsigned long
+get_init_ra_size(unsigned long size, unsigned long max)
 {
-	if (actual == 0) {
-		if (orig_next_size > 1) {
-			ra->next_size = orig_next_size - 1;
-			if (ra->ahead_size)
-				ra->ahead_size = ra->next_size;
-		} else {
-			ra->next_size = -1UL;
-			ra->size = 0;
-		}
-	}
+	unsigned long newsize = 1;
+
+	while (newsize < size)
+		newsize <<= 1;
+
+	if (newsize <= max / 32)
+		newsize = newsize * 4;
+	else if (newsize <= max / 4)
+		newsize = newsize * 2;
+	else
+		newsize = max;
+	return newsize;
 }
 
 /*
- * page_cache_readahead is the main function.  If performs the adaptive
- * readahead window size management and submits the readahead I/O.
+ * Size the next window, ramping up quickly while it is small.
  */
-void
-page_cache_readahead(struct address_space *mapping, struct file_ra_state *ra,
-			struct file *filp, unsigned long offset)
+static unsigned long
+get_next_ra_size(unsigned long cur, unsigned long max)
 {
-	unsigned max;
-	unsigned min;
-	unsigned orig_next_size;
-	unsigned actual;
+	unsigned long newsize;
 
-	/*
-	 * Here we detect the case where the application is performing
-	 * sub-page sized reads.  We avoid doing extra work and bogusly
-	 * perturbing the readahead window expansion logic.
-	 * If next_size is zero, this is the very first read for this
-	 * file handle, or the window is maximally shrunk.
-	 */
-	if (offset == ra->prev_page) {
-		if (ra->next_size != 0)
-			goto out;
-	}
+	if (cur < max / 16)
+		newsize = 4 * cur;
+	else
+		newsize = 2 * cur;
+	return min(newsize, max);
+}
 
-	if (ra->next_size == -1UL)
-		goto out;	/* Maximally shrunk */
+/*
+ * Count the cached pages immediately before offset, up to max.
+ */
+static unsigned long
+count_history_pages(struct address_space *mapping, unsigned long offset,
+			unsigned long max)
+{
+	unsigned long nr = 0;
 
-	max = get_max_readahead(ra);
-	if (max == 0)
-		goto out;	/* No readahead */
+	spin_lock(&mapping->page_lock);
+	while (nr < max && nr < offset &&
+	       page_cache_present(mapping, offset - nr - 1))
+		nr++;
+	spin_unlock(&mapping->page_lock);
+	return nr;
+}
 
-	min = get_min_readahead(ra);
-	orig_next_size = ra->next_size;
+/*
+ * Find the first page at or after offset which is not cached, looking no
+ * more than max pages ahead.  Returns 0 if there is none that close.
+ */
+static unsigned long
+next_uncached_page(struct address_space *mapping, unsigned long offset,
+			unsigned long max)
+{
+	unsigned long index;
 
-	if (ra->next_size == 0 && offset == 0) {
-		/*
-		 * Special case - first read from first page.
-		 * We'll assume it's a whole-file read, and
-		 * grow the window fast.
-		 */
-		ra->next_size = max / 2;
-		goto do_io;
+	spin_lock(&mapping->page_lock);
+	for (index = offset; index - offset < max; index++) {
+		if (!page_cache_present(mapping, index))
+			break;
 	}
+	spin_unlock(&mapping->page_lock);
+	return index - offset < max ? index : 0;
+}
+
+static void
+ondemand_readahead(struct address_space *mapping, struct file_ra_state *ra,
+			struct file *filp, int hit_marker,
+			unsigned long offset, unsigned long req_size)
+{
+	struct backing_dev_info *bdi = mapping->backing_dev_info;
+	unsigned long max = get_max_readahead(ra);
+	unsigned long start;
 
-	ra->prev_page = offset;
+	if (req_size > max)
+		req_size = max;
+	if (req_size == 0)
+		req_size = 1;
+
+	if (hit_marker) {
+		atomic_inc(&bdi->ra_hits);
 
-	if (offset >= ra->start && offset <= (ra->start + ra->size)) {
 		/*
-		 * A readahead hit.  Either inside the window, or one
-		 * page beyond the end.  Expand the next readahead size.
+		 * Our own marker, or the reader has got to the end of the
+		 * window: move on to the next one.
 		 */
-		ra->next_size += 2;
-	} else {
+		if (offset == ra->start + ra->size - ra->async_size ||
+		    offset == ra->start + ra->size) {
+			ra->start += ra->size;
+			ra->size = get_next_ra_size(ra->size, max);
+			ra->async_size = ra->size;
+			goto readit;
+		}
+
 		/*
-		 * A miss - lseek, pagefault, pread, etc.  Shrink the readahead
-		 * window.
+		 * Some other stream's marker.  Its window ends at the first
+		 * uncached page, and the part of it from the marker on was as
+		 * big as that stream's readahead had grown.
 		 */
-		ra->next_size -= 2;
+		start = next_uncached_page(mapping, offset + 1, max);
+		if (!start)
+			return;
+		ra->start = start;
+		ra->size = get_next_ra_size(start - offset, max);
+		ra->async_size = ra->size;
+		goto readit;
 	}
 
-	if ((long)ra->next_size > (long)max)
-		ra->next_size = max;
-	if ((long)ra->next_size <= 0L) {
-		ra->next_size = -1UL;
-		ra->size = 0;
-		goto out;		/* Readahead is off */
+	atomic_inc(&bdi->ra_misses);
+
+	/*
+	 * A miss inside the window we have just read: thrashing.
+	 */
+	if (ra->size && offset >= ra->start && offset < ra->start + ra->size) {
+		ra->start = offset;
+		ra->size = max(ra->size / 2, get_min_readahead(ra));
+		if (ra->size > max)
+			ra->size = max;
+		ra->async_size = ra->size / 2;
+		goto readit;
 	}
 
 	/*
-	 * Is this request outside the current window?
+	 * The first page, or the one after the last read: a new sequential
+	 * stream.
 	 */
-	if (offset < ra->start || offset >= (ra->start + ra->size)) {
-		/*
-		 * A miss against the current window.  Have we merely
-		 * advanced into the ahead window?
-		 */
-		if (offset == ra->ahead_start) {
-			/*
-			 * Yes, we have.  The ahead window now becomes
-			 * the current window.
-			 */
-			ra->start = ra->ahead_start;
-			ra->size = ra->ahead_size;
-			ra->prev_page = ra->start;
-			ra->ahead_start = 0;
-			ra->ahead_size = 0;
-
-			/*
-			 * Control now returns, probably to sleep until I/O
-			 * completes against the first ahead page.
-			 * When the second page in the old ahead window is
-			 * requested, control will return here and more I/O
-			 * will be submitted to build the new ahead window.
-			 */
-			goto out;
-		}
-do_io:
-		/*
-		 * This is the "unusual" path.  We come here during
-		 * startup or after an lseek.  We invalidate the
-		 * ahead window and get some I/O underway for the new
-		 * current window.
-		 */
+	if (offset == 0 || offset - ra->prev_page <= 1UL) {
 		ra->start = offset;
-		ra->size = ra->next_size;
-		ra->ahead_start = 0;		/* Invalidate these */
-		ra->ahead_size = 0;
-		actual = do_page_cache_readahead(mapping, filp, offset,
-						 ra->size);
-		check_ra_success(ra, ra->size, actual, orig_next_size);
-	} else {
-		/*
-		 * This read request is within the current window.  It is time
-		 * to submit I/O for the ahead window while the application is
-		 * crunching through the current window.
-		 */
-		if (ra->ahead_start == 0) {
-			ra->ahead_start = ra->start + ra->size;
-			ra->ahead_size = ra->next_size;
-			actual = do_page_cache_readahead(mapping, filp,
-					ra->ahead_start, ra->ahead_size);
-			check_ra_success(ra, ra->ahead_size,
-					actual, orig_next_size);
-		}
+		ra->size = get_init_ra_size(req_size, max);
+		ra->async_size = ra->size > req_size ?
+					ra->size - req_size : ra->size;
+		goto readit;
 	}
-out:
+
+	/*
+	 * Just after some cached pages: probably a stream which was being
+	 * read through another file_ra_state, or which lost its marker.
+	 */
+	start = count_history_pages(mapping, offset, max);
+	if (start >= req_size) {
+		ra->start = offset;
+		ra->size = get_init_ra_size(start + req_size, max);
+		ra->async_size = ra->size;
+		goto readit;
+	}
+
+	/*
+	 * A random read.  Read what was asked for, and forget about the old
+	 * window so that later misses in it are not taken for thrashing.
+	 */
+	ra->size = 0;
+	__do_page_cache_readahead(mapping, filp, offset, req_size, 0);
 	return;
-}
 
+readit:
+	__do_page_cache_readahead(mapping, filp, ra->start, ra->size,
+					ra->async_size);
+}
 
-/*
- * handle_ra_miss() is called when it is known that a page which should have
- * been present in the pagecache (we just did some readahead there) was in fact
- * not found.  This will happen if it was evicted by the VM (readahead
- * thrashing) or if the readahead window is maximally shrunk.
- *
- * If the window has been maximally shrunk (next_size == -1UL) then look to see
- * if we are getting misses against sequential file offsets.  If so, and this
- * persists then resume readahead.
+/**
+ * page_cache_sync_readahead - readahead on a cache miss
+ * @mapping: the address_space
+ * @ra: the file_ra_state of the reader
+ * @filp: the file being read, passed on to readpage
+ * @offset: the page which was not in the pagecache
+ * @req_size: how many pages the reader wants, starting at offset
  *
- * Otherwise we're thrashing, so shrink the readahead window by three pages.
- * This is because it is grown by two pages on a readahead hit.  Theory being
- * that the readahead window size will stabilise around the maximum level at
- * which there is no thrashing.
+ * Called when a page the reader wants is not in the pagecache.  Reads it,
+ * and as much more as the reader looks likely to want.
  */
-void handle_ra_miss(struct address_space *mapping,
-		struct file_ra_state *ra, pgoff_t offset)
+void page_cache_sync_readahead(struct address_space *mapping,
+			struct file_ra_state *ra, struct file *filp,
+			unsigned long offset, unsigned long req_size)
 {
-	if (ra->next_size == -1UL) {
-		const unsigned long max = get_max_readahead(ra);
-
-		if (offset != ra->prev_page + 1) {
-			ra->size = 0;			/* Not sequential */
-		} else {
-			ra->size++;			/* A sequential read */
-			if (ra->size >= max) {		/* Resume readahead */
-				ra->start = offset - max;
-				ra->next_size = max;
-				ra->size = max;
-				ra->ahead_start = 0;
-				ra->ahead_size = 0;
-			}
-		}
-		ra->prev_page = offset;
-	} else {
-		const unsigned long min = get_min_readahead(ra);
+	if (!get_max_readahead(ra))
+		return;
+	ondemand_readahead(mapping, ra, filp, 0, offset, req_size);
+}
 
-		ra->next_size -= 3;
-		if (ra->next_size < min)
-			ra->next_size = min;
-	}
+/**
+ * page_cache_async_readahead - readahead on reaching a marker
+ * @mapping: the address_space
+ * @ra: the file_ra_state of the reader
+ * @filp: the file being read, passed on to readpage
+ * @page: the page at offset, which has PG_readahead set
+ * @offset: the page the reader has got to
+ * @req_size: how many pages the reader wants, starting at offset
+ *
+ * Called when the reader comes across a readahead marker.  Starts I/O on the
+ * next window of its stream, so that it is there before the reader is.
+ */
+void page_cache_async_readahead(struct address_space *mapping,
+			struct file_ra_state *ra, struct file *filp,
+			struct page *page, unsigned long offset,
+			unsigned long req_size)
+{
+	if (!TestClearPageReadahead(page))
+		return;
+	if (!get_max_readahead(ra))
+		return;
+	/*
+	 * Don't queue more when the device is already busy: the reader will
+	 * miss and come back through page_cache_sync_readahead().
+	 */
+	if (bdi_read_congested(mapping->backing_dev_info))
+		return;
+	ondemand_readahead(mapping, ra, filp, 1, offset, req_size);
 }
 
 /*
@@ -156,6 +156,29 @@ int page_referenced(struct page * page)
 	return referenced;
 }
 
+/**
+ * page_single_mapping - find where a page is mapped, if only once
+ * @page: the page
+ * @mm: where to return the mm it is mapped into
+ * @address: where to return the virtual address it is mapped at
+ *
+ * Returns zero if the page is mapped more than once or not at all.
+ * Caller needs to hold the pte_chain_lock.
+ */
+int page_single_mapping(struct page *page, struct mm_struct **mm,
+			unsigned long *address)
+{
+	pte_t *ptep;
+
+	if (!PageDirect(page) || !page->pte.direct)
+		return 0;
+	ptep = rmap_ptep_map(page->pte.direct);
+	*mm = ptep_to_mm(ptep);
+	*address = ptep_to_address(ptep);
+	rmap_ptep_unmap(ptep);
+	return 1;
+}
+
 /**
  * page_add_rmap - add reverse mapping entry to a page
  * @page: the page to add the mapping to
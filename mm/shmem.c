@@ -79,6 +79,29 @@ static inline struct page *shmem_dir_alloc(unsigned int gfp_mask)
 	return alloc_pages(gfp_mask, PAGE_CACHE_SHIFT-PAGE_SHIFT);
 }
 
+#ifdef CONFIG_NUMA
+/*
+ * Pages of a shared object are placed by the policy of the object, which
+ * is the same whichever task happens to fault them in.
+ */
+static struct page *shmem_alloc_page(struct inode *inode, unsigned long idx)
+{
+	struct shmem_inode_info *info = SHMEM_I(inode);
+	struct mempolicy *pol;
+	struct page *page;
+
+	spin_lock(&info->lock);
+	pol = info->policy;
+	mpol_get(pol);
+	spin_unlock(&info->lock);
+	page = alloc_page_policy(inode->i_mapping->gfp_mask, pol, idx);
+	mpol_free(pol);
+	return page;
+}
+#else
+#define shmem_alloc_page(inode, idx)	page_cache_alloc((inode)->i_mapping)
+#endif
+
 static inline void shmem_dir_free(struct page *page)
 {
 	__free_pages(page, PAGE_CACHE_SHIFT-PAGE_SHIFT);
@@ -551,6 +574,10 @@ static void shmem_delete_inode(struct inode *inode)
 		inode->i_size = 0;
 		shmem_truncate(inode);
 	}
+#ifdef CONFIG_NUMA
+	mpol_free(info->policy);
+	info->policy = NULL;
+#endif
 	BUG_ON(inode->i_blocks);
 	spin_lock(&sbinfo->stat_lock);
 	sbinfo->free_inodes++;
@@ -885,7 +912,7 @@ repeat:
 
 		if (!filepage) {
 			spin_unlock(&info->lock);
-			filepage = page_cache_alloc(mapping);
+			filepage = shmem_alloc_page(inode, idx);
 			if (!filepage) {
 				shmem_free_block(inode);
 				error = -ENOMEM;
@@ -1005,6 +1032,48 @@ void shmem_lock(struct file *file, int lock)
 	spin_unlock(&info->lock);
 }
 
+#ifdef CONFIG_NUMA
+/*
+ * A shared mapping sets the policy of the whole object; a private one
+ * only that of its own vma, which its copied-on-write pages follow.
+ */
+int shmem_set_policy(struct vm_area_struct *vma, struct mempolicy *new)
+{
+	struct inode *inode = vma->vm_file->f_dentry->d_inode;
+	struct shmem_inode_info *info = SHMEM_I(inode);
+	struct mempolicy *old;
+
+	if (!(vma->vm_flags & VM_SHARED))
+		return 0;
+	mpol_get(new);
+	spin_lock(&info->lock);
+	old = info->policy;
+	info->policy = new;
+	spin_unlock(&info->lock);
+	mpol_free(old);
+	return 0;
+}
+
+struct mempolicy *shmem_get_policy(struct vm_area_struct *vma,
+				   unsigned long addr)
+{
+	struct inode *inode = vma->vm_file->f_dentry->d_inode;
+	struct shmem_inode_info *info = SHMEM_I(inode);
+	struct mempolicy *pol;
+
+	if (!(vma->vm_flags & VM_SHARED)) {
+		pol = vma_policy(vma);
+		mpol_get(pol);
+		return pol;
+	}
+	spin_lock(&info->lock);
+	pol = info->policy;
+	mpol_get(pol);
+	spin_unlock(&info->lock);
+	return pol;
+}
+#endif
+
 static int shmem_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	struct vm_operations_struct *ops;
@@ -1815,6 +1884,10 @@ static struct super_operations shmem_ops = {
 static struct vm_operations_struct shmem_vm_ops = {
 	.nopage		= shmem_nopage,
 	.populate	= shmem_populate,
+#ifdef CONFIG_NUMA
+	.set_policy	= shmem_set_policy,
+	.get_policy	= shmem_get_policy,
+#endif
 };
 
 static struct super_block *shmem_get_sb(struct file_system_type *fs_type,
@@ -762,8 +762,11 @@ static inline void * kmem_getpages (kmem_cache_t *cachep, unsigned long flags)
 	 * would be relatively rare and ignorable.
 	 */
 	flags |= cachep->gfpflags;
-	if ( cachep->flags & SLAB_RECLAIM_ACCOUNT) 
+	flags &= ~__GFP_MOVABLE;
+	if ( cachep->flags & SLAB_RECLAIM_ACCOUNT) {
 		atomic_add(1<<cachep->gfporder, &slab_reclaim_pages);
+		flags |= __GFP_RECLAIMABLE;
+	}
 	addr = (void*) __get_free_pages(flags, cachep->gfporder);
 	/* Assume that now we have the pages no one else can legally
 	 * messes with the 'struct page's.
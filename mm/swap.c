@@ -24,6 +24,7 @@
 #include <linux/mm_inline.h>
 #include <linux/buffer_head.h>	/* for try_to_release_page() */
 #include <linux/percpu.h>
+#include <linux/memgroup.h>
 
 /* How many pages do we try to swap or page in/out together? */
 int page_cluster;
@@ -83,6 +84,7 @@ void activate_page(struct page *page)
 		SetPageActive(page);
 		add_page_to_active_list(zone, page);
 		inc_page_state(pgactivate);
+		workingset_activation(zone);
 	}
 	spin_unlock_irq(&zone->lru_lock);
 }
@@ -113,8 +115,10 @@ static DEFINE_PER_CPU(struct pagevec, lru_add_active_pvecs) = { 0, };
 
 void lru_cache_add(struct page *page)
 {
-	struct pagevec *pvec = &get_cpu_var(lru_add_pvecs);
+	struct pagevec *pvec;
 
+	memgroup_charge(page);
+	pvec = &get_cpu_var(lru_add_pvecs);
 	page_cache_get(page);
 	if (!pagevec_add(pvec, page))
 		__pagevec_lru_add(pvec);
@@ -123,8 +127,10 @@ void lru_cache_add(struct page *page)
 
 void lru_cache_add_active(struct page *page)
 {
-	struct pagevec *pvec = &get_cpu_var(lru_add_active_pvecs);
+	struct pagevec *pvec;
 
+	memgroup_charge(page);
+	pvec = &get_cpu_var(lru_add_active_pvecs);
 	page_cache_get(page);
 	if (!pagevec_add(pvec, page))
 		__pagevec_lru_add_active(pvec);
@@ -185,6 +191,14 @@ void release_pages(struct page **pages, int nr, int cold)
 		struct page *page = pages[i];
 		struct zone *pagezone;
 
+		if (PageCompound(page)) {
+			if (zone) {
+				spin_unlock_irq(&zone->lru_lock);
+				zone = NULL;
+			}
+			put_page(page);
+			continue;
+		}
 		if (PageReserved(page) || !put_page_testzero(page))
 			continue;
 
@@ -273,7 +287,11 @@ void __pagevec_lru_add(struct pagevec *pvec)
 		}
 		if (TestSetPageLRU(page))
 			BUG();
-		add_page_to_inactive_list(zone, page);
+		/* add_to_page_cache() activates refaulting pages */
+		if (PageActive(page))
+			add_page_to_active_list(zone, page);
+		else
+			add_page_to_inactive_list(zone, page);
 	}
 	if (zone)
 		spin_unlock_irq(&zone->lru_lock);
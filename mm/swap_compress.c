@@ -0,0 +1,362 @@
+/*
+ *  linux/mm/swap_compress.c
+ *
+ *  A compressed cache in front of the swap devices.
+ *
+ *  Pages written out by reclaim are deflated and kept in memory, indexed
+ *  by their swap entry, instead of being written to disk; swap_readpage()
+ *  finds them here again.  The copy stays until the swap entry is freed,
+ *  so that a page which is swapped in and out again without having been
+ *  dirtied needs no write at all.
+ *
+ *  The cache is limited to vm.swap_compress_percent of memory.  Above
+ *  that, pdflush pushes the oldest entries out to the swap device in
+ *  batches, in swap offset order, by bringing them back into the swap
+ *  cache and writing them out like reclaim would.
+ */
+
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/radix-tree.h>
+#include <linux/crypto.h>
+#include <linux/writeback.h>
+#include <linux/percpu.h>
+#include <asm/bitops.h>
+
+struct zentry {
+	swp_entry_t entry;
+	struct list_head lru;		/* oldest first */
+	unsigned int length;
+	u8 data[0];
+};
+
+/*
+ * Pages which don't compress to less than this are not worth keeping:
+ * any bigger, and the entry would need a whole page from kmalloc.
+ */
+#define SWAP_COMPRESS_MAX	(PAGE_SIZE / 2 - sizeof(struct zentry))
+
+int sysctl_swap_compress_percent = 10;
+
+static spinlock_t zcache_lock = SPIN_LOCK_UNLOCKED;
+static RADIX_TREE(zcache_tree, GFP_ATOMIC);
+static LIST_HEAD(zcache_lru);
+static unsigned long zcache_pages;	/* entries in the cache */
+static unsigned long zcache_bytes;	/* memory they take up, slack and all */
+
+static int zcache_ready;
+static unsigned long zcache_evicting;
+
+/*
+ * Each cpu has its own compressor and output buffer.  They are set up at
+ * boot, because the deflate transform allocates its workspace on first
+ * use with GFP_KERNEL.
+ */
+static DEFINE_PER_CPU(struct crypto_tfm *, zcache_tfm);
+static DEFINE_PER_CPU(u8 *, zcache_buf);
+
+static inline unsigned int zentry_size(unsigned int length)
+{
+	return sizeof(struct zentry) + length;
+}
+
+static inline int zcache_full(void)
+{
+	return (zcache_bytes >> PAGE_SHIFT) >=
+		num_physpages * sysctl_swap_compress_percent / 100;
+}
+
+/*
+ * Drop the cached copy of `entry', if any.  zcache_lock is held.
+ */
+static void __zcache_remove(swp_entry_t entry)
+{
+	struct zentry *z;
+
+	z = radix_tree_delete(&zcache_tree, entry.val);
+	if (z) {
+		list_del(&z->lru);
+		zcache_pages--;
+		zcache_bytes -= ksize(z);
+		kfree(z);
+	}
+}
+
+static void zcache_evict(unsigned long unused);
+
+/**
+ * swap_compress_store - keep a compressed copy of a swap cache page
+ * @page: the locked swap cache page being written out
+ *
+ * Called by swap_writepage() on behalf of reclaim.  Returns 0 if the page
+ * is now in the cache and need not be written to disk.  Otherwise any
+ * older copy of it is discarded, so that the disk copy is used.
+ */
+int swap_compress_store(struct page *page)
+{
+	swp_entry_t entry = { .val = page->index };
+	struct crypto_tfm *tfm;
+	struct zentry *z = NULL;
+	unsigned int length = SWAP_COMPRESS_MAX;
+	void *src;
+	u8 *buf;
+	int cpu;
+	int err;
+
+	if (!zcache_ready || !sysctl_swap_compress_percent)
+		goto reject;
+	if (zcache_full()) {
+		if (!test_and_set_bit(0, &zcache_evicting) &&
+		    pdflush_operation(zcache_evict, 0))
+			clear_bit(0, &zcache_evicting);
+		goto reject;
+	}
+	if (radix_tree_preload(GFP_NOIO))
+		goto reject;
+
+	cpu = get_cpu();
+	tfm = per_cpu(zcache_tfm, cpu);
+	buf = per_cpu(zcache_buf, cpu);
+	src = kmap_atomic(page, KM_USER0);
+	err = crypto_comp_compress(tfm, src, PAGE_SIZE, buf, &length);
+	kunmap_atomic(src, KM_USER0);
+	if (!err && length <= SWAP_COMPRESS_MAX) {
+		z = kmalloc(zentry_size(length), GFP_ATOMIC | __GFP_NOWARN);
+		if (z) {
+			z->entry = entry;
+			z->length = length;
+			memcpy(z->data, buf, length);
+		}
+	}
+	put_cpu();
+
+	spin_lock(&zcache_lock);
+	__zcache_remove(entry);
+	if (z) {
+		radix_tree_insert(&zcache_tree, entry.val, z);
+		list_add_tail(&z->lru, &zcache_lru);
+		zcache_pages++;
+		zcache_bytes += ksize(z);
+	}
+	spin_unlock(&zcache_lock);
+	radix_tree_preload_end();
+
+	if (z) {
+		inc_page_state(pgzstore);
+		return 0;
+	}
+	inc_page_state(pgzreject);
+	return -ENOMEM;
+
+reject:
+	swap_compress_invalidate(entry);
+	inc_page_state(pgzreject);
+	return -ENOMEM;
+}
+
+/**
+ * swap_compress_load - fill a page from the compressed cache
+ * @page: the locked swap cache page being read in
+ *
+ * Returns 0, with @page filled in, if its contents were in the cache.
+ */
+int swap_compress_load(struct page *page)
+{
+	swp_entry_t entry = { .val = page->index };
+	struct crypto_tfm *tfm;
+	struct zentry *z;
+	unsigned int length = PAGE_SIZE;
+	void *dst;
+	int err = 0;
+
+	if (!zcache_pages)
+		return -ENOENT;
+
+	spin_lock(&zcache_lock);
+	z = radix_tree_lookup(&zcache_tree, entry.val);
+	if (z) {
+		tfm = per_cpu(zcache_tfm, smp_processor_id());
+		dst = kmap_atomic(page, KM_USER0);
+		err = crypto_comp_decompress(tfm, z->data, z->length,
+						dst, &length);
+		kunmap_atomic(dst, KM_USER0);
+		/* A hit makes it young again */
+		list_move_tail(&z->lru, &zcache_lru);
+	}
+	spin_unlock(&zcache_lock);
+
+	if (!z)
+		return -ENOENT;
+	if (err || length != PAGE_SIZE) {
+		printk(KERN_ERR "swap_compress: bad entry %08lx\n", entry.val);
+		return -EIO;
+	}
+	inc_page_state(pgzload);
+	return 0;
+}
+
+/**
+ * swap_compress_invalidate - forget a swap entry
+ * @entry: the swap entry
+ *
+ * Called when @entry is freed, or about to be written to disk.  The swap
+ * device locks may be held.
+ */
+void swap_compress_invalidate(swp_entry_t entry)
+{
+	if (!zcache_pages)
+		return;
+	spin_lock(&zcache_lock);
+	__zcache_remove(entry);
+	spin_unlock(&zcache_lock);
+}
+
+/*
+ * Collect up to `max' of the oldest entries, sorted by swap entry so that
+ * they go to the disk in order.
+ */
+static int zcache_oldest(swp_entry_t *entries, int max)
+{
+	struct list_head *p;
+	int nr = 0;
+	int i;
+
+	spin_lock(&zcache_lock);
+	list_for_each(p, &zcache_lru) {
+		swp_entry_t entry = list_entry(p, struct zentry, lru)->entry;
+
+		for (i = nr; i > 0 && entries[i - 1].val > entry.val; i--)
+			entries[i] = entries[i - 1];
+		entries[i] = entry;
+		if (++nr == max)
+			break;
+	}
+	spin_unlock(&zcache_lock);
+	return nr;
+}
+
+/*
+ * Bring the entry back into the swap cache and start writing it to disk.
+ */
+static void zcache_writeout(swp_entry_t entry)
+{
+	struct writeback_control wbc = {
+		.sync_mode = WB_SYNC_NONE,
+		.nr_to_write = SWAP_CLUSTER_MAX,
+		.nonblocking = 1,
+	};
+	struct address_space *mapping = &swapper_space;
+	struct page *page;
+
+	page = read_swap_cache_async(entry);
+	if (!page) {
+		/* The entry was freed meanwhile */
+		swap_compress_invalidate(entry);
+		return;
+	}
+	lock_page(page);
+	if (!PageSwapCache(page) || page->index != entry.val ||
+	    !PageUptodate(page) || PageWriteback(page)) {
+		unlock_page(page);
+		goto out;
+	}
+	swap_compress_invalidate(entry);
+	set_page_dirty(page);
+
+	spin_lock(&mapping->page_lock);
+	if (test_clear_page_dirty(page)) {
+		list_move(&page->list, &mapping->locked_pages);
+		spin_unlock(&mapping->page_lock);
+		SetPageReclaim(page);
+		inc_page_state(pgzevict);
+		swap_writepage(page, &wbc);
+	} else {
+		spin_unlock(&mapping->page_lock);
+		unlock_page(page);
+	}
+out:
+	page_cache_release(page);
+}
+
+/*
+ * Run by pdflush when the cache is over its limit: write the oldest
+ * entries out until it is down to 7/8 of the limit.
+ */
+static void zcache_evict(unsigned long unused)
+{
+	swp_entry_t entries[SWAP_CLUSTER_MAX];
+	unsigned long target, before;
+	int nr, i;
+
+	target = num_physpages * sysctl_swap_compress_percent / 100;
+	target -= target / 8;
+	while ((zcache_bytes >> PAGE_SHIFT) >= target) {
+		before = zcache_pages;
+		nr = zcache_oldest(entries, SWAP_CLUSTER_MAX);
+		for (i = 0; i < nr; i++)
+			zcache_writeout(entries[i]);
+		blk_run_queues();
+		/* Stuck behind pages which are busy elsewhere */
+		if (zcache_pages >= before)
+			break;
+		cond_resched();
+	}
+	clear_bit(0, &zcache_evicting);
+}
+
+int swap_compress_report_meminfo(char *buf)
+{
+	return sprintf(buf,
+		"SwapCompressed: %8lu kB\n"
+		"SwapCompressedUsed: %4lu kB\n",
+		zcache_pages << (PAGE_SHIFT - 10),
+		zcache_bytes >> 10);
+}
+
+static int __init swap_compress_init(void)
+{
+	struct page *page;
+	void *src;
+	int cpu;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+	src = page_address(page);
+	clear_page(src);
+
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		struct crypto_tfm *tfm;
+		unsigned int length = PAGE_SIZE;
+		u8 *buf;
+
+		if (!cpu_possible(cpu))
+			continue;
+		tfm = crypto_alloc_tfm("deflate", 0);
+		buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+		/* Get the workspaces allocated now, while we may sleep */
+		if (!tfm || !buf ||
+		    crypto_comp_compress(tfm, src, PAGE_SIZE, buf, &length) ||
+		    crypto_comp_decompress(tfm, buf, length, src, &length)) {
+			printk(KERN_WARNING
+				"swap_compress: no deflate, disabled\n");
+			if (tfm)
+				crypto_free_tfm(tfm);
+			kfree(buf);
+			break;
+		}
+		per_cpu(zcache_tfm, cpu) = tfm;
+		per_cpu(zcache_buf, cpu) = buf;
+	}
+	__free_page(page);
+	if (cpu == NR_CPUS)
+		zcache_ready = 1;
+	return 0;
+}
+
+late_initcall(swap_compress_init);
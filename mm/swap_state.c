@@ -13,6 +13,7 @@
 #include <linux/init.h>
 #include <linux/pagemap.h>
 #include <linux/backing-dev.h>
+#include <linux/rmap-locking.h>
 
 #include <asm/pgtable.h>
 
@@ -105,9 +106,14 @@ void __delete_from_swap_cache(struct page *page)
  *
  * Allocate swap space for the page and add the page to the
  * swap cache.  Caller needs to hold the page lock. 
+ *
+ * A page mapped by a single process is placed next to its virtual
+ * neighbours, see get_swap_page_near().
  */
 int add_to_swap(struct page * page)
 {
+	struct mm_struct *mm = NULL;
+	unsigned long address = 0;
 	swp_entry_t entry;
 	int pf_flags;
 	int err;
@@ -115,8 +121,16 @@ int add_to_swap(struct page * page)
 	if (!PageLocked(page))
 		BUG();
 
+	pte_chain_lock(page);
+	if (!page_single_mapping(page, &mm, &address))
+		mm = NULL;
+	pte_chain_unlock(page);
+
 	for (;;) {
-		entry = get_swap_page();
+		if (mm)
+			entry = get_swap_page_near(mm, address);
+		else
+			entry = get_swap_page();
 		if (!entry.val)
 			return 0;
 
@@ -156,6 +170,7 @@ int add_to_swap(struct page * page)
 			/* Raced with "speculative" read_swap_cache_async */
 			INC_CACHE_INFO(exist_race);
 			swap_free(entry);
+			mm = NULL;	/* Don't retry the same slot */
 			continue;
 		default:
 			/* -ENOMEM radix-tree allocation failure */
@@ -23,6 +23,8 @@
 #include <linux/module.h>
 #include <linux/rmap-locking.h>
 #include <linux/security.h>
+#include <linux/hugetlb.h>
+#include <linux/hash.h>
 
 #include <asm/pgtable.h>
 #include <linux/swapops.h>
@@ -43,7 +45,44 @@ struct swap_list_t swap_list = {-1, -1};
 
 struct swap_info_struct swap_info[MAX_SWAPFILES];
 
-#define SWAPFILE_CLUSTER 256
+#define SWAPFILE_CLUSTER_SHIFT	8
+#define SWAPFILE_CLUSTER	(1 << SWAPFILE_CLUSTER_SHIFT)
+
+/*
+ * Find SWAPFILE_CLUSTER consecutive free slots.  Returns the first, or
+ * zero if there are none.
+ */
+static unsigned long scan_swap_cluster(struct swap_info_struct *si)
+{
+	unsigned long offset = si->lowest_bit;
+	unsigned long nr;
+
+check_next_cluster:
+	if (offset + SWAPFILE_CLUSTER - 1 > si->highest_bit)
+		return 0;
+	for (nr = offset; nr < offset + SWAPFILE_CLUSTER; nr++) {
+		if (si->swap_map[nr]) {
+			offset = nr + 1;
+			goto check_next_cluster;
+		}
+	}
+	return offset;
+}
+
+static void take_swap_slot(struct swap_info_struct *si, unsigned long offset)
+{
+	if (offset == si->lowest_bit)
+		si->lowest_bit++;
+	if (offset == si->highest_bit)
+		si->highest_bit--;
+	if (si->lowest_bit > si->highest_bit) {
+		si->lowest_bit = si->max;
+		si->highest_bit = 0;
+	}
+	si->swap_map[offset] = 1;
+	si->inuse_pages++;
+	nr_swap_pages--;
+}
 
 static inline int scan_swap_map(struct swap_info_struct *si)
 {
@@ -68,39 +107,16 @@ static inline int scan_swap_map(struct swap_info_struct *si)
 	si->cluster_nr = SWAPFILE_CLUSTER;
 
 	/* try to find an empty (even not aligned) cluster. */
-	offset = si->lowest_bit;
- check_next_cluster:
-	if (offset+SWAPFILE_CLUSTER-1 <= si->highest_bit)
-	{
-		int nr;
-		for (nr = offset; nr < offset+SWAPFILE_CLUSTER; nr++)
-			if (si->swap_map[nr])
-			{
-				offset = nr+1;
-				goto check_next_cluster;
-			}
-		/* We found a completly empty cluster, so start
-		 * using it.
-		 */
+	offset = scan_swap_cluster(si);
+	if (offset)
 		goto got_page;
-	}
 	/* No luck, so now go finegrined as usual. -Andrea */
 	for (offset = si->lowest_bit; offset <= si->highest_bit ; offset++) {
 		if (si->swap_map[offset])
 			continue;
 		si->lowest_bit = offset+1;
 	got_page:
-		if (offset == si->lowest_bit)
-			si->lowest_bit++;
-		if (offset == si->highest_bit)
-			si->highest_bit--;
-		if (si->lowest_bit > si->highest_bit) {
-			si->lowest_bit = si->max;
-			si->highest_bit = 0;
-		}
-		si->swap_map[offset] = 1;
-		si->inuse_pages++;
-		nr_swap_pages--;
+		take_swap_slot(si, offset);
 		si->cluster_next = offset+1;
 		return offset;
 	}
@@ -157,6 +173,127 @@ out:
 	return entry;
 }
 
+/*
+ * Anonymous pages are given swap slots in the order reclaim finds them on
+ * the LRU, which has little to do with where they are mapped, so swapin
+ * readahead used to read mostly unrelated pages.  Instead every aligned
+ * window of SWAPFILE_CLUSTER pages of virtual address space gets a
+ * cluster of swap of its own, and a page at index i of the window goes
+ * into slot i of the cluster, if that is free.  Neighbouring pages then
+ * sit next to each other on disk, whatever order they are swapped out
+ * in: they are written out in large requests, and the readahead in
+ * do_swap_page() reads what the process will fault on next.
+ *
+ * A window gets a free run of slots just ahead of the sequential
+ * allocator in scan_swap_map(), which is moved past it; see
+ * reserve_swap_window().  The windows are remembered in a small hash
+ * keyed by mm and address; the mm is only used as a key, so a stale
+ * entry does no harm.
+ */
+#define SWAP_HINT_BITS	6
+
+/* How far reserve_swap_window() looks for a free run */
+#define SWAP_WINDOW_SCAN	(16 * SWAPFILE_CLUSTER)
+
+static struct swap_hint {
+	struct mm_struct *mm;
+	unsigned long window;
+	swp_entry_t base;
+} swap_hints[1 << SWAP_HINT_BITS];
+
+/*
+ * Find SWAPFILE_CLUSTER free slots in a row for a new window, looking no
+ * further than SWAP_WINDOW_SCAN slots from cluster_next, and move
+ * cluster_next past them so that scan_swap_map() leaves them to the
+ * window.  Nothing is marked in swap_map: the slots the window doesn't
+ * use stay free for the first-free fallback.  Returns the first slot, or
+ * zero.  The device lock is held.
+ */
+static unsigned long reserve_swap_window(struct swap_info_struct *si)
+{
+	unsigned long offset = si->cluster_next;
+	unsigned long limit = offset + SWAP_WINDOW_SCAN;
+	unsigned long nr, run = 0;
+
+	if (offset < si->lowest_bit)
+		offset = si->lowest_bit;
+	if (limit > si->highest_bit + 1)
+		limit = si->highest_bit + 1;
+	for (nr = offset; nr < limit; nr++) {
+		if (si->swap_map[nr]) {
+			run = 0;
+			continue;
+		}
+		if (++run == SWAPFILE_CLUSTER) {
+			si->cluster_next = nr + 1;
+			return nr + 1 - SWAPFILE_CLUSTER;
+		}
+	}
+	return 0;
+}
+
+/**
+ * get_swap_page_near - allocate a swap slot for an anonymous page
+ * @mm: the mm the page is mapped into
+ * @address: the virtual address it is mapped at
+ */
+swp_entry_t get_swap_page_near(struct mm_struct *mm, unsigned long address)
+{
+	unsigned long window = address >> (PAGE_SHIFT + SWAPFILE_CLUSTER_SHIFT);
+	unsigned long idx = (address >> PAGE_SHIFT) & (SWAPFILE_CLUSTER - 1);
+	struct swap_info_struct *p;
+	struct swap_hint *h;
+	unsigned long offset;
+	swp_entry_t entry;
+	int type;
+
+	h = swap_hints + hash_long((unsigned long)mm ^ window, SWAP_HINT_BITS);
+	entry.val = 0;
+	swap_list_lock();
+	if (nr_swap_pages <= 0)
+		goto out;
+
+	if (h->mm == mm && h->window == window) {
+		type = swp_type(h->base);
+		p = &swap_info[type];
+		if ((p->flags & SWP_ACTIVE) == SWP_ACTIVE) {
+			offset = swp_offset(h->base) + idx;
+			swap_device_lock(p);
+			if (offset < p->max && !p->swap_map[offset]) {
+				take_swap_slot(p, offset);
+				entry = swp_entry(type, offset);
+			}
+			swap_device_unlock(p);
+			/* If the slot is taken, don't give up the window yet */
+			goto out;
+		}
+	}
+
+	/* Start a new window, on the best device with room */
+	for (type = swap_list.head; type >= 0; type = swap_info[type].next) {
+		p = &swap_info[type];
+		if ((p->flags & SWP_ACTIVE) != SWP_ACTIVE)
+			continue;
+		swap_device_lock(p);
+		offset = reserve_swap_window(p);
+		if (offset)
+			take_swap_slot(p, offset + idx);
+		swap_device_unlock(p);
+		if (offset) {
+			h->mm = mm;
+			h->window = window;
+			h->base = swp_entry(type, offset);
+			entry = swp_entry(type, offset + idx);
+			break;
+		}
+	}
+out:
+	swap_list_unlock();
+	if (!entry.val)
+		entry = get_swap_page();
+	return entry;
+}
+
 static struct swap_info_struct * swap_info_get(swp_entry_t entry)
 {
 	struct swap_info_struct * p;
@@ -216,6 +353,8 @@ static int swap_entry_free(struct swap_info_struct *p, unsigned long offset)
 				p->highest_bit = offset;
 			nr_swap_pages++;
 			p->inuse_pages--;
+			swap_compress_invalidate(swp_entry(p - swap_info,
+								offset));
 		}
 	}
 	return count;
@@ -402,7 +541,7 @@ static int unuse_pmd(struct vm_area_struct * vma, pmd_t *dir,
 	unsigned long end;
 	pte_t swp_pte = swp_entry_to_pte(entry);
 
-	if (pmd_none(*dir))
+	if (pmd_none(*dir) || pmd_huge(*dir))
 		return 0;
 	if (pmd_bad(*dir)) {
 		pmd_ERROR(*dir);
@@ -116,6 +116,7 @@ void truncate_inode_pages(struct address_space *mapping, loff_t lstart)
 	pgoff_t next;
 	int i;
 
+	clear_shadow_entries(mapping, start);
 	if (mapping->nrpages == 0)
 		return;
 
@@ -175,6 +176,40 @@ void truncate_inode_pages(struct address_space *mapping, loff_t lstart)
 	}
 }
 
+/**
+ * clear_shadow_entries - drop the shadow entries of evicted pages
+ * @mapping: the address_space
+ * @start: the offset from which to drop them
+ *
+ * Reclaim leaves shadow entries in the radix tree in place of the pages it
+ * evicts (see mm/workingset.c).  They have to go when the file is truncated
+ * and before the inode is freed.
+ */
+void clear_shadow_entries(struct address_space *mapping, pgoff_t start)
+{
+	void *shadows[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	unsigned int nr, i;
+
+	if (!mapping->nrshadows)
+		return;
+
+	spin_lock(&mapping->page_lock);
+	while ((nr = radix_tree_gang_lookup_exceptional(&mapping->page_tree,
+				shadows, indices, start, PAGEVEC_SIZE))) {
+		for (i = 0; i < nr; i++)
+			radix_tree_delete(&mapping->page_tree, indices[i]);
+		mapping->nrshadows -= nr;
+		start = indices[nr - 1] + 1;
+		if (start == 0)
+			break;
+		spin_unlock(&mapping->page_lock);
+		cond_resched();
+		spin_lock(&mapping->page_lock);
+	}
+	spin_unlock(&mapping->page_lock);
+}
+
 /**
  * invalidate_mapping_pages - Invalidate all the unlocked pages of one inode
  * @mapping: the address_space which holds the pages to invalidate
@@ -12,6 +12,7 @@
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/interrupt.h>
+#include <linux/init.h>
 
 #include <linux/vmalloc.h>
 
@@ -20,8 +21,25 @@
 #include <asm/tlbflush.h>
 
 
+/*
+ * vmlist is kept sorted by address, and vmlist_rb indexes it for
+ * lookups.  Allocation starts searching at free_cache, the last area
+ * allocated, unless the request could fit into a hole below it:
+ * cached_hole_size is the largest hole below free_cache.
+ *
+ * vfree() and vunmap() only clear the page tables.  The area stays on
+ * the list, marked VM_LAZYFREE so that its address space isn't reused,
+ * until VM_LAZY_MAX_PAGES have piled up or the space runs out.  Then
+ * all of them are purged with a single TLB flush.
+ */
 rwlock_t vmlist_lock = RW_LOCK_UNLOCKED;
 struct vm_struct *vmlist;
+static struct rb_root vmlist_rb = RB_ROOT;
+static struct vm_struct *free_cache;
+static unsigned long cached_hole_size;
+static unsigned long vm_lazy_pages;
+
+#define VM_LAZY_MAX_PAGES	((32 * 1024 * 1024) >> PAGE_SHIFT)
 
 static void unmap_area_pte(pmd_t *pmd, unsigned long address,
 				  unsigned long size)
@@ -133,7 +151,10 @@ static int map_area_pmd(pmd_t *pmd, unsigned long address,
 	return 0;
 }
 
-void unmap_vm_area(struct vm_struct *area)
+/*
+ * Clear the page tables of the area, leaving the TLB flush to the caller.
+ */
+static void __unmap_vm_area(struct vm_struct *area)
 {
 	unsigned long address = VMALLOC_VMADDR(area->addr);
 	unsigned long end = (address + area->size);
@@ -146,7 +167,13 @@ void unmap_vm_area(struct vm_struct *area)
 		address = (address + PGDIR_SIZE) & PGDIR_MASK;
 		dir++;
 	} while (address && (address < end));
-	flush_tlb_kernel_range(VMALLOC_VMADDR(area->addr), end);
+}
+
+void unmap_vm_area(struct vm_struct *area)
+{
+	__unmap_vm_area(area);
+	flush_tlb_kernel_range(VMALLOC_VMADDR(area->addr),
+			VMALLOC_VMADDR(area->addr) + area->size);
 }
 
 int map_vm_area(struct vm_struct *area, pgprot_t prot, struct page ***pages)
@@ -179,6 +206,135 @@ int map_vm_area(struct vm_struct *area, pgprot_t prot, struct page ***pages)
 }
 
 
+static struct vm_struct *__find_vm_area(void *addr)
+{
+	struct rb_node *n = vmlist_rb.rb_node;
+	struct vm_struct *tmp;
+
+	while (n) {
+		tmp = rb_entry(n, struct vm_struct, rb);
+		if (addr < tmp->addr)
+			n = n->rb_left;
+		else if (addr > tmp->addr)
+			n = n->rb_right;
+		else
+			return tmp;
+	}
+	return NULL;
+}
+
+/*
+ * Put the area on vmlist after `prev' (at the head if NULL), and into
+ * the tree.  vmlist_lock is held for writing.
+ */
+static void __link_vm_area(struct vm_struct *area, struct vm_struct *prev)
+{
+	struct rb_node **p = &vmlist_rb.rb_node;
+	struct rb_node *parent = NULL;
+	struct vm_struct *tmp;
+
+	if (prev) {
+		area->next = prev->next;
+		prev->next = area;
+	} else {
+		area->next = vmlist;
+		vmlist = area;
+	}
+
+	while (*p) {
+		parent = *p;
+		tmp = rb_entry(parent, struct vm_struct, rb);
+		if (area->addr < tmp->addr)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+	rb_link_node(&area->rb, parent, p);
+	rb_insert_color(&area->rb, &vmlist_rb);
+}
+
+static void __unlink_vm_area(struct vm_struct *area)
+{
+	struct rb_node *n = rb_prev(&area->rb);
+	struct vm_struct *prev = NULL;
+
+	if (n)
+		prev = rb_entry(n, struct vm_struct, rb);
+	if (prev)
+		prev->next = area->next;
+	else
+		vmlist = area->next;
+	rb_erase(&area->rb, &vmlist_rb);
+
+	/*
+	 * The hole left behind lies above prev, so the search can still
+	 * start there.  cached_hole_size stays right for the space below.
+	 */
+	if (free_cache && area->addr <= free_cache->addr)
+		free_cache = prev;
+}
+
+/*
+ * Drop all lazily freed areas, with one TLB flush for all of them.
+ * vmlist_lock is held for writing.
+ */
+static void __purge_vm_lazy(void)
+{
+	struct vm_struct **p, *tmp;
+	unsigned long start = ~0UL, end = 0;
+
+	for (p = &vmlist; (tmp = *p) ;) {
+		if (!(tmp->flags & VM_LAZYFREE)) {
+			p = &tmp->next;
+			continue;
+		}
+		*p = tmp->next;
+		rb_erase(&tmp->rb, &vmlist_rb);
+		if ((unsigned long)tmp->addr < start)
+			start = (unsigned long)tmp->addr;
+		if ((unsigned long)tmp->addr + tmp->size > end)
+			end = (unsigned long)tmp->addr + tmp->size;
+		kfree(tmp);
+	}
+	free_cache = NULL;
+	cached_hole_size = 0;
+	vm_lazy_pages = 0;
+	if (end)
+		flush_tlb_kernel_range(start, end);
+}
+
+/**
+ *	purge_vm_lazy  -  flush the TLB entries of lazily freed areas
+ *
+ *	The pages of lazily freed areas may already have been reused while
+ *	stale TLB entries still map them.  Anything that needs no other
+ *	mapping of a page to exist, like change_page_attr(), must call this
+ *	first.  Not from interrupt context.
+ */
+void purge_vm_lazy(void)
+{
+	if (!vm_lazy_pages)
+		return;
+	write_lock(&vmlist_lock);
+	__purge_vm_lazy();
+	write_unlock(&vmlist_lock);
+}
+
+/*
+ * For architectures which set up part of the vmalloc space themselves
+ * while booting, before get_vm_area() is used.
+ */
+void __init register_vm_area(struct vm_struct *area)
+{
+	struct vm_struct *prev = NULL, *tmp;
+
+	write_lock(&vmlist_lock);
+	for (tmp = vmlist; tmp && tmp->addr < area->addr; tmp = tmp->next)
+		prev = tmp;
+	__link_vm_area(area, prev);
+	write_unlock(&vmlist_lock);
+}
+
 /**
  *	get_vm_area  -  reserve a contingous kernel virtual area
  *
@@ -191,8 +347,9 @@ int map_vm_area(struct vm_struct *area, pgprot_t prot, struct page ***pages)
  */
 struct vm_struct *get_vm_area(unsigned long size, unsigned long flags)
 {
-	struct vm_struct **p, *tmp, *area;
-	unsigned long addr = VMALLOC_START;
+	struct vm_struct *prev, *tmp, *area;
+	unsigned long addr;
+	int purged = 0;
 
 	area = kmalloc(sizeof(*area), GFP_KERNEL);
 	if (unlikely(!area))
@@ -208,31 +365,52 @@ struct vm_struct *get_vm_area(unsigned long size, unsigned long flags)
 	}
 
 	write_lock(&vmlist_lock);
-	for (p = &vmlist; (tmp = *p) ;p = &tmp->next) {
+retry:
+	if (size <= cached_hole_size)
+		free_cache = NULL;
+	if (free_cache) {
+		prev = free_cache;
+		addr = prev->size + (unsigned long)prev->addr;
+		tmp = prev->next;
+	} else {
+		cached_hole_size = 0;
+		prev = NULL;
+		addr = VMALLOC_START;
+		tmp = vmlist;
+	}
+	for (; tmp; prev = tmp, tmp = tmp->next) {
 		if ((size + addr) < addr)
 			goto out;
 		if (size + addr <= (unsigned long)tmp->addr)
 			goto found;
+		if (addr + cached_hole_size < (unsigned long)tmp->addr)
+			cached_hole_size = (unsigned long)tmp->addr - addr;
 		addr = tmp->size + (unsigned long)tmp->addr;
 		if (addr > VMALLOC_END-size)
 			goto out;
 	}
+	if ((size + addr) < addr || addr > VMALLOC_END-size)
+		goto out;
 
 found:
-	area->next = *p;
-	*p = area;
-
 	area->flags = flags;
 	area->addr = (void *)addr;
 	area->size = size;
 	area->pages = NULL;
 	area->nr_pages = 0;
 	area->phys_addr = 0;
+	__link_vm_area(area, prev);
+	free_cache = area;
 	write_unlock(&vmlist_lock);
 
 	return area;
 
 out:
+	if (vm_lazy_pages && !purged) {
+		__purge_vm_lazy();
+		purged = 1;
+		goto retry;
+	}
 	write_unlock(&vmlist_lock);
 	kfree(area);
 	return NULL;
@@ -249,19 +427,16 @@ out:
  */
 struct vm_struct *remove_vm_area(void *addr)
 {
-	struct vm_struct **p, *tmp;
+	struct vm_struct *tmp;
 
 	write_lock(&vmlist_lock);
-	for (p = &vmlist ; (tmp = *p) ;p = &tmp->next) {
-		 if (tmp->addr == addr)
-			 goto found;
+	tmp = __find_vm_area(addr);
+	if (!tmp || (tmp->flags & VM_LAZYFREE)) {
+		write_unlock(&vmlist_lock);
+		return NULL;
 	}
-	write_unlock(&vmlist_lock);
-	return NULL;
-
-found:
 	unmap_vm_area(tmp);
-	*p = tmp->next;
+	__unlink_vm_area(tmp);
 	write_unlock(&vmlist_lock);
 	return tmp;
 }
@@ -269,6 +444,9 @@ found:
 void __vunmap(void *addr, int deallocate_pages)
 {
 	struct vm_struct *area;
+	struct page **pages;
+	unsigned int nr_pages;
+	int purge;
 
 	if (!addr)
 		return;
@@ -278,27 +456,46 @@ void __vunmap(void *addr, int deallocate_pages)
 		return;
 	}
 
-	area = remove_vm_area(addr);
-	if (unlikely(!area)) {
+	write_lock(&vmlist_lock);
+	area = __find_vm_area(addr);
+	if (unlikely(!area || (area->flags & VM_LAZYFREE))) {
+		write_unlock(&vmlist_lock);
 		printk(KERN_ERR "Trying to vfree() nonexistent vm area (%p)\n",
 				addr);
 		return;
 	}
+
+	/*
+	 * Nobody may use the address any more, so stale TLB entries
+	 * for it are harmless until the area is purged.
+	 */
+	__unmap_vm_area(area);
+	area->flags |= VM_LAZYFREE;
+	pages = area->pages;
+	nr_pages = area->nr_pages;
+	area->pages = NULL;
+	area->nr_pages = 0;
+	vm_lazy_pages += area->size >> PAGE_SHIFT;
+	purge = vm_lazy_pages > VM_LAZY_MAX_PAGES;
+	write_unlock(&vmlist_lock);
 	
 	if (deallocate_pages) {
 		int i;
 
-		for (i = 0; i < area->nr_pages; i++) {
-			if (unlikely(!area->pages[i]))
+		for (i = 0; i < nr_pages; i++) {
+			if (unlikely(!pages[i]))
 				BUG();
-			__free_page(area->pages[i]);
+			__free_page(pages[i]);
 		}
 
-		kfree(area->pages);
+		kfree(pages);
 	}
 
-	kfree(area);
-	return;
+	if (purge) {
+		write_lock(&vmlist_lock);
+		__purge_vm_lazy();
+		write_unlock(&vmlist_lock);
+	}
 }
 
 /**
@@ -462,6 +659,8 @@ long vread(char *buf, char *addr, unsigned long count)
 		vaddr = (char *) tmp->addr;
 		if (addr >= vaddr + tmp->size - PAGE_SIZE)
 			continue;
+		if (tmp->flags & VM_LAZYFREE)
+			continue;
 		while (addr < vaddr) {
 			if (count == 0)
 				goto finished;
@@ -500,6 +699,8 @@ long vwrite(char *buf, char *addr, unsigned long count)
 		vaddr = (char *) tmp->addr;
 		if (addr >= vaddr + tmp->size - PAGE_SIZE)
 			continue;
+		if (tmp->flags & VM_LAZYFREE)
+			continue;
 		while (addr < vaddr) {
 			if (count == 0)
 				goto finished;
@@ -29,6 +29,7 @@
 #include <linux/backing-dev.h>
 #include <linux/rmap-locking.h>
 #include <linux/topology.h>
+#include <linux/memgroup.h>
 
 #include <asm/pgalloc.h>
 #include <asm/tlbflush.h>
@@ -43,10 +44,22 @@
  */
 #define DEF_PRIORITY 12
 
+/*
+ * Pages of files marked FADV_KEEP are only reclaimed once the priority
+ * has dropped to this.
+ */
+#define KEEP_PRIORITY (DEF_PRIORITY / 2)
+
 /*
  * From 0 .. 100.  Higher means more swappy.
  */
 int vm_swappiness = 60;
+
+/*
+ * Direct reclaim which fails to free enough at this priority or below tells
+ * user space about it through /proc/mempressure.  Negative turns it off.
+ */
+int vm_pressure_priority = DEF_PRIORITY / 2;
 static long total_memory;
 
 #ifdef ARCH_HAS_PREFETCH
@@ -216,15 +229,100 @@ static int may_write_to_queue(struct backing_dev_info *bdi)
 	return 0;
 }
 
+/*
+ * Dirty swap cache pages are written out together once the whole batch
+ * has been looked at, in the order of their swap slots, so that pages
+ * which were given neighbouring slots (see get_swap_page_near()) go to
+ * the queue back to back and are merged into large requests.
+ */
+static void add_swap_page_sorted(struct page *page, struct list_head *list)
+{
+	struct list_head *pos;
+
+	list_for_each(pos, list) {
+		if (list_entry(pos, struct page, lru)->index > page->index)
+			break;
+	}
+	list_add_tail(&page->lru, pos);
+}
+
+/*
+ * Write out the locked pages queued by add_swap_page_sorted() and move
+ * them to ret_pages.  Pages which have been cleaned meanwhile are freed
+ * into freed_pvec and counted in nr_freed, as shrink_list() would have.
+ * Returns the number of pages activated.
+ */
+static int pageout_swap_pages(struct list_head *swap_pages,
+			      struct list_head *ret_pages,
+			      struct pagevec *freed_pvec, int *nr_freed)
+{
+	int pgactivate = 0;
+
+	while (!list_empty(swap_pages)) {
+		struct page *page;
+		struct address_space *mapping;
+
+		page = list_entry(swap_pages->next, struct page, lru);
+		list_del(&page->lru);
+		mapping = page->mapping;
+
+		spin_lock(&mapping->page_lock);
+		if (test_clear_page_dirty(page)) {
+			int res;
+			struct writeback_control wbc = {
+				.sync_mode = WB_SYNC_NONE,
+				.nr_to_write = SWAP_CLUSTER_MAX,
+				.nonblocking = 1,
+				.for_reclaim = 1,
+			};
+
+			list_move(&page->list, &mapping->locked_pages);
+			spin_unlock(&mapping->page_lock);
+
+			SetPageReclaim(page);
+			res = mapping->a_ops->writepage(page, &wbc);
+
+			if (res == WRITEPAGE_ACTIVATE) {
+				ClearPageReclaim(page);
+				SetPageActive(page);
+				pgactivate++;
+				unlock_page(page);
+			} else if (!PageWriteback(page)) {
+				/* synchronous write or broken a_ops? */
+				ClearPageReclaim(page);
+			}
+		} else if (page_count(page) == 2 && !PagePrivate(page) &&
+			   PageSwapCache(page)) {
+			swp_entry_t swap = { .val = page->index };
+
+			__delete_from_swap_cache(page);
+			spin_unlock(&mapping->page_lock);
+			swap_free(swap);
+			__put_page(page);	/* The pagecache ref */
+			unlock_page(page);
+			(*nr_freed)++;
+			if (!pagevec_add(freed_pvec, page))
+				__pagevec_release_nonlru(freed_pvec);
+			continue;
+		} else {
+			spin_unlock(&mapping->page_lock);
+			unlock_page(page);
+		}
+		list_add(&page->lru, ret_pages);
+	}
+	return pgactivate;
+}
+
 /*
  * shrink_list returns the number of reclaimed pages
  */
 static int
 shrink_list(struct list_head *page_list, unsigned int gfp_mask,
-		int *max_scan, int *nr_mapped)
+		int *max_scan, int *nr_mapped, int priority)
 {
 	struct address_space *mapping;
 	LIST_HEAD(ret_pages);
+	LIST_HEAD(swap_pages);
 	struct pagevec freed_pvec;
 	int pgactivate = 0;
 	int ret = 0;
@@ -262,12 +360,18 @@ shrink_list(struct list_head *page_list, unsigned int gfp_mask,
 
 		mapping = page->mapping;
 
+		/* The file asked to stay resident */
+		if (mapping && mapping_keep(mapping) &&
+				priority > KEEP_PRIORITY) {
+			pte_chain_unlock(page);
+			goto keep_locked;
+		}
+
 #ifdef CONFIG_SWAP
 		/*
 		 * Anonymous process memory without backing store. Try to
-		 * allocate it some swap space here.
-		 *
-		 * XXX: implement swap clustering ?
+		 * allocate it some swap space here, next to the pages it is
+		 * mapped next to.
 		 */
 		if (page_mapped(page) && !mapping && !PagePrivate(page)) {
 			pte_chain_unlock(page);
@@ -324,6 +428,10 @@ shrink_list(struct list_head *page_list, unsigned int gfp_mask,
 				goto keep_locked;
 			if (!may_write_to_queue(mapping->backing_dev_info))
 				goto keep_locked;
+			if (PageSwapCache(page)) {
+				add_swap_page_sorted(page, &swap_pages);
+				continue;
+			}
 			spin_lock(&mapping->page_lock);
 			if (test_clear_page_dirty(page)) {
 				int res;
@@ -407,7 +515,8 @@ shrink_list(struct list_head *page_list, unsigned int gfp_mask,
 		}
 #endif /* CONFIG_SWAP */
 
-		__remove_from_page_cache(page);
+		__remove_from_page_cache_shadow(page,
+				workingset_eviction(mapping, page));
 		spin_unlock(&mapping->page_lock);
 		__put_page(page);
 
@@ -427,6 +536,8 @@ keep:
 		list_add(&page->lru, &ret_pages);
 		BUG_ON(PageLRU(page));
 	}
+	pgactivate += pageout_swap_pages(&swap_pages, &ret_pages,
+					 &freed_pvec, &ret);
 	list_splice(&ret_pages, page_list);
 	if (pagevec_count(&freed_pvec))
 		__pagevec_release_nonlru(&freed_pvec);
@@ -450,7 +561,7 @@ keep:
  */
 static int
 shrink_cache(const int nr_pages, struct zone *zone,
-		unsigned int gfp_mask, int max_scan, int *nr_mapped)
+		unsigned int gfp_mask, int max_scan, int *nr_mapped, int priority)
 {
 	LIST_HEAD(page_list);
 	struct pagevec pvec;
@@ -505,7 +616,7 @@ shrink_cache(const int nr_pages, struct zone *zone,
 		max_scan -= nr_scan;
 		mod_page_state(pgscan, nr_scan);
 		nr_freed = shrink_list(&page_list, gfp_mask,
-					&max_scan, nr_mapped);
+					&max_scan, nr_mapped, priority);
 		ret += nr_freed;
 		if (nr_freed <= 0 && list_empty(&page_list))
 			goto done;
@@ -536,6 +647,86 @@ done:
 	return ret;
 }
 
+#ifdef CONFIG_MEMGROUP
+/*
+ * Reclaim from the pages charged to a memory group, oldest first.  They
+ * are taken off whichever zone LRU they are on, active or inactive, and
+ * go through shrink_list() like the pages shrink_cache() takes.
+ */
+int shrink_mem_group(struct mem_group *grp, unsigned int gfp_mask,
+			int nr_pages)
+{
+	struct page *pages[SWAP_CLUSTER_MAX];
+	int max_scan = nr_pages * 4;
+	int ret = 0;
+
+	lru_add_drain();
+	while (max_scan > 0 && ret < nr_pages) {
+		LIST_HEAD(page_list);
+		int nr_mapped = 0;
+		int nr, i;
+
+		nr = memgroup_oldest(grp, pages, SWAP_CLUSTER_MAX);
+		if (!nr)
+			break;
+		max_scan -= nr;
+		for (i = 0; i < nr; i++) {
+			struct page *page = pages[i];
+			struct zone *zone = page_zone(page);
+
+			spin_lock_irq(&zone->lru_lock);
+			if (page->mem_group != grp || !TestClearPageLRU(page)) {
+				spin_unlock_irq(&zone->lru_lock);
+				continue;
+			}
+			if (page_count(page) == 0) {
+				/* It is currently in pagevec_release() */
+				SetPageLRU(page);
+				spin_unlock_irq(&zone->lru_lock);
+				continue;
+			}
+			list_del(&page->lru);
+			if (TestClearPageActive(page))
+				zone->nr_active--;
+			else
+				zone->nr_inactive--;
+			page_cache_get(page);
+			list_add(&page->lru, &page_list);
+			spin_unlock_irq(&zone->lru_lock);
+		}
+		if (list_empty(&page_list))
+			continue;
+		mod_page_state(pgscan, nr);
+		/* The group's limit wins over FADV_KEEP */
+		ret += shrink_list(&page_list, gfp_mask, &max_scan,
+					&nr_mapped, 0);
+		putback_lru_pages(&page_list);
+	}
+	grp->reclaimed += ret;
+	return ret;
+}
+
+/*
+ * Global reclaim takes from the groups which are over their limits first.
+ * Those pages may come from any zone, so the callers don't count them
+ * towards what they have to free from their own zones.
+ */
+int shrink_mem_groups(unsigned int gfp_mask)
+{
+	int ret = 0;
+	int i;
+
+	for (i = 0; i < MEMGROUP_MAX; i++) {
+		struct mem_group *grp = &mem_groups[i];
+
+		if (memgroup_over_limit(grp))
+			ret += shrink_mem_group(grp, gfp_mask,
+						SWAP_CLUSTER_MAX);
+	}
+	return ret;
+}
+#endif /* CONFIG_MEMGROUP */
+
 /*
  * This moves pages from the active list to the inactive list.
  *
@@ -748,7 +939,7 @@ shrink_zone(struct zone *zone, int max_scan, unsigned int gfp_mask,
 		refill_inactive_zone(zone, count, ps, priority);
 	}
 	return shrink_cache(nr_pages, zone, gfp_mask,
-				max_scan, nr_mapped);
+				max_scan, nr_mapped, priority);
 }
 
 /*
@@ -828,6 +1019,8 @@ int try_to_free_pages(struct zone *cz,
 
 	inc_page_state(allocstall);
 
+	shrink_mem_groups(gfp_mask);
+
 	for (priority = DEF_PRIORITY; priority >= 0; priority--) {
 		int total_scanned = 0;
 		struct page_state ps;
@@ -839,6 +1032,8 @@ int try_to_free_pages(struct zone *cz,
 			ret = 1;
 			goto out;
 		}
+		if (priority <= vm_pressure_priority)
+			mem_pressure_notify(priority);
 		if (!(gfp_mask & __GFP_FS))
 			break;		/* Let the caller handle it */
 		/*
@@ -891,6 +1086,8 @@ static int balance_pgdat(pg_data_t *pgdat, int nr_pages, struct page_state *ps)
 
 	inc_page_state(pageoutrun);
 
+	shrink_mem_groups(GFP_KERNEL);
+
 	for (priority = DEF_PRIORITY; priority; priority--) {
 		int all_zones_ok = 1;
 
@@ -0,0 +1,120 @@
+/*
+ *  linux/mm/workingset.c
+ *
+ *  Refault detection for the page cache.
+ *
+ *  New page cache pages start out on the inactive list and need a second
+ *  reference there to be activated.  A page which is used regularly, but
+ *  less often than the inactive list takes to cycle, therefore never makes
+ *  it to the active list: a big sequential read pushes it out along with
+ *  everything else, and it is read in again, inactive again, every time.
+ *
+ *  To catch that, every zone counts its evictions and activations in
+ *  inactive_age.  When reclaim evicts a page cache page it leaves a shadow
+ *  entry in the page's slot in the radix tree, recording the zone and its
+ *  inactive_age at that time.  When the page is read back in and finds the
+ *  shadow, the difference to the zone's inactive_age now is the refault
+ *  distance: how many more pages the inactive list would have needed to
+ *  hold to keep the page resident.  If that is no more than the size of the
+ *  active list, the page would have made it had it been given a slot there,
+ *  so it starts out on the active list instead.  Pages of a one-off scan
+ *  never refault, and stay on the inactive list as before.
+ *
+ *  Shadow entries are dropped when the page comes back, when the file is
+ *  truncated past them, and when the inode is freed.  Nothing else frees
+ *  them, and the radix tree nodes they keep alive, so a mapping stops
+ *  taking new ones once it has as many shadows as pages in the cache:
+ *  otherwise a file streamed through the cache would leave a shadow for
+ *  every page it ever had.
+ */
+
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/pagemap.h>
+#include <linux/backing-dev.h>
+#include <linux/radix-tree.h>
+
+/*
+ * A shadow entry is the zone's number in zone_table and the eviction time,
+ * above the radix tree's exceptional bit.  inactive_age is an atomic_t, so
+ * no more than 31 bits of it are used even where there is room for more.
+ */
+#define ZONE_NUM_BITS		(BITS_PER_LONG - ZONE_SHIFT)
+#define EVICTION_SHIFT		(ZONE_NUM_BITS + 1)
+#define EVICTION_MASK		((~0UL >> EVICTION_SHIFT) & 0x7fffffffUL)
+
+static void *pack_shadow(unsigned long zone_num, unsigned long eviction)
+{
+	eviction = (eviction & EVICTION_MASK) << ZONE_NUM_BITS | zone_num;
+	return (void *)(eviction << 1 | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+		unsigned long *eviction)
+{
+	unsigned long entry = (unsigned long)shadow >> 1;
+
+	*zone = zone_table[entry & ((1UL << ZONE_NUM_BITS) - 1)];
+	*eviction = entry >> ZONE_NUM_BITS;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page cache page
+ * @mapping: the page's mapping
+ * @page: the page being evicted
+ *
+ * Returns the shadow entry to leave in the page's slot, or NULL if there is
+ * no point remembering it, or no room.  Called by reclaim under the
+ * mapping's page_lock.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	/* Pages of ramfs and tmpfs are never really evicted */
+	if (mapping->backing_dev_info->memory_backed)
+		return NULL;
+	if (mapping->nrshadows >= mapping->nrpages)
+		return NULL;
+
+	eviction = atomic_read(&zone->inactive_age);
+	atomic_inc(&zone->inactive_age);
+	return pack_shadow(page->flags >> ZONE_SHIFT, eviction);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a page
+ * @shadow: the shadow entry the page replaces
+ *
+ * Returns 1 if the page was evicted recently enough that it should start
+ * out on the active list.
+ */
+int workingset_refault(void *shadow)
+{
+	unsigned long eviction, refault_distance;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &eviction);
+	refault_distance = (atomic_read(&zone->inactive_age) - eviction) &
+				EVICTION_MASK;
+
+	inc_page_state(pgrefault);
+	if (refault_distance <= zone->nr_active) {
+		inc_page_state(pgprotected);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * workingset_activation - note a page being activated
+ * @zone: the page's zone
+ *
+ * An activation takes a page off the inactive list just like an eviction
+ * does, so it counts towards the refault distance as well.
+ */
+void workingset_activation(struct zone *zone)
+{
+	atomic_inc(&zone->inactive_age);
+}